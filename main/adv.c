@@ -0,0 +1,170 @@
+#include "adv.h"
+#include "sig.h"
+#include <stdio.h>
+#include <string.h>
+
+void gravity_adv_iter_init(GravityAdvIter *iter, const uint8_t *data, uint8_t len) {
+    iter->data = data;
+    iter->len = (data == NULL) ? 0 : len;
+    iter->pos = 0;
+}
+
+/* Fetch the next AD structure into field.
+   Returns false at the end of the data, at zero-length padding, or if the
+   next structure claims to extend beyond the end of the data */
+bool gravity_adv_iter_next(GravityAdvIter *iter, GravityAdvField *field) {
+    if (iter->pos >= iter->len) {
+        return false;
+    }
+    uint8_t structLen = iter->data[iter->pos];
+    if (structLen == 0 || structLen > iter->len - iter->pos - 1) {
+        iter->pos = iter->len;
+        return false;
+    }
+    field->type = iter->data[iter->pos + 1];
+    field->len = structLen - 1;
+    field->value = &iter->data[iter->pos + 2];
+    iter->pos += structLen + 1;
+    return true;
+}
+
+static uint16_t adv_le16(const uint8_t *value) {
+    return value[0] | (value[1] << 8);
+}
+
+/* Decode the commonly-useful fields of the specified advertisement */
+void gravity_adv_summarise(const uint8_t *data, uint8_t len, GravityAdvSummary *summary) {
+    memset(summary, 0, sizeof(GravityAdvSummary));
+    GravityAdvIter iter;
+    GravityAdvField field;
+    gravity_adv_iter_init(&iter, data, len);
+    while (gravity_adv_iter_next(&iter, &field)) {
+        switch (field.type) {
+            case GRAVITY_AD_FLAGS:
+                if (field.len >= 1) {
+                    summary->flags = field.value[0];
+                    summary->present |= GRAVITY_ADV_HAS_FLAGS;
+                }
+                break;
+            case GRAVITY_AD_TX_POWER:
+                if (field.len >= 1) {
+                    summary->txPower = (int8_t)field.value[0];
+                    summary->present |= GRAVITY_ADV_HAS_TX_POWER;
+                }
+                break;
+            case GRAVITY_AD_APPEARANCE:
+                if (field.len >= 2) {
+                    summary->appearance = adv_le16(field.value);
+                    summary->present |= GRAVITY_ADV_HAS_APPEARANCE;
+                }
+                break;
+            case GRAVITY_AD_UUID16_PARTIAL:
+            case GRAVITY_AD_UUID16_COMPLETE:
+                if (field.len >= 2 && (summary->present & GRAVITY_ADV_HAS_UUID16) == 0) {
+                    summary->uuid16 = adv_le16(field.value);
+                    summary->present |= GRAVITY_ADV_HAS_UUID16;
+                }
+                summary->uuidCount += field.len / 2;
+                break;
+            case GRAVITY_AD_UUID32_PARTIAL:
+            case GRAVITY_AD_UUID32_COMPLETE:
+                summary->uuidCount += field.len / 4;
+                break;
+            case GRAVITY_AD_UUID128_PARTIAL:
+            case GRAVITY_AD_UUID128_COMPLETE:
+                summary->uuidCount += field.len / 16;
+                break;
+            case GRAVITY_AD_SERVICE_DATA16:
+            case GRAVITY_AD_SERVICE_DATA32:
+            case GRAVITY_AD_SERVICE_DATA128:
+                if ((summary->present & GRAVITY_ADV_HAS_SERVICE_DATA) == 0) {
+                    if (field.type == GRAVITY_AD_SERVICE_DATA16 && field.len >= 2) {
+                        summary->serviceDataUuid = adv_le16(field.value);
+                    }
+                    summary->present |= GRAVITY_ADV_HAS_SERVICE_DATA;
+                }
+                break;
+            case GRAVITY_AD_NAME_SHORT:
+                if (field.len > 0) {
+                    summary->shortNameOffset = field.value - data;
+                    summary->shortNameLen = field.len;
+                    summary->present |= GRAVITY_ADV_HAS_SHORT_NAME;
+                }
+                break;
+            case GRAVITY_AD_MANUFACTURER:
+                if (field.len >= 2 && (summary->present & GRAVITY_ADV_HAS_MANUFACTURER) == 0) {
+                    summary->companyId = adv_le16(field.value);
+                    summary->mfgOffset = field.value + 2 - data;
+                    summary->mfgLen = field.len - 2;
+                    summary->present |= GRAVITY_ADV_HAS_MANUFACTURER;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+/* Describe summary in a single line, e.g.
+   "Flags 06 Tx -8 App Watch Mfg Apple, Inc.(10) Svc 0xFE9F+1 Data 0xFD6F"
+   Appearance and manufacturer are named when they're in the SIG tables.
+   data is the advertisement that summary was generated from.
+   strOutput must have space for GRAVITY_ADV_SUMMARY_STRLEN + 1 characters */
+char *gravity_adv_summary_format(const GravityAdvSummary *summary, const uint8_t *data, char *strOutput) {
+    char *out = strOutput;
+    char *end = strOutput + GRAVITY_ADV_SUMMARY_STRLEN + 1;
+    strOutput[0] = '\0';
+
+    if ((summary->present & GRAVITY_ADV_HAS_FLAGS) != 0) {
+        out += snprintf(out, end - out, "Flags %02X ", summary->flags);
+    }
+    if ((summary->present & GRAVITY_ADV_HAS_TX_POWER) != 0 && out < end) {
+        out += snprintf(out, end - out, "Tx %d ", summary->txPower);
+    }
+    if ((summary->present & GRAVITY_ADV_HAS_APPEARANCE) != 0 && out < end) {
+        const char *appearance = gravity_sig_appearance_name(summary->appearance);
+        if (appearance != NULL) {
+            out += snprintf(out, end - out, "App %.20s ", appearance);
+        } else {
+            out += snprintf(out, end - out, "App 0x%04X ", summary->appearance);
+        }
+    }
+    if ((summary->present & GRAVITY_ADV_HAS_MANUFACTURER) != 0 && out < end) {
+        const char *company = gravity_sig_company_name(summary->companyId);
+        if (company != NULL) {
+            out += snprintf(out, end - out, "Mfg %.20s(%u) ", company, summary->mfgLen);
+        } else {
+            out += snprintf(out, end - out, "Mfg 0x%04X(%u) ", summary->companyId, summary->mfgLen);
+        }
+    }
+    if (summary->uuidCount > 0 && out < end) {
+        if ((summary->present & GRAVITY_ADV_HAS_UUID16) != 0) {
+            out += snprintf(out, end - out, "Svc 0x%04X", summary->uuid16);
+        } else {
+            out += snprintf(out, end - out, "Svc");
+        }
+        if (summary->uuidCount > 1 && out < end) {
+            out += snprintf(out, end - out, "+%u", summary->uuidCount - 1);
+        }
+        if (out < end) {
+            out += snprintf(out, end - out, " ");
+        }
+    }
+    if ((summary->present & GRAVITY_ADV_HAS_SERVICE_DATA) != 0 && out < end) {
+        if (summary->serviceDataUuid != 0) {
+            out += snprintf(out, end - out, "Data 0x%04X ", summary->serviceDataUuid);
+        } else {
+            out += snprintf(out, end - out, "Data ");
+        }
+    }
+    if ((summary->present & GRAVITY_ADV_HAS_SHORT_NAME) != 0 && data != NULL && out < end) {
+        out += snprintf(out, end - out, "Short \"%.*s\" ", summary->shortNameLen, (const char *)&data[summary->shortNameOffset]);
+    }
+
+    /* Remove the trailing space */
+    size_t len = strlen(strOutput);
+    if (len > 0 && strOutput[len - 1] == ' ') {
+        strOutput[len - 1] = '\0';
+    }
+    return strOutput;
+}
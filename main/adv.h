@@ -0,0 +1,79 @@
+#ifndef GRAVITY_ADV_H
+#define GRAVITY_ADV_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* BLE advertising data and Bluetooth Classic EIR data are both a sequence of
+   AD structures: a length byte, an AD type byte and (length - 1) bytes of value.
+   The iterator walks these in place without copying, and never reads beyond
+   the bounds it was given, however malformed the data.
+*/
+
+/* AD types from the Bluetooth Assigned Numbers */
+#define GRAVITY_AD_FLAGS            0x01
+#define GRAVITY_AD_UUID16_PARTIAL   0x02
+#define GRAVITY_AD_UUID16_COMPLETE  0x03
+#define GRAVITY_AD_UUID32_PARTIAL   0x04
+#define GRAVITY_AD_UUID32_COMPLETE  0x05
+#define GRAVITY_AD_UUID128_PARTIAL  0x06
+#define GRAVITY_AD_UUID128_COMPLETE 0x07
+#define GRAVITY_AD_NAME_SHORT       0x08
+#define GRAVITY_AD_NAME_COMPLETE    0x09
+#define GRAVITY_AD_TX_POWER         0x0A
+#define GRAVITY_AD_SERVICE_DATA16   0x16
+#define GRAVITY_AD_APPEARANCE       0x19
+#define GRAVITY_AD_SERVICE_DATA32   0x20
+#define GRAVITY_AD_SERVICE_DATA128  0x21
+#define GRAVITY_AD_MANUFACTURER     0xFF
+
+typedef struct GravityAdvIter {
+    const uint8_t *data;
+    uint8_t len;
+    uint8_t pos;
+} GravityAdvIter;
+
+typedef struct GravityAdvField {
+    uint8_t type;
+    uint8_t len;                /* Length of value */
+    const uint8_t *value;       /* Points into the iterated data */
+} GravityAdvField;
+
+/* Bits of GravityAdvSummary.present */
+#define GRAVITY_ADV_HAS_FLAGS        0x01
+#define GRAVITY_ADV_HAS_TX_POWER     0x02
+#define GRAVITY_ADV_HAS_APPEARANCE   0x04
+#define GRAVITY_ADV_HAS_MANUFACTURER 0x08
+#define GRAVITY_ADV_HAS_UUID16       0x10
+#define GRAVITY_ADV_HAS_SERVICE_DATA 0x20
+#define GRAVITY_ADV_HAS_SHORT_NAME   0x40
+
+/* The commonly-useful fields of an advertisement, decoded once when the
+   advertisement is stored so that listing devices doesn't parse it again.
+   Variable-length fields are recorded as an offset and length into the
+   stored advertisement rather than being copied */
+typedef struct GravityAdvSummary {
+    uint8_t present;
+    uint8_t flags;
+    int8_t txPower;             /* dBm */
+    uint8_t uuidCount;          /* Service UUIDs of any size */
+    uint16_t appearance;
+    uint16_t companyId;
+    uint16_t uuid16;            /* First 16-bit service UUID */
+    uint16_t serviceDataUuid;   /* UUID of the first service data; 0 if not 16-bit */
+    uint8_t mfgOffset;          /* Manufacturer data following the company ID */
+    uint8_t mfgLen;
+    uint8_t shortNameOffset;
+    uint8_t shortNameLen;
+} GravityAdvSummary;
+
+/* Longest string produced by gravity_adv_summary_format() */
+#define GRAVITY_ADV_SUMMARY_STRLEN 96
+
+void gravity_adv_iter_init(GravityAdvIter *iter, const uint8_t *data, uint8_t len);
+bool gravity_adv_iter_next(GravityAdvIter *iter, GravityAdvField *field);
+void gravity_adv_summarise(const uint8_t *data, uint8_t len, GravityAdvSummary *summary);
+char *gravity_adv_summary_format(const GravityAdvSummary *summary, const uint8_t *data, char *strOutput);
+
+#endif
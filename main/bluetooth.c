@@ -1,29 +1,136 @@
 #include "bluetooth.h"
+#include "coex.h"
 #include "common.h"
+#include "gatt.h"
+#include "mem.h"
+#include "oui.h"
+#include "output.h"
 #include "probe.h"
+#include "sig.h"
+#include "slab.h"
 #include "sdkconfig.h"
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include <stdint.h>
 #include <time.h>
 
 #if defined(CONFIG_BT_ENABLED)
 
-#include "uuids.c"
-
 esp_err_t gravity_bt_discover_services(app_gap_cb_t *dev);
+esp_err_t bt_service_rm_dev(app_gap_cb_t *device);
+static app_gap_cb_t *bt_dev_find(gravity_mac_t bdaKey);
+static uint32_t bt_digest(const uint8_t *data, uint8_t len);
+static esp_err_t bt_dev_set_name(app_gap_cb_t *dev, const char *name, uint8_t len);
+static esp_err_t bt_dev_set_eir(app_gap_cb_t *dev, gravity_bt_scan_t transport, const uint8_t *eir, uint8_t len);
+static void bt_dev_seen(app_gap_cb_t *dev, gravity_bt_scan_t transport, int32_t rssi);
+static bool bt_svc_conclude(const esp_bd_addr_t bda, bool success);
 
 const char *BT_TAG = "bt@GRAVITY";
 
 app_gap_cb_t **gravity_bt_devices = NULL;
-uint8_t gravity_bt_dev_count = 0;
+uint16_t gravity_bt_dev_count = 0;
 app_gap_cb_t **gravity_selected_bt = NULL;
-uint8_t gravity_sel_bt_count = 0;
-app_gap_cb_t **gravity_svc_disc_q = NULL;
-uint8_t gravity_svc_disc_count = 0;
+uint16_t gravity_sel_bt_count = 0;
 app_gap_state_t state;
 static bool btInitialised = false;
 static bool bleInitialised = false;
 static bool btServiceDiscoveryActive = false;
 
+/* Service discovery scheduler
+   Bluetooth Classic can only discover one device's services at a time, so
+   requests wait in a fixed ring buffer. Requests record the device's address
+   rather than a pointer to it, so purging a device while it is queued is
+   harmless. When the radio is free the highest-priority request that isn't
+   backing off is dispatched, and moved out of the ring by replacing it with
+   the request at the head. A timer bounds each request; failed and timed-out
+   requests are requeued with an exponential backoff until they have used
+   their retries. The same timer wakes the scheduler when every queued
+   request is backing off */
+typedef struct {
+    uint32_t notBefore;         /* Milliseconds (esp_timer) before which the request waits */
+    esp_bd_addr_t bda;
+    uint8_t attempts;
+} bt_svc_req_t;
+
+#define BT_SVC_BACKOFF_MILLIS 5000
+/* Staleness is worth 1dB of RSSI for each minute since services were last
+   discovered, up to this limit; devices never discovered get the limit */
+#define BT_SVC_STALE_MAX_MINUTES 60
+
+static bt_svc_req_t btSvcQueue[CONFIG_BT_SVC_DISC_QUEUE_LEN];
+static uint16_t btSvcHead = 0;
+static uint16_t btSvcCount = 0;
+static bt_svc_req_t btSvcActive;    /* Valid while btServiceDiscoveryActive */
+static esp_timer_handle_t btSvcTimer = NULL;
+/* The scheduler is driven from the console, the GAP callback and btSvcTimer.
+   The lock is created by the first request, which always comes from the
+   console before either of the others can run */
+static StaticSemaphore_t btSvcLockBuffer;
+static SemaphoreHandle_t btSvcLock = NULL;
+static uint32_t btSvcCompleted = 0;
+static uint32_t btSvcFailed = 0;
+static uint32_t btSvcTimeouts = 0;
+static uint32_t btSvcRetries = 0;
+
+/* Hash index over gravity_bt_devices, keyed by bdaKey, so that scan results
+   can find an existing device without walking the whole array. Uses open
+   addressing with linear probing; the capacity is a power of two that is kept
+   at least twice the device count so probe sequences stay short. Devices are
+   allocated individually, so their pointers survive gravity_bt_devices being
+   reallocated. Devices are only ever removed in batches, after which the index
+   is rebuilt, so no tombstones are needed. If the index can't be allocated
+   lookups fall back to a linear search */
+static app_gap_cb_t **btDeviceIndex = NULL;
+static uint32_t btDeviceIndexSize = 0;
+
+/* Number of elements allocated for gravity_bt_devices. The array doubles in
+   size when it fills, rather than being reallocated for every new device */
+static uint32_t btDeviceCapacity = 0;
+/* Number of elements allocated for gravity_selected_bt, which grows the same way */
+static uint32_t btSelCapacity = 0;
+
+/* Device records, and their names and EIR/advertising data, are allocated
+   from slabs rather than individually from the heap. Names and EIR use the
+   smallest of these size classes that fits: most names are short, legacy BLE
+   advertising data is at most 31 bytes, advertising data plus a scan response
+   62 and Classic EIR 240. Names are at most ESP_BT_GAP_MAX_BDNAME_LEN (248)
+   bytes plus a terminator.
+   Devices without a name share btNoName rather than allocating an empty string.
+   Device records are hot and names and EIR are cold; see mem.h.
+   Chunk sizes hold 31 blocks, or 7 of the rarely-used 256-byte class, after
+   the chunk header */
+static void *bt_chunk_alloc(size_t alignment, size_t bytes);
+static void *bt_cold_chunk_alloc(size_t alignment, size_t bytes);
+#define BT_BUF_CLASS_COUNT 4
+static GravitySlab btDeviceSlab = GRAVITY_SLAB_INIT(sizeof(app_gap_cb_t), 2048, bt_chunk_alloc);
+static GravitySlab btBufSlabs[BT_BUF_CLASS_COUNT] = {
+    GRAVITY_SLAB_INIT(16, 512, bt_cold_chunk_alloc),
+    GRAVITY_SLAB_INIT(32, 1024, bt_cold_chunk_alloc),
+    GRAVITY_SLAB_INIT(64, 2048, bt_cold_chunk_alloc),
+    GRAVITY_SLAB_INIT(256, 2048, bt_cold_chunk_alloc)
+};
+static char btNoName[1] = "";
+
+/* When the memory budget is reached, BLE devices are evicted until usage
+   falls to this percentage of the budget. Evicting in batches means the
+   candidate heap is built once per batch rather than once per new device */
+#define BT_BUDGET_LOW_WATER 90
+static uint32_t btBudgetEvictions = 0;
+static uint32_t btBudgetRejections = 0;
+/* Whether the console has been told that new devices are being ignored.
+   Cleared when a device fits again, so each time the budget fills is reported once */
+static bool btBudgetFullReported = false;
+
+/* Advertising reports received, how many repeated the device's previous
+   advertisement, and how many name/EIR buffers had to be allocated */
+static uint32_t btAdvReports = 0;
+static uint32_t btAdvUnchanged = 0;
+static uint32_t btBufAllocs = 0;
+/* Set while a new device is being added, when it is safe for an allocation
+   to purge existing devices to make room */
+static bool btAllocMayPurge = false;
+
 enum bt_device_parameters {
     BT_PARAM_COD = 0,
     BT_PARAM_RSSI,
@@ -40,7 +147,7 @@ static esp_gattc_descr_elem_t *descr_elem_result = NULL;
 
 #define REMOTE_SERVICE_UUID        0x00FF
 #define REMOTE_NOTIFY_CHAR_UUID    0xFF01
-#define PROFILE_NUM      1
+#define PROFILE_NUM      2
 
 static int bt_comparator(const void *varOne, const void *varTwo);
 
@@ -163,8 +270,7 @@ char *bda2str(esp_bd_addr_t bda, char *str, size_t size) {
         return NULL;
     }
 
-    uint8_t *p = bda;
-    sprintf(str, "%02x:%02x:%02x:%02x:%02x:%02x", p[0], p[1], p[2], p[3], p[4], p[5]);
+    gravity_mac_format(gravity_mac_load(bda), str);
     return str;
 }
 
@@ -256,6 +362,49 @@ static esp_ble_scan_params_t ble_scan_params = {
     .scan_duplicate         = BLE_SCAN_DUPLICATE_DISABLE
 };
 
+#ifdef CONFIG_BLE_DUPLICATE_RESET_SECONDS
+    #define BT_DUPLICATE_RESET_SECONDS CONFIG_BLE_DUPLICATE_RESET_SECONDS
+#else
+    #define BT_DUPLICATE_RESET_SECONDS 5
+#endif
+
+/* BLE scan profiles, selected with "set BLE_SCAN_PROFILE". Interval and
+   window are in units of 0.625ms.
+   With the controller's duplicate filter enabled an advertiser is only
+   reported to Gravity the first time it is heard in each scan. The filter is
+   reset whenever scanning starts, so these profiles use a short scan cycle to
+   keep RSSI and last-seen times fresh */
+typedef struct {
+    const char *name;
+    esp_ble_scan_type_t scanType;
+    uint16_t interval;
+    uint16_t window;
+    esp_ble_scan_duplicate_t duplicate;
+    uint32_t cycleSeconds;
+} bt_scan_profile_t;
+
+static const bt_scan_profile_t btScanProfiles[GRAVITY_BLE_PROFILE_COUNT] = {
+    [GRAVITY_BLE_PROFILE_AGGRESSIVE] = { "AGGRESSIVE", BLE_SCAN_TYPE_ACTIVE, 0x50, 0x50, BLE_SCAN_DUPLICATE_DISABLE, CONFIG_BLE_SCAN_SECONDS },
+    [GRAVITY_BLE_PROFILE_BALANCED] = { "BALANCED", BLE_SCAN_TYPE_ACTIVE, 0x50, 0x30, BLE_SCAN_DUPLICATE_DISABLE, CONFIG_BLE_SCAN_SECONDS },
+    [GRAVITY_BLE_PROFILE_FILTERED] = { "FILTERED", BLE_SCAN_TYPE_ACTIVE, 0x50, 0x30, BLE_SCAN_DUPLICATE_ENABLE, BT_DUPLICATE_RESET_SECONDS },
+    [GRAVITY_BLE_PROFILE_PASSIVE] = { "PASSIVE", BLE_SCAN_TYPE_PASSIVE, 0x320, 0x50, BLE_SCAN_DUPLICATE_ENABLE, BT_DUPLICATE_RESET_SECONDS }
+};
+static gravity_ble_profile_t btScanProfile = GRAVITY_BLE_PROFILE_BALANCED;
+
+/* Advertising reports delivered to esp_gap_cb, devices discovered and time
+   spent scanning with each profile, so their overhead can be compared */
+typedef struct {
+    uint32_t reports;
+    uint32_t newDevices;
+    uint32_t activeMillis;
+} bt_scan_profile_stats_t;
+static bt_scan_profile_stats_t btScanProfileStats[GRAVITY_BLE_PROFILE_COUNT];
+static bool btScanRunning = false;
+static uint32_t btScanClockedAt = 0;
+static uint32_t btScanStatusAt = 0;
+static void bt_scan_clock(bool running);
+static uint32_t bt_svc_now_millis();
+
 struct gattc_profile_inst {
     esp_gattc_cb_t gattc_cb;
     uint16_t gattc_if;
@@ -269,11 +418,15 @@ struct gattc_profile_inst {
 
 /* One gatt-based profile one app_id and one gattc_if, this array will store the gattc_if returned by ESP_GATTS_REG_EVT */
 static void gattc_profile_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param);
-static struct gattc_profile_inst gl_profile_tab[1] = {
+static struct gattc_profile_inst gl_profile_tab[PROFILE_NUM] = {
     [0] = {
         .gattc_cb = gattc_profile_event_handler,
         .gattc_if = ESP_GATT_IF_NONE,       /* Not get the gatt_if, so initial is ESP_GATT_IF_NONE */
     },
+    [GRAVITY_GATT_APP_ID] = {
+        .gattc_cb = gravity_gatt_event_handler,
+        .gattc_if = ESP_GATT_IF_NONE,
+    },
 };
 
 static void gattc_profile_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param)
@@ -501,7 +654,11 @@ static void esp_gap_cb(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *par
     uint8_t adv_name_len = 0;
     switch (event) {
     case ESP_GAP_BLE_SCAN_PARAM_SET_COMPLETE_EVT: {
-        esp_ble_gap_start_scanning(CONFIG_BLE_SCAN_SECONDS);
+        /* Parameters are also set when the scan profile changes, which
+           shouldn't start a scan that isn't wanted */
+        if (attack_status[ATTACK_SCAN_BLE] && gravity_coex_radio_active(GRAVITY_COEX_BLE)) {
+            esp_ble_gap_start_scanning(btScanProfiles[btScanProfile].cycleSeconds);
+        }
         break;
     }
     case ESP_GAP_BLE_SCAN_START_COMPLETE_EVT:
@@ -510,6 +667,13 @@ static void esp_gap_cb(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *par
             ESP_LOGE(BT_TAG, "scan start failed, error status = %x", param->scan_start_cmpl.status);
             break;
         }
+        bt_scan_clock(true);
+        /* Profiles with a short scan cycle would otherwise report their
+           status every few seconds */
+        if (btScanStatusAt != 0 && bt_svc_now_millis() - btScanStatusAt < CONFIG_BLE_SCAN_SECONDS * 1000) {
+            break;
+        }
+        btScanStatusAt = bt_svc_now_millis();
         #ifdef CONFIG_FLIPPER
             printf("BLE scan status: %s\n%d cached BT devices.\n", attack_status[ATTACK_SCAN_BLE]?"ON":"OFF", gravity_bt_dev_count);
         #else
@@ -527,62 +691,73 @@ static void esp_gap_cb(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *par
             printf("discovery ble result\n");
             break;
         case ESP_GAP_SEARCH_INQ_RES_EVT:
+            ++btAdvReports;
+            ++btScanProfileStats[btScanProfile].reports;
+            uint8_t *advData = scan_result->scan_rst.ble_adv;
+            uint8_t advLen = scan_result->scan_rst.adv_data_len;
+
+            /* Does the BDA exist? */
+            app_gap_cb_t *dev = bt_dev_find(gravity_mac_load(scan_result->scan_rst.bda));
+            if (dev != NULL) {
+                /* Found - Update. This may be a Classic device seen over BLE for the first time */
+                grav_bt_transport *ble = &dev->transport[GRAVITY_BT_SCAN_BLE];
+                bt_dev_seen(dev, GRAVITY_BT_SCAN_BLE, scan_result->scan_rst.rssi);
+                /* Needed to connect for GATT service discovery */
+                dev->bleAddrType = scan_result->scan_rst.ble_addr_type;
+                /* Devices repeat the same advertisement many times a second. If it
+                   hasn't changed there is nothing else to update */
+                if (advLen > 0 && advLen == ble->eir_len && bt_digest(advData, advLen) == ble->eirDigest &&
+                        !memcmp(advData, ble->eir, advLen)) {
+                    ++btAdvUnchanged;
+                    break;
+                }
+            }
+
             /* Get device name */
             char bdNameStr[ESP_BT_GAP_MAX_BDNAME_LEN + 1];
-            adv_name = esp_ble_resolve_adv_data(scan_result->scan_rst.ble_adv,
-                                                ESP_BLE_AD_TYPE_NAME_CMPL, &adv_name_len);
-            memcpy(bdNameStr, adv_name, adv_name_len);
+            adv_name = esp_ble_resolve_adv_data(advData, ESP_BLE_AD_TYPE_NAME_CMPL, &adv_name_len);
+            if (adv_name == NULL) {
+                adv_name_len = 0;
+            } else {
+                memcpy(bdNameStr, adv_name, adv_name_len);
+            }
             bdNameStr[adv_name_len] = '\0';
 
-            /* Does the BDA exist? */
-            int devIdx = 0;
-            for ( ; devIdx < gravity_bt_dev_count && memcmp(scan_result->scan_rst.bda, gravity_bt_devices[devIdx]->bda, ESP_BD_ADDR_LEN); ++devIdx) { }
-            if (devIdx < gravity_bt_dev_count) {
-                /* Found - Update */
-                gravity_bt_devices[devIdx]->rssi = scan_result->scan_rst.rssi;
-                if (scan_result->scan_rst.adv_data_len > 0) {
-                    if (gravity_bt_devices[devIdx]->eir != NULL) {
-                        free(gravity_bt_devices[devIdx]->eir);
-                    }
-                    gravity_bt_devices[devIdx]->eir = malloc(sizeof(uint8_t) * scan_result->scan_rst.adv_data_len);
-                    if (gravity_bt_devices[devIdx]->eir == NULL) {
-                        #ifdef CONFIG_FLIPPER
-                            printf("%sfor EIR (len %u).\n", STRINGS_MALLOC_FAIL, scan_result->scan_rst.adv_data_len);
-                        #else
-                            ESP_LOGE(BT_TAG, "%sfor EIR (length %u).", STRINGS_MALLOC_FAIL, scan_result->scan_rst.adv_data_len);
-                        #endif
-                        return; /* Out of memory */
-                    }
-                    memcpy(gravity_bt_devices[devIdx]->eir, scan_result->scan_rst.ble_adv, scan_result->scan_rst.adv_data_len);
-                    gravity_bt_devices[devIdx]->eir_len = scan_result->scan_rst.adv_data_len;
+            if (dev != NULL) {
+                if (advLen > 0 && bt_dev_set_eir(dev, GRAVITY_BT_SCAN_BLE, advData, advLen) != ESP_OK) {
+                    #ifdef CONFIG_FLIPPER
+                        printf("%sfor EIR (len %u).\n", STRINGS_MALLOC_FAIL, advLen);
+                    #else
+                        ESP_LOGE(BT_TAG, "%sfor EIR (length %u).", STRINGS_MALLOC_FAIL, advLen);
+                    #endif
+                    return; /* Out of memory */
                 }
-                if (adv_name_len > 0) {
-                    gravity_bt_devices[devIdx]->bdname_len = adv_name_len;
-                    if (gravity_bt_devices[devIdx]->bdName != NULL) {
-                        free(gravity_bt_devices[devIdx]->bdName);
-                    }
-                    gravity_bt_devices[devIdx]->bdName = malloc(sizeof(char) * (adv_name_len + 1));
-                    if (gravity_bt_devices[devIdx]->bdName == NULL) {
-                        #ifdef CONFIG_FLIPPER
-                            printf("%sfor bdName (len %u).\n", STRINGS_MALLOC_FAIL, adv_name_len);
-                        #else
-                            ESP_LOGE(BT_TAG, "%sfor Bluetooth Device Name (length %u).", STRINGS_MALLOC_FAIL, adv_name_len);
-                        #endif
-                        return; /* ESP_ERR_NO_MEM */
-                    }
-                    strncpy(gravity_bt_devices[devIdx]->bdName, bdNameStr, adv_name_len);
-                    gravity_bt_devices[devIdx]->bdName[adv_name_len] = '\0';
+                if (adv_name_len > 0 && bt_dev_set_name(dev, bdNameStr, adv_name_len) != ESP_OK) {
+                    #ifdef CONFIG_FLIPPER
+                        printf("%sfor bdName (len %u).\n", STRINGS_MALLOC_FAIL, adv_name_len);
+                    #else
+                        ESP_LOGE(BT_TAG, "%sfor Bluetooth Device Name (length %u).", STRINGS_MALLOC_FAIL, adv_name_len);
+                    #endif
+                    return; /* ESP_ERR_NO_MEM */
+                }
+            } else if (bt_dev_add_components(scan_result->scan_rst.bda, bdNameStr, adv_name_len, advData, advLen, 0,
+                                             scan_result->scan_rst.rssi, GRAVITY_BT_SCAN_BLE) == ESP_OK) {
+                ++btScanProfileStats[btScanProfile].newDevices;
+                gravity_coex_record_discovery(GRAVITY_COEX_BLE);
+                dev = bt_dev_find(gravity_mac_load(scan_result->scan_rst.bda));
+                if (dev != NULL) {
+                    dev->bleAddrType = scan_result->scan_rst.ble_addr_type;
                 }
-            } else {
-                bt_dev_add_components(scan_result->scan_rst.bda, bdNameStr, adv_name_len, scan_result->scan_rst.ble_adv, scan_result->scan_rst.adv_data_len, 0, scan_result->scan_rst.rssi, GRAVITY_BT_SCAN_BLE);
             }
             break;
         case ESP_GAP_SEARCH_INQ_CMPL_EVT:
             /* Restart the BLE scanner if it hasn't been disabled (status will be displayed on
                successful start)
             */
-            if (attack_status[ATTACK_SCAN_BLE]) {
-                esp_ble_gap_start_scanning(CONFIG_BLE_SCAN_SECONDS);
+            if (attack_status[ATTACK_SCAN_BLE] && gravity_coex_radio_active(GRAVITY_COEX_BLE)) {
+                esp_ble_gap_start_scanning(btScanProfiles[btScanProfile].cycleSeconds);
+            } else {
+                bt_scan_clock(false);
             }
             break;
         default:
@@ -596,6 +771,8 @@ static void esp_gap_cb(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *par
             ESP_LOGE(BT_TAG, "scan stop failed, error status = %x", param->scan_stop_cmpl.status);
             break;
         }
+        bt_scan_clock(false);
+        btScanStatusAt = 0;
         ESP_LOGI(BT_TAG, "stop scan successfully");
         break;
 
@@ -651,10 +828,14 @@ static void esp_gattc_cb(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp
     } while (0);
 }
 
-esp_err_t gravity_ble_scan_start(gravity_bt_purge_strategy_t purgeStrat) {
+/* Register BLE callbacks and GATT client applications. Registering the
+   scanning application sets scan parameters, which starts a BLE scan if one
+   has been requested */
+esp_err_t gravity_ble_initialise() {
     esp_err_t err = ESP_OK;
-    purgeStrategy = purgeStrat;
-
+    if (bleInitialised) {
+        return ESP_OK;
+    }
     if (!btInitialised) {
         err = gravity_bt_initialise();
         if (err != ESP_OK) {
@@ -663,38 +844,164 @@ esp_err_t gravity_ble_scan_start(gravity_bt_purge_strategy_t purgeStrat) {
         }
     }
 
+    err = esp_ble_gap_register_callback(esp_gap_cb);
+    if (err != ESP_OK) {
+        printf("%s\n", esp_err_to_name(err));
+        return err;
+    }
+
+    err = esp_ble_gattc_register_callback(esp_gattc_cb);
+    if (err != ESP_OK) {
+        printf("%s\n", esp_err_to_name(err));
+        return err;
+    }
+
+    err = esp_ble_gattc_app_register(0);
+    if (err != ESP_OK) {
+        printf("%s\n", esp_err_to_name(err));
+        //return err;
+    }
+
+    err = esp_ble_gattc_app_register(GRAVITY_GATT_APP_ID);
+    if (err != ESP_OK) {
+        printf("%s\n", esp_err_to_name(err));
+    }
+
+    err = esp_ble_gatt_set_local_mtu(500);
+    if (err != ESP_OK) {
+        printf("%s\n", esp_err_to_name(err));\
+        //return err;
+    }
+    bleInitialised = true;
+    printf("BLE Initialised.\n");
+    return ESP_OK;
+}
+
+esp_err_t gravity_ble_scan_start(gravity_bt_purge_strategy_t purgeStrat) {
+    esp_err_t err = ESP_OK;
+    purgeStrategy = purgeStrat;
+
     if (!bleInitialised) {
-        err = esp_ble_gap_register_callback(esp_gap_cb);
-        if (err != ESP_OK) {
-            printf("%s\n", esp_err_to_name(err));
-            return err;
-        }
+        err = gravity_ble_initialise();
+    } else {
+        err |= esp_ble_gap_start_scanning(btScanProfiles[btScanProfile].cycleSeconds);
+    }
+    return err;
+}
 
-        err = esp_ble_gattc_register_callback(esp_gattc_cb);
-        if (err != ESP_OK) {
-            printf("%s\n", esp_err_to_name(err));
-            return err;
-        }
+/* Pause and resume BLE scanning while the coexistence scheduler gives the
+   radio to something else */
+esp_err_t gravity_ble_scan_pause() {
+    if (!bleInitialised) {
+        return ESP_OK;
+    }
+    return esp_ble_gap_stop_scanning();
+}
 
-        err = esp_ble_gattc_app_register(0);
-        if (err != ESP_OK) {
-            printf("%s\n", esp_err_to_name(err));
-            //return err;
-        }
+esp_err_t gravity_ble_scan_resume() {
+    if (!bleInitialised) {
+        /* Scanning will start once BLE has been initialised */
+        return ESP_OK;
+    }
+    return esp_ble_gap_start_scanning(btScanProfiles[btScanProfile].cycleSeconds);
+}
 
-        err = esp_ble_gatt_set_local_mtu(500);
-        if (err != ESP_OK) {
-            printf("%s\n", esp_err_to_name(err));\
-            //return err;
+/* As above, for Bluetooth Classic discovery */
+esp_err_t gravity_bt_discovery_pause() {
+    if (!btInitialised) {
+        return ESP_OK;
+    }
+    return esp_bt_gap_cancel_discovery();
+}
+
+esp_err_t gravity_bt_discovery_resume() {
+    if (!btInitialised) {
+        return ESP_OK;
+    }
+    state = APP_GAP_STATE_DEVICE_DISCOVERING;
+    return esp_bt_gap_start_discovery(ESP_BT_INQ_MODE_GENERAL_INQUIRY, CONFIG_BT_SCAN_DURATION, 0);
+}
+
+/* Add the time since it was last called to the active profile's scanning
+   time, and note whether a scan is now running. The radio scheduler
+   measures BLE airtime from the same events */
+static void bt_scan_clock(bool running) {
+    uint32_t now = bt_svc_now_millis();
+    if (btScanRunning) {
+        btScanProfileStats[btScanProfile].activeMillis += now - btScanClockedAt;
+    }
+    btScanClockedAt = now;
+    btScanRunning = running;
+    gravity_coex_record_airtime(GRAVITY_COEX_BLE, running);
+}
+
+esp_err_t gravity_ble_profile_from_string(const char *str, gravity_ble_profile_t *profile) {
+    for (int i = 0; i < GRAVITY_BLE_PROFILE_COUNT; ++i) {
+        if (!strcasecmp(str, btScanProfiles[i].name)) {
+            *profile = i;
+            return ESP_OK;
         }
-        bleInitialised = true;
-        printf("BLE Initialised.\n");
-    } else {
-        err |= esp_ble_gap_start_scanning(CONFIG_BLE_SCAN_SECONDS);
     }
+    return ESP_ERR_INVALID_ARG;
+}
+
+gravity_ble_profile_t gravity_ble_get_profile() {
+    return btScanProfile;
+}
+
+/* Switch to the specified BLE scan profile. Scan parameters can't be changed
+   while the controller is scanning, so a running scan is stopped; it is
+   restarted by esp_gap_cb once the new parameters have been accepted */
+esp_err_t gravity_ble_set_profile(gravity_ble_profile_t profile) {
+    if (profile >= GRAVITY_BLE_PROFILE_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    bt_scan_clock(btScanRunning);
+    btScanProfile = profile;
+    ble_scan_params.scan_type = btScanProfiles[profile].scanType;
+    ble_scan_params.scan_interval = btScanProfiles[profile].interval;
+    ble_scan_params.scan_window = btScanProfiles[profile].window;
+    ble_scan_params.scan_duplicate = btScanProfiles[profile].duplicate;
+
+    /* Until BLE is initialised the parameters are applied when it is */
+    if (!bleInitialised) {
+        return ESP_OK;
+    }
+    esp_err_t err = ESP_OK;
+    if (btScanRunning) {
+        err |= esp_ble_gap_stop_scanning();
+    }
+    err |= esp_ble_gap_set_scan_params(&ble_scan_params);
     return err;
 }
 
+/* Display each scan profile's settings, with the rate at which it delivered
+   advertisements to Gravity and discovered new devices */
+esp_err_t gravity_ble_profile_report() {
+    bt_scan_clock(btScanRunning);
+    #ifndef CONFIG_FLIPPER
+        ESP_LOGI(BT_TAG, "  Profile     Scan     Interval  Window  Duplicates  Cycle   Scanned  Adv/sec  New/min");
+    #endif
+    for (int i = 0; i < GRAVITY_BLE_PROFILE_COUNT; ++i) {
+        const bt_scan_profile_t *profile = &btScanProfiles[i];
+        const bt_scan_profile_stats_t *stats = &btScanProfileStats[i];
+        uint32_t seconds = stats->activeMillis / 1000;
+        /* Rates in tenths */
+        uint32_t advRate = (stats->activeMillis == 0) ? 0 : (uint32_t)((uint64_t)stats->reports * 10000 / stats->activeMillis);
+        uint32_t newRate = (stats->activeMillis == 0) ? 0 : (uint32_t)((uint64_t)stats->newDevices * 600000 / stats->activeMillis);
+        #ifdef CONFIG_FLIPPER
+            printf("%s%s: %lus\n%lu.%lu adv/s %lu.%lu new/m\n", (i == btScanProfile)?"*":"", profile->name, seconds,
+                   advRate / 10, advRate % 10, newRate / 10, newRate % 10);
+        #else
+            ESP_LOGI(BT_TAG, "%c %-10s  %-7s  %5dms   %4dms  %-10s  %3lus  %6lus  %5lu.%lu  %5lu.%lu", (i == btScanProfile)?'*':' ', profile->name,
+                     (profile->scanType == BLE_SCAN_TYPE_ACTIVE)?"Active":"Passive", profile->interval * 5 / 8, profile->window * 5 / 8,
+                     (profile->duplicate == BLE_SCAN_DUPLICATE_ENABLE)?"Filtered":"All", profile->cycleSeconds, seconds,
+                     advRate / 10, advRate % 10, newRate / 10, newRate % 10);
+        #endif
+    }
+    return ESP_OK;
+}
+
 /* update_device_info
    This function is called by the Bluetooth callback when a device discovered event
    is received. It will maintain gravity_bt_devices and gravity_bt_dev_count with a
@@ -722,15 +1029,13 @@ void update_device_info(esp_bt_gap_cb_param_t *param) {
     }
 
     /* Is it a new BDA (i.e. device we haven't seen before)? */
-    int deviceIdx = 0;
     memcpy(dev_bda, param->disc_res.bda, ESP_BD_ADDR_LEN);
     bda2str(param->disc_res.bda, bda_str, MAC_STRLEN + 1);
-    for (; deviceIdx < gravity_bt_dev_count && memcmp(param->disc_res.bda,
-                    gravity_bt_devices[deviceIdx]->bda, ESP_BD_ADDR_LEN); ++deviceIdx) { }
+    app_gap_cb_t *device = bt_dev_find(gravity_mac_load(param->disc_res.bda));
 
     int numProp = param->disc_res.num_prop;
     #ifdef CONFIG_DEBUG_VERBOSE
-        printf("BEGIN UPDATE_DEVICE_INFO() BDA: %s %sNum properties %d: ", bda_str, (deviceIdx < gravity_bt_dev_count)?"Already cached, ":"New device, ", numProp);
+        printf("BEGIN UPDATE_DEVICE_INFO() BDA: %s %sNum properties %d: ", bda_str, (device != NULL)?"Already cached, ":"New device, ", numProp);
         /* Display info about each attached property */
         for (int i = 0; i < numProp; ++i) {
             p = param->disc_res.prop + i;
@@ -799,18 +1104,19 @@ void update_device_info(esp_bt_gap_cb_param_t *param) {
     }
 
     /* Is BDA already in gravity_bt_devices[]? */
-    if (deviceIdx < gravity_bt_dev_count) {
+    if (device != NULL) {
         /* Found an existing device with the same BDA - Update its RSSI */
         /* YAGNI - Update bdname if it's changed */
         // TODO: Include a timestamp so we can age devices
-        if (paramUpdated[BT_PARAM_BDNAME] && ((gravity_bt_devices[deviceIdx]->bdName == NULL && dev_bdname_len > 0) || strcmp(gravity_bt_devices[deviceIdx]->bdName, dev_bdname))) {
+        if (paramUpdated[BT_PARAM_BDNAME] && ((device->bdName == NULL && dev_bdname_len > 0) || strcmp(device->bdName, dev_bdname))) {
             #ifdef CONFIG_FLIPPER
                 printf("BT: Update BT Device %s Name \"%s\"\n", bda_str, dev_bdname);
             #else
                 ESP_LOGI(BT_TAG, "Update BT Device %s Name \"%s\"", bda_str, dev_bdname);
             #endif
         }
-        if (updateDevice(paramUpdated, dev_bda, dev_cod, dev_rssi, dev_bdname_len, dev_bdname, dev_eir_len, dev_eir) != ESP_OK) {
+        if (updateDevice(paramUpdated, device, dev_bda, dev_cod, dev_rssi, dev_bdname_len, dev_bdname, dev_eir_len, dev_eir,
+                         GRAVITY_BT_SCAN_CLASSIC_DISCOVERY) != ESP_OK) {
             #ifdef CONFIG_FLIPPER
                 printf("An error occurred trying to update the device in memory. Sorry about that.\n");
             #else
@@ -833,7 +1139,10 @@ void update_device_info(esp_bt_gap_cb_param_t *param) {
         #else
             ESP_LOGI(BT_TAG, "%s", devString);
         #endif
-        bt_dev_add_components(dev_bda, dev_bdname, dev_bdname_len, dev_eir, dev_eir_len, dev_cod, dev_rssi, GRAVITY_BT_SCAN_CLASSIC_DISCOVERY);
+        if (bt_dev_add_components(dev_bda, dev_bdname, dev_bdname_len, dev_eir, dev_eir_len, dev_cod, dev_rssi,
+                                  GRAVITY_BT_SCAN_CLASSIC_DISCOVERY) == ESP_OK) {
+            gravity_coex_record_discovery(GRAVITY_COEX_BT_CLASSIC);
+        }
     }
 
     state = APP_GAP_STATE_DEVICE_DISCOVER_COMPLETE;
@@ -841,31 +1150,27 @@ void update_device_info(esp_bt_gap_cb_param_t *param) {
     //esp_bt_gap_cancel_discovery();
 }
 
-/* Update the element of gravity_bt_devices[] that is specified by theBda
-   If the BDA does not exist in the data model it will be created instead.
+/* Update device, the element of gravity_bt_devices[] that has theBda, as
+   previously found by the caller, with what was seen on transport.
+   If device is NULL the BDA does not exist in the data model and it will be
+   created instead.
 */
-esp_err_t updateDevice(bool *updatedFlags, esp_bd_addr_t theBda, int32_t theCod, int32_t theRssi, uint8_t theNameLen, char *theName, uint8_t theEirLen, uint8_t *theEir) {
+esp_err_t updateDevice(bool *updatedFlags, app_gap_cb_t *device, esp_bd_addr_t theBda, int32_t theCod, int32_t theRssi, uint8_t theNameLen, char *theName, uint8_t theEirLen, uint8_t *theEir, gravity_bt_scan_t transport) {
     esp_err_t err = ESP_OK;
-    int deviceIdx = 0;
-    while (deviceIdx < gravity_bt_dev_count && memcmp(theBda, gravity_bt_devices[deviceIdx]->bda, ESP_BD_ADDR_LEN)) {
-        ++deviceIdx;
-    }
-    if (deviceIdx < gravity_bt_dev_count) {
+    if (device != NULL) {
         /* We found a stored device with the same BDA */
         if (updatedFlags[BT_PARAM_COD]) {
-            gravity_bt_devices[deviceIdx]->cod = theCod;
+            device->cod = theCod;
             updatedFlags[BT_PARAM_COD] = false;
         }
         if (updatedFlags[BT_PARAM_RSSI]) {
-            gravity_bt_devices[deviceIdx]->rssi = theRssi;
             updatedFlags[BT_PARAM_RSSI] = false;
+        } else if (gravity_bt_dev_seen_on(device, transport)) {
+            /* Keep the transport's last known RSSI */
+            theRssi = device->transport[transport].rssi;
         }
         if (updatedFlags[BT_PARAM_BDNAME]) {
-            if (gravity_bt_devices[deviceIdx]->bdName != NULL) {
-                free(gravity_bt_devices[deviceIdx]->bdName);
-            }
-            gravity_bt_devices[deviceIdx]->bdName = malloc(sizeof(char) * (theNameLen + 1));
-            if (gravity_bt_devices[deviceIdx]->bdName == NULL) {
+            if (bt_dev_set_name(device, theName, theNameLen) != ESP_OK) {
                 #ifdef CONFIG_FLIPPER
                     printf("%sfor BDName (len %u).\n", STRINGS_MALLOC_FAIL, theNameLen);
                 #else
@@ -873,17 +1178,10 @@ esp_err_t updateDevice(bool *updatedFlags, esp_bd_addr_t theBda, int32_t theCod,
                 #endif
                 return ESP_ERR_NO_MEM;
             }
-            strncpy(gravity_bt_devices[deviceIdx]->bdName, theName, theNameLen);
-            gravity_bt_devices[deviceIdx]->bdName[theNameLen] = '\0';
-            gravity_bt_devices[deviceIdx]->bdname_len = theNameLen;
             updatedFlags[BT_PARAM_BDNAME] = false;
         }
         if (updatedFlags[BT_PARAM_EIR]) {
-            if (gravity_bt_devices[deviceIdx]->eir != NULL) {
-                free(gravity_bt_devices[deviceIdx]->eir);
-            }
-            gravity_bt_devices[deviceIdx]->eir = malloc(sizeof(uint8_t) * theEirLen);
-            if (gravity_bt_devices[deviceIdx] == NULL) {
+            if (bt_dev_set_eir(device, transport, theEir, theEirLen) != ESP_OK) {
                 #ifdef CONFIG_FLIPPER
                     printf("%sfor EIR (len %u).\n", STRINGS_MALLOC_FAIL, theEirLen);
                 #else
@@ -891,60 +1189,202 @@ esp_err_t updateDevice(bool *updatedFlags, esp_bd_addr_t theBda, int32_t theCod,
                 #endif
                 return ESP_ERR_NO_MEM;
             }
-            memcpy(gravity_bt_devices[deviceIdx]->eir, theEir, theEirLen);
-            gravity_bt_devices[deviceIdx]->eir_len = theEirLen;
         }
-        /* Update lastSeen and lastSeen */
-        gravity_bt_devices[deviceIdx]->lastSeen = clock();
+        bt_dev_seen(device, transport, theRssi);
     } else {
         /* Device doesn't exist, add it instead */
-        return bt_dev_add_components(theBda, theName, theNameLen, theEir, theEirLen, theCod, theRssi, GRAVITY_BT_SCAN_CLASSIC_DISCOVERY);
+        return bt_dev_add_components(theBda, theName, theNameLen, theEir, theEirLen, theCod, theRssi, transport);
     }
     return err;
 }
 
-app_gap_cb_t *gravity_svc_disc_queue_pop() {
-    #ifdef CONFIG_DEBUG_VERBOSE
-        char bda_str[MAC_STRLEN + 1] = "";
-        bda2str(gravity_svc_disc_q[0]->bda, bda_str, MAC_STRLEN + 1);
-        printf("Beginning of pop, first queue item is %s (%s).\n", bda_str, gravity_svc_disc_q[0]->bdName);
-    #endif
+static uint32_t bt_svc_now_millis() {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
 
-    app_gap_cb_t **newQ = NULL;
-    if (gravity_svc_disc_count == 0) {
-        printf("queue is empty, returning NULL\n");
-        return NULL;
-    } else {
-        /* Shrink the queue */
-        if (gravity_svc_disc_count > 1) {
-            newQ = malloc(sizeof(app_gap_cb_t *) * (gravity_svc_disc_count - 1));
-            if (newQ == NULL) {
-                #ifdef CONFIG_FLIPPER
-                    printf("%s\n", STRINGS_MALLOC_FAIL);
-                #else
-                    ESP_LOGE(BT_TAG, "%s.", STRINGS_MALLOC_FAIL);
-                #endif
-                return NULL;
+/* Priority of a queued request; larger is more urgent. Nearby devices answer
+   quickly and reliably so RSSI dominates, but staleness lets devices that
+   have never been discovered overtake slightly stronger ones that have */
+static int32_t bt_svc_priority(const bt_svc_req_t *req, clock_t now) {
+    app_gap_cb_t *dev = bt_dev_find(gravity_mac_load(req->bda));
+    if (dev == NULL) {
+        /* Not in scan results - Its signal strength is unknown */
+        return -128 + BT_SVC_STALE_MAX_MINUTES;
+    }
+    uint32_t staleMinutes = BT_SVC_STALE_MAX_MINUTES;
+    if (dev->bt_services.lastSeen != 0) {
+        staleMinutes = (now - dev->bt_services.lastSeen) / CLOCKS_PER_SEC / 60;
+        if (staleMinutes > BT_SVC_STALE_MAX_MINUTES) {
+            staleMinutes = BT_SVC_STALE_MAX_MINUTES;
+        }
+    }
+    return dev->rssi + (int32_t)staleMinutes;
+}
+
+/* Add a request to the ring. Must be called with btSvcLock taken.
+   Returns false if the ring is full */
+static bool bt_svc_push(const bt_svc_req_t *req) {
+    if (btSvcCount == CONFIG_BT_SVC_DISC_QUEUE_LEN) {
+        return false;
+    }
+    btSvcQueue[(btSvcHead + btSvcCount) % CONFIG_BT_SVC_DISC_QUEUE_LEN] = *req;
+    ++btSvcCount;
+    return true;
+}
+
+/* Is a request for bda queued or in progress? Must be called with btSvcLock taken */
+static bool bt_svc_pending(const esp_bd_addr_t bda) {
+    gravity_mac_t key = gravity_mac_load(bda);
+    if (btServiceDiscoveryActive && gravity_mac_load(btSvcActive.bda) == key) {
+        return true;
+    }
+    for (uint16_t i = 0; i < btSvcCount; ++i) {
+        if (gravity_mac_load(btSvcQueue[(btSvcHead + i) % CONFIG_BT_SVC_DISC_QUEUE_LEN].bda) == key) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void bt_svc_timer_cb(void *arg);
+
+static esp_err_t bt_svc_timer_start(uint32_t millis) {
+    if (btSvcTimer == NULL) {
+        const esp_timer_create_args_t timerArgs = {
+            .callback = &bt_svc_timer_cb,
+            .name = "btSvcDisc"
+        };
+        esp_err_t err = esp_timer_create(&timerArgs, &btSvcTimer);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    esp_timer_stop(btSvcTimer);
+    return esp_timer_start_once(btSvcTimer, (uint64_t)millis * 1000);
+}
+
+/* Start service discovery for the most urgent queued request, if the radio
+   is free. If every queued request is backing off, arm the timer for when
+   the first of them becomes eligible */
+static void bt_svc_dispatch() {
+    while (true) {
+        uint32_t now = bt_svc_now_millis();
+        clock_t nowClock = clock();
+        int32_t best = -1;
+        int32_t bestPriority = INT32_MIN;
+        uint32_t wait = UINT32_MAX;
+
+        xSemaphoreTake(btSvcLock, portMAX_DELAY);
+        if (btServiceDiscoveryActive) {
+            xSemaphoreGive(btSvcLock);
+            return;
+        }
+        for (uint16_t i = 0; i < btSvcCount; ++i) {
+            bt_svc_req_t *req = &btSvcQueue[(btSvcHead + i) % CONFIG_BT_SVC_DISC_QUEUE_LEN];
+            int32_t remaining = (int32_t)(req->notBefore - now);
+            if (remaining > 0) {
+                if ((uint32_t)remaining < wait) {
+                    wait = remaining;
+                }
+                continue;
+            }
+            int32_t priority = bt_svc_priority(req, nowClock);
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                best = i;
             }
-            /* Copy relevant array elements beginning with the first */
-            memcpy(newQ, &(gravity_svc_disc_q[1]), (gravity_svc_disc_count - 1));
         }
-        app_gap_cb_t *retVal = gravity_svc_disc_q[0];
-        --gravity_svc_disc_count;
-        free(gravity_svc_disc_q);
-        gravity_svc_disc_q = newQ;
-        return retVal;
+        if (best >= 0) {
+            uint16_t slot = (btSvcHead + best) % CONFIG_BT_SVC_DISC_QUEUE_LEN;
+            btSvcActive = btSvcQueue[slot];
+            btSvcQueue[slot] = btSvcQueue[btSvcHead];
+            btSvcHead = (btSvcHead + 1) % CONFIG_BT_SVC_DISC_QUEUE_LEN;
+            --btSvcCount;
+            ++btSvcActive.attempts;
+            btServiceDiscoveryActive = true;
+        }
+        xSemaphoreGive(btSvcLock);
+
+        if (best < 0) {
+            if (wait != UINT32_MAX) {
+                bt_svc_timer_start(wait);
+            }
+            return;
+        }
+
+        #ifdef CONFIG_DEBUG_VERBOSE
+            char bda_str[MAC_STRLEN + 1] = "";
+            bda2str(btSvcActive.bda, bda_str, MAC_STRLEN + 1);
+            printf("Service discovery: Requesting %s (attempt %u, priority %ld, %u queued)\n",
+                   bda_str, btSvcActive.attempts, bestPriority, btSvcCount);
+        #endif
+        state = APP_GAP_STATE_SERVICE_DISCOVERING;
+        if (esp_bt_gap_get_remote_services(btSvcActive.bda) == ESP_OK &&
+                bt_svc_timer_start(CONFIG_BT_SVC_DISC_TIMEOUT * 1000) == ESP_OK) {
+            return;
+        }
+        /* The request couldn't be made or couldn't be bounded - Treat it as
+           failed and try the next one */
+        bt_svc_conclude(btSvcActive.bda, false);
     }
 }
 
-/* Search the store of known UUIDs for the specified UUID */
-bt_uuid *svcForUUID(uint16_t uuid) {
-    uint8_t svcIdx = 0;
-    for ( ; svcIdx < BT_UUID_COUNT && uuid != bt_uuids[svcIdx].uuid16; ++ svcIdx) {}
-    if (svcIdx == BT_UUID_COUNT) {
-        return NULL;
+/* Conclude the request in progress for bda, requeueing it with a backoff if
+   it failed and has retries remaining.
+   Returns false if that request is not in progress - It may have already
+   timed out, or the results may have been requested by someone else */
+static bool bt_svc_conclude(const esp_bd_addr_t bda, bool success) {
+    if (btSvcLock == NULL) {
+        /* Nothing has been requested */
+        return false;
     }
-    return &(bt_uuids[svcIdx]);
+    xSemaphoreTake(btSvcLock, portMAX_DELAY);
+    if (!btServiceDiscoveryActive || gravity_mac_load(btSvcActive.bda) != gravity_mac_load(bda)) {
+        xSemaphoreGive(btSvcLock);
+        return false;
+    }
+    bt_svc_req_t req = btSvcActive;
+    btServiceDiscoveryActive = false;
+    bool requeued = false;
+    if (!success && req.attempts <= CONFIG_BT_SVC_DISC_RETRIES) {
+        req.notBefore = bt_svc_now_millis() + (BT_SVC_BACKOFF_MILLIS << (req.attempts - 1));
+        requeued = bt_svc_push(&req);
+    }
+    xSemaphoreGive(btSvcLock);
+
+    if (success) {
+        ++btSvcCompleted;
+    } else if (requeued) {
+        ++btSvcRetries;
+    } else {
+        ++btSvcFailed;
+        char bda_str[MAC_STRLEN + 1];
+        bda2str(req.bda, bda_str, MAC_STRLEN + 1);
+        #ifdef CONFIG_FLIPPER
+            printf("No services from\n%s\n", bda_str);
+        #else
+            ESP_LOGW(BT_TAG, "Service discovery for %s failed after %u attempts", bda_str, req.attempts);
+        #endif
+    }
+    return true;
+}
+
+/* Fires when the request in progress has timed out, or when a request that
+   was backing off becomes eligible */
+static void bt_svc_timer_cb(void *arg) {
+    bool timedOut = false;
+    esp_bd_addr_t bda;
+    xSemaphoreTake(btSvcLock, portMAX_DELAY);
+    if (btServiceDiscoveryActive) {
+        memcpy(bda, btSvcActive.bda, ESP_BD_ADDR_LEN);
+        timedOut = true;
+    }
+    xSemaphoreGive(btSvcLock);
+    if (timedOut && bt_svc_conclude(bda, false)) {
+        ++btSvcTimeouts;
+        state = APP_GAP_STATE_SERVICE_DISCOVER_COMPLETE;
+    }
+    bt_svc_dispatch();
 }
 
 esp_err_t listUnknownServicesDev(app_gap_cb_t *device) {
@@ -966,7 +1406,7 @@ esp_err_t listUnknownServicesDev(app_gap_cb_t *device) {
            are ordered in the same way
         */
         if (!(device->bt_services.known_services_len > knownCount && device->bt_services.service_uuids[i].len == ESP_UUID_LEN_16 &&
-                device->bt_services.known_services[knownCount]->uuid16 == device->bt_services.service_uuids[i].uuid.uuid16)) {
+                device->bt_services.known_services[knownCount] == device->bt_services.service_uuids[i].uuid.uuid16)) {
             /* Check UUID length */
             if (device->bt_services.service_uuids[i].len == ESP_UUID_LEN_128) {
                 /* Display 16 bytes */
@@ -1015,9 +1455,9 @@ esp_err_t listUnknownServices() {
     return err;
 }
 
-esp_err_t listKnownServices(app_gap_cb_t **devices, uint8_t devCount) {
+esp_err_t listKnownServices(app_gap_cb_t **devices, uint16_t devCount) {
     esp_err_t err = ESP_OK;
-    for (uint8_t i = 0; i < devCount; ++i) {
+    for (uint16_t i = 0; i < devCount; ++i) {
         err |= listKnownServicesDev(devices[i]);
         printf("\n");
     }
@@ -1028,7 +1468,7 @@ esp_err_t bt_listAllServices() {
     return bt_listAllServicesFor(gravity_bt_devices, gravity_bt_dev_count);
 }
 
-esp_err_t bt_listAllServicesFor(app_gap_cb_t **devices, uint8_t devCount) {
+esp_err_t bt_listAllServicesFor(app_gap_cb_t **devices, uint16_t devCount) {
     esp_err_t err = ESP_OK;
     for (int i = 0; i < devCount; ++i) {
         err |= bt_listAllServicesDev(devices[i]);
@@ -1055,15 +1495,15 @@ esp_err_t bt_listAllServicesDev(app_gap_cb_t *thisDev) {
        current element has a matching UUID
     */
     for (uint8_t i = 0; i < thisDev->bt_services.num_services; ++i) {
-        if (knownIdx < thisDev->bt_services.known_services_len && thisDev->bt_services.service_uuids[i].len == ESP_UUID_LEN_16 && thisDev->bt_services.known_services[knownIdx]->uuid16 == thisDev->bt_services.service_uuids[i].uuid.uuid16) {
+        if (knownIdx < thisDev->bt_services.known_services_len && thisDev->bt_services.service_uuids[i].len == ESP_UUID_LEN_16 && thisDev->bt_services.known_services[knownIdx] == thisDev->bt_services.service_uuids[i].uuid.uuid16) {
             /* There's a valid known service to display, current service is 16-bit,
                and the next known service (ordering will always be consistent) has
                the same UUID as the current service
             */
             #ifdef CONFIG_FLIPPER
-                printf("0x%04x:\n%s\n", thisDev->bt_services.known_services[knownIdx]->uuid16, thisDev->bt_services.known_services[knownIdx]->name);
+                printf("0x%04x:\n%s\n", thisDev->bt_services.known_services[knownIdx], gravity_sig_service_name(thisDev->bt_services.known_services[knownIdx]));
             #else
-                ESP_LOGI(BT_TAG, "ESP_UUID_LEN_16: 0x%04x, Service: %s", thisDev->bt_services.known_services[knownIdx]->uuid16, thisDev->bt_services.known_services[knownIdx]->name);
+                ESP_LOGI(BT_TAG, "ESP_UUID_LEN_16: 0x%04x, Service: %s", thisDev->bt_services.known_services[knownIdx], gravity_sig_service_name(thisDev->bt_services.known_services[knownIdx]));
             #endif
             ++knownIdx;
         } else {
@@ -1100,6 +1540,7 @@ esp_err_t bt_listAllServicesDev(app_gap_cb_t *thisDev) {
             }
         }
     }
+    err |= gravity_gatt_list_services(thisDev);
     return err;
 }
 
@@ -1116,9 +1557,9 @@ esp_err_t listKnownServicesDev(app_gap_cb_t *thisDev) {
     /* Display each service */
     for (int i = 0; i < thisDev->bt_services.known_services_len; ++i) {
         #ifdef CONFIG_FLIPPER
-            printf("0x%04x\n%s\n", thisDev->bt_services.known_services[i]->uuid16, thisDev->bt_services.known_services[i]->name);
+            printf("0x%04x\n%s\n", thisDev->bt_services.known_services[i], gravity_sig_service_name(thisDev->bt_services.known_services[i]));
         #else
-            ESP_LOGI(BT_TAG, "0x%04x :  %s", thisDev->bt_services.known_services[i]->uuid16, thisDev->bt_services.known_services[i]->name);
+            ESP_LOGI(BT_TAG, "0x%04x :  %s", thisDev->bt_services.known_services[i], gravity_sig_service_name(thisDev->bt_services.known_services[i]));
         #endif
     }
     return err;
@@ -1137,12 +1578,12 @@ esp_err_t identifyKnownServices(app_gap_cb_t *thisDev) {
 
     /* First, count the number of services that are known */
     uint8_t knownCount = 0;
-    bt_uuid *thisSvc = NULL;
+    const char *thisSvc = NULL;
     for (int i = 0; i < bt_services->num_services; ++i) {
         if (bt_services->service_uuids[i].len == ESP_UUID_LEN_16) {
             /* Only 16-bit UUIDs are known */
             // TODO: What about 32?
-            thisSvc = svcForUUID(bt_services->service_uuids[i].uuid.uuid16);
+            thisSvc = gravity_sig_service_name(bt_services->service_uuids[i].uuid.uuid16);
             if (thisSvc != NULL) {
                 ++knownCount;
             }
@@ -1159,7 +1600,7 @@ esp_err_t identifyKnownServices(app_gap_cb_t *thisDev) {
     /* Begin preparing known service attributes */
     bt_services->known_services_len = knownCount;
     if (knownCount > 0) {
-        bt_services->known_services = malloc(sizeof(bt_uuid *) * knownCount);
+        bt_services->known_services = gravity_mem_alloc(GRAVITY_MEM_COLD, sizeof(uint16_t) * knownCount);
         if (bt_services->known_services == NULL) {
             #ifdef CONFIG_FLIPPER
                 printf("%s\n", STRINGS_MALLOC_FAIL);
@@ -1174,18 +1615,18 @@ esp_err_t identifyKnownServices(app_gap_cb_t *thisDev) {
     uint8_t curSvc = 0;
     for (int i = 0; i < bt_services->num_services; ++i) {
         if (bt_services->service_uuids[i].len == ESP_UUID_LEN_16) {
-            thisSvc = svcForUUID(bt_services->service_uuids[i].uuid.uuid16);
+            thisSvc = gravity_sig_service_name(bt_services->service_uuids[i].uuid.uuid16);
             if (thisSvc != NULL) {
                 /* Notify user of discovered service */
                 #ifdef CONFIG_DEBUG
                     #ifdef CONFIG_FLIPPER
-                        printf("0x%04x: %s\n", thisSvc->uuid16, thisSvc->name);
+                        printf("0x%04x: %s\n", bt_services->service_uuids[i].uuid.uuid16, thisSvc);
                     #else
-                        ESP_LOGI(BT_TAG, "UUID 0x%04x: %s", thisSvc->uuid16, thisSvc->name);
+                        ESP_LOGI(BT_TAG, "UUID 0x%04x: %s", bt_services->service_uuids[i].uuid.uuid16, thisSvc);
                     #endif
                 #endif
                 /* Add thisSvc to known_uuids */
-                bt_services->known_services[curSvc++] = thisSvc;
+                bt_services->known_services[curSvc++] = bt_services->service_uuids[i].uuid.uuid16;
             }
         }
     }
@@ -1193,16 +1634,495 @@ esp_err_t identifyKnownServices(app_gap_cb_t *thisDev) {
     return err;
 }
 
+/* Place dev in the first free slot of its probe sequence */
+static void bt_index_put(app_gap_cb_t *dev) {
+    uint32_t mask = btDeviceIndexSize - 1;
+    uint32_t slot = gravity_mac_hash(dev->bdaKey) & mask;
+    while (btDeviceIndex[slot] != NULL) {
+        slot = (slot + 1) & mask;
+    }
+    btDeviceIndex[slot] = dev;
+}
+
+/* Regenerate btDeviceIndex from gravity_bt_devices, resizing it to suit the
+   current number of devices. Must be called whenever elements are removed
+   from gravity_bt_devices */
+static esp_err_t bt_index_rebuild() {
+    if (btDeviceIndex != NULL) {
+        free(btDeviceIndex);
+        btDeviceIndex = NULL;
+    }
+    btDeviceIndexSize = 0;
+    if (gravity_bt_dev_count == 0) {
+        return ESP_OK;
+    }
+    uint32_t newSize = 16;
+    while (newSize < gravity_bt_dev_count * 2) {
+        newSize <<= 1;
+    }
+    btDeviceIndex = gravity_mem_alloc(GRAVITY_MEM_HOT, sizeof(app_gap_cb_t *) * newSize);
+    if (btDeviceIndex != NULL) {
+        memset(btDeviceIndex, 0, sizeof(app_gap_cb_t *) * newSize);
+    } else {
+        #ifdef CONFIG_DEBUG
+            #ifdef CONFIG_FLIPPER
+                printf("%sfor BT index, using linear search.\n", STRINGS_MALLOC_FAIL);
+            #else
+                ESP_LOGW(BT_TAG, "%sfor the Bluetooth device index (%lu slots). Falling back to linear search.", STRINGS_MALLOC_FAIL, newSize);
+            #endif
+        #endif
+        return ESP_ERR_NO_MEM;
+    }
+    btDeviceIndexSize = newSize;
+    for (int i = 0; i < gravity_bt_dev_count; ++i) {
+        if (gravity_bt_devices[i] != NULL) {
+            bt_index_put(gravity_bt_devices[i]);
+        }
+    }
+    return ESP_OK;
+}
+
+/* Add dev, which has just been appended to gravity_bt_devices, to the index,
+   growing the index if it would become more than half full */
+static esp_err_t bt_index_add(app_gap_cb_t *dev) {
+    if (btDeviceIndex == NULL || gravity_bt_dev_count * 2 > btDeviceIndexSize) {
+        return bt_index_rebuild();
+    }
+    bt_index_put(dev);
+    return ESP_OK;
+}
+
+/* Find the device with the specified packed BDA, or NULL if it isn't known */
+static app_gap_cb_t *bt_dev_find(gravity_mac_t bdaKey) {
+    if (btDeviceIndex == NULL) {
+        int devIdx = 0;
+        for ( ; devIdx < gravity_bt_dev_count && gravity_bt_devices[devIdx]->bdaKey != bdaKey; ++devIdx) { }
+        return (devIdx < gravity_bt_dev_count) ? gravity_bt_devices[devIdx] : NULL;
+    }
+    uint32_t mask = btDeviceIndexSize - 1;
+    uint32_t slot = gravity_mac_hash(bdaKey) & mask;
+    while (btDeviceIndex[slot] != NULL) {
+        if (btDeviceIndex[slot]->bdaKey == bdaKey) {
+            return btDeviceIndex[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+    return NULL;
+}
+
+/* gravity_bt_devices is always ordered by index: devices are appended with
+   the next index, and removing devices preserves the order of the rest.
+   Find the device with the specified index, or NULL if there isn't one */
+static app_gap_cb_t *bt_dev_with_index(uint16_t index) {
+    int low = 0;
+    int high = gravity_bt_dev_count - 1;
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        if (gravity_bt_devices[mid]->index == index) {
+            return gravity_bt_devices[mid];
+        } else if (gravity_bt_devices[mid]->index < index) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return NULL;
+}
+
+/* Number devices consecutively from 1. Only needed when the next index would
+   overflow, after tens of thousands of devices have come and gone */
+static void bt_dev_renumber() {
+    for (uint16_t i = 0; i < gravity_bt_dev_count; ++i) {
+        gravity_bt_devices[i]->index = i + 1;
+    }
+}
+
 app_gap_cb_t *deviceWithBDA(esp_bd_addr_t bda) {
-    uint8_t devIdx = 0;
-    for ( ; devIdx < gravity_bt_dev_count && memcmp(bda, gravity_bt_devices[devIdx]->bda, 6); ++devIdx) { }
-    if (devIdx < gravity_bt_dev_count) {
-        return gravity_bt_devices[devIdx];
+    return bt_dev_find(gravity_mac_load(bda));
+}
+
+/* Allocate a chunk for one of the Bluetooth slabs. While adding a new device
+   this may purge BLE devices to make room; at other times existing devices
+   are being updated and must not be purged out from under the caller */
+static void *bt_chunk_alloc(size_t alignment, size_t bytes) {
+    if (btAllocMayPurge) {
+        return gravity_ble_purge_and_alloc(GRAVITY_MEM_HOT, alignment, bytes);
+    }
+    return gravity_mem_alloc_aligned(GRAVITY_MEM_HOT, alignment, bytes);
+}
+
+static void *bt_cold_chunk_alloc(size_t alignment, size_t bytes) {
+    if (btAllocMayPurge) {
+        return gravity_ble_purge_and_alloc(GRAVITY_MEM_COLD, alignment, bytes);
+    }
+    return gravity_mem_alloc_aligned(GRAVITY_MEM_COLD, alignment, bytes);
+}
+
+/* Size class for a name or EIR buffer of len bytes, or NULL if it's too large */
+static GravitySlab *bt_buf_slab(uint16_t len) {
+    for (int i = 0; i < BT_BUF_CLASS_COUNT; ++i) {
+        if (len <= btBufSlabs[i].blockSize) {
+            return &btBufSlabs[i];
+        }
+    }
+    return NULL;
+}
+
+/* Make *buf, which is NULL or a buffer for oldLen bytes, large enough for
+   newLen bytes. The existing buffer is kept if newLen is in the same size
+   class, so the frequent case of a device re-advertising similar data
+   doesn't touch the allocator. If newLen is 0 or allocation fails *buf is NULL.
+   The contents of the buffer are not preserved */
+static esp_err_t bt_buf_resize(void **buf, uint16_t oldLen, uint16_t newLen) {
+    GravitySlab *oldSlab = (*buf == NULL || oldLen == 0) ? NULL : bt_buf_slab(oldLen);
+    GravitySlab *newSlab = (newLen == 0) ? NULL : bt_buf_slab(newLen);
+    if (*buf != NULL && oldSlab == newSlab) {
+        return ESP_OK;
+    }
+    if (oldSlab != NULL) {
+        gravity_slab_free(oldSlab, *buf);
+    }
+    *buf = NULL;
+    if (newLen == 0) {
+        return ESP_OK;
+    }
+    if (newSlab == NULL) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    *buf = gravity_slab_alloc(newSlab);
+    ++btBufAllocs;
+    return (*buf == NULL) ? ESP_ERR_NO_MEM : ESP_OK;
+}
+
+/* Set dev's name to the first len characters of name */
+static esp_err_t bt_dev_set_name(app_gap_cb_t *dev, const char *name, uint8_t len) {
+    void *buf = (dev->bdname_len == 0) ? NULL : dev->bdName;
+    esp_err_t err = bt_buf_resize(&buf, (dev->bdname_len == 0) ? 0 : dev->bdname_len + 1,
+                                  (len == 0) ? 0 : len + 1);
+    if (err != ESP_OK || len == 0) {
+        dev->bdName = btNoName;
+        dev->bdname_len = 0;
+        return err;
+    }
+    dev->bdName = buf;
+    memcpy(dev->bdName, name, len);
+    dev->bdName[len] = '\0';
+    dev->bdname_len = len;
+    return ESP_OK;
+}
+
+/* FNV-1a digest of an advertisement, used to recognise repeats cheaply */
+static uint32_t bt_digest(const uint8_t *data, uint8_t len) {
+    uint32_t digest = 2166136261u;
+    for (int i = 0; i < len; ++i) {
+        digest = (digest ^ data[i]) * 16777619u;
+    }
+    return digest;
+}
+
+/* Has dev been seen on transport? */
+bool gravity_bt_dev_seen_on(app_gap_cb_t *dev, gravity_bt_scan_t transport) {
+    return (dev->transports & (1 << transport)) != 0;
+}
+
+/* Is dev's BDA a random BLE address? Only BLE devices can use one, and the
+   controller reports the address type with each advertisement */
+static bool bt_dev_random_addr(app_gap_cb_t *dev) {
+    return gravity_bt_dev_seen_on(dev, GRAVITY_BT_SCAN_BLE) &&
+           !gravity_bt_dev_seen_on(dev, GRAVITY_BT_SCAN_CLASSIC_DISCOVERY) &&
+           (dev->bleAddrType == BLE_ADDR_TYPE_RANDOM || dev->bleAddrType == BLE_ADDR_TYPE_RPA_RANDOM);
+}
+
+/* Vendor of dev, or NULL if it isn't known. Random addresses have no OUI */
+static const char *bt_dev_vendor(app_gap_cb_t *dev) {
+    return bt_dev_random_addr(dev) ? NULL : gravity_oui_vendor(dev->bdaKey);
+}
+
+/* Record that dev has just been seen on transport with the specified RSSI */
+static void bt_dev_seen(app_gap_cb_t *dev, gravity_bt_scan_t transport, int32_t rssi) {
+    clock_t now = clock();
+    dev->transports |= (1 << transport);
+    dev->transport[transport].rssi = rssi;
+    dev->transport[transport].lastSeen = now;
+    dev->rssi = rssi;
+    dev->lastSeen = now;
+}
+
+/* The advertising data or EIR that dev->adv describes. BLE advertisements
+   carry more of the fields that are summarised, so they're preferred */
+static uint8_t *bt_dev_adv_data(app_gap_cb_t *dev) {
+    if (dev->transport[GRAVITY_BT_SCAN_BLE].eir_len > 0) {
+        return dev->transport[GRAVITY_BT_SCAN_BLE].eir;
+    }
+    return dev->transport[GRAVITY_BT_SCAN_CLASSIC_DISCOVERY].eir;
+}
+
+/* Set the EIR or advertising data dev sent over transport to the len bytes at eir */
+static esp_err_t bt_dev_set_eir(app_gap_cb_t *dev, gravity_bt_scan_t transport, const uint8_t *eir, uint8_t len) {
+    grav_bt_transport *t = &dev->transport[transport];
+    void *buf = t->eir;
+    esp_err_t err = bt_buf_resize(&buf, t->eir_len, len);
+    t->eir = buf;
+    if (err != ESP_OK || len == 0) {
+        t->eir = NULL;
+        t->eir_len = 0;
+        t->eirDigest = 0;
     } else {
-        return NULL;
+        memcpy(t->eir, eir, len);
+        t->eir_len = len;
+        t->eirDigest = bt_digest(eir, len);
+    }
+    /* Summarise whichever payload is now preferred */
+    uint8_t *advData = bt_dev_adv_data(dev);
+    if (advData == NULL) {
+        memset(&dev->adv, 0, sizeof(GravityAdvSummary));
+    } else {
+        gravity_adv_summarise(advData, (advData == dev->transport[GRAVITY_BT_SCAN_BLE].eir) ?
+                              dev->transport[GRAVITY_BT_SCAN_BLE].eir_len :
+                              dev->transport[GRAVITY_BT_SCAN_CLASSIC_DISCOVERY].eir_len, &dev->adv);
+    }
+    return err;
+}
+
+/* Release dev and its buffers. The caller is responsible for removing it from
+   gravity_bt_devices and calling gravity_bt_shrink_devices() */
+static void bt_dev_free(app_gap_cb_t *dev) {
+    /* Don't leave a dangling pointer in gravity_selected_bt */
+    if (dev->selected) {
+        uint16_t selIdx = 0;
+        for ( ; selIdx < gravity_sel_bt_count && gravity_selected_bt[selIdx] != dev; ++selIdx) { }
+        if (selIdx < gravity_sel_bt_count) {
+            memmove(&gravity_selected_bt[selIdx], &gravity_selected_bt[selIdx + 1],
+                    sizeof(app_gap_cb_t *) * (gravity_sel_bt_count - selIdx - 1));
+            --gravity_sel_bt_count;
+        }
+    }
+    bt_service_rm_dev(dev);
+    bt_dev_set_name(dev, NULL, 0);
+    for (int i = 0; i < GRAVITY_BT_TRANSPORT_COUNT; ++i) {
+        bt_dev_set_eir(dev, i, NULL, 0);
+    }
+    gravity_slab_free(&btDeviceSlab, dev);
+}
+
+/* Forget what was seen of dev on transport. If dev hasn't been seen on any
+   other transport it is freed and true is returned; the caller is then
+   responsible for removing it from gravity_bt_devices and calling
+   gravity_bt_shrink_devices() */
+static bool bt_dev_drop_transport(app_gap_cb_t *dev, gravity_bt_scan_t transport) {
+    dev->transports &= ~(1 << transport);
+    if (dev->transports == 0) {
+        bt_dev_free(dev);
+        return true;
+    }
+    bt_dev_set_eir(dev, transport, NULL, 0);
+    dev->transport[transport].lastSeen = 0;
+    dev->transport[transport].rssi = 0;
+    /* The device's RSSI and age now come from the transport that remains */
+    for (int i = 0; i < GRAVITY_BT_TRANSPORT_COUNT; ++i) {
+        if (gravity_bt_dev_seen_on(dev, i)) {
+            dev->rssi = dev->transport[i].rssi;
+            dev->lastSeen = dev->transport[i].lastSeen;
+        }
+    }
+    return false;
+}
+
+/* Return unused slab chunks to the heap after devices have been removed */
+static void bt_pool_trim() {
+    gravity_slab_trim(&btDeviceSlab);
+    for (int i = 0; i < BT_BUF_CLASS_COUNT; ++i) {
+        gravity_slab_trim(&btBufSlabs[i]);
     }
 }
 
+/* Number of bytes of heap used to store Bluetooth devices, including the
+   device array, its index and unused space in the slabs */
+static size_t bt_pool_bytes() {
+    size_t bytes = gravity_slab_bytes(&btDeviceSlab);
+    for (int i = 0; i < BT_BUF_CLASS_COUNT; ++i) {
+        bytes += gravity_slab_bytes(&btBufSlabs[i]);
+    }
+    bytes += btDeviceCapacity * sizeof(app_gap_cb_t *);
+    bytes += btDeviceIndexSize * sizeof(app_gap_cb_t *);
+    return bytes;
+}
+
+/* Number of bytes of the pool that are in use by devices. This is what the
+   memory budget limits; free slab blocks are reused before the heap grows */
+static size_t bt_pool_used() {
+    size_t bytes = btDeviceSlab.inUse * btDeviceSlab.blockSize;
+    for (int i = 0; i < BT_BUF_CLASS_COUNT; ++i) {
+        bytes += btBufSlabs[i].inUse * btBufSlabs[i].blockSize;
+    }
+    bytes += btDeviceCapacity * sizeof(app_gap_cb_t *);
+    bytes += btDeviceIndexSize * sizeof(app_gap_cb_t *);
+    return bytes;
+}
+
+/* Bytes a name or EIR buffer of len bytes occupies */
+static size_t bt_buf_bytes(uint16_t len) {
+    GravitySlab *slab = (len == 0) ? NULL : bt_buf_slab(len);
+    return (slab == NULL) ? 0 : slab->blockSize;
+}
+
+/* Bytes a device occupies, including its name and EIR buffers */
+static size_t bt_dev_bytes(app_gap_cb_t *dev) {
+    size_t bytes = btDeviceSlab.blockSize + bt_buf_bytes((dev->bdname_len == 0) ? 0 : dev->bdname_len + 1);
+    for (int i = 0; i < GRAVITY_BT_TRANSPORT_COUNT; ++i) {
+        bytes += bt_buf_bytes(dev->transport[i].eir_len);
+    }
+    return bytes;
+}
+
+/* Could dev be evicted under the active purge strategies? Only what was seen
+   by BLE scanning is purged automatically - a dual-mode device keeps its
+   record and Classic results - and selected devices are never evicted because
+   gravity_selected_bt refers to them */
+static bool bt_evict_eligible(app_gap_cb_t *dev, clock_t now) {
+    if (!gravity_bt_dev_seen_on(dev, GRAVITY_BT_SCAN_BLE) || dev->selected) {
+        return false;
+    }
+    grav_bt_transport *ble = &dev->transport[GRAVITY_BT_SCAN_BLE];
+    if ((purgeStrategy & GRAVITY_BLE_PURGE_RSSI) == GRAVITY_BLE_PURGE_RSSI && ble->rssi <= PURGE_MAX_RSSI) {
+        return true;
+    }
+    if ((purgeStrategy & GRAVITY_BLE_PURGE_AGE) == GRAVITY_BLE_PURGE_AGE &&
+            (now - ble->lastSeen) / CLOCKS_PER_SEC >= PURGE_MIN_AGE) {
+        return true;
+    }
+    if ((purgeStrategy & GRAVITY_BLE_PURGE_UNNAMED) == GRAVITY_BLE_PURGE_UNNAMED && dev->bdname_len == 0) {
+        return true;
+    }
+    return (purgeStrategy & GRAVITY_BLE_PURGE_UNSELECTED) == GRAVITY_BLE_PURGE_UNSELECTED;
+}
+
+/* Should one be evicted before two? Strategies are applied in the same order
+   as gravity_ble_purge_and_malloc(): weakest RSSI, then oldest, then unnamed */
+static bool bt_evict_before(app_gap_cb_t *one, app_gap_cb_t *two) {
+    grav_bt_transport *bleOne = &one->transport[GRAVITY_BT_SCAN_BLE];
+    grav_bt_transport *bleTwo = &two->transport[GRAVITY_BT_SCAN_BLE];
+    if ((purgeStrategy & GRAVITY_BLE_PURGE_RSSI) == GRAVITY_BLE_PURGE_RSSI && bleOne->rssi != bleTwo->rssi) {
+        return bleOne->rssi < bleTwo->rssi;
+    }
+    if ((purgeStrategy & GRAVITY_BLE_PURGE_AGE) == GRAVITY_BLE_PURGE_AGE && bleOne->lastSeen != bleTwo->lastSeen) {
+        return bleOne->lastSeen < bleTwo->lastSeen;
+    }
+    if ((purgeStrategy & GRAVITY_BLE_PURGE_UNNAMED) == GRAVITY_BLE_PURGE_UNNAMED &&
+            (one->bdname_len == 0) != (two->bdname_len == 0)) {
+        return one->bdname_len == 0;
+    }
+    return bleOne->lastSeen < bleTwo->lastSeen;
+}
+
+/* Restore the min-heap property below element i. The heap holds indices into
+   gravity_bt_devices so evicted devices can be removed from the array */
+static void bt_evict_sift_down(uint16_t *heap, uint16_t count, uint16_t i) {
+    while (true) {
+        uint16_t smallest = i;
+        uint16_t left = 2 * i + 1;
+        uint16_t right = left + 1;
+        if (left < count && bt_evict_before(gravity_bt_devices[heap[left]], gravity_bt_devices[heap[smallest]])) {
+            smallest = left;
+        }
+        if (right < count && bt_evict_before(gravity_bt_devices[heap[right]], gravity_bt_devices[heap[smallest]])) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            return;
+        }
+        uint16_t tmp = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+/* Make room within the BLE memory budget for a further `needed` bytes,
+   evicting BLE devices if necessary.
+   Returns ESP_ERR_NO_MEM if the budget can't accommodate the new bytes, in
+   which case the caller should not allocate them */
+static esp_err_t bt_budget_reserve(size_t needed) {
+    if (PURGE_MEMORY_BUDGET == 0) {
+        return ESP_OK;
+    }
+    size_t budget = (size_t)PURGE_MEMORY_BUDGET * 1024;
+    size_t used = bt_pool_used();
+    if (used + needed <= budget) {
+        return ESP_OK;
+    }
+
+    /* Build a heap of eviction candidates */
+    uint16_t *heap = NULL;
+    uint16_t heapCount = 0;
+    if (gravity_bt_dev_count > 0 && (purgeStrategy & GRAVITY_BLE_PURGE_NONE) != GRAVITY_BLE_PURGE_NONE) {
+        heap = malloc(sizeof(uint16_t) * gravity_bt_dev_count);
+    }
+    if (heap != NULL) {
+        clock_t now = clock();
+        for (uint16_t i = 0; i < gravity_bt_dev_count; ++i) {
+            if (bt_evict_eligible(gravity_bt_devices[i], now)) {
+                heap[heapCount++] = i;
+            }
+        }
+        for (int i = heapCount / 2 - 1; i >= 0; --i) {
+            bt_evict_sift_down(heap, heapCount, i);
+        }
+    }
+
+    /* Evict down to the low-water mark, so this doesn't run again for the
+       next few devices */
+    size_t target = budget * BT_BUDGET_LOW_WATER / 100;
+    target = (target > needed) ? target - needed : 0;
+    uint16_t evicted = 0;
+    while (used > target && heapCount > 0) {
+        uint16_t victim = heap[0];
+        heap[0] = heap[--heapCount];
+        bt_evict_sift_down(heap, heapCount, 0);
+
+        app_gap_cb_t *dev = gravity_bt_devices[victim];
+        size_t devBytes = bt_dev_bytes(dev);
+        if (bt_dev_drop_transport(dev, GRAVITY_BT_SCAN_BLE)) {
+            gravity_bt_devices[victim] = NULL;
+        } else {
+            /* A dual-mode device only gives up its advertisement */
+            devBytes -= bt_dev_bytes(dev);
+        }
+        used = (used > devBytes) ? used - devBytes : 0;
+        ++evicted;
+    }
+    if (heap != NULL) {
+        free(heap);
+    }
+    if (evicted > 0) {
+        btBudgetEvictions += evicted;
+        gravity_bt_shrink_devices();
+        #ifdef CONFIG_DEBUG
+            #ifdef CONFIG_FLIPPER
+                printf("BLE budget: purged %u\n", evicted);
+            #else
+                ESP_LOGI(BT_TAG, "Purged %u BLE devices to stay within the %u KB memory budget.", evicted, PURGE_MEMORY_BUDGET);
+            #endif
+        #endif
+    }
+
+    if (bt_pool_used() + needed > budget) {
+        ++btBudgetRejections;
+        if (!btBudgetFullReported) {
+            btBudgetFullReported = true;
+            #ifdef CONFIG_FLIPPER
+                printf("BLE budget %uKB full\nIgnoring new devices\n", PURGE_MEMORY_BUDGET);
+            #else
+                ESP_LOGW(BT_TAG, "The %u KB BLE memory budget is full and no devices can be purged; new BLE devices will be ignored. Set BLE_PURGE_STRAT or raise BLE_MEMORY_BUDGET.",
+                         PURGE_MEMORY_BUDGET);
+            #endif
+        }
+        return ESP_ERR_NO_MEM;
+    }
+    btBudgetFullReported = false;
+    return ESP_OK;
+}
+
 /* This function is called by the Bluetooth callback function when a remote service event is received
    This function maintains the bt_services element of the bluetooth device data model.
    In order to do this, the function:
@@ -1231,21 +2151,25 @@ static void bt_remote_service_cb(esp_bt_gap_cb_param_t *param) {
     state = APP_GAP_STATE_SERVICE_DISCOVER_COMPLETE;
     if (param->rmt_srvcs.stat == ESP_BT_STATUS_SUCCESS) {
         if (thisDev != NULL) {
+            /* Replace any results from an earlier discovery */
+            bt_service_rm_dev(thisDev);
             thisDev->bt_services.lastSeen = clock();
             thisDev->bt_services.num_services = param->rmt_srvcs.num_uuids;
             /* Allocate space for UUID array */
-            thisDev->bt_services.service_uuids = malloc(sizeof(esp_bt_uuid_t) * param->rmt_srvcs.num_uuids);
+            thisDev->bt_services.service_uuids = gravity_mem_alloc(GRAVITY_MEM_COLD, sizeof(esp_bt_uuid_t) * param->rmt_srvcs.num_uuids);
             if (thisDev->bt_services.service_uuids == NULL) {
                 #ifdef CONFIG_FLIPPER
                     printf("%s\n", STRINGS_MALLOC_FAIL);
                 #else
                     ESP_LOGE(BT_TAG, "%s", STRINGS_MALLOC_FAIL);
                 #endif
+                thisDev->bt_services.num_services = 0;
+            } else {
+                /* Copy UUIDs from discovery results to thisDev */
+                memcpy(thisDev->bt_services.service_uuids, param->rmt_srvcs.uuid_list, sizeof(esp_bt_uuid_t) * param->rmt_srvcs.num_uuids);
+                /* Parse the UUIDs and collate known_uuids */
+                identifyKnownServices(thisDev);
             }
-            /* Copy UUIDs from discovery results to thisDev */
-            memcpy(thisDev->bt_services.service_uuids, param->rmt_srvcs.uuid_list, sizeof(esp_bt_uuid_t) * param->rmt_srvcs.num_uuids);
-            /* Parse the UUIDs and collate known_uuids */
-            identifyKnownServices(thisDev);
         }
         #ifdef CONFIG_DEBUG_VERBOSE
             for (int i = 0; i < param->rmt_srvcs.num_uuids; ++i) {
@@ -1273,38 +2197,23 @@ static void bt_remote_service_cb(esp_bt_gap_cb_param_t *param) {
             }
         #endif
     }
-    #ifdef CONFIG_DEBUG_VERBOSE
-        printf("remote service callback - Outputs done, checking queue (len %u, addr %p)\n",
-                gravity_svc_disc_count, gravity_svc_disc_q);
-    #endif
     /* Service discovery complete - Is there a queue to take the next one from? */
-    if (gravity_svc_disc_count == 0) {
-        /* No queue - Finish service discovery */
-        #ifdef CONFIG_DEBUG
+    if (bt_svc_conclude(param->rmt_srvcs.bda, param->rmt_srvcs.stat == ESP_BT_STATUS_SUCCESS)) {
+        esp_timer_stop(btSvcTimer);
+        #ifdef CONFIG_DEBUG_VERBOSE
+            printf("remote service callback - Outputs done, %u requests queued\n", btSvcCount);
+        #endif
+        bt_svc_dispatch();
+    }
+    #ifdef CONFIG_DEBUG
+        if (!btServiceDiscoveryActive && btSvcCount == 0) {
             #ifdef CONFIG_FLIPPER
                 printf("Service Discovery:\n\tNo devices left in queue.\n");
             #else
                 ESP_LOGI(BT_TAG, "Service Discovery: No devices left in scan queue, finishing.");
             #endif
-        #endif
-        btServiceDiscoveryActive = false;
-    } else {
-        app_gap_cb_t *thisDev = gravity_svc_disc_queue_pop();
-        #ifdef CONFIG_DEBUG_VERBOSE
-            char bda_str[MAC_STRLEN + 1] = "";
-            if (thisDev != NULL) {
-                bda2str(thisDev->bda, bda_str, MAC_STRLEN + 1);
-            }
-            #ifdef CONFIG_FLIPPER
-                printf("Service Discovery:\n\tPopped %s from the queue.\n", (thisDev==NULL)?"NULL":bda_str);
-            #else
-                ESP_LOGI(BT_TAG, "Service Discovery: Popped %s from the queue.", (thisDev == NULL)?"NULL":bda_str);
-            #endif
-        #endif
-        if (thisDev != NULL) {
-            esp_bt_gap_get_remote_services(thisDev->bda);
         }
-    }
+    #endif
 }
 
 static void bt_gap_cb(esp_bt_gap_cb_event_t event, esp_bt_gap_cb_param_t *param) {
@@ -1314,12 +2223,14 @@ static void bt_gap_cb(esp_bt_gap_cb_event_t event, esp_bt_gap_cb_param_t *param)
             break;
         case ESP_BT_GAP_DISC_STATE_CHANGED_EVT:
             if (param->disc_st_chg.state == ESP_BT_GAP_DISCOVERY_STOPPED) {
+                gravity_coex_record_airtime(GRAVITY_COEX_BT_CLASSIC, false);
                 /* Display status & restart Discovery */
-                if (attack_status[ATTACK_SCAN_BT_DISCOVERY]) {
+                if (attack_status[ATTACK_SCAN_BT_DISCOVERY] && gravity_coex_radio_active(GRAVITY_COEX_BT_CLASSIC)) {
                     state = APP_GAP_STATE_DEVICE_DISCOVERING;
                     esp_bt_gap_start_discovery(ESP_BT_INQ_MODE_GENERAL_INQUIRY, CONFIG_BT_SCAN_DURATION, 0);
                 }
             } else if (param->disc_st_chg.state == ESP_BT_GAP_DISCOVERY_STARTED) {
+                gravity_coex_record_airtime(GRAVITY_COEX_BT_CLASSIC, true);
                 gravity_bt_scan_display_status();
             }
             break;
@@ -1376,6 +2287,11 @@ esp_err_t gravity_bt_initialise() {
     err |= esp_bluedroid_init();
     err |= esp_bluedroid_enable();
 
+    /* Size the budget now that the Bluetooth stack has taken its share of memory */
+    if (PURGE_MEMORY_BUDGET_AUTO) {
+        PURGE_MEMORY_BUDGET = gravity_mem_auto_budget();
+    }
+
     btInitialised = true;
     return err;
 }
@@ -1395,8 +2311,11 @@ esp_err_t bt_dev_add_components(esp_bd_addr_t bda, char *bdName, uint8_t bdNameL
     esp_err_t err2 = ESP_OK;
     UNUSED(err2);
 
+    if (devScanType >= GRAVITY_BT_TRANSPORT_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
     /* Make sure the specified BDA doesn't already exist */
-    if (isBDAInArray(bda, gravity_bt_devices, gravity_bt_dev_count)) {
+    if (bt_dev_find(gravity_mac_load(bda)) != NULL) {
         char bdaStr[MAC_STRLEN + 1] = "";
         #ifdef CONFIG_FLIPPER
             printf("Unable to add existing BT Dev:\n%25s\n", bda2str(bda, bdaStr, MAC_STRLEN + 1));
@@ -1405,93 +2324,109 @@ esp_err_t bt_dev_add_components(esp_bd_addr_t bda, char *bdName, uint8_t bdNameL
         #endif
         return ESP_ERR_NOT_SUPPORTED;
     }
-
-    /* Set up a replacement copy of gravity_bt_devices */
-    app_gap_cb_t **newDevices = gravity_ble_purge_and_malloc(sizeof(app_gap_cb_t *) * (gravity_bt_dev_count + 1));
-    if (newDevices == NULL) {
+    if (gravity_bt_dev_count == GRAVITY_BT_MAX_DEVICES) {
         #ifdef CONFIG_FLIPPER
-            printf("%sto add BT device\n", STRINGS_MALLOC_FAIL);
+            printf("BT device table full\n");
         #else
-            ESP_LOGE(BT_TAG, "%sfor Bluetooth Device #%d.", STRINGS_MALLOC_FAIL, (gravity_bt_dev_count + 1));
+            ESP_LOGE(BT_TAG, "Unable to add Bluetooth device: Gravity already has the maximum of %u devices.", GRAVITY_BT_MAX_DEVICES);
         #endif
         return ESP_ERR_NO_MEM;
     }
-    /* Copy contents from gravity_bt_devices to newDevices */
-    /* This was previously a loop iterating through and calling an additional function to
-       copy the struct. Luckily I stuffed up and corrupted nearby memory so I had to use my
-       brain and come up with a simple solution - Copy the memory contents of the first array
-       to the second.
-    */
-    /* Calculate max index while we're looping */
-    uint8_t maxIndex = 0;
-    for (int i=0;i<gravity_bt_dev_count;++i) {
-        newDevices[i] = gravity_bt_devices[i];
-        if (gravity_bt_devices[i]->index > maxIndex) {
-            maxIndex = gravity_bt_devices[i]->index;
+
+    /* Keep within the BLE memory budget, purging devices ahead of time rather
+       than waiting for an allocation to fail */
+    size_t needed = btDeviceSlab.blockSize + bt_buf_bytes((bdNameLen == 0) ? 0 : bdNameLen + 1) + bt_buf_bytes(eirLen);
+    if (gravity_bt_dev_count >= btDeviceCapacity) {
+        needed += ((btDeviceCapacity == 0) ? 16 : btDeviceCapacity) * sizeof(app_gap_cb_t *);
+    }
+    if (bt_budget_reserve(needed) != ESP_OK) {
+        /* The budget is full of devices that can't be purged - Ignore this one */
+        return ESP_ERR_NO_MEM;
+    }
+
+    /* Grow gravity_bt_devices if it's full. This may purge BLE devices, so
+       copy the device pointers only once the allocation has succeeded */
+    if (gravity_bt_dev_count >= btDeviceCapacity) {
+        uint32_t newCapacity = (btDeviceCapacity == 0) ? 16 : btDeviceCapacity * 2;
+        app_gap_cb_t **newDevices = gravity_ble_purge_and_malloc(sizeof(app_gap_cb_t *) * newCapacity);
+        if (newDevices == NULL) {
+            #ifdef CONFIG_FLIPPER
+                printf("%sto add BT device\n", STRINGS_MALLOC_FAIL);
+            #else
+                ESP_LOGE(BT_TAG, "%sfor Bluetooth Device #%d.", STRINGS_MALLOC_FAIL, (gravity_bt_dev_count + 1));
+            #endif
+            return ESP_ERR_NO_MEM;
+        }
+        if (gravity_bt_devices != NULL) {
+            memcpy(newDevices, gravity_bt_devices, sizeof(app_gap_cb_t *) * gravity_bt_dev_count);
+            free(gravity_bt_devices);
         }
+        gravity_bt_devices = newDevices;
+        btDeviceCapacity = newCapacity;
     }
-    /* Create new device at index gravity_bt_dev_count */
-    newDevices[gravity_bt_dev_count] = gravity_ble_purge_and_malloc(sizeof(app_gap_cb_t));
-    if (newDevices[gravity_bt_dev_count] == NULL) {
+
+    /* Create the new device. The new device isn't in gravity_bt_devices yet,
+       so it's safe for its allocations to purge other devices */
+    btAllocMayPurge = true;
+    app_gap_cb_t *newDev = gravity_slab_alloc(&btDeviceSlab);
+    if (newDev == NULL) {
+        btAllocMayPurge = false;
         #ifdef CONFIG_FLIPPER
             printf("%sfor BT device %d.\n", STRINGS_MALLOC_FAIL, gravity_bt_dev_count + 1);
         #else
             ESP_LOGE(BT_TAG, "%s(%d) for BT device #%d.", STRINGS_MALLOC_FAIL, sizeof(app_gap_cb_t), gravity_bt_dev_count + 1);
         #endif
-        free(newDevices);
         return ESP_ERR_NO_MEM;
     }
-    newDevices[gravity_bt_dev_count]->bt_services.known_services = NULL;
-    newDevices[gravity_bt_dev_count]->bt_services.known_services_len = 0;
-    newDevices[gravity_bt_dev_count]->bt_services.num_services = 0;
-    newDevices[gravity_bt_dev_count]->bt_services.service_uuids = NULL;
-    newDevices[gravity_bt_dev_count]->bt_services.lastSeen = 0;
-    newDevices[gravity_bt_dev_count]->bdname_len = bdNameLen;
-    newDevices[gravity_bt_dev_count]->eir_len = eirLen;
-    newDevices[gravity_bt_dev_count]->eir = NULL;
-    newDevices[gravity_bt_dev_count]->rssi = rssi;
-    newDevices[gravity_bt_dev_count]->cod = cod;
-    newDevices[gravity_bt_dev_count]->scanType = devScanType;
-    newDevices[gravity_bt_dev_count]->lastSeen = clock();
-    newDevices[gravity_bt_dev_count]->selected = false;
-    newDevices[gravity_bt_dev_count]->index = maxIndex + 1;
-    memcpy(newDevices[gravity_bt_dev_count]->bda, bda, ESP_BD_ADDR_LEN);
-    newDevices[gravity_bt_dev_count]->bdName = gravity_ble_purge_and_malloc(sizeof(char) * (bdNameLen + 1));
-    if (newDevices[gravity_bt_dev_count]->bdName == NULL) {
+    newDev->bt_services.known_services = NULL;
+    newDev->bt_services.known_services_len = 0;
+    newDev->bt_services.num_services = 0;
+    newDev->bt_services.service_uuids = NULL;
+    newDev->bt_services.lastSeen = 0;
+    newDev->bt_services.gatt = NULL;
+    newDev->bleAddrType = 0;
+    newDev->bdname_len = 0;
+    newDev->bdName = btNoName;
+    memset(newDev->transport, 0, sizeof(newDev->transport));
+    memset(&newDev->adv, 0, sizeof(GravityAdvSummary));
+    newDev->transports = 0;
+    newDev->cod = cod;
+    bt_dev_seen(newDev, devScanType, rssi);
+    newDev->selected = false;
+    memcpy(newDev->bda, bda, ESP_BD_ADDR_LEN);
+    newDev->bdaKey = gravity_mac_load(bda);
+    if (bt_dev_set_name(newDev, bdName, bdNameLen) != ESP_OK) {
+        btAllocMayPurge = false;
         #ifdef CONFIG_FLIPPER
             printf("%sfor BDName (len %u).\n", STRINGS_MALLOC_FAIL, bdNameLen);
         #else
             ESP_LOGE(BT_TAG, "%sfor Bluetooth Device Name (length %u).", STRINGS_MALLOC_FAIL, bdNameLen);
         #endif
-        free(newDevices);
+        bt_dev_free(newDev);
         return ESP_ERR_NO_MEM;
     }
-    strncpy(newDevices[gravity_bt_dev_count]->bdName, bdName, bdNameLen);
-    newDevices[gravity_bt_dev_count]->bdName[bdNameLen] = '\0';
-    if (eirLen > 0) {
-        newDevices[gravity_bt_dev_count]->eir = gravity_ble_purge_and_malloc(sizeof(uint8_t) * eirLen);
-        if (newDevices[gravity_bt_dev_count]->eir == NULL) {
-            #ifdef CONFIG_FLIPPER
-                printf("%sfor EIR (len %u).\n", STRINGS_MALLOC_FAIL, eirLen);
-            #else
-                ESP_LOGE(BT_TAG, "%sfor EIR (length %u).", STRINGS_MALLOC_FAIL, eirLen);
-            #endif
-            if (newDevices[gravity_bt_dev_count]->bdName != NULL) {
-                free(newDevices[gravity_bt_dev_count]->bdName);
-            }
-            free(newDevices);
-            return ESP_ERR_NO_MEM;
-        }
-        memcpy(newDevices[gravity_bt_dev_count]->eir, eir, eirLen);
+    if (bt_dev_set_eir(newDev, devScanType, eir, eirLen) != ESP_OK) {
+        btAllocMayPurge = false;
+        #ifdef CONFIG_FLIPPER
+            printf("%sfor EIR (len %u).\n", STRINGS_MALLOC_FAIL, eirLen);
+        #else
+            ESP_LOGE(BT_TAG, "%sfor EIR (length %u).", STRINGS_MALLOC_FAIL, eirLen);
+        #endif
+        bt_dev_free(newDev);
+        return ESP_ERR_NO_MEM;
     }
+    btAllocMayPurge = false;
 
-    /* Finally copy new device array into place */
-    if (gravity_bt_devices != NULL) {
-        free(gravity_bt_devices);
+    /* Number the device after the last one; done last because purging may
+       have removed devices */
+    if (gravity_bt_dev_count > 0 && gravity_bt_devices[gravity_bt_dev_count - 1]->index == GRAVITY_BT_MAX_DEVICES) {
+        bt_dev_renumber();
     }
-    gravity_bt_devices = newDevices;
-    ++gravity_bt_dev_count;
+    newDev->index = (gravity_bt_dev_count == 0) ? 1 : gravity_bt_devices[gravity_bt_dev_count - 1]->index + 1;
 
+    /* Finally add the new device to the array */
+    gravity_bt_devices[gravity_bt_dev_count++] = newDev;
+    bt_index_add(newDev);
 
     #ifdef CONFIG_DEBUG_VERBOSE
         printf("End of bt_dev_add_components(), gravity_bt_devices has %u elements:\n", gravity_bt_dev_count);
@@ -1506,15 +2441,38 @@ esp_err_t bt_dev_add_components(esp_bd_addr_t bda, char *bdName, uint8_t bdNameL
     return err;
 }
 
+/* Add a copy of dev, including what was seen of it on each transport */
 esp_err_t bt_dev_add(app_gap_cb_t *dev) {
-    return bt_dev_add_components(dev->bda, dev->bdName, dev->bdname_len,
-            dev->eir, dev->eir_len, dev->cod, dev->rssi, dev->scanType);
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    app_gap_cb_t *newDev = NULL;
+    for (int i = 0; i < GRAVITY_BT_TRANSPORT_COUNT; ++i) {
+        if (!gravity_bt_dev_seen_on(dev, i)) {
+            continue;
+        }
+        grav_bt_transport *t = &dev->transport[i];
+        if (newDev == NULL) {
+            err = bt_dev_add_components(dev->bda, dev->bdName, dev->bdname_len,
+                    t->eir, t->eir_len, dev->cod, t->rssi, i);
+            newDev = (err == ESP_OK) ? bt_dev_find(dev->bdaKey) : NULL;
+            if (newDev == NULL) {
+                return err;
+            }
+        } else {
+            bt_dev_seen(newDev, i, t->rssi);
+            err = bt_dev_set_eir(newDev, i, t->eir, t->eir_len);
+        }
+    }
+    return err;
 }
 
 /* Is the specified bluetooth device address in the specified array, which has the specified length? */
-bool isBDAInArray(esp_bd_addr_t bda, app_gap_cb_t **array, uint8_t arrayLen) {
+bool isBDAInArray(esp_bd_addr_t bda, app_gap_cb_t **array, uint16_t arrayLen) {
     int i = 0;
-    for (; i < arrayLen && memcmp(bda, array[i]->bda, ESP_BD_ADDR_LEN); ++i) { }
+    gravity_mac_t bdaKey = gravity_mac_load(bda);
+    if (array == gravity_bt_devices && arrayLen == gravity_bt_dev_count) {
+        return bt_dev_find(bdaKey) != NULL;
+    }
+    for (; i < arrayLen && array[i]->bdaKey != bdaKey; ++i) { }
 
     /* If i < arrayLen then it was found */
     return (i < arrayLen);
@@ -1529,45 +2487,47 @@ esp_err_t bt_dev_copy(app_gap_cb_t dest, app_gap_cb_t source) {
     esp_err_t err = ESP_OK;
 
     /* Start with the pass-by-value elements */
-    dest.bdname_len = source.bdname_len;
-    dest.eir_len = source.eir_len;
     dest.rssi = source.rssi;
     dest.cod = source.cod;
+    dest.lastSeen = source.lastSeen;
+    dest.transports = source.transports;
 
     /* And now the refs */
     memcpy(dest.bda, source.bda, ESP_BD_ADDR_LEN);
-    /* EIR - free, malloc, copy */
-    if (dest.eir != NULL) {
-        free(dest.eir);
-    }
-    dest.eir = malloc(sizeof(uint8_t) * source.eir_len);
-    if (dest.eir == NULL) {
-        #ifdef CONFIG_FLIPPER
-            printf("%sfor EIR (len %u).\n", STRINGS_MALLOC_FAIL, source.eir_len);
-        #else
-            ESP_LOGE(BT_TAG, "%sfor EIR (length %u).", STRINGS_MALLOC_FAIL, source.eir_len);
-        #endif
-        return ESP_ERR_NO_MEM;
-    }
-    memcpy(dest.eir, source.eir, source.eir_len);
-    /* bdName - free, malloc, copy */
-    if (dest.bdName != NULL) {
-        free(dest.bdName);
+    dest.bdaKey = source.bdaKey;
+    /* Don't release dest's buffers - see above */
+    memset(&dest.adv, 0, sizeof(GravityAdvSummary));
+    dest.bdName = btNoName;
+    dest.bdname_len = 0;
+    for (int i = 0; i < GRAVITY_BT_TRANSPORT_COUNT; ++i) {
+        dest.transport[i] = source.transport[i];
+        dest.transport[i].eir = NULL;
+        dest.transport[i].eir_len = 0;
+    }
+    for (int i = 0; i < GRAVITY_BT_TRANSPORT_COUNT; ++i) {
+        if (bt_dev_set_eir(&dest, i, source.transport[i].eir, source.transport[i].eir_len) != ESP_OK) {
+            #ifdef CONFIG_FLIPPER
+                printf("%sfor EIR (len %u).\n", STRINGS_MALLOC_FAIL, source.transport[i].eir_len);
+            #else
+                ESP_LOGE(BT_TAG, "%sfor EIR (length %u).", STRINGS_MALLOC_FAIL, source.transport[i].eir_len);
+            #endif
+            for (int j = 0; j < i; ++j) {
+                bt_dev_set_eir(&dest, j, NULL, 0);
+            }
+            return ESP_ERR_NO_MEM;
+        }
     }
-    dest.bdName = malloc(sizeof(char) * (source.bdname_len + 1));
-    if (dest.bdName == NULL) {
+    if (bt_dev_set_name(&dest, source.bdName, source.bdname_len) != ESP_OK) {
         #ifdef CONFIG_FLIPPER
             printf("%sfor bdName (len %u).\n", STRINGS_MALLOC_FAIL, source.bdname_len);
         #else
             ESP_LOGE(BT_TAG, "%sfor Bluetooth device name (length %u).", STRINGS_MALLOC_FAIL, source.bdname_len);
         #endif
-        if (dest.eir != NULL) {
-            free(dest.eir);
+        for (int i = 0; i < GRAVITY_BT_TRANSPORT_COUNT; ++i) {
+            bt_dev_set_eir(&dest, i, NULL, 0);
         }
         return ESP_ERR_NO_MEM;
     }
-    strncpy(dest.bdName, source.bdName, source.bdname_len);
-    dest.bdName[source.bdname_len] = '\0';
 
     return err;
 }
@@ -1576,57 +2536,43 @@ esp_err_t bt_dev_copy(app_gap_cb_t dest, app_gap_cb_t source) {
    Currently only supports Bluetooth Classic. BLE coming soon :-)
    Only a single instance of service discovery can run per Bluetooth radio,
    so a queueing strategy had to be implemented for this.
-   This function will:
-   - Commence service discovery if it is not currently running
-   - append the specified device to the service discovery queue if it is currently running
-   The queue is consumed by bt_gap_cb, with a new instance started when the
-   previous one completes.
+   This function adds the specified device to the service discovery queue,
+   unless it is already queued, and commences service discovery if it is not
+   currently running. The queue is consumed by bt_svc_dispatch(), with the next
+   request started when the previous one completes or times out.
 */
 esp_err_t gravity_bt_discover_services(app_gap_cb_t *dev) {
-    if (btServiceDiscoveryActive) {
-        /* Create new queue object */
-        app_gap_cb_t **newQ = malloc(sizeof(app_gap_cb_t *) * (gravity_svc_disc_count + 1));
-        if (newQ == NULL) {
-            #ifdef CONFIG_FLIPPER
-                printf("%s\n", STRINGS_MALLOC_FAIL);
-            #else
-                ESP_LOGI(BT_TAG, "%s svc_disc 1.", STRINGS_MALLOC_FAIL);
-            #endif
-            return ESP_ERR_NO_MEM;
-        }
-        /* Copy across gravity_svc_disc_count elements */
-        memcpy(newQ, gravity_svc_disc_q, sizeof(app_gap_cb_t *) * gravity_svc_disc_count);
-        /* Append dev */
-        newQ[gravity_svc_disc_count] = dev;
-        /* Replace queue */
-        if (gravity_svc_disc_count > 0) {
-            free(gravity_svc_disc_q);
-        }
-        gravity_svc_disc_q = newQ;
-        ++gravity_svc_disc_count;
+    if (btSvcLock == NULL) {
+        btSvcLock = xSemaphoreCreateMutexStatic(&btSvcLockBuffer);
+    }
+    bt_svc_req_t req = { .notBefore = bt_svc_now_millis(), .attempts = 0 };
+    memcpy(req.bda, dev->bda, ESP_BD_ADDR_LEN);
 
-        #ifdef CONFIG_DEBUG_VERBOSE
-            char bda_str[MAC_STRLEN + 1] = "";
-            bda2str(gravity_svc_disc_q[gravity_svc_disc_count - 1]->bda, bda_str, MAC_STRLEN + 1);
-            printf("Service discovery: %s, queueing BDA %s (%s) at index %u\n",
-                    btServiceDiscoveryActive?"Starting":"Stopped", bda_str, gravity_svc_disc_q[gravity_svc_disc_count - 1]->bdName, gravity_svc_disc_count);
-        #endif
-    } else {
-        #ifdef CONFIG_DEBUG_VERBOSE
-            char bda_str[MAC_STRLEN + 1] = "";
-            bda2str(dev->bda, bda_str, MAC_STRLEN + 1);
-            printf("Starting service discovery for %s (%s).\nQueue length %u, address %p.\n",
-                    bda_str, dev->bdName, gravity_svc_disc_count, gravity_svc_disc_q);
+    xSemaphoreTake(btSvcLock, portMAX_DELAY);
+    /* A device only needs to be queued once */
+    bool queued = bt_svc_pending(dev->bda) || bt_svc_push(&req);
+    xSemaphoreGive(btSvcLock);
+    if (!queued) {
+        #ifdef CONFIG_FLIPPER
+            printf("Service queue full\n");
+        #else
+            ESP_LOGW(BT_TAG, "Service discovery queue is full (%d devices); increase BT_SVC_DISC_QUEUE_LEN to queue more.", CONFIG_BT_SVC_DISC_QUEUE_LEN);
         #endif
-        /* Simply start service discovery */
-        btServiceDiscoveryActive = true;
-        return esp_bt_gap_get_remote_services(dev->bda);
+        return ESP_ERR_NO_MEM;
     }
+
+    #ifdef CONFIG_DEBUG_VERBOSE
+        char bda_str[MAC_STRLEN + 1] = "";
+        bda2str(dev->bda, bda_str, MAC_STRLEN + 1);
+        printf("Service discovery: %s, queueing BDA %s (%s), %u queued\n",
+                btServiceDiscoveryActive?"Running":"Starting", bda_str, dev->bdName, btSvcCount);
+    #endif
+    bt_svc_dispatch();
     return ESP_OK;
 }
 
 /* Discover all services for gravity_bt_devices */
-esp_err_t gravity_bt_discover_services_for(app_gap_cb_t **devices, uint8_t deviceCount) {
+esp_err_t gravity_bt_discover_services_for(app_gap_cb_t **devices, uint16_t deviceCount) {
     esp_err_t res = ESP_OK;
 
     #ifdef CONFIG_DEBUG_VERBOSE
@@ -1634,10 +2580,11 @@ esp_err_t gravity_bt_discover_services_for(app_gap_cb_t **devices, uint8_t devic
         for (int i = 0; i < deviceCount; ++i) {
             char strBda[MAC_STRLEN + 1];
             char strEir[ESP_BT_GAP_EIR_DATA_LEN + 1];
+            grav_bt_transport *classic = &devices[i]->transport[GRAVITY_BT_SCAN_CLASSIC_DISCOVERY];
             bda2str(devices[i]->bda, strBda, MAC_STRLEN + 1);
-            memcpy(strEir, devices[i]->eir, devices[i]->eir_len);
-            strEir[devices[i]->eir_len] = '\0';
-            printf("Device %d:\t\tBDA \"%s\"\tCOD: %lu\tRSSI: %ld\nName Len: %u\tEIR Len: %u\tName: \"%s\"\nEIR: \"%s\"\n",i,strBda,devices[i]->cod, devices[i]->rssi,devices[i]->bdname_len, devices[i]->eir_len, devices[i]->bdName, strEir);
+            memcpy(strEir, classic->eir, classic->eir_len);
+            strEir[classic->eir_len] = '\0';
+            printf("Device %d:\t\tBDA \"%s\"\tCOD: %lu\tRSSI: %ld\nName Len: %u\tEIR Len: %u\tName: \"%s\"\nEIR: \"%s\"\n",i,strBda,devices[i]->cod, devices[i]->rssi,devices[i]->bdname_len, classic->eir_len, devices[i]->bdName, strEir);
         }
     #endif
 
@@ -1672,12 +2619,7 @@ esp_err_t gravity_bt_gap_services_discover(app_gap_cb_t *device) {
     }
 
     /* A little validation to be user-friendly */
-    bool deviceFound = false;
-    if (device != NULL) {
-        for (int i = 0; i < gravity_bt_dev_count && !deviceFound; ++i) {
-            deviceFound = !memcmp(gravity_bt_devices[i]->bda, device->bda, ESP_BD_ADDR_LEN);
-        }
-    }
+    bool deviceFound = (device != NULL && bt_dev_find(device->bdaKey) != NULL);
     /* Display a warning if there are no BT devices, or there are but the specified device is non-NULL and not found */
     if (gravity_bt_dev_count == 0 || (device != NULL && !deviceFound)) {
         char dev_bda[MAC_STRLEN + 1];
@@ -1705,14 +2647,47 @@ esp_err_t gravity_bt_scan_display_status() {
         ESP_LOGI(BT_TAG, "Bluetooth Classic Scanning %s, BLE Scanning %s\t%u Devices Discovered", attack_status[ATTACK_SCAN_BT_DISCOVERY]?"Active":"Inactive", attack_status[ATTACK_SCAN_BLE]?"Active":"Inactive", gravity_bt_dev_count);
     #endif
 
+    /* Memory density of the device store, in tenths of a device per KB */
+    size_t bytes = bt_pool_bytes();
+    uint32_t densityTenths = (bytes == 0) ? 0 : (uint32_t)((uint64_t)gravity_bt_dev_count * 10240 / bytes);
+    #ifdef CONFIG_FLIPPER
+        printf("%u bytes, %lu.%lu dev/KB\n", bytes, densityTenths / 10, densityTenths % 10);
+    #else
+        ESP_LOGI(BT_TAG, "Devices are using %u bytes (%lu.%lu devices per KB)", bytes, densityTenths / 10, densityTenths % 10);
+    #endif
+    #ifdef CONFIG_FLIPPER
+        printf("Adv %lu, %lu same\n%lu buffer allocs\n", btAdvReports, btAdvUnchanged, btBufAllocs);
+    #else
+        ESP_LOGI(BT_TAG, "%lu advertisements received, %lu unchanged from the previous one; %lu name/EIR buffers allocated",
+                 btAdvReports, btAdvUnchanged, btBufAllocs);
+    #endif
+    if (PURGE_MEMORY_BUDGET > 0) {
+        #ifdef CONFIG_FLIPPER
+            printf("Budget %u/%uKB\n%lu purged, %lu ignored\n", bt_pool_used() / 1024, PURGE_MEMORY_BUDGET, btBudgetEvictions, btBudgetRejections);
+        #else
+            ESP_LOGI(BT_TAG, "Memory budget: %u of %u KB used; %lu devices purged and %lu ignored to stay within budget",
+                     bt_pool_used() / 1024, PURGE_MEMORY_BUDGET, btBudgetEvictions, btBudgetRejections);
+        #endif
+    }
+    if (btServiceDiscoveryActive || btSvcCount > 0 || btSvcCompleted > 0 || btSvcFailed > 0) {
+        #ifdef CONFIG_FLIPPER
+            printf("Svc %s, %u queued\n%lu done %lu failed\n%lu timeouts %lu retries\n", btServiceDiscoveryActive?"ON":"OFF",
+                   btSvcCount, btSvcCompleted, btSvcFailed, btSvcTimeouts, btSvcRetries);
+        #else
+            ESP_LOGI(BT_TAG, "Service discovery %s with %u devices queued; %lu completed, %lu failed, %lu timed out, %lu retried",
+                     btServiceDiscoveryActive?"running":"idle", btSvcCount, btSvcCompleted, btSvcFailed, btSvcTimeouts, btSvcRetries);
+        #endif
+    }
+    err |= gravity_gatt_report();
+
     return err;
 }
 
-esp_err_t gravity_bt_list_all_devices(bool hideExpiredPackets) {
+esp_err_t gravity_bt_list_all_devices(bool hideExpiredPackets, const GravityFilter *filter) {
     esp_err_t err = ESP_OK;
 
     if (gravity_bt_dev_count > 0) {
-        err |= gravity_bt_list_devices(gravity_bt_devices, gravity_bt_dev_count, hideExpiredPackets);
+        err |= gravity_bt_list_devices(gravity_bt_devices, gravity_bt_dev_count, hideExpiredPackets, filter);
     } else {
         #ifdef CONFIG_FLIPPER
             printf("No HCIs in scan results\n");
@@ -1723,71 +2698,177 @@ esp_err_t gravity_bt_list_all_devices(bool hideExpiredPackets) {
     return err;
 }
 
-esp_err_t gravity_bt_list_devices(app_gap_cb_t **devices, uint8_t deviceCount, bool hideExpiredPackets) {
+/* Copy dev's name, or failing that the shortened name from its advertisement,
+   into strName, truncating it to maxLen characters */
+static void bt_dev_display_name(app_gap_cb_t *dev, char *strName, uint8_t maxLen) {
+    GravityAdvSummary *adv = &dev->adv;
+    memset(strName, '\0', maxLen + 1);
+    if (dev->bdname_len == 0 && (adv->present & GRAVITY_ADV_HAS_SHORT_NAME) != 0) {
+        /* Fall back to the shortened name from the advertisement */
+        uint8_t *advData = bt_dev_adv_data(dev);
+        strncpy(strName, (char *)&advData[adv->shortNameOffset], (adv->shortNameLen < maxLen) ? adv->shortNameLen : maxLen);
+    } else {
+        strncpy(strName, dev->bdName, maxLen);
+    }
+}
+
+/* Does dev satisfy every predicate in filter? elapsed is the number of
+   seconds since it was last seen */
+bool gravity_bt_dev_matches(const GravityFilter *filter, app_gap_cb_t *dev, unsigned long elapsed) {
+    if (filter == NULL) {
+        return true;
+    }
+    for (int i = 0; i < filter->predicateCount; ++i) {
+        const gravity_predicate_t *predicate = &filter->predicates[i];
+        bool match = false;
+        switch (predicate->field) {
+            case GRAVITY_FIELD_RSSI:
+                match = gravity_filter_match_number(predicate, dev->rssi);
+                break;
+            case GRAVITY_FIELD_AGE:
+                match = gravity_filter_match_number(predicate, elapsed);
+                break;
+            case GRAVITY_FIELD_SELECTED:
+                match = gravity_filter_match_number(predicate, dev->selected);
+                break;
+            case GRAVITY_FIELD_VENDOR:
+                match = gravity_filter_match_text(predicate, bt_dev_vendor(dev));
+                break;
+            case GRAVITY_FIELD_NAME: {
+                char strName[ESP_BT_GAP_MAX_BDNAME_LEN + 1];
+                bt_dev_display_name(dev, strName, ESP_BT_GAP_MAX_BDNAME_LEN);
+                match = gravity_filter_match_text(predicate, strName);
+                break;
+            }
+            default:
+                break;
+        }
+        if (!match) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Stringify the transports dev was found on. strScanType must have space
+   for 18 characters */
+static esp_err_t bt_dev_scan_type(app_gap_cb_t *dev, char *strScanType) {
+    if (gravity_bt_dev_seen_on(dev, GRAVITY_BT_SCAN_CLASSIC_DISCOVERY) && gravity_bt_dev_seen_on(dev, GRAVITY_BT_SCAN_BLE)) {
+        strcpy(strScanType, "Dual Mode (BR+LE)");
+        return ESP_OK;
+    }
+    return bt_scanTypeToString(gravity_bt_dev_seen_on(dev, GRAVITY_BT_SCAN_BLE) ?
+                               GRAVITY_BT_SCAN_BLE : GRAVITY_BT_SCAN_CLASSIC_DISCOVERY, strScanType);
+}
+
+/* Display the columns of dev requested by filter */
+static esp_err_t bt_dev_list_projected(const GravityFilter *filter, app_gap_cb_t *dev, unsigned long elapsed) {
+    esp_err_t err = ESP_OK;
+    char cell[GRAVITY_FILTER_CELL_LEN + 1];
+    uint8_t cellLen = 0;
+    for (uint8_t col = 0; col < filter->columnCount; ++col) {
+        switch (filter->columns[col]) {
+            case GRAVITY_COL_ID:
+                cell[0] = (dev->selected) ? '*' : ' ';
+                gravity_format_uint(&cell[1], dev->index);
+                break;
+            case GRAVITY_COL_RSSI:
+                gravity_format_int(cell, dev->rssi, 4);
+                break;
+            case GRAVITY_COL_NAME:
+                bt_dev_display_name(dev, cell, 24);
+                break;
+            case GRAVITY_COL_MAC:
+                gravity_mac_format(dev->bdaKey, cell);
+                break;
+            case GRAVITY_COL_VENDOR:
+                snprintf(cell, sizeof(cell), "%s", gravity_oui_vendor_display_bda(dev->bdaKey, bt_dev_random_addr(dev)));
+                break;
+            case GRAVITY_COL_CLASS:
+                err |= cod2shortStr(dev->cod, cell, &cellLen);
+                break;
+            case GRAVITY_COL_SCAN:
+                err |= bt_dev_scan_type(dev, cell);
+                break;
+            case GRAVITY_COL_AGE:
+                gravity_filter_format_age(elapsed, cell);
+                break;
+            case GRAVITY_COL_ADV:
+                gravity_adv_summary_format(&dev->adv, bt_dev_adv_data(dev), cell);
+                break;
+            default:
+                cell[0] = '\0';
+                break;
+        }
+        gravity_filter_print_cell(filter, col, cell);
+    }
+    return err;
+}
+
+/* Display devices. Rows are tested against filter's predicates, OFFSET and
+   LIMIT before they are formatted, and filter may specify the columns */
+esp_err_t gravity_bt_list_devices(app_gap_cb_t **devices, uint16_t deviceCount, bool hideExpiredPackets, const GravityFilter *filter) {
     esp_err_t err = ESP_OK;
 
     char strBssid[MAC_STRLEN + 1];
     char strTime[26];
     char strName[25]; /* Hold a substring of device name */
     char strScanType[18];
-    unsigned long nowTime;
     unsigned long elapsed;
-    double minutes;
+    uint32_t matched = 0;
+    bool done = false;
+
+    /* Sort a copy of devices. gravity_bt_devices must stay in index order
+       for bt_dev_with_index() and bt_dev_add_components() */
+    app_gap_cb_t **sorted = NULL;
+    if (sortCount > 0 && deviceCount > 1) {
+        sorted = malloc(sizeof(app_gap_cb_t *) * deviceCount);
+        if (sorted == NULL) {
+            #ifdef CONFIG_FLIPPER
+                printf("%sto sort %u devices.\n", STRINGS_MALLOC_FAIL, deviceCount);
+            #else
+                ESP_LOGE(BT_TAG, "%sto sort %u devices.", STRINGS_MALLOC_FAIL, deviceCount);
+            #endif
+            return ESP_ERR_NO_MEM;
+        }
+        memcpy(sorted, devices, sizeof(app_gap_cb_t *) * deviceCount);
+        qsort(sorted, deviceCount, sizeof(app_gap_cb_t *), &bt_comparator);
+        devices = sorted;
+    }
 
     // Print header
-    #ifdef CONFIG_FLIPPER
-        printf(" ID | RSSI |      Name      | Class | LastSeen\n");
-        printf("===|====|========|====|======\n");
-    #else
-        printf(" ID | RSSI | Name                   | BSSID             | Class    | Scan Method       | LastSeen\n");
-        printf("====|======|========================|===================|==========|===================|===========================\n");
-    #endif
-
-    /* Apply the sort to selectedAPs */
-    qsort(devices, deviceCount, sizeof(app_gap_cb_t *), &bt_comparator);
-
-    // Display devices
-    for (int deviceIdx = 0; deviceIdx < deviceCount; ++deviceIdx) {
-        err |= mac_bytes_to_string(devices[deviceIdx]->bda, strBssid);
-
-        /* Stringify timestamp */
-        nowTime = clock();
-        elapsed = (nowTime - devices[deviceIdx]->lastSeen) / CLOCKS_PER_SEC;
-        #ifdef CONFIG_DISPLAY_FRIENDLY_AGE
-            if (elapsed < 60.0) {
-                strcpy(strTime, "Under a minute ago");
-            } else if (elapsed < 3600.0) {
-                sprintf(strTime, "%d %s ago", (int)elapsed/60, (elapsed >= 120)?"minutes":"minute");
-            } else {
-                sprintf(strTime, "%d %s ago", (int)elapsed/3600, (elapsed >= 7200)?"hours":"hour");
-            }
+    gravity_out_begin();
+    bool projected = gravity_filter_projected(filter);
+    if (projected) {
+        gravity_filter_print_header(filter);
+    } else {
+        #ifdef CONFIG_FLIPPER
+            gravity_out_str(" ID | RSSI |      Name      | Class | LastSeen\n");
+            gravity_out_str("===|====|========|====|======\n");
         #else
-            /* Display precise time */
-            char strTmp[16] = "";
-            unsigned long tmp = elapsed;
-            strcpy(strTime, "");
-            if (tmp >= 3600.0) {
-                sprintf(strTmp, "%2dh ", (int)tmp/3600);
-                strcat(strTime, strTmp);
-                tmp = tmp % 3600;
-            }
-            if (tmp >= 60) {
-                sprintf(strTmp, "%2dm ", (int)tmp/60);
-                strcat(strTime, strTmp);
-                tmp = tmp % 60;
-            }
-            sprintf(strTmp, "%2lds", tmp);
-            strcat(strTime, strTmp);
+            gravity_out_str(" ID | RSSI | Name                   | BSSID             | Vendor               | Class    | Scan Method       | LastSeen                  | Advertising\n");
+            gravity_out_str("====|======|========================|===================|======================|==========|===================|===========================|============\n");
         #endif
-        /* Skip the rest of this loop iteration if the packet has expired */
-        minutes = (elapsed / 60.0);
-        if (hideExpiredPackets && scanResultExpiry != 0 && minutes >= scanResultExpiry) {
+    }
+
+    // Display devices
+    for (int deviceIdx = 0; deviceIdx < deviceCount && !done; ++deviceIdx) {
+        /* Skip expired and filtered devices before formatting anything */
+        elapsed = (clock() - devices[deviceIdx]->lastSeen) / CLOCKS_PER_SEC;
+        if ((hideExpiredPackets && scanResultExpiry != 0 && (elapsed / 60.0) >= scanResultExpiry) ||
+                !gravity_bt_dev_matches(filter, devices[deviceIdx], elapsed) || !gravity_filter_page(filter, &matched, &done)) {
+            continue;
+        }
+        if (projected) {
+            err |= bt_dev_list_projected(filter, devices[deviceIdx], elapsed);
             continue;
         }
 
+        gravity_mac_format(devices[deviceIdx]->bdaKey, strBssid);
+        gravity_filter_format_age(elapsed, strTime);
+
         // Shorten device name as necessary to display
-        memset(strName, '\0', 25);
-        strncpy(strName, devices[deviceIdx]->bdName, 25);
+        bt_dev_display_name(devices[deviceIdx], strName, 24);
         #ifdef CONFIG_FLIPPER
             strName[16] = '\0';
         #endif
@@ -1797,17 +2878,43 @@ esp_err_t gravity_bt_list_devices(app_gap_cb_t **devices, uint8_t deviceCount, b
         uint8_t shortCodLen = 0;
         err |= cod2shortStr(devices[deviceIdx]->cod, shortCod, &shortCodLen);
 
-        /* Stringify scanType for display to console */
-        err |= bt_scanTypeToString(devices[deviceIdx]->scanType, strScanType);
+        /* Stringify the transports the device was found on for display to console */
+        err |= bt_dev_scan_type(devices[deviceIdx], strScanType);
 
         /* Finally, display */
+        gravity_out_char((devices[deviceIdx]->selected) ? '*' : ' ');
+        gravity_out_int(devices[deviceIdx]->index, 2);
+        gravity_out_write(" | ", 3);
+        gravity_out_int(devices[deviceIdx]->rssi, 4);
         #ifdef CONFIG_FLIPPER
-            printf("%s%2d | %4ld |%-16s|%-7s| %s\n", (devices[deviceIdx]->selected?"*":" "), devices[deviceIdx]->index, devices[deviceIdx]->rssi, strName, shortCod, strTime);
+            gravity_out_write(" |", 2);
+            gravity_out_padded(strName, 16);
+            gravity_out_char('|');
+            gravity_out_padded(shortCod, 7);
+            gravity_out_write("| ", 2);
+            gravity_out_str(strTime);
         #else
-            printf("%s%2d | %4ld | %-22s | %-17s |%-10s| %-17s | %s\n", (devices[deviceIdx]->selected?"*":" "), devices[deviceIdx]->index, devices[deviceIdx]->rssi, strName, strBssid, shortCod, strScanType, strTime);
+            char strAdv[GRAVITY_ADV_SUMMARY_STRLEN + 1];
+            gravity_adv_summary_format(&devices[deviceIdx]->adv, bt_dev_adv_data(devices[deviceIdx]), strAdv);
+            gravity_out_write(" | ", 3);
+            gravity_out_padded(strName, 22);
+            gravity_out_write(" | ", 3);
+            gravity_out_padded(strBssid, 17);
+            gravity_out_write(" | ", 3);
+            gravity_out_padded(gravity_oui_vendor_display_bda(devices[deviceIdx]->bdaKey, bt_dev_random_addr(devices[deviceIdx])), 20);
+            gravity_out_write(" |", 2);
+            gravity_out_padded(shortCod, 10);
+            gravity_out_write("| ", 2);
+            gravity_out_padded(strScanType, 17);
+            gravity_out_write(" | ", 3);
+            gravity_out_padded(strTime, 25);
+            gravity_out_write(" | ", 3);
+            gravity_out_str(strAdv);
         #endif
-
+        gravity_out_char('\n');
     }
+    gravity_out_end();
+    free(sorted);
     return err;
 }
 
@@ -1840,8 +2947,9 @@ static int bt_comparator(const void *varOne, const void *varTwo) {
     if (sortCount == 0) {
         return 0;
     }
-    app_gap_cb_t *one = (app_gap_cb_t *)varOne;
-    app_gap_cb_t *two = (app_gap_cb_t *)varTwo;
+    /* Elements are app_gap_cb_t pointers */
+    app_gap_cb_t *one = *(app_gap_cb_t **)varOne;
+    app_gap_cb_t *two = *(app_gap_cb_t **)varTwo;
     if (sortCount == 1) {
         if (sortResults[0] == GRAVITY_SORT_AGE) {
             if (one->lastSeen == two->lastSeen) {
@@ -2095,29 +3203,27 @@ esp_err_t gravity_clear_bt() {
         free(gravity_selected_bt);
         gravity_selected_bt = NULL;
         gravity_sel_bt_count = 0;
+        btSelCapacity = 0;
     }
 
     if (gravity_bt_devices != NULL) {
         for (int i = 0; i < gravity_bt_dev_count; ++i) {
             if (gravity_bt_devices[i] != NULL) {
-                if (gravity_bt_devices[i]->bdName != NULL) {
-                    free(gravity_bt_devices[i]->bdName);
-                }
-                if (gravity_bt_devices[i]->eir != NULL) {
-                    free(gravity_bt_devices[i]->eir);
-                }
-                free(gravity_bt_devices[i]);
+                bt_dev_free(gravity_bt_devices[i]);
             }
         }
         free(gravity_bt_devices);
         gravity_bt_devices = NULL;
     }
     gravity_bt_dev_count = 0;
+    btDeviceCapacity = 0;
+    bt_index_rebuild();
+    bt_pool_trim();
     return err;
 }
 
 esp_err_t gravity_clear_bt_selected() {
-    uint8_t newCount = gravity_bt_dev_count - gravity_sel_bt_count;
+    uint16_t newCount = gravity_bt_dev_count - gravity_sel_bt_count;
 
     if (newCount == gravity_bt_dev_count) {
         /* Nothing to do */
@@ -2145,6 +3251,7 @@ esp_err_t gravity_clear_bt_selected() {
         free(gravity_selected_bt);
         gravity_selected_bt = NULL;
         gravity_sel_bt_count = 0;
+        btSelCapacity = 0;
     }
 
     for (int i = 0; i < gravity_bt_dev_count; ++i) {
@@ -2155,13 +3262,7 @@ esp_err_t gravity_clear_bt_selected() {
                 printf("%s (%d) is selected\n", (gravity_bt_devices[i]->bdname_len > 0)?gravity_bt_devices[i]->bdName:bda_str, i);
             #endif
             /* Element i is selected, free it */
-            if (gravity_bt_devices[i]->bdName != NULL) {
-                free(gravity_bt_devices[i]->bdName);
-            }
-            if (gravity_bt_devices[i]->eir != NULL) {
-                free(gravity_bt_devices[i]->eir);
-            }
-            free(gravity_bt_devices[i]);
+            bt_dev_free(gravity_bt_devices[i]);
             gravity_bt_devices[i] = NULL;
         }
     }
@@ -2169,101 +3270,166 @@ esp_err_t gravity_clear_bt_selected() {
     return gravity_bt_shrink_devices();
 }
 
-esp_err_t gravity_select_bt(uint8_t selIndex) {
-    esp_err_t err = ESP_OK;
-    app_gap_cb_t **newSel = NULL;
-
+esp_err_t gravity_select_bt(uint16_t selIndex) {
     /* Find the device */
-    uint8_t devIdx = 0;
-    for ( ; devIdx < gravity_bt_dev_count && gravity_bt_devices[devIdx]->index != selIndex; ++devIdx) { }
-    if (devIdx < gravity_bt_dev_count) {
-        /* Found the device - Invert its selected status */
-        gravity_bt_devices[devIdx]->selected = !gravity_bt_devices[devIdx]->selected;
-        /* Are we adding to, or removing from, gravity_selected_bt ? */
-        if (gravity_bt_devices[devIdx]->selected) {
-            /* Adding to gravity_selected_bt */
-            if (newSel != NULL) {
-                free(newSel);
-            }
-            newSel = malloc(sizeof(app_gap_cb_t *) * ++gravity_sel_bt_count);
+    app_gap_cb_t *dev = bt_dev_with_index(selIndex);
+    if (dev == NULL) {
+        /* No such device */
+        #ifdef CONFIG_FLIPPER
+            printf("No BT Device with index %u\n", selIndex);
+        #else
+            ESP_LOGE(BT_TAG, "No Bluetooth device exists with the specified index (%u).", selIndex);
+        #endif
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /* Are we adding to, or removing from, gravity_selected_bt ? */
+    if (!dev->selected) {
+        /* Adding to gravity_selected_bt, which doubles in size when it fills
+           so that selecting every device isn't quadratic */
+        if (gravity_sel_bt_count >= btSelCapacity) {
+            uint32_t newCapacity = (btSelCapacity == 0) ? 16 : btSelCapacity * 2;
+            app_gap_cb_t **newSel = malloc(sizeof(app_gap_cb_t *) * newCapacity);
             if (newSel == NULL) {
                 #ifdef CONFIG_FLIPPER
-                    printf("%sfor %d pointers.\n", STRINGS_MALLOC_FAIL, gravity_sel_bt_count);
+                    printf("%sfor %lu pointers.\n", STRINGS_MALLOC_FAIL, newCapacity);
                 #else
-                    ESP_LOGE(BT_TAG, "%sfor %d pointers.", STRINGS_MALLOC_FAIL, gravity_sel_bt_count);
+                    ESP_LOGE(BT_TAG, "%sfor %lu pointers.", STRINGS_MALLOC_FAIL, newCapacity);
                 #endif
                 return ESP_ERR_NO_MEM;
             }
             /* Copy across the old elements */
-            memcpy(newSel, gravity_selected_bt, sizeof(app_gap_cb_t *) * (gravity_sel_bt_count - 1));
-            newSel[gravity_sel_bt_count - 1] = gravity_bt_devices[devIdx];
-
-            if (gravity_selected_bt != NULL && gravity_sel_bt_count > 1) {
+            if (gravity_selected_bt != NULL) {
+                memcpy(newSel, gravity_selected_bt, sizeof(app_gap_cb_t *) * gravity_sel_bt_count);
                 free(gravity_selected_bt);
             }
             gravity_selected_bt = newSel;
-        } else {
-            /* Removing device from gravity_selected_bt */
-            --gravity_sel_bt_count;
-            if (gravity_sel_bt_count > 0) {
-                newSel = malloc(sizeof(app_gap_cb_t *) * gravity_sel_bt_count);
-                if (newSel == NULL) {
-                    #ifdef CONFIG_FLIPPER
-                        printf("%sfor %d pointers\n", STRINGS_MALLOC_FAIL, gravity_sel_bt_count);
-                    #else
-                        ESP_LOGE(BT_TAG, "%sfor %d pointers.", STRINGS_MALLOC_FAIL, gravity_sel_bt_count);
-                    #endif
-                    return ESP_ERR_NO_MEM;
-                }
-                /* Copy across selected indices */
-                int numSelected = 0;
-                for (int i = 0; i < gravity_bt_dev_count; ++i) {
-                    if (gravity_bt_devices[i]->selected) {
-                        newSel[numSelected++] = gravity_bt_devices[i];
-                    }
-                }
-                if (numSelected != gravity_sel_bt_count) {
-                    #ifdef CONFIG_FLIPPER
-                        printf("Expected %d selected Bluetooth devices, found %d.\n", gravity_sel_bt_count, numSelected);
-                    #else
-                        ESP_LOGE(BT_TAG, "Expected %d selected Bluetooth devices, found %d.", gravity_sel_bt_count, numSelected);
-                    #endif
-                }
-                /* We're done at last */
-                if (gravity_selected_bt != NULL) {
-                    free(gravity_selected_bt);
-                }
-                gravity_selected_bt = newSel;
-            } else {
-                /* We probably just made it 0 */
-                if (gravity_selected_bt != NULL) {
-                    free(gravity_selected_bt);
-                    gravity_selected_bt = NULL;
-                }
-            }
+            btSelCapacity = newCapacity;
         }
+        gravity_selected_bt[gravity_sel_bt_count++] = dev;
+        dev->selected = true;
     } else {
-        /* No such device */
+        /* Removing device from gravity_selected_bt, keeping the others in order */
+        uint16_t selIdx = 0;
+        for ( ; selIdx < gravity_sel_bt_count && gravity_selected_bt[selIdx] != dev; ++selIdx) { }
+        if (selIdx < gravity_sel_bt_count) {
+            memmove(&gravity_selected_bt[selIdx], &gravity_selected_bt[selIdx + 1],
+                    sizeof(app_gap_cb_t *) * (gravity_sel_bt_count - selIdx - 1));
+            --gravity_sel_bt_count;
+        } else {
+            #ifdef CONFIG_FLIPPER
+                printf("BT %u was not in selected list\n", selIndex);
+            #else
+                ESP_LOGE(BT_TAG, "Bluetooth device %u is selected but was not in the selected list.", selIndex);
+            #endif
+        }
+        dev->selected = false;
+        if (gravity_sel_bt_count == 0) {
+            free(gravity_selected_bt);
+            gravity_selected_bt = NULL;
+            btSelCapacity = 0;
+        }
+    }
+    return ESP_OK;
+}
+
+/* Select every Bluetooth device that satisfies filter, or if top is non-zero
+   the top best of them ranked by rankBy (GRAVITY_SORT_RSSI or
+   GRAVITY_SORT_AGE). Devices that are already selected stay selected. The
+   devices are evaluated in a single pass and gravity_selected_bt grows at
+   most once. If newCount is not NULL it receives the number of devices
+   newly selected */
+esp_err_t gravity_select_bt_where(const GravityFilter *filter, uint32_t top, GRAVITY_SORT_TYPE rankBy, uint32_t *newCount) {
+    if (newCount != NULL) {
+        *newCount = 0;
+    }
+    if (gravity_bt_dev_count == 0) {
+        return ESP_OK;
+    }
+    uint32_t capacity = (top == 0 || top > gravity_bt_dev_count) ? gravity_bt_dev_count : top;
+    uint32_t *positions = malloc(sizeof(uint32_t) * capacity);
+    int32_t *keys = malloc(sizeof(int32_t) * capacity);
+    if (positions == NULL || keys == NULL) {
         #ifdef CONFIG_FLIPPER
-            printf("No BT Device with index %d\n", selIndex);
+            printf("%sfor %lu devices.\n", STRINGS_MALLOC_FAIL, capacity);
         #else
-            ESP_LOGE(BT_TAG, "No Bluetooth device exists with the specified index (%d).", selIndex);
+            ESP_LOGE(BT_TAG, "%sto select %lu devices.", STRINGS_MALLOC_FAIL, capacity);
         #endif
-        return ESP_ERR_INVALID_ARG;
+        free(positions);
+        free(keys);
+        return ESP_ERR_NO_MEM;
+    }
+
+    /* Single pass over the devices, ranking matches if TOP was specified */
+    uint32_t found = 0;
+    for (uint16_t i = 0; i < gravity_bt_dev_count; ++i) {
+        app_gap_cb_t *dev = gravity_bt_devices[i];
+        if (dev == NULL) {
+            continue;
+        }
+        unsigned long elapsed = (clock() - dev->lastSeen) / CLOCKS_PER_SEC;
+        if ((scanResultExpiry != 0 && (elapsed / 60.0) >= scanResultExpiry) ||
+                !gravity_bt_dev_matches(filter, dev, elapsed)) {
+            continue;
+        }
+        if (top == 0) {
+            positions[found++] = i;
+        } else {
+            gravity_filter_rank(positions, keys, &found, capacity, i,
+                                (rankBy == GRAVITY_SORT_AGE) ? -(int32_t)elapsed : dev->rssi);
+        }
+    }
+    uint32_t adding = 0;
+    for (uint32_t i = 0; i < found; ++i) {
+        if (!gravity_bt_devices[positions[i]]->selected) {
+            ++adding;
+        }
     }
 
+    /* Make room for every new selection at once */
+    esp_err_t err = ESP_OK;
+    if (adding > 0 && gravity_sel_bt_count + adding > btSelCapacity) {
+        uint32_t newCapacity = (btSelCapacity == 0) ? 16 : btSelCapacity;
+        while (newCapacity < gravity_sel_bt_count + adding) {
+            newCapacity *= 2;
+        }
+        app_gap_cb_t **newSel = malloc(sizeof(app_gap_cb_t *) * newCapacity);
+        if (newSel == NULL) {
+            #ifdef CONFIG_FLIPPER
+                printf("%sfor %lu pointers.\n", STRINGS_MALLOC_FAIL, newCapacity);
+            #else
+                ESP_LOGE(BT_TAG, "%sfor %lu pointers.", STRINGS_MALLOC_FAIL, newCapacity);
+            #endif
+            err = ESP_ERR_NO_MEM;
+        } else {
+            if (gravity_selected_bt != NULL) {
+                memcpy(newSel, gravity_selected_bt, sizeof(app_gap_cb_t *) * gravity_sel_bt_count);
+                free(gravity_selected_bt);
+            }
+            gravity_selected_bt = newSel;
+            btSelCapacity = newCapacity;
+        }
+    }
+    if (adding > 0 && err == ESP_OK) {
+        for (uint32_t i = 0; i < found; ++i) {
+            app_gap_cb_t *dev = gravity_bt_devices[positions[i]];
+            if (!dev->selected) {
+                dev->selected = true;
+                gravity_selected_bt[gravity_sel_bt_count++] = dev;
+            }
+        }
+        if (newCount != NULL) {
+            *newCount = adding;
+        }
+    }
+    free(positions);
+    free(keys);
     return err;
 }
 
-bool gravity_bt_isSelected(uint8_t selIndex) {
-    /* Find selIndex */
-    int i = 0;
-    for ( ; i < gravity_bt_dev_count && gravity_bt_devices[i]->index != selIndex; ++i) { }
-    if (i < gravity_bt_dev_count) {
-        /* We found an item with the specified index */
-        return (gravity_bt_devices[i]->selected);
-    }
-    return false;
+bool gravity_bt_isSelected(uint16_t selIndex) {
+    app_gap_cb_t *dev = bt_dev_with_index(selIndex);
+    return (dev != NULL && dev->selected);
 }
 
 esp_err_t gravity_bt_disable_scan() {
@@ -2291,13 +3457,17 @@ esp_err_t bt_service_rm_dev(app_gap_cb_t *device) {
         services->known_services = NULL;
         services->known_services_len = 0;
     }
+    if (services->gatt != NULL) {
+        free(services->gatt);
+        services->gatt = NULL;
+    }
     return err;
 }
 
 /* Remove all BT services from the specified devices
    This function will release all memory reserved by services for the specified devices.
 */
-esp_err_t bt_service_rm(app_gap_cb_t **devices, uint8_t devCount) {
+esp_err_t bt_service_rm(app_gap_cb_t **devices, uint16_t devCount) {
     esp_err_t err = ESP_OK;
     for (int i = 0; i < devCount; ++i) {
         err |= bt_service_rm_dev(devices[i]);
@@ -2311,10 +3481,12 @@ esp_err_t bt_service_rm_all() {
 
 /* Purge all BLE records with the earliest lastSeen, unless lastSeen
    is > CONFIG_BLE_PURGE_MIN_AGE
+   Purging only forgets what was seen on devType's transport; dual-mode
+   devices keep their record while they've been seen on the other
 */
 esp_err_t purgeAge(GravityDeviceType devType, uint16_t purge_min_age) {
     esp_err_t err = ESP_OK;
-    uint8_t newCount = 0;
+    uint16_t newCount = 0;
     UNUSED(newCount);
     gravity_bt_scan_t scanType = GRAVITY_BT_SCAN_TYPE_COUNT;
 
@@ -2337,9 +3509,9 @@ esp_err_t purgeAge(GravityDeviceType devType, uint16_t purge_min_age) {
     /* Find the oldest age */
     clock_t minAge = -1;
     for (int i = 0; i < gravity_bt_dev_count; ++i) {
-        if (gravity_bt_devices[i]->scanType == scanType && (minAge == -1 ||
-                gravity_bt_devices[i]->lastSeen < minAge)) {
-            minAge = gravity_bt_devices[i]->lastSeen;
+        if (gravity_bt_dev_seen_on(gravity_bt_devices[i], scanType) && (minAge == -1 ||
+                gravity_bt_devices[i]->transport[scanType].lastSeen < minAge)) {
+            minAge = gravity_bt_devices[i]->transport[scanType].lastSeen;
         }
     }
     if (minAge == -1) {
@@ -2357,15 +3529,9 @@ esp_err_t purgeAge(GravityDeviceType devType, uint16_t purge_min_age) {
 
     /* If we're still here, remove all BLE records lastSeen at (or before, to cater for minAge dodginess) minAge */
     for (int i = 0; i < gravity_bt_dev_count; ++i) {
-        if (gravity_bt_devices[i]->scanType == scanType && gravity_bt_devices[i]->lastSeen <= minAge) {
-            /* Don't forget to free the name and EIR */
-            if (gravity_bt_devices[i]->bdName != NULL && gravity_bt_devices[i]->bdname_len > 0) {
-                free(gravity_bt_devices[i]->bdName);
-            }
-            if (gravity_bt_devices[i]->eir != NULL && gravity_bt_devices[i]->eir_len > 0) {
-                free(gravity_bt_devices[i]->eir);
-            }
-            free(gravity_bt_devices[i]);
+        if (gravity_bt_dev_seen_on(gravity_bt_devices[i], scanType) &&
+                gravity_bt_devices[i]->transport[scanType].lastSeen <= minAge &&
+                bt_dev_drop_transport(gravity_bt_devices[i], scanType)) {
             gravity_bt_devices[i] = NULL;
         }
     }
@@ -2379,7 +3545,7 @@ esp_err_t purgeAge(GravityDeviceType devType, uint16_t purge_min_age) {
    is > CONFIG_GRAVITY_BLE_PURGE_MIN_RSSI, then return ESP_ERR_NOT_FOUND */
 esp_err_t purgeRSSI(GravityDeviceType devType, int32_t purge_max_rssi) {
     esp_err_t err = ESP_OK;
-    uint8_t newCount = 0;
+    uint16_t newCount = 0;
     gravity_bt_scan_t scanType = GRAVITY_BT_SCAN_TYPE_COUNT;
 
     switch (devType) {
@@ -2401,8 +3567,9 @@ esp_err_t purgeRSSI(GravityDeviceType devType, int32_t purge_max_rssi) {
     /* Find the smallest RSSI */
     int32_t smallRSSI = 0; /* Invalid */
     for (int i = 0; i < gravity_bt_dev_count; ++i) {
-        if (gravity_bt_devices[i]->rssi < smallRSSI) {
-            smallRSSI = gravity_bt_devices[i]->rssi;
+        if (gravity_bt_dev_seen_on(gravity_bt_devices[i], scanType) &&
+                gravity_bt_devices[i]->transport[scanType].rssi < smallRSSI) {
+            smallRSSI = gravity_bt_devices[i]->transport[scanType].rssi;
         }
     }
 
@@ -2413,15 +3580,10 @@ esp_err_t purgeRSSI(GravityDeviceType devType, int32_t purge_max_rssi) {
 
     /* Free any elements with the smallest RSSI */
     for (int i = 0; i < gravity_bt_dev_count; ++i) {
-        if (gravity_bt_devices[i]->scanType == scanType && gravity_bt_devices[i]->rssi == smallRSSI) {
-            /* Delete the object */
-            if (gravity_bt_devices[i]->bdName != NULL && gravity_bt_devices[i]->bdname_len > 0) {
-                free(gravity_bt_devices[i]->bdName);
-            }
-            if (gravity_bt_devices[i]->eir != NULL && gravity_bt_devices[i]->eir_len > 0) {
-                free(gravity_bt_devices[i]->eir);
-            }
-            free(gravity_bt_devices[i]);
+        if (gravity_bt_dev_seen_on(gravity_bt_devices[i], scanType) &&
+                gravity_bt_devices[i]->transport[scanType].rssi == smallRSSI &&
+                bt_dev_drop_transport(gravity_bt_devices[i], scanType)) {
+            /* The object has been deleted */
             gravity_bt_devices[i] = NULL;
         } else {
             ++newCount;
@@ -2439,7 +3601,10 @@ esp_err_t purgeRSSI(GravityDeviceType devType, int32_t purge_max_rssi) {
             free(gravity_bt_devices);
             gravity_bt_devices = NULL;
             gravity_bt_dev_count = 0;
+            btDeviceCapacity = 0;
         }
+        bt_index_rebuild();
+        bt_pool_trim();
     } else {
         /* Shrink the NULLs out of gravity_bt_devices */
         err = gravity_bt_shrink_devices();
@@ -2450,7 +3615,7 @@ esp_err_t purgeRSSI(GravityDeviceType devType, int32_t purge_max_rssi) {
 /* Purge all BLE devices that are not selected */
 esp_err_t purgeUnselected(GravityDeviceType devType) {
     esp_err_t err = ESP_OK;
-    uint8_t newCount = 0;
+    uint16_t newCount = 0;
     gravity_bt_scan_t scanType = GRAVITY_BT_SCAN_TYPE_COUNT;
 
     switch (devType) {
@@ -2473,17 +3638,11 @@ esp_err_t purgeUnselected(GravityDeviceType devType) {
        Loop through gravity_bt_devices. Along the way count new devices (selected or not BLE)
        and free the bdname, eir and app_gap_cb_t */
     for (int i = 0; i < gravity_bt_dev_count; ++i) {
-        if (gravity_bt_devices[i]->scanType != scanType || gravity_bt_devices[i]->selected) {
+        if (!gravity_bt_dev_seen_on(gravity_bt_devices[i], scanType) || gravity_bt_devices[i]->selected ||
+                !bt_dev_drop_transport(gravity_bt_devices[i], scanType)) {
             ++newCount;
         } else {
-            /* Element is specified type and not selected */
-            if (gravity_bt_devices[i]->bdname_len > 0 && gravity_bt_devices[i]->bdName != NULL) {
-                free(gravity_bt_devices[i]->bdName);
-            }
-            if (gravity_bt_devices[i]->eir_len > 0 && gravity_bt_devices[i]->eir != NULL) {
-                free(gravity_bt_devices[i]->eir);
-            }
-            free(gravity_bt_devices[i]);
+            /* Element was only seen on the specified transport and is not selected */
             gravity_bt_devices[i] = NULL;
         }
     }
@@ -2498,7 +3657,10 @@ esp_err_t purgeUnselected(GravityDeviceType devType) {
             free(gravity_bt_devices);
             gravity_bt_devices = NULL;
             gravity_bt_dev_count = 0;
+            btDeviceCapacity = 0;
         }
+        bt_index_rebuild();
+        bt_pool_trim();
     } else {
         /* Shorten gravity_bt_devices */
         err = gravity_bt_shrink_devices();
@@ -2509,7 +3671,7 @@ esp_err_t purgeUnselected(GravityDeviceType devType) {
 /* Purge all BLE devices that don't have a name */
 esp_err_t purgeUnnamed(GravityDeviceType devType) {
     esp_err_t err = ESP_OK;
-    uint8_t newCount = 0;
+    uint16_t newCount = 0;
     gravity_bt_scan_t scanType = GRAVITY_BT_SCAN_TYPE_COUNT;
 
     switch (devType) {
@@ -2530,15 +3692,11 @@ esp_err_t purgeUnnamed(GravityDeviceType devType) {
 
     /* To minimise memory usage, first free any app_gap_cb_t elements that can be purged */
     for (int i = 0; i < gravity_bt_dev_count; ++i) {
-        if (gravity_bt_devices[i]->scanType != scanType || (gravity_bt_devices[i]->bdname_len > 0 &&
-                gravity_bt_devices[i]->bdName != NULL)) {
+        if (!gravity_bt_dev_seen_on(gravity_bt_devices[i], scanType) || (gravity_bt_devices[i]->bdname_len > 0 &&
+                gravity_bt_devices[i]->bdName != NULL) || !bt_dev_drop_transport(gravity_bt_devices[i], scanType)) {
             ++newCount;
         } else {
-            /* Element is devType and has no name */
-            if (gravity_bt_devices[i]->bdName != NULL) {
-                free(gravity_bt_devices[i]->bdName);
-            }
-            free(gravity_bt_devices[i]);
+            /* Element was only seen on devType's transport and has no name */
             gravity_bt_devices[i] = NULL;
         }
     }
@@ -2552,7 +3710,10 @@ esp_err_t purgeUnnamed(GravityDeviceType devType) {
             free(gravity_bt_devices);
             gravity_bt_devices = NULL;
             gravity_bt_dev_count = 0;
+            btDeviceCapacity = 0;
         }
+        bt_index_rebuild();
+        bt_pool_trim();
     } else {
         /* Shorten gravity_bt_devices */
         err = gravity_bt_shrink_devices();
@@ -2596,8 +3757,14 @@ esp_err_t purgeBT(gravity_bt_purge_strategy_t strategy, uint16_t minAge, int32_t
    gravity_bt_purge_strategy_t purgeStrategy = GRAVITY_BLE_PURGE_NONE;
    This variable is used by the function if memory allocation for the new device fails
 */
-void *gravity_ble_purge_and_malloc(uint16_t bytes) {
-    void *retVal = malloc(bytes);
+void *gravity_ble_purge_and_malloc(size_t bytes) {
+    return gravity_ble_purge_and_alloc(GRAVITY_MEM_HOT, 0, bytes);
+}
+
+/* As gravity_ble_purge_and_malloc(), allocating from the specified storage tier
+   and aligning to alignment bytes if it isn't 0 */
+void *gravity_ble_purge_and_alloc(gravity_mem_tier_t tier, size_t alignment, size_t bytes) {
+    void *retVal = gravity_mem_alloc_aligned(tier, alignment, bytes);
     gravity_bt_purge_strategy_t purgeAttempts = purgeStrategy;
     esp_err_t err = ESP_OK;
     while (retVal == NULL) {
@@ -2659,51 +3826,27 @@ void *gravity_ble_purge_and_malloc(uint16_t bytes) {
         // If there's nothing else I can purge
         //    break;
         // Purge stuff
-        retVal = malloc(bytes);
+        retVal = gravity_mem_alloc_aligned(tier, alignment, bytes);
     };
     return retVal;
 }
 
 /* Shrink gravity_bt_devices to remove gaps left after purging elements
-   This function will regenerate a new instance of gravity_bt_devices,
-   removing any elements of gravity_bt_devices that are NULL.
+   This function compacts gravity_bt_devices in place, removing any elements
+   that are NULL, and returns any slab memory that is no longer needed.
 */
 esp_err_t gravity_bt_shrink_devices() {
     esp_err_t err = ESP_OK;
-    uint8_t targetCount = 0; /* Number of elements at end of function */
-    app_gap_cb_t **newDevices = NULL;
+    uint16_t targetCount = 0; /* Number of elements at end of function */
 
-    /* Count number of elements in result */
-    for (int i = 0; i < gravity_bt_dev_count; ++i) {
-        if (gravity_bt_devices[i] != NULL) {
-            ++targetCount;
-        }
-    }
-    /* Allocate memory for new gravity_bt_devices if it has any elements */
-    if (targetCount > 0) {
-        newDevices = malloc(sizeof(app_gap_cb_t *) * targetCount);
-        if (newDevices == NULL) {
-            #ifdef CONFIG_FLIPPER
-                printf("Unable to allocate memory for %u pointers.\n", targetCount);
-            #else
-                ESP_LOGE(BT_TAG, "Unable to allocate memory for %u BT pointers.", targetCount);
-            #endif
-            return ESP_ERR_NO_MEM;
-        }
-    }
-    /* Copy across pointers from gravity_bt_devices into newDevices */
-    targetCount = 0;
     for (int i = 0; i < gravity_bt_dev_count; ++i) {
         if (gravity_bt_devices[i] != NULL) {
-            newDevices[targetCount++] = gravity_bt_devices[i];
+            gravity_bt_devices[targetCount++] = gravity_bt_devices[i];
         }
     }
-    /* Free and replace gravity_bt_devices */
-    if (gravity_bt_devices != NULL && gravity_bt_dev_count > 0) {
-        free(gravity_bt_devices);
-    }
-    gravity_bt_devices = newDevices;
     gravity_bt_dev_count = targetCount;
+    bt_index_rebuild();
+    bt_pool_trim();
 
     return err;
 }
@@ -8,6 +8,9 @@
 #include <esp_wifi_types.h>
 #include <stddef.h>
 #include "common.h"
+#include "mac.h"
+#include "adv.h"
+#include "mem.h"
 
 #if defined(CONFIG_BT_ENABLED)
 
@@ -28,6 +31,16 @@ typedef enum {
     GRAVITY_BT_SCAN_TYPE_COUNT
 } gravity_bt_scan_t;
 
+/* BLE scan profiles, trading discovery speed against the number of
+   advertisements Gravity has to process */
+typedef enum {
+    GRAVITY_BLE_PROFILE_AGGRESSIVE = 0,
+    GRAVITY_BLE_PROFILE_BALANCED,
+    GRAVITY_BLE_PROFILE_FILTERED,
+    GRAVITY_BLE_PROFILE_PASSIVE,
+    GRAVITY_BLE_PROFILE_COUNT
+} gravity_ble_profile_t;
+
 typedef enum {
     APP_GAP_STATE_IDLE = 0,
     APP_GAP_STATE_DEVICE_DISCOVERING,
@@ -36,65 +49,102 @@ typedef enum {
     APP_GAP_STATE_SERVICE_DISCOVER_COMPLETE,
 } app_gap_state_t;
 
+/* Members of these structs are ordered largest first so that
+   the compiler doesn't need to pad them */
+
+/* Primary GATT services of a BLE device, in a single allocation sized to fit:
+   uuid16Count 16-bit UUIDs followed by uuid128Count 128-bit UUIDs, both in
+   the byte order used by esp_bt_uuid_t. 32-bit UUIDs are stored as 128-bit */
 typedef struct {
-    //esp_bt_uuid_t *uuid;
-    uint16_t uuid16;
-    char name[40];
-} bt_uuid;
+    clock_t lastSeen;
+    uint8_t uuid16Count;
+    uint8_t uuid128Count;
+    uint8_t uuids[];
+} grav_ble_gatt;
 
 typedef struct {
-    uint8_t num_services;
     esp_bt_uuid_t *service_uuids;
-    bt_uuid **known_services;
-    uint8_t known_services_len;
+    uint16_t *known_services; /* 16-bit UUIDs of services with a name */
+    grav_ble_gatt *gatt; /* BLE GATT services, NULL until discovered */
     clock_t lastSeen;
+    uint8_t num_services;
+    uint8_t known_services_len;
 } grav_bt_svc;
 
+/* Dual-mode devices are found by both Classic discovery and BLE scanning.
+   They are held in a single record, with what was seen on each transport
+   kept separately. Transports are indexed by gravity_bt_scan_t */
+#define GRAVITY_BT_TRANSPORT_COUNT (GRAVITY_BT_SCAN_BLE + 1)
+
 typedef struct {
-    uint8_t bdname_len;
+    uint8_t *eir; /* EIR (Classic) or advertising data (BLE) */
+    uint32_t eirDigest; /* Digest of eir, to recognise repeated advertisements */
+    clock_t lastSeen;
+    int8_t rssi;
     uint8_t eir_len;
-    int32_t rssi;
+} grav_bt_transport;
+
+typedef struct {
+    gravity_mac_t bdaKey; /* Packed bda */
+    int32_t rssi; /* From the transport the device was most recently seen on */
     uint32_t cod;
-    uint8_t *eir; // Was [ESP_BT_GAP_EIR_DATA_LEN];
     char *bdName; // Was [ESP_BT_GAP_MAX_BDNAME_LEN + 1];
+    clock_t lastSeen; /* Most recent of the transports' lastSeen */
+    grav_bt_svc bt_services; /* Hold service scan results */
+    grav_bt_transport transport[GRAVITY_BT_TRANSPORT_COUNT];
+    GravityAdvSummary adv; /* Fields decoded from the BLE advertisement, or EIR if there isn't one */
+    uint16_t index;
     esp_bd_addr_t bda;
-    gravity_bt_scan_t scanType;
-    clock_t lastSeen;
+    uint8_t bdname_len;
+    uint8_t transports; /* Bit (1 << gravity_bt_scan_t) is set for each transport the device has been seen on */
+    uint8_t bleAddrType; /* esp_ble_addr_type_t of the BLE address, needed to connect */
     bool selected;
-    uint8_t index;
-    grav_bt_svc bt_services; /* Hold service scan results */
 } app_gap_cb_t;
 
-extern bt_uuid bt_uuids[];
+/* Devices are numbered from 1; gravity_bt_dev_count can't exceed this */
+#define GRAVITY_BT_MAX_DEVICES UINT16_MAX
+
 extern app_gap_cb_t **gravity_bt_devices;
-extern uint8_t gravity_bt_dev_count;
+extern uint16_t gravity_bt_dev_count;
 extern app_gap_cb_t **gravity_selected_bt;
-extern uint8_t gravity_sel_bt_count;
+extern uint16_t gravity_sel_bt_count;
 
 extern const char *BT_TAG;
 
 esp_err_t bt_listAllServices();
-esp_err_t bt_listAllServicesFor(app_gap_cb_t **devices, uint8_t devCount);
+esp_err_t bt_listAllServicesFor(app_gap_cb_t **devices, uint16_t devCount);
 esp_err_t bt_listAllServicesDev(app_gap_cb_t *thisDev);
 esp_err_t bt_service_rm_all();
-esp_err_t listKnownServices(app_gap_cb_t **devices, uint8_t devCount);
+esp_err_t listKnownServices(app_gap_cb_t **devices, uint16_t devCount);
 esp_err_t listKnownServicesDev(app_gap_cb_t *thisDev);
 esp_err_t listUnknownServices();
 app_gap_cb_t *deviceWithBDA(esp_bd_addr_t bda);
 esp_err_t identifyKnownServices(app_gap_cb_t *thisDev);
+esp_err_t gravity_ble_initialise();
 esp_err_t gravity_ble_scan_start(gravity_bt_purge_strategy_t purgeStrat);
+esp_err_t gravity_ble_set_profile(gravity_ble_profile_t profile);
+gravity_ble_profile_t gravity_ble_get_profile();
+esp_err_t gravity_ble_profile_from_string(const char *str, gravity_ble_profile_t *profile);
+esp_err_t gravity_ble_profile_report();
+esp_err_t gravity_ble_scan_pause();
+esp_err_t gravity_ble_scan_resume();
+esp_err_t gravity_bt_discovery_pause();
+esp_err_t gravity_bt_discovery_resume();
 esp_err_t gravity_bt_initialise();
 esp_err_t gravity_bt_gap_start();
 esp_err_t gravity_bt_gap_services_discover(app_gap_cb_t *device);
 esp_err_t gravity_bt_scan_display_status();
-esp_err_t gravity_bt_list_all_devices(bool hideExpiredPackets);
-esp_err_t gravity_bt_list_devices(app_gap_cb_t **devices, uint8_t deviceCount, bool hideExpiredPackets);
+esp_err_t gravity_bt_list_all_devices(bool hideExpiredPackets, const GravityFilter *filter);
+esp_err_t gravity_bt_list_devices(app_gap_cb_t **devices, uint16_t deviceCount, bool hideExpiredPackets, const GravityFilter *filter);
+bool gravity_bt_dev_matches(const GravityFilter *filter, app_gap_cb_t *dev, unsigned long elapsed);
 esp_err_t gravity_clear_bt();
 esp_err_t gravity_clear_bt_selected();
-esp_err_t gravity_select_bt(uint8_t selIndex);
-bool gravity_bt_isSelected(uint8_t selIndex);
+esp_err_t gravity_select_bt(uint16_t selIndex);
+esp_err_t gravity_select_bt_where(const GravityFilter *filter, uint32_t top, GRAVITY_SORT_TYPE rankBy, uint32_t *newCount);
+bool gravity_bt_isSelected(uint16_t selIndex);
 esp_err_t gravity_bt_disable_scan();
-void *gravity_ble_purge_and_malloc(uint16_t bytes);
+void *gravity_ble_purge_and_malloc(size_t bytes);
+void *gravity_ble_purge_and_alloc(gravity_mem_tier_t tier, size_t alignment, size_t bytes);
 esp_err_t gravity_bt_shrink_devices();
 char *purgeStrategyToString(gravity_bt_purge_strategy_t strategy, char *strOutput);
 esp_err_t purgeBLE(gravity_bt_purge_strategy_t strategy, uint16_t minAge, int32_t maxRssi);
@@ -106,12 +156,13 @@ esp_err_t bt_dev_add_components(esp_bd_addr_t bda, char *bdName, uint8_t bdNameL
 esp_err_t bt_dev_copy(app_gap_cb_t dest, app_gap_cb_t source);
 
 esp_err_t bt_scanTypeToString(gravity_bt_scan_t scanType, char *strOutput);
-bool isBDAInArray(esp_bd_addr_t bda, app_gap_cb_t **array, uint8_t arrayLen);
+bool isBDAInArray(esp_bd_addr_t bda, app_gap_cb_t **array, uint16_t arrayLen);
 esp_err_t gravity_bt_discover_all_services();
 esp_err_t gravity_bt_discover_selected_services();
 //esp_err_t gravity_bt_discover_services(app_gap_cb_t *dev);
 
-esp_err_t updateDevice(bool *updatedFlags, esp_bd_addr_t theBda, int32_t theCod, int32_t theRssi, uint8_t theNameLen, char *theName, uint8_t theEirLen, uint8_t *theEir);
+bool gravity_bt_dev_seen_on(app_gap_cb_t *dev, gravity_bt_scan_t transport);
+esp_err_t updateDevice(bool *updatedFlags, app_gap_cb_t *device, esp_bd_addr_t theBda, int32_t theCod, int32_t theRssi, uint8_t theNameLen, char *theName, uint8_t theEirLen, uint8_t *theEir, gravity_bt_scan_t transport);
 
 #endif
 #endif
\ No newline at end of file
@@ -0,0 +1,396 @@
+#include "coex.h"
+#include "common.h"
+#include "hop.h"
+#include <esp_timer.h>
+#include <stdlib.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+const char *COEX_TAG = "coex@GRAVITY";
+
+#ifdef CONFIG_COEX_PERIOD_MILLIS
+    #define COEX_PERIOD_MILLIS CONFIG_COEX_PERIOD_MILLIS
+#else
+    #define COEX_PERIOD_MILLIS 4000
+#endif
+
+static const char *coexRadioNames[GRAVITY_COEX_RADIO_COUNT] = { "WiFi", "BLE", "BT Classic" };
+
+/* Relative share of each scheduling period given to each radio */
+static uint8_t coexWeights[GRAVITY_COEX_RADIO_COUNT] = {
+    #ifdef CONFIG_COEX_WEIGHT_WIFI
+        CONFIG_COEX_WEIGHT_WIFI, CONFIG_COEX_WEIGHT_BLE, CONFIG_COEX_WEIGHT_BT_CLASSIC
+    #else
+        2, 1, 1
+    #endif
+};
+
+/* The scheduler is driven from the console and coexTimer. The lock is
+   created by the first refresh, which comes from the console before the
+   timer can be started */
+static esp_timer_handle_t coexTimer = NULL;
+static StaticSemaphore_t coexLockBuffer;
+static SemaphoreHandle_t coexLock = NULL;
+static bool coexRunning = false;
+static gravity_coex_radio_t coexCurrent = GRAVITY_COEX_WIFI;
+/* Radios that have been paused by the scheduler. Scans check this before
+   restarting themselves */
+static volatile bool coexPaused[GRAVITY_COEX_RADIO_COUNT];
+
+/* Statistics since the scheduler last started, until it stopped */
+static int64_t coexStatsStart = 0;
+static int64_t coexStatsEnd = 0;
+static long coexSliceMillis = 0;
+static uint64_t coexScheduledMicros[GRAVITY_COEX_RADIO_COUNT];
+static uint32_t coexSlices[GRAVITY_COEX_RADIO_COUNT];
+static volatile uint32_t coexDiscoveries[GRAVITY_COEX_RADIO_COUNT];
+
+/* Airtime each radio has actually spent listening, measured from the radio
+   events reported to gravity_coex_record_airtime(). These arrive from the
+   Bluetooth stack's task as well as the console and coexTimer, so they have
+   their own lock. Time is only counted while the scheduler runs */
+static portMUX_TYPE coexAirLock = portMUX_INITIALIZER_UNLOCKED;
+static bool coexAirCounting = false;
+static bool coexAirOn[GRAVITY_COEX_RADIO_COUNT];
+static int64_t coexAirSince[GRAVITY_COEX_RADIO_COUNT];
+static uint64_t coexAirMicros[GRAVITY_COEX_RADIO_COUNT];
+
+static void coex_timer_cb(void *arg);
+
+/* Start or stop counting airtime. Starting discards the airtime counted so
+   far; stopping adds on the time radios have been listening until now */
+static void coex_airtime_count(bool counting, int64_t now) {
+    portENTER_CRITICAL(&coexAirLock);
+    for (int i = 0; i < GRAVITY_COEX_RADIO_COUNT; ++i) {
+        if (counting) {
+            coexAirMicros[i] = 0;
+        } else if (coexAirCounting && coexAirOn[i]) {
+            coexAirMicros[i] += now - coexAirSince[i];
+        }
+        coexAirSince[i] = now;
+    }
+    coexAirCounting = counting;
+    portEXIT_CRITICAL(&coexAirLock);
+}
+
+/* Is radio's scan active? */
+static bool coex_radio_wanted(gravity_coex_radio_t radio) {
+    switch (radio) {
+        case GRAVITY_COEX_WIFI:
+            return attack_status[ATTACK_SCAN];
+        #if defined(CONFIG_BT_ENABLED)
+            case GRAVITY_COEX_BLE:
+                return attack_status[ATTACK_SCAN_BLE];
+            case GRAVITY_COEX_BT_CLASSIC:
+                return attack_status[ATTACK_SCAN_BT_DISCOVERY];
+        #endif
+        default:
+            return false;
+    }
+}
+
+/* Sum of the weights of the radios that are scanning. If every one has a
+   weight of 0 they're all given an equal share */
+static uint16_t coex_weight_total() {
+    uint16_t total = 0;
+    for (int i = 0; i < GRAVITY_COEX_RADIO_COUNT; ++i) {
+        if (coex_radio_wanted(i)) {
+            total += coexWeights[i];
+        }
+    }
+    return total;
+}
+
+static bool coex_radio_schedulable(gravity_coex_radio_t radio) {
+    return coex_radio_wanted(radio) && (coexWeights[radio] > 0 || coex_weight_total() == 0);
+}
+
+static uint8_t coex_wanted_count() {
+    uint8_t count = 0;
+    for (int i = 0; i < GRAVITY_COEX_RADIO_COUNT; ++i) {
+        if (coex_radio_wanted(i)) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+/* Length of radio's slice of the scheduling period */
+static long coex_slice_millis(gravity_coex_radio_t radio) {
+    uint16_t total = coex_weight_total();
+    if (total == 0) {
+        return COEX_PERIOD_MILLIS / coex_wanted_count();
+    }
+    return (long)COEX_PERIOD_MILLIS * coexWeights[radio] / total;
+}
+
+/* The radio to schedule after radio */
+static gravity_coex_radio_t coex_next(gravity_coex_radio_t radio) {
+    for (int i = 1; i <= GRAVITY_COEX_RADIO_COUNT; ++i) {
+        gravity_coex_radio_t next = (radio + i) % GRAVITY_COEX_RADIO_COUNT;
+        if (coex_radio_schedulable(next)) {
+            return next;
+        }
+    }
+    return radio;
+}
+
+static esp_err_t coex_pause(gravity_coex_radio_t radio) {
+    esp_err_t err = ESP_OK;
+    coexPaused[radio] = true;
+    switch (radio) {
+        case GRAVITY_COEX_WIFI:
+            err |= esp_wifi_set_promiscuous(false);
+            if (err == ESP_OK) {
+                gravity_coex_record_airtime(GRAVITY_COEX_WIFI, false);
+            }
+            err |= hop_state_refresh();
+            break;
+        #if defined(CONFIG_BT_ENABLED)
+            case GRAVITY_COEX_BLE:
+                err |= gravity_ble_scan_pause();
+                break;
+            case GRAVITY_COEX_BT_CLASSIC:
+                err |= gravity_bt_discovery_pause();
+                break;
+        #endif
+        default:
+            break;
+    }
+    return err;
+}
+
+static esp_err_t coex_resume(gravity_coex_radio_t radio) {
+    esp_err_t err = ESP_OK;
+    coexPaused[radio] = false;
+    switch (radio) {
+        case GRAVITY_COEX_WIFI:
+            err |= esp_wifi_set_promiscuous(true);
+            if (err == ESP_OK) {
+                gravity_coex_record_airtime(GRAVITY_COEX_WIFI, true);
+            }
+            err |= hop_state_refresh();
+            break;
+        #if defined(CONFIG_BT_ENABLED)
+            case GRAVITY_COEX_BLE:
+                err |= gravity_ble_scan_resume();
+                break;
+            case GRAVITY_COEX_BT_CLASSIC:
+                err |= gravity_bt_discovery_resume();
+                break;
+        #endif
+        default:
+            break;
+    }
+    return err;
+}
+
+/* Give the radio to next, for one slice */
+static esp_err_t coex_begin_slice(gravity_coex_radio_t next) {
+    esp_err_t err = ESP_OK;
+    if (next != coexCurrent || coexPaused[next]) {
+        if (!coexPaused[coexCurrent] && coex_radio_wanted(coexCurrent)) {
+            err |= coex_pause(coexCurrent);
+        }
+        err |= coex_resume(next);
+    }
+    coexCurrent = next;
+    coexSliceMillis = coex_slice_millis(next);
+    coexScheduledMicros[next] += (uint64_t)coexSliceMillis * 1000;
+    ++coexSlices[next];
+    err |= esp_timer_start_once(coexTimer, (uint64_t)coexSliceMillis * 1000);
+    return err;
+}
+
+static void coex_timer_cb(void *arg) {
+    xSemaphoreTake(coexLock, portMAX_DELAY);
+    if (coexRunning) {
+        coex_begin_slice(coex_next(coexCurrent));
+    }
+    xSemaphoreGive(coexLock);
+}
+
+/* Start or stop the scheduler to match the scans that are active. Call this
+   whenever a WiFi, BLE or Bluetooth Classic scan starts or stops */
+esp_err_t gravity_coex_refresh() {
+    esp_err_t err = ESP_OK;
+    if (coexLock == NULL) {
+        coexLock = xSemaphoreCreateMutexStatic(&coexLockBuffer);
+    }
+    if (coexTimer == NULL) {
+        esp_timer_create_args_t args = {
+            .callback = &coex_timer_cb,
+            .name = "coexTimer"
+        };
+        err = esp_timer_create(&args, &coexTimer);
+        if (err != ESP_OK) {
+            #ifdef CONFIG_FLIPPER
+                printf("Failed to create coex timer\n");
+            #else
+                ESP_LOGE(COEX_TAG, "Failed to create the radio coexistence timer: %s.", esp_err_to_name(err));
+            #endif
+            return err;
+        }
+    }
+
+    xSemaphoreTake(coexLock, portMAX_DELAY);
+    int64_t now = esp_timer_get_time();
+    if (coex_wanted_count() >= 2) {
+        if (!coexRunning) {
+            /* Reset statistics and start with the first radio in turn */
+            coexStatsStart = now;
+            coex_airtime_count(true, now);
+            for (int i = 0; i < GRAVITY_COEX_RADIO_COUNT; ++i) {
+                coexScheduledMicros[i] = 0;
+                coexSlices[i] = 0;
+                coexDiscoveries[i] = 0;
+            }
+            coexCurrent = coex_next(GRAVITY_COEX_RADIO_COUNT - 1);
+        } else {
+            esp_timer_stop(coexTimer);
+        }
+        /* A radio that has just started scanning waits for its turn */
+        for (int i = 0; i < GRAVITY_COEX_RADIO_COUNT; ++i) {
+            if (i != coexCurrent && coex_radio_wanted(i) && !coexPaused[i]) {
+                err |= coex_pause(i);
+            }
+        }
+        /* Carry on with the current slice unless its radio has stopped scanning */
+        gravity_coex_radio_t next = coex_radio_schedulable(coexCurrent) ? coexCurrent : coex_next(coexCurrent);
+        err |= coex_begin_slice(next);
+        coexRunning = true;
+    } else if (coexRunning) {
+        esp_timer_stop(coexTimer);
+        coexStatsEnd = now;
+        coex_airtime_count(false, now);
+        coexRunning = false;
+        /* Hand the radio back to whichever scan remains. Promiscuous mode is
+           used by more than scanning, so WiFi is always restored */
+        for (int i = 0; i < GRAVITY_COEX_RADIO_COUNT; ++i) {
+            if (coexPaused[i]) {
+                if (i == GRAVITY_COEX_WIFI || coex_radio_wanted(i)) {
+                    err |= coex_resume(i);
+                } else {
+                    coexPaused[i] = false;
+                }
+            }
+        }
+    }
+    xSemaphoreGive(coexLock);
+    return err;
+}
+
+/* May radio's scan run now? Scans that restart themselves when a scan cycle
+   ends check this first */
+bool gravity_coex_radio_active(gravity_coex_radio_t radio) {
+    return !coexPaused[radio];
+}
+
+/* Called when a scan discovers a new device */
+void gravity_coex_record_discovery(gravity_coex_radio_t radio) {
+    ++coexDiscoveries[radio];
+}
+
+/* Called when radio actually starts or stops listening: WiFi when
+   promiscuous mode is enabled or disabled, BLE when a scan starts or ends,
+   and Bluetooth Classic when discovery starts or stops. Pausing a scan only
+   requests this, and Bluetooth reports it once the controller has done so */
+void gravity_coex_record_airtime(gravity_coex_radio_t radio, bool on) {
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&coexAirLock);
+    if (on != coexAirOn[radio]) {
+        if (coexAirCounting && coexAirOn[radio]) {
+            coexAirMicros[radio] += now - coexAirSince[radio];
+        }
+        coexAirSince[radio] = now;
+        coexAirOn[radio] = on;
+    }
+    portEXIT_CRITICAL(&coexAirLock);
+}
+
+/* Parse weights of the form <wifi>:<ble>:<classic>, e.g. "2:1:1" */
+esp_err_t gravity_coex_weights_parse(const char *spec) {
+    uint8_t newWeights[GRAVITY_COEX_RADIO_COUNT];
+    const char *pos = spec;
+    char *endPtr = NULL;
+    for (int i = 0; i < GRAVITY_COEX_RADIO_COUNT; ++i) {
+        long weight = strtol(pos, &endPtr, 10);
+        char expected = (i == GRAVITY_COEX_RADIO_COUNT - 1) ? '\0' : ':';
+        if (endPtr == pos || *endPtr != expected || weight < 0 || weight > UINT8_MAX) {
+            #ifdef CONFIG_FLIPPER
+                printf("Invalid weights \"%s\"\n", spec);
+            #else
+                ESP_LOGE(COEX_TAG, "Invalid weights \"%s\". Expected <wifi>:<ble>:<classic>, each from 0 to %d.", spec, UINT8_MAX);
+            #endif
+            return ESP_ERR_INVALID_ARG;
+        }
+        newWeights[i] = weight;
+        pos = endPtr + 1;
+    }
+    if (coexLock != NULL) {
+        xSemaphoreTake(coexLock, portMAX_DELAY);
+    }
+    memcpy(coexWeights, newWeights, sizeof(coexWeights));
+    if (coexLock != NULL) {
+        xSemaphoreGive(coexLock);
+    }
+    /* Apply the new weights from the next slice */
+    return ESP_OK;
+}
+
+/* str must have space for COEX_WEIGHTS_STRLEN + 1 characters */
+esp_err_t gravity_coex_weights_to_string(char *str) {
+    sprintf(str, "%u:%u:%u", coexWeights[GRAVITY_COEX_WIFI], coexWeights[GRAVITY_COEX_BLE], coexWeights[GRAVITY_COEX_BT_CLASSIC]);
+    return ESP_OK;
+}
+
+/* Display the weights, and for each radio the share of time it was
+   scheduled, the share it was measured listening, and the rate at which it
+   discovered new devices while listening, since the scheduler last started */
+esp_err_t gravity_coex_report() {
+    char strWeights[COEX_WEIGHTS_STRLEN + 1];
+    gravity_coex_weights_to_string(strWeights);
+    if (coexLock != NULL) {
+        xSemaphoreTake(coexLock, portMAX_DELAY);
+    }
+    int64_t now = esp_timer_get_time();
+    uint64_t active[GRAVITY_COEX_RADIO_COUNT];
+    portENTER_CRITICAL(&coexAirLock);
+    for (int i = 0; i < GRAVITY_COEX_RADIO_COUNT; ++i) {
+        active[i] = coexAirMicros[i];
+        if (coexAirCounting && coexAirOn[i]) {
+            active[i] += now - coexAirSince[i];
+        }
+    }
+    portEXIT_CRITICAL(&coexAirLock);
+    uint64_t elapsed = (coexStatsStart == 0) ? 0 : (coexRunning ? now : coexStatsEnd) - coexStatsStart;
+    #ifdef CONFIG_FLIPPER
+        printf("Coex %s, %ldms\nWeights %s\n", coexRunning?"ON":"OFF", (long)COEX_PERIOD_MILLIS, strWeights);
+    #else
+        ESP_LOGI(COEX_TAG, "Radio scheduler %s; weights (WiFi:BLE:Classic) %s over %ldms. %llus since the scheduler started.",
+                 coexRunning?"running":"idle", strWeights, (long)COEX_PERIOD_MILLIS, elapsed / 1000000);
+        ESP_LOGI(COEX_TAG, "  Radio       Slices  Target  Achieved  Found  Found/min");
+    #endif
+    for (int i = 0; i < GRAVITY_COEX_RADIO_COUNT; ++i) {
+        /* Percentages and rates in tenths */
+        uint32_t target = (elapsed == 0) ? 0 : (uint32_t)(coexScheduledMicros[i] * 1000 / elapsed);
+        uint32_t achieved = (elapsed == 0) ? 0 : (uint32_t)(active[i] * 1000 / elapsed);
+        uint32_t rate = (active[i] == 0) ? 0 : (uint32_t)((uint64_t)coexDiscoveries[i] * 600000000ULL / active[i]);
+        if (target > 1000) {
+            target = 1000;
+        }
+        if (achieved > 1000) {
+            achieved = 1000;
+        }
+        #ifdef CONFIG_FLIPPER
+            printf("%s: %lu.%lu%% %lu.%lu/m\n", coexRadioNames[i], achieved / 10, achieved % 10, rate / 10, rate % 10);
+        #else
+            ESP_LOGI(COEX_TAG, "  %-10s  %6lu  %4lu.%lu%%  %5lu.%lu%%  %5lu  %7lu.%lu", coexRadioNames[i], coexSlices[i],
+                     target / 10, target % 10, achieved / 10, achieved % 10, coexDiscoveries[i], rate / 10, rate % 10);
+        #endif
+    }
+    if (coexLock != NULL) {
+        xSemaphoreGive(coexLock);
+    }
+    return ESP_OK;
+}
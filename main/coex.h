@@ -0,0 +1,36 @@
+#ifndef GRAVITY_COEX_H
+#define GRAVITY_COEX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <esp_err.h>
+
+/* Radio coexistence scheduler
+   ESP32 has a single 2.4GHz radio. When a WiFi scan runs alongside a BLE scan
+   or Bluetooth Classic discovery, the scheduler shares airtime between them
+   explicitly: each scheduling period is divided into slices in proportion to
+   the radios' weights, and only the radio that owns the current slice is
+   scanning. The scheduler only runs while two or more scans are active.
+*/
+
+typedef enum {
+    GRAVITY_COEX_WIFI = 0,
+    GRAVITY_COEX_BLE,
+    GRAVITY_COEX_BT_CLASSIC,
+    GRAVITY_COEX_RADIO_COUNT
+} gravity_coex_radio_t;
+
+/* Space needed to format the weights: "255:255:255" */
+#define COEX_WEIGHTS_STRLEN 11
+
+extern const char *COEX_TAG;
+
+esp_err_t gravity_coex_refresh();
+bool gravity_coex_radio_active(gravity_coex_radio_t radio);
+void gravity_coex_record_discovery(gravity_coex_radio_t radio);
+void gravity_coex_record_airtime(gravity_coex_radio_t radio, bool on);
+esp_err_t gravity_coex_weights_parse(const char *spec);
+esp_err_t gravity_coex_weights_to_string(char *str);
+esp_err_t gravity_coex_report();
+
+#endif
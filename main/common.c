@@ -18,6 +18,19 @@ char STRINGS_HOPMODE_INVALID[] = "Invalid hopMode ";
 gravity_bt_purge_strategy_t purgeStrategy = GRAVITY_BLE_PURGE_NONE;
 uint16_t PURGE_MIN_AGE = 180; // TODO: Add these as args to SCAN
 int32_t PURGE_MAX_RSSI = -70;
+#ifdef CONFIG_BLE_MEMORY_BUDGET
+    uint16_t PURGE_MEMORY_BUDGET = CONFIG_BLE_MEMORY_BUDGET;
+#else
+    uint16_t PURGE_MEMORY_BUDGET = 0;
+#endif
+#ifdef CONFIG_BLE_MEMORY_BUDGET_AUTO
+    bool PURGE_MEMORY_BUDGET_AUTO = true;
+#else
+    bool PURGE_MEMORY_BUDGET_AUTO = false;
+#endif
+
+/* Lookup table used to format bytes as hexadecimal without sprintf() */
+static const char HEX_DIGITS[] = "0123456789ABCDEF";
 
 int max(int one, int two) {
     if (one >= two) {
@@ -51,12 +64,24 @@ esp_err_t mac_string_to_bytes(char *strMac, uint8_t *bMac) {
     return ESP_OK;
 }
 
+/* Format the specified key as a string representing a MAC address.
+   strMac must be a pointer initialised to contain at least
+   18 bytes (MAC + '\0') */
+void gravity_mac_format(gravity_mac_t key, char *strMac) {
+    for (int i = 0; i < GRAVITY_MAC_LEN; ++i) {
+        uint8_t thisByte = (key >> (8 * (GRAVITY_MAC_LEN - 1 - i))) & 0xFF;
+        strMac[3 * i] = HEX_DIGITS[thisByte >> 4];
+        strMac[3 * i + 1] = HEX_DIGITS[thisByte & 0x0F];
+        strMac[3 * i + 2] = ':';
+    }
+    strMac[MAC_STRLEN] = '\0';
+}
+
 /* Convert the specified byte array to a string representing
    a MAC address. strMac must be a pointer initialised to
    contain at least 18 bytes (MAC + '\0') */
 esp_err_t mac_bytes_to_string(uint8_t *bMac, char *strMac) {
-    sprintf(strMac, "%02X:%02X:%02X:%02X:%02X:%02X", bMac[0],
-            bMac[1], bMac[2], bMac[3], bMac[4], bMac[5]);
+    gravity_mac_format(gravity_mac_load(bMac), strMac);
     return ESP_OK;
 }
 
@@ -69,18 +94,18 @@ esp_err_t mac_bytes_to_string(uint8_t *bMac, char *strMac) {
    (standard formatting - 0F:AA:E5)
 */
 esp_err_t bytes_to_string(uint8_t *bytes, char *string, int byteCount) {
-    esp_err_t err = ESP_OK;
-    char temp[4];
-    memset(string, '\0', (3 * byteCount));
+    if (byteCount <= 0) {
+        string[0] = '\0';
+        return ESP_OK;
+    }
     for (int i = 0; i < byteCount; ++i) {
-        sprintf(temp, "%02X", bytes[i]);
-        if (i < (byteCount - 1)) {
-            /* If we're not printing the last byte append ':' */
-            strcat(temp, ":");
-        }
-        strcat(string, temp);
+        string[3 * i] = HEX_DIGITS[bytes[i] >> 4];
+        string[3 * i + 1] = HEX_DIGITS[bytes[i] & 0x0F];
+        string[3 * i + 2] = ':';
     }
-    return err;
+    /* Replace the final ':' with a terminator */
+    string[3 * byteCount - 1] = '\0';
+    return ESP_OK;
 }
 
 /* Return the GravityCommand (typedef enum) associated with
@@ -157,20 +182,23 @@ GravityCommand gravityCommandFromString(char *input) {
     if (!strcasecmp(input, "purge")) {
         return GRAVITY_PURGE;
     }
+    if (!strcasecmp(input, "survey")) {
+        return GRAVITY_SURVEY;
+    }
     return GRAVITY_NONE;
 }
 
 /* Check whether the specified ScanResultSTA list contains the specified ScanResultSTA */
 bool staResultListContainsSTA(ScanResultSTA **list, int listLen, ScanResultSTA *sta) {
 	int i;
-	for (i = 0; i < listLen && memcmp(list[i]->mac, sta->mac, 6); ++i) { }
+	for (i = 0; i < listLen && list[i]->macKey != sta->macKey; ++i) { }
 	return (i < listLen);
 }
 
 /* Check whether the specified ScanResultAP list contains the specified ScanResultAP */
 bool apResultListContainsAP(ScanResultAP **list, int listLen, ScanResultAP *ap) {
     int i;
-    for (i = 0; i < listLen && memcmp(list[i]->espRecord.bssid, ap->espRecord.bssid, 6); ++i) { }
+    for (i = 0; i < listLen && list[i]->bssidKey != ap->bssidKey; ++i) { }
     return (i < listLen);
 }
 
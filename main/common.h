@@ -16,6 +16,9 @@
 #include <esp_interface.h>
 #include <esp_wifi_types.h>
 
+#include "filter.h"
+#include "mac.h"
+
 /* Adding mana.h causes it to be unabe to use PROBE_RESPONSE_AUTH_TYPE */
 /* Adding scan.h causes it to be unable to use ScanResultAP and ScanResultSTA */
 #include "usage_const.h"
@@ -41,11 +44,20 @@ typedef enum {
     GRAVITY_BLE_PURGE_NONE = 16
 } gravity_bt_purge_strategy_t;
 
-/* Include after the above enum */
+/* Sort orders, used by view and select-where */
+typedef enum GRAVITY_SORT_TYPE {
+    GRAVITY_SORT_NONE,
+    GRAVITY_SORT_AGE,
+    GRAVITY_SORT_RSSI,
+    GRAVITY_SORT_SSID
+} GRAVITY_SORT_TYPE;
+
+/* Include after the above enums */
 #include "bluetooth.h"
 
 struct ScanResultAP {
     wifi_ap_record_t espRecord;
+    gravity_mac_t bssidKey; /* Packed espRecord.bssid */
     clock_t lastSeen;
     int index;
     bool selected;
@@ -59,8 +71,9 @@ struct ScanResultSTA {
     int index;
     bool selected;
     uint8_t mac[6];
-    char strMac[MAC_STRLEN + 1];
+    gravity_mac_t macKey;
     uint8_t apMac[6];
+    gravity_mac_t apKey;
     ScanResultAP *ap;
     int channel;
     wifi_second_chan_t second;
@@ -87,6 +100,7 @@ enum AttackMode {
     ATTACK_RANDOMISE_MAC, // True
     ATTACK_BT,
     ATTACK_STALK,
+    ATTACK_SURVEY,
     ATTACKS_COUNT
 };
 typedef enum AttackMode AttackMode;
@@ -116,6 +130,7 @@ enum GravityCommand {
     GRAVITY_GET_VERSION,
     GRAVITY_PURGE,
     GRAVITY_BT,
+    GRAVITY_SURVEY,
     GRAVITY_NONE = 99
 };
 typedef enum GravityCommand GravityCommand;
@@ -145,13 +160,6 @@ typedef enum PROBE_RESPONSE_AUTH_TYPE {
 extern const char *AUTH_TYPE_NAMES[];
 extern const char *AUTH_TYPE_FLIPPER_NAMES[];
 
-typedef enum GRAVITY_SORT_TYPE {
-    GRAVITY_SORT_NONE,
-    GRAVITY_SORT_AGE,
-    GRAVITY_SORT_RSSI,
-    GRAVITY_SORT_SSID
-} GRAVITY_SORT_TYPE;
-
 /* General-purpose device selector */
 typedef enum GravityDeviceType {
     GRAVITY_DEV_AP = 1,
@@ -192,10 +200,10 @@ extern ScanResultAP *gravity_aps;
 extern ScanResultSTA *gravity_stas;
 extern ScanResultAP **gravity_selected_aps;
 extern ScanResultSTA **gravity_selected_stas;
-esp_err_t gravity_list_all_stas(bool hideExpiredPackets);
-esp_err_t gravity_list_all_aps(bool hideExpiredPackets);
-esp_err_t gravity_list_sta(ScanResultSTA **stas, int staCount, bool hideExpiredPackets);
-esp_err_t gravity_list_ap(ScanResultAP **aps, int apCount, bool hideExpiredPackets);
+esp_err_t gravity_list_all_stas(bool hideExpiredPackets, const GravityFilter *filter);
+esp_err_t gravity_list_all_aps(bool hideExpiredPackets, const GravityFilter *filter);
+esp_err_t gravity_list_sta(ScanResultSTA **stas, int staCount, bool hideExpiredPackets, const GravityFilter *filter);
+esp_err_t gravity_list_ap(ScanResultAP **aps, int apCount, bool hideExpiredPackets, const GravityFilter *filter);
 
 esp_err_t authTypeToString(PROBE_RESPONSE_AUTH_TYPE authType, char theString[], bool flipperStrings);
 esp_err_t send_probe_response(uint8_t *srcAddr, uint8_t *destAddr, char *ssid, enum PROBE_RESPONSE_AUTH_TYPE authType, uint16_t seqNum);
@@ -222,6 +230,8 @@ extern const char *TAG;
 extern gravity_bt_purge_strategy_t purgeStrategy;
 extern uint16_t PURGE_MIN_AGE;
 extern int32_t PURGE_MAX_RSSI;
+extern uint16_t PURGE_MEMORY_BUDGET; /* KB; 0 is unlimited */
+extern bool PURGE_MEMORY_BUDGET_AUTO; /* Size PURGE_MEMORY_BUDGET from free memory */
 
 /* Common string definitions */
 extern char STRINGS_HOP_STATE_FAIL[];
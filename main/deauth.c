@@ -2,6 +2,7 @@
 #include "common.h"
 #include "esp_err.h"
 #include "probe.h"
+#include "frames.h"
 
 // ========== DEAUTH PACKET ========== //
 uint8_t deauth_pkt[26] = {
@@ -67,11 +68,12 @@ void deauthLoop(void *pvParameter) {
                 targetCount = 1;
                 // TODO: Channel
                 memset(targetSTA[0]->mac, 0xFF, 6);
-                strcpy(targetSTA[0]->strMac, "FF:FF:FF:FF:FF:FF");
+                targetSTA[0]->macKey = GRAVITY_MAC_BROADCAST;
                 /* Use device MAC as srcAddr */
                 uint8_t myMac[6];
                 ESP_ERROR_CHECK(esp_wifi_get_mac(WIFI_IF_AP, myMac));
                 memcpy(targetSTA[0]->apMac, myMac, 6);
+                targetSTA[0]->apKey = gravity_mac_load(myMac);
                 break;
             case DEAUTH_MODE_STA:
                 /* Use gravity_selected_sta as targetSTA */
@@ -116,7 +118,9 @@ void deauthLoop(void *pvParameter) {
                     /* Set device MAC to targetSTA[i].apMac if it exists */
                     #ifdef CONFIG_DEBUG_VERBOSE
                         printf("spoofing, i is %d, mode is %d", i, mode);
-                        printf(" STA is %s", targetSTA[i]->strMac);
+                        char strSta[MAC_STRLEN + 1];
+                        gravity_mac_format(targetSTA[i]->macKey, strSta);
+                        printf(" STA is %s", strSta);
                         printf(" AP is %p", targetSTA[i]->ap);
                         printf(" AP MAC %02x:%02x:%02x:%02x:%02x:%02x\n",targetSTA[i]->apMac[0],targetSTA[i]->apMac[1],targetSTA[i]->apMac[2],targetSTA[i]->apMac[3],targetSTA[i]->apMac[4],targetSTA[i]->apMac[5]);
                     #endif
@@ -140,7 +144,9 @@ void deauthLoop(void *pvParameter) {
             }
             /* Set destination */
             #ifdef CONFIG_DEBUG_VERBOSE
-                printf("Destination %s\n",targetSTA[i]->strMac);
+                char strDest[MAC_STRLEN + 1];
+                gravity_mac_format(targetSTA[i]->macKey, strDest);
+                printf("Destination %s\n", strDest);
             #endif
             memcpy(&deauth_pkt[DEAUTH_DEST_OFFSET], targetSTA[i]->mac, 6);
 
@@ -194,6 +200,9 @@ esp_err_t deauth_stop() {
         deauthTask = NULL;
         mode = DEAUTH_MODE_OFF;
         attack_status[ATTACK_DEAUTH] = false;
+        /* Drop deauth's frame subscriptions and stop hopping if nothing else needs it */
+        gravity_frames_rebuild();
+        hop_state_refresh();
     }
 
     return ESP_OK;
@@ -271,10 +280,10 @@ esp_err_t display_deauth_status() {
     #ifdef CONFIG_DEBUG
         if (mode == DEAUTH_MODE_STA) {
             // Print selectedSTA
-            gravity_list_sta(gravity_selected_stas, gravity_sel_sta_count, false);
+            gravity_list_sta(gravity_selected_stas, gravity_sel_sta_count, false, NULL);
         } else if (mode == DEAUTH_MODE_AP) {
             // Print selectedAP
-            gravity_list_ap(gravity_selected_aps, gravity_sel_ap_count, false);
+            gravity_list_ap(gravity_selected_aps, gravity_sel_ap_count, false, NULL);
         }
     #endif
 
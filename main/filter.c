@@ -0,0 +1,457 @@
+#include "filter.h"
+#include "output.h"
+#include "sdkconfig.h"
+#include <ctype.h>
+#include <esp_log.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+static const char *FILTER_TAG = "filter@GRAVITY";
+
+/* Field names, with an alternative name that may also be used */
+static const char *fieldNames[GRAVITY_FIELD_COUNT][2] = {
+    { "RSSI", NULL },
+    { "CHANNEL", "CH" },
+    { "AGE", NULL },
+    { "SELECTED", NULL },
+    { "ASSOCIATED", NULL },
+    { "AP", NULL },
+    { "VENDOR", NULL },
+    { "NAME", "SSID" }
+};
+
+typedef struct {
+    const char *name;
+    const char *alias;
+    const char *heading;
+    uint8_t width;
+} filter_column_def_t;
+
+static const filter_column_def_t columnDefs[GRAVITY_COL_COUNT] = {
+    { "ID", NULL, " ID", 4 },
+    { "RSSI", NULL, "RSSI", 4 },
+    { "NAME", "SSID", "Name", 32 },
+    { "MAC", "BSSID", "MAC", 17 },
+    { "VENDOR", NULL, "Vendor", 20 },
+    { "CLIENTS", "CLI", "Cli", 3 },
+    { "AP", NULL, "Access Point", 36 },
+    { "CHANNEL", "CH", "Ch", 2 },
+    { "AGE", "LASTSEEN", "Last Seen", 24 },
+    { "WPS", NULL, "WPS", 3 },
+    { "CLASS", "COD", "Class", 10 },
+    { "SCAN", NULL, "Scan Method", 17 },
+    { "ADV", NULL, "Advertising", 0 }
+};
+
+void gravity_filter_init(GravityFilter *filter) {
+    memset(filter, 0, sizeof(GravityFilter));
+}
+
+/* Does arg start a filter clause? */
+bool gravity_filter_is_keyword(const char *arg) {
+    return !strcasecmp(arg, "WHERE") || !strcasecmp(arg, "LIMIT") || !strcasecmp(arg, "OFFSET") ||
+            !strcasecmp(arg, "COLUMNS");
+}
+
+/* Are the len characters at str name, ignoring case? */
+static bool filter_name_is(const char *str, size_t len, const char *name) {
+    return name != NULL && strlen(name) == len && !strncasecmp(str, name, len);
+}
+
+static bool filter_is_text_field(gravity_field_t field) {
+    return field == GRAVITY_FIELD_VENDOR || field == GRAVITY_FIELD_NAME;
+}
+
+static bool filter_is_bool_field(gravity_field_t field) {
+    return field == GRAVITY_FIELD_SELECTED || field == GRAVITY_FIELD_ASSOCIATED;
+}
+
+static void filter_invalid(const char *what, const char *arg) {
+    #ifdef CONFIG_FLIPPER
+        printf("Invalid %s:\n%s\n", what, arg);
+    #else
+        ESP_LOGE(FILTER_TAG, "Invalid %s: \"%s\"", what, arg);
+    #endif
+}
+
+/* Parse a predicate such as rssi>-70, name~JBL, selected or !associated
+   Returns ESP_ERR_NOT_FOUND if arg isn't a predicate at all, which ends a
+   WHERE clause, and ESP_ERR_INVALID_ARG if it is a malformed one */
+static esp_err_t filter_parse_predicate(const char *arg, gravity_predicate_t *predicate) {
+    const char *pos = arg;
+    bool negate = (*pos == '!');
+    if (negate) {
+        ++pos;
+    }
+    size_t nameLen = 0;
+    while (isalpha((unsigned char)pos[nameLen])) {
+        ++nameLen;
+    }
+    int field = 0;
+    for (; field < GRAVITY_FIELD_COUNT && !filter_name_is(pos, nameLen, fieldNames[field][0]) &&
+            !filter_name_is(pos, nameLen, fieldNames[field][1]); ++field) { }
+    if (nameLen == 0 || field == GRAVITY_FIELD_COUNT) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    pos += nameLen;
+    memset(predicate, 0, sizeof(gravity_predicate_t));
+    predicate->field = field;
+
+    if (*pos == '\0') {
+        /* A bare field is a test of a flag. Anything else named like a field
+           (AP, for example) isn't part of the WHERE clause */
+        if (!filter_is_bool_field(field)) {
+            return ESP_ERR_NOT_FOUND;
+        }
+        predicate->op = negate ? GRAVITY_OP_EQ : GRAVITY_OP_NE;
+        predicate->number = 0;
+        return ESP_OK;
+    }
+    if (negate) {
+        filter_invalid("predicate", arg);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!strncmp(pos, "<=", 2)) {
+        predicate->op = GRAVITY_OP_LE;
+        pos += 2;
+    } else if (!strncmp(pos, ">=", 2)) {
+        predicate->op = GRAVITY_OP_GE;
+        pos += 2;
+    } else if (!strncmp(pos, "!=", 2)) {
+        predicate->op = GRAVITY_OP_NE;
+        pos += 2;
+    } else if (!strncmp(pos, "==", 2)) {
+        predicate->op = GRAVITY_OP_EQ;
+        pos += 2;
+    } else if (*pos == '=') {
+        predicate->op = GRAVITY_OP_EQ;
+        ++pos;
+    } else if (*pos == '<') {
+        predicate->op = GRAVITY_OP_LT;
+        ++pos;
+    } else if (*pos == '>') {
+        predicate->op = GRAVITY_OP_GT;
+        ++pos;
+    } else if (*pos == '~') {
+        predicate->op = GRAVITY_OP_CONTAINS;
+        ++pos;
+    } else {
+        filter_invalid("predicate", arg);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (filter_is_text_field(field)) {
+        if ((predicate->op != GRAVITY_OP_EQ && predicate->op != GRAVITY_OP_NE && predicate->op != GRAVITY_OP_CONTAINS) ||
+                strlen(pos) > GRAVITY_FILTER_TEXT_LEN) {
+            filter_invalid("predicate", arg);
+            return ESP_ERR_INVALID_ARG;
+        }
+        strcpy(predicate->text, pos);
+        return ESP_OK;
+    }
+
+    char *end = NULL;
+    long value = strtol(pos, &end, 10);
+    if (predicate->op == GRAVITY_OP_CONTAINS || *pos == '\0' || *end != '\0') {
+        filter_invalid("predicate", arg);
+        return ESP_ERR_INVALID_ARG;
+    }
+    predicate->number = value;
+    return ESP_OK;
+}
+
+static esp_err_t filter_parse_count(const char *keyword, const char *arg, uint32_t *count) {
+    char *end = NULL;
+    long value = (arg == NULL) ? -1 : strtol(arg, &end, 10);
+    if (arg == NULL || *arg == '\0' || *end != '\0' || value < 0) {
+        filter_invalid(keyword, (arg == NULL) ? "" : arg);
+        return ESP_ERR_INVALID_ARG;
+    }
+    *count = value;
+    return ESP_OK;
+}
+
+/* Parse a comma-separated list of column names */
+static esp_err_t filter_parse_columns(GravityFilter *filter, const char *arg) {
+    filter->columnCount = 0;
+    const char *pos = arg;
+    while (pos != NULL && *pos != '\0') {
+        const char *comma = strchr(pos, ',');
+        size_t len = (comma == NULL) ? strlen(pos) : (size_t)(comma - pos);
+        int col = 0;
+        for (; col < GRAVITY_COL_COUNT && !filter_name_is(pos, len, columnDefs[col].name) &&
+                !filter_name_is(pos, len, columnDefs[col].alias); ++col) { }
+        if (col == GRAVITY_COL_COUNT || filter->columnCount == GRAVITY_COL_COUNT) {
+            filter_invalid("column", arg);
+            return ESP_ERR_INVALID_ARG;
+        }
+        filter->columns[filter->columnCount++] = col;
+        pos = (comma == NULL) ? NULL : comma + 1;
+    }
+    if (filter->columnCount == 0) {
+        filter_invalid("column", (arg == NULL) ? "" : arg);
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+/* Parse the filter clause that starts at argv[*index]:
+     WHERE <predicate> [ AND <predicate> ]*
+     LIMIT <n>
+     OFFSET <n>
+     COLUMNS <column>[,<column>]*
+   On success *index is left at the last argument of the clause */
+esp_err_t gravity_filter_parse(GravityFilter *filter, int argc, char **argv, int *index) {
+    int i = *index;
+    esp_err_t err = ESP_OK;
+    const char *next = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+    if (!strcasecmp(argv[i], "LIMIT")) {
+        err = filter_parse_count("LIMIT", next, &filter->limit);
+        ++i;
+    } else if (!strcasecmp(argv[i], "OFFSET")) {
+        err = filter_parse_count("OFFSET", next, &filter->offset);
+        ++i;
+    } else if (!strcasecmp(argv[i], "COLUMNS")) {
+        err = filter_parse_columns(filter, next);
+        ++i;
+    } else if (!strcasecmp(argv[i], "WHERE")) {
+        bool found = false;
+        for (++i; i < argc; ++i) {
+            if (found && !strcasecmp(argv[i], "AND")) {
+                continue;
+            }
+            gravity_predicate_t predicate;
+            err = filter_parse_predicate(argv[i], &predicate);
+            if (err == ESP_ERR_NOT_FOUND) {
+                err = ESP_OK;
+                break;
+            } else if (err != ESP_OK) {
+                return err;
+            }
+            if (filter->predicateCount == GRAVITY_FILTER_MAX_PREDICATES) {
+                #ifdef CONFIG_FLIPPER
+                    printf("At most %d predicates\n", GRAVITY_FILTER_MAX_PREDICATES);
+                #else
+                    ESP_LOGE(FILTER_TAG, "WHERE can have at most %d predicates.", GRAVITY_FILTER_MAX_PREDICATES);
+                #endif
+                return ESP_ERR_INVALID_ARG;
+            }
+            filter->predicates[filter->predicateCount++] = predicate;
+            found = true;
+        }
+        if (!found) {
+            filter_invalid("WHERE clause", (i < argc) ? argv[i] : "");
+            return ESP_ERR_INVALID_ARG;
+        }
+        --i;
+    } else {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (err == ESP_OK) {
+        *index = i;
+    }
+    return err;
+}
+
+/* Check that every field and column used by filter applies to a table
+   whose fields and columns are given as bitmasks */
+esp_err_t gravity_filter_check(const GravityFilter *filter, uint32_t fields, uint32_t columns, const char *table) {
+    if (filter == NULL) {
+        return ESP_OK;
+    }
+    for (int i = 0; i < filter->predicateCount; ++i) {
+        if ((fields & GRAVITY_FILTER_BIT(filter->predicates[i].field)) == 0) {
+            #ifdef CONFIG_FLIPPER
+                printf("%s has no %s\n", table, fieldNames[filter->predicates[i].field][0]);
+            #else
+                ESP_LOGE(FILTER_TAG, "%s can't be filtered by %s.", table, fieldNames[filter->predicates[i].field][0]);
+            #endif
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    for (int i = 0; i < filter->columnCount; ++i) {
+        if ((columns & GRAVITY_FILTER_BIT(filter->columns[i])) == 0) {
+            #ifdef CONFIG_FLIPPER
+                printf("%s has no %s\n", table, columnDefs[filter->columns[i]].name);
+            #else
+                ESP_LOGE(FILTER_TAG, "%s has no %s column.", table, columnDefs[filter->columns[i]].name);
+            #endif
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    return ESP_OK;
+}
+
+bool gravity_filter_match_number(const gravity_predicate_t *predicate, int32_t value) {
+    switch (predicate->op) {
+        case GRAVITY_OP_EQ:
+            return value == predicate->number;
+        case GRAVITY_OP_NE:
+            return value != predicate->number;
+        case GRAVITY_OP_LT:
+            return value < predicate->number;
+        case GRAVITY_OP_LE:
+            return value <= predicate->number;
+        case GRAVITY_OP_GT:
+            return value > predicate->number;
+        case GRAVITY_OP_GE:
+            return value >= predicate->number;
+        default:
+            return false;
+    }
+}
+
+/* Case-insensitive substring search */
+static bool filter_contains(const char *haystack, const char *needle) {
+    size_t needleLen = strlen(needle);
+    for (; *haystack != '\0'; ++haystack) {
+        if (!strncasecmp(haystack, needle, needleLen)) {
+            return true;
+        }
+    }
+    return needleLen == 0;
+}
+
+/* Text comparisons ignore case. A NULL value, such as an unknown vendor,
+   only matches != */
+bool gravity_filter_match_text(const gravity_predicate_t *predicate, const char *value) {
+    if (value == NULL) {
+        return predicate->op == GRAVITY_OP_NE;
+    }
+    switch (predicate->op) {
+        case GRAVITY_OP_EQ:
+            return !strcasecmp(value, predicate->text);
+        case GRAVITY_OP_NE:
+            return strcasecmp(value, predicate->text) != 0;
+        case GRAVITY_OP_CONTAINS:
+            return filter_contains(value, predicate->text);
+        default:
+            return false;
+    }
+}
+
+/* Apply OFFSET and LIMIT to a row that matched the predicates. matched
+   counts matching rows so far. Returns whether the row is displayed, and
+   sets done once it is the last row LIMIT allows */
+bool gravity_filter_page(const GravityFilter *filter, uint32_t *matched, bool *done) {
+    ++(*matched);
+    if (filter == NULL) {
+        return true;
+    }
+    if (*matched <= filter->offset) {
+        return false;
+    }
+    if (filter->limit != 0 && *matched - filter->offset >= filter->limit) {
+        *done = true;
+    }
+    return true;
+}
+
+/* Keep the positions of the capacity highest-ranked rows seen so far in
+   ranked, highest key first, with keys[i] the key of ranked[i]. Rows with
+   equal keys keep the order they were offered in. Each call costs at most
+   capacity moves, so ranking a whole table is a single pass */
+void gravity_filter_rank(uint32_t *ranked, int32_t *keys, uint32_t *count, uint32_t capacity, uint32_t position, int32_t key) {
+    uint32_t slot = *count;
+    for ( ; slot > 0 && keys[slot - 1] < key; --slot) { }
+    if (slot >= capacity) {
+        return;
+    }
+    uint32_t last = (*count < capacity) ? (*count)++ : capacity - 1;
+    memmove(&ranked[slot + 1], &ranked[slot], sizeof(uint32_t) * (last - slot));
+    memmove(&keys[slot + 1], &keys[slot], sizeof(int32_t) * (last - slot));
+    ranked[slot] = position;
+    keys[slot] = key;
+}
+
+/* Were columns specified? If not the default layout is used */
+bool gravity_filter_projected(const GravityFilter *filter) {
+    return filter != NULL && filter->columnCount > 0;
+}
+
+/* Display a cell of a projected row. The row ends after its last column */
+void gravity_filter_print_cell(const GravityFilter *filter, uint8_t position, const char *text) {
+    bool last = (position + 1 == filter->columnCount);
+    #ifdef CONFIG_FLIPPER
+        /* The Flipper's screen is too narrow to pad columns */
+        if (position > 0) {
+            gravity_out_char('|');
+        }
+        gravity_out_str(text);
+    #else
+        if (position > 0) {
+            gravity_out_write(" | ", 3);
+        }
+        if (last) {
+            gravity_out_str(text);
+        } else {
+            gravity_out_padded(text, columnDefs[filter->columns[position]].width);
+        }
+    #endif
+    if (last) {
+        gravity_out_char('\n');
+    }
+}
+
+void gravity_filter_print_header(const GravityFilter *filter) {
+    for (uint8_t i = 0; i < filter->columnCount; ++i) {
+        gravity_filter_print_cell(filter, i, columnDefs[filter->columns[i]].heading);
+    }
+    #ifndef CONFIG_FLIPPER
+        for (uint8_t i = 0; i < filter->columnCount; ++i) {
+            uint8_t width = columnDefs[filter->columns[i]].width;
+            if (width == 0) {
+                width = strlen(columnDefs[filter->columns[i]].heading);
+            }
+            if (i > 0) {
+                gravity_out_write("=|=", 3);
+            }
+            gravity_out_repeat('=', width);
+        }
+        gravity_out_char('\n');
+    #endif
+}
+
+/* Describe how long ago something was seen, elapsed seconds ago. strTime
+   must have space for 26 characters */
+void gravity_filter_format_age(unsigned long elapsed, char *strTime) {
+    #ifdef CONFIG_DISPLAY_FRIENDLY_AGE
+        if (elapsed < 60) {
+            strcpy(strTime, "Under a minute ago");
+            return;
+        }
+        const char *unit = NULL;
+        uint32_t count = 0;
+        if (elapsed < 3600) {
+            count = elapsed / 60;
+            unit = (elapsed >= 120) ? " minutes ago" : " minute ago";
+        } else {
+            count = elapsed / 3600;
+            unit = (elapsed >= 7200) ? " hours ago" : " hour ago";
+        }
+        strcpy(&strTime[gravity_format_uint(strTime, count)], unit);
+    #else
+        /* Display precise time */
+        char *pos = strTime;
+        unsigned long tmp = elapsed;
+        if (tmp >= 3600) {
+            pos += gravity_format_int(pos, tmp / 3600, 2);
+            memcpy(pos, "h ", 2);
+            pos += 2;
+            tmp = tmp % 3600;
+        }
+        if (tmp >= 60) {
+            pos += gravity_format_int(pos, tmp / 60, 2);
+            memcpy(pos, "m ", 2);
+            pos += 2;
+            tmp = tmp % 60;
+        }
+        pos += gravity_format_int(pos, tmp, 2);
+        strcpy(pos, "s");
+    #endif
+}
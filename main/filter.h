@@ -0,0 +1,119 @@
+#ifndef GRAVITY_FILTER_H
+#define GRAVITY_FILTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <esp_err.h>
+
+/* Row filters for VIEW
+   A filter holds predicates (WHERE rssi>-70 AND name~JBL), paging (LIMIT and
+   OFFSET) and a column projection (COLUMNS id,rssi,name). List functions test
+   each row against the predicates before formatting anything, skip the first
+   OFFSET matching rows and stop once LIMIT rows have been displayed, so rows
+   that aren't wanted cost nothing to print. Predicates are ANDed together.
+   A filter of all zeroes (or NULL) matches everything and uses the default
+   columns.
+*/
+
+typedef enum {
+    GRAVITY_FIELD_RSSI = 0,
+    GRAVITY_FIELD_CHANNEL,
+    GRAVITY_FIELD_AGE,          /* Seconds since the device was last seen */
+    GRAVITY_FIELD_SELECTED,
+    GRAVITY_FIELD_ASSOCIATED,   /* A STA with an AP, or an AP with STAs */
+    GRAVITY_FIELD_AP,           /* ID of a STA's AP */
+    GRAVITY_FIELD_VENDOR,
+    GRAVITY_FIELD_NAME,         /* SSID or Bluetooth device name */
+    GRAVITY_FIELD_COUNT
+} gravity_field_t;
+
+typedef enum {
+    GRAVITY_OP_EQ = 0,
+    GRAVITY_OP_NE,
+    GRAVITY_OP_LT,
+    GRAVITY_OP_LE,
+    GRAVITY_OP_GT,
+    GRAVITY_OP_GE,
+    GRAVITY_OP_CONTAINS         /* Case-insensitive substring */
+} gravity_op_t;
+
+typedef enum {
+    GRAVITY_COL_ID = 0,
+    GRAVITY_COL_RSSI,
+    GRAVITY_COL_NAME,
+    GRAVITY_COL_MAC,
+    GRAVITY_COL_VENDOR,
+    GRAVITY_COL_CLIENTS,
+    GRAVITY_COL_AP,
+    GRAVITY_COL_CHANNEL,
+    GRAVITY_COL_AGE,
+    GRAVITY_COL_WPS,
+    GRAVITY_COL_CLASS,
+    GRAVITY_COL_SCAN,
+    GRAVITY_COL_ADV,
+    GRAVITY_COL_COUNT
+} gravity_column_t;
+
+/* Fields and columns that apply to each type of result */
+#define GRAVITY_FILTER_BIT(x) (1 << (x))
+#define GRAVITY_FILTER_AP_FIELDS (GRAVITY_FILTER_BIT(GRAVITY_FIELD_RSSI) | GRAVITY_FILTER_BIT(GRAVITY_FIELD_CHANNEL) | \
+            GRAVITY_FILTER_BIT(GRAVITY_FIELD_AGE) | GRAVITY_FILTER_BIT(GRAVITY_FIELD_SELECTED) | \
+            GRAVITY_FILTER_BIT(GRAVITY_FIELD_ASSOCIATED) | GRAVITY_FILTER_BIT(GRAVITY_FIELD_VENDOR) | \
+            GRAVITY_FILTER_BIT(GRAVITY_FIELD_NAME))
+#define GRAVITY_FILTER_STA_FIELDS (GRAVITY_FILTER_BIT(GRAVITY_FIELD_RSSI) | GRAVITY_FILTER_BIT(GRAVITY_FIELD_CHANNEL) | \
+            GRAVITY_FILTER_BIT(GRAVITY_FIELD_AGE) | GRAVITY_FILTER_BIT(GRAVITY_FIELD_SELECTED) | \
+            GRAVITY_FILTER_BIT(GRAVITY_FIELD_ASSOCIATED) | GRAVITY_FILTER_BIT(GRAVITY_FIELD_AP) | \
+            GRAVITY_FILTER_BIT(GRAVITY_FIELD_VENDOR))
+#define GRAVITY_FILTER_BT_FIELDS (GRAVITY_FILTER_BIT(GRAVITY_FIELD_RSSI) | GRAVITY_FILTER_BIT(GRAVITY_FIELD_AGE) | \
+            GRAVITY_FILTER_BIT(GRAVITY_FIELD_SELECTED) | GRAVITY_FILTER_BIT(GRAVITY_FIELD_VENDOR) | \
+            GRAVITY_FILTER_BIT(GRAVITY_FIELD_NAME))
+#define GRAVITY_FILTER_AP_COLUMNS (GRAVITY_FILTER_BIT(GRAVITY_COL_ID) | GRAVITY_FILTER_BIT(GRAVITY_COL_RSSI) | \
+            GRAVITY_FILTER_BIT(GRAVITY_COL_NAME) | GRAVITY_FILTER_BIT(GRAVITY_COL_MAC) | \
+            GRAVITY_FILTER_BIT(GRAVITY_COL_VENDOR) | GRAVITY_FILTER_BIT(GRAVITY_COL_CLIENTS) | \
+            GRAVITY_FILTER_BIT(GRAVITY_COL_CHANNEL) | GRAVITY_FILTER_BIT(GRAVITY_COL_AGE) | \
+            GRAVITY_FILTER_BIT(GRAVITY_COL_WPS))
+#define GRAVITY_FILTER_STA_COLUMNS (GRAVITY_FILTER_BIT(GRAVITY_COL_ID) | GRAVITY_FILTER_BIT(GRAVITY_COL_RSSI) | \
+            GRAVITY_FILTER_BIT(GRAVITY_COL_MAC) | GRAVITY_FILTER_BIT(GRAVITY_COL_VENDOR) | \
+            GRAVITY_FILTER_BIT(GRAVITY_COL_AP) | GRAVITY_FILTER_BIT(GRAVITY_COL_CHANNEL) | \
+            GRAVITY_FILTER_BIT(GRAVITY_COL_AGE))
+#define GRAVITY_FILTER_BT_COLUMNS (GRAVITY_FILTER_BIT(GRAVITY_COL_ID) | GRAVITY_FILTER_BIT(GRAVITY_COL_RSSI) | \
+            GRAVITY_FILTER_BIT(GRAVITY_COL_NAME) | GRAVITY_FILTER_BIT(GRAVITY_COL_MAC) | \
+            GRAVITY_FILTER_BIT(GRAVITY_COL_VENDOR) | GRAVITY_FILTER_BIT(GRAVITY_COL_CLASS) | \
+            GRAVITY_FILTER_BIT(GRAVITY_COL_SCAN) | GRAVITY_FILTER_BIT(GRAVITY_COL_AGE) | \
+            GRAVITY_FILTER_BIT(GRAVITY_COL_ADV))
+
+#define GRAVITY_FILTER_MAX_PREDICATES 6
+#define GRAVITY_FILTER_TEXT_LEN 32
+/* Big enough for any cell; the longest is a BLE advertising summary */
+#define GRAVITY_FILTER_CELL_LEN 96
+
+typedef struct {
+    int32_t number;
+    char text[GRAVITY_FILTER_TEXT_LEN + 1];
+    uint8_t field;              /* gravity_field_t */
+    uint8_t op;                 /* gravity_op_t */
+} gravity_predicate_t;
+
+typedef struct GravityFilter {
+    gravity_predicate_t predicates[GRAVITY_FILTER_MAX_PREDICATES];
+    uint32_t offset;
+    uint32_t limit;             /* 0 is unlimited */
+    uint8_t columns[GRAVITY_COL_COUNT]; /* Displayed in this order */
+    uint8_t columnCount;        /* 0 uses the default layout */
+    uint8_t predicateCount;
+} GravityFilter;
+
+void gravity_filter_init(GravityFilter *filter);
+bool gravity_filter_is_keyword(const char *arg);
+esp_err_t gravity_filter_parse(GravityFilter *filter, int argc, char **argv, int *index);
+esp_err_t gravity_filter_check(const GravityFilter *filter, uint32_t fields, uint32_t columns, const char *table);
+bool gravity_filter_match_number(const gravity_predicate_t *predicate, int32_t value);
+bool gravity_filter_match_text(const gravity_predicate_t *predicate, const char *value);
+bool gravity_filter_page(const GravityFilter *filter, uint32_t *matched, bool *done);
+void gravity_filter_rank(uint32_t *ranked, int32_t *keys, uint32_t *count, uint32_t capacity, uint32_t position, int32_t key);
+bool gravity_filter_projected(const GravityFilter *filter);
+void gravity_filter_print_header(const GravityFilter *filter);
+void gravity_filter_print_cell(const GravityFilter *filter, uint8_t position, const char *text);
+void gravity_filter_format_age(unsigned long elapsed, char *strTime);
+
+#endif
@@ -0,0 +1,310 @@
+#include "frames.h"
+#include "common.h"
+
+#ifdef CONFIG_FRAME_LATENCY_STATS
+    #include <esp_cpu.h>
+#endif
+
+const char *FRAMES_TAG = "frames@GRAVITY";
+
+static gravity_frame_consumer_t frameConsumers[GRAVITY_FRAME_MAX_CONSUMERS];
+static uint8_t frameConsumerCount = 0;
+
+/* Dispatch table, indexed by the first byte of the Frame Control field.
+   Each element is a bitmask of the consumers (indices into frameConsumers)
+   that are currently interested in frames with that FC byte. The table is
+   only recalculated when a feature is started or stopped, so a frame that
+   nobody wants costs a single table load.
+*/
+static uint16_t frameDispatch[256];
+static bool framesActive = false;
+
+/* Union of the subtypes wanted by active consumers, used to configure the
+   driver's promiscuous filters */
+static uint16_t activeSubtypes[GRAVITY_FRAME_TYPE_COUNT];
+/* Filters are only pushed to the driver once promiscuous mode has been set up */
+static bool filterEnabled = false;
+
+/* Mapping from control frame subtypes to promiscuous control filter bits */
+static const uint32_t ctrlFilterBits[16] = {
+    [7] = WIFI_PROMIS_CTRL_FILTER_MASK_WRAPPER,
+    [8] = WIFI_PROMIS_CTRL_FILTER_MASK_BAR,
+    [9] = WIFI_PROMIS_CTRL_FILTER_MASK_BA,
+    [10] = WIFI_PROMIS_CTRL_FILTER_MASK_PSPOLL,
+    [11] = WIFI_PROMIS_CTRL_FILTER_MASK_RTS,
+    [12] = WIFI_PROMIS_CTRL_FILTER_MASK_CTS,
+    [13] = WIFI_PROMIS_CTRL_FILTER_MASK_ACK,
+    [14] = WIFI_PROMIS_CTRL_FILTER_MASK_CFEND,
+    [15] = WIFI_PROMIS_CTRL_FILTER_MASK_CFENDACK
+};
+
+/* Register a handler for the specified frame types and subtypes
+   feature: The handler will only receive frames while attack_status[feature] is true
+   mgmtSubtypes, ctrlSubtypes, dataSubtypes: Bitmask of the subtypes of each frame
+   type that the handler is interested in. Use FRAME_SUBTYPE_BIT(), FRAME_SUBTYPES_ALL
+   and FRAME_SUBTYPES_NONE to specify these.
+   handler: The function to call when a matching frame is received
+*/
+esp_err_t gravity_frames_subscribe(AttackMode feature, uint16_t mgmtSubtypes, uint16_t ctrlSubtypes,
+                            uint16_t dataSubtypes, gravity_frame_handler_t handler) {
+    if (handler == NULL || feature >= ATTACKS_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (frameConsumerCount == GRAVITY_FRAME_MAX_CONSUMERS) {
+        #ifdef CONFIG_FLIPPER
+            printf("Frame consumers full (%d)\n", GRAVITY_FRAME_MAX_CONSUMERS);
+        #else
+            ESP_LOGE(FRAMES_TAG, "Unable to subscribe to frames: All %d consumers are in use.", GRAVITY_FRAME_MAX_CONSUMERS);
+        #endif
+        return ESP_ERR_NO_MEM;
+    }
+    gravity_frame_consumer_t *consumer = &frameConsumers[frameConsumerCount++];
+    consumer->feature = feature;
+    consumer->subtypes[GRAVITY_FRAME_TYPE_MGMT] = mgmtSubtypes;
+    consumer->subtypes[GRAVITY_FRAME_TYPE_CTRL] = ctrlSubtypes;
+    consumer->subtypes[GRAVITY_FRAME_TYPE_DATA] = dataSubtypes;
+    consumer->handler = handler;
+
+    return ESP_OK;
+}
+
+/* Recalculate the dispatch table from the active features and their subscriptions
+   This must be called whenever attack_status[] changes
+*/
+esp_err_t gravity_frames_rebuild() {
+    uint16_t activeConsumers = 0;
+    memset(activeSubtypes, 0, sizeof(activeSubtypes));
+    for (int i = 0; i < frameConsumerCount; ++i) {
+        if (attack_status[frameConsumers[i].feature]) {
+            activeConsumers |= (1 << i);
+            for (int type = 0; type < GRAVITY_FRAME_TYPE_COUNT; ++type) {
+                activeSubtypes[type] |= frameConsumers[i].subtypes[type];
+            }
+        }
+    }
+
+    for (int fc = 0; fc < 256; ++fc) {
+        uint16_t fcConsumers = 0;
+        /* Version 0 is the only 802.11 protocol version, and type 3 is reserved */
+        if (activeConsumers != 0 && FRAME_VERSION(fc) == 0 && FRAME_TYPE(fc) < GRAVITY_FRAME_TYPE_COUNT) {
+            for (int i = 0; i < frameConsumerCount; ++i) {
+                if ((activeConsumers & (1 << i)) &&
+                        (frameConsumers[i].subtypes[FRAME_TYPE(fc)] & FRAME_SUBTYPE_BIT(FRAME_SUBTYPE(fc)))) {
+                    fcConsumers |= (1 << i);
+                }
+            }
+        }
+        frameDispatch[fc] = fcConsumers;
+    }
+    framesActive = (activeConsumers != 0);
+
+    #ifdef CONFIG_DEBUG_VERBOSE
+        int fcCount = 0;
+        for (int fc = 0; fc < 256; ++fc) {
+            if (frameDispatch[fc] != 0) {
+                ++fcCount;
+            }
+        }
+        #ifdef CONFIG_FLIPPER
+            printf("Frames: %d consumers, %d FC\n", __builtin_popcount(activeConsumers), fcCount);
+        #else
+            ESP_LOGI(FRAMES_TAG, "%d frame consumers active, listening for %d frame types.", __builtin_popcount(activeConsumers), fcCount);
+        #endif
+    #endif
+
+    if (filterEnabled) {
+        return gravity_frames_apply_filter();
+    }
+    return ESP_OK;
+}
+
+/* Configure the driver's promiscuous filters so that only frame types with an
+   active consumer are passed to Gravity. Frames nobody wants are discarded by
+   the driver instead of crossing into wifi_pkt_rcvd().
+   This is first called by initPromiscuous(), after which it is reapplied
+   every time the dispatch table is rebuilt.
+*/
+esp_err_t gravity_frames_apply_filter() {
+    esp_err_t err = ESP_OK;
+    wifi_promiscuous_filter_t filter = { .filter_mask = 0 };
+    wifi_promiscuous_filter_t ctrlFilter = { .filter_mask = 0 };
+
+    if (activeSubtypes[GRAVITY_FRAME_TYPE_MGMT] != 0) {
+        filter.filter_mask |= WIFI_PROMIS_FILTER_MASK_MGMT;
+    }
+    if (activeSubtypes[GRAVITY_FRAME_TYPE_DATA] != 0) {
+        filter.filter_mask |= WIFI_PROMIS_FILTER_MASK_DATA;
+    }
+    if (activeSubtypes[GRAVITY_FRAME_TYPE_CTRL] != 0) {
+        filter.filter_mask |= WIFI_PROMIS_FILTER_MASK_CTRL;
+        for (int subtype = 0; subtype < 16; ++subtype) {
+            if (activeSubtypes[GRAVITY_FRAME_TYPE_CTRL] & FRAME_SUBTYPE_BIT(subtype)) {
+                ctrlFilter.filter_mask |= ctrlFilterBits[subtype];
+            }
+        }
+    }
+    /* Don't hand the driver an empty mask while nothing is listening;
+       management frames are the lightest class and are dropped by the
+       (empty) dispatch table */
+    if (filter.filter_mask == 0) {
+        filter.filter_mask = WIFI_PROMIS_FILTER_MASK_MGMT;
+    }
+
+    err |= esp_wifi_set_promiscuous_filter(&filter);
+    if (ctrlFilter.filter_mask != 0) {
+        err |= esp_wifi_set_promiscuous_ctrl_filter(&ctrlFilter);
+    }
+    filterEnabled = true;
+
+    #ifdef CONFIG_DEBUG_VERBOSE
+        #ifdef CONFIG_FLIPPER
+            printf("Filter 0x%02lx, ctrl 0x%08lx\n", filter.filter_mask, ctrlFilter.filter_mask);
+        #else
+            ESP_LOGI(FRAMES_TAG, "Promiscuous filter 0x%02lx, control frame filter 0x%08lx.", filter.filter_mask, ctrlFilter.filter_mask);
+        #endif
+    #endif
+    if (err != ESP_OK) {
+        #ifdef CONFIG_FLIPPER
+            printf("Failed to set frame filter: %s\n", esp_err_to_name(err));
+        #else
+            ESP_LOGW(FRAMES_TAG, "Failed to set promiscuous filters: %s", esp_err_to_name(err));
+        #endif
+    }
+    return err;
+}
+
+/* Does Gravity need to monitor frames as they arrive? */
+bool gravity_frames_active() {
+    return framesActive;
+}
+
+/* Body of the dispatcher, shared by the IRAM and flash copies below */
+static inline __attribute__((always_inline)) void frames_dispatch_body(uint8_t *payload, wifi_pkt_rx_ctrl_t rx_ctrl) {
+    uint16_t consumers = frameDispatch[payload[0]];
+    /* Consumer index 0 is the first registered, so handlers run in registration order */
+    for (int i = 0; consumers != 0; ++i, consumers >>= 1) {
+        if (consumers & 1) {
+            frameConsumers[i].handler(payload, rx_ctrl);
+        }
+    }
+}
+
+#ifdef CONFIG_FRAME_LATENCY_STATS
+/* The layout that gravity_frames_dispatch() uses, and a latency histogram for each */
+static GravityFrameLayout frameLayout = GRAVITY_FRAME_LAYOUT_IRAM;
+static uint32_t frameLatency[GRAVITY_FRAME_LAYOUT_COUNT][GRAVITY_FRAME_LATENCY_BUCKETS];
+static uint32_t frameLatencyMax[GRAVITY_FRAME_LAYOUT_COUNT];
+
+/* Flash-resident copy of the dispatcher, used to compare against the IRAM layout */
+static void __attribute__((noinline)) frames_dispatch_flash(uint8_t *payload, wifi_pkt_rx_ctrl_t rx_ctrl) {
+    frames_dispatch_body(payload, rx_ctrl);
+}
+#endif
+
+/* Pass the specified frame to every active consumer that has subscribed to its type */
+void FRAME_HOT_ATTR gravity_frames_dispatch(uint8_t *payload, wifi_pkt_rx_ctrl_t rx_ctrl) {
+    #ifdef CONFIG_FRAME_LATENCY_STATS
+        uint32_t start = esp_cpu_get_cycle_count();
+        if (frameLayout == GRAVITY_FRAME_LAYOUT_FLASH) {
+            frames_dispatch_flash(payload, rx_ctrl);
+        } else {
+            frames_dispatch_body(payload, rx_ctrl);
+        }
+        gravity_frames_latency_record(esp_cpu_get_cycle_count() - start);
+    #else
+        frames_dispatch_body(payload, rx_ctrl);
+    #endif
+}
+
+#ifdef CONFIG_FRAME_LATENCY_STATS
+/* Histogram bucket for the specified number of cycles
+   Values below 4 have their own bucket, after which each power of two
+   is split into 4 buckets, giving a resolution of 25% */
+static inline __attribute__((always_inline)) uint8_t frames_latency_bucket(uint32_t cycles) {
+    if (cycles < 4) {
+        return cycles;
+    }
+    uint8_t msb = 31 - __builtin_clz(cycles);
+    return ((msb - 1) << 2) | ((cycles >> (msb - 2)) & 0x03);
+}
+
+/* Smallest cycle count that falls into the specified bucket */
+static uint32_t frames_latency_bucket_floor(uint8_t bucket) {
+    if (bucket < 4) {
+        return bucket;
+    }
+    return (uint32_t)(4 | (bucket & 0x03)) << ((bucket >> 2) - 1);
+}
+
+/* Record the time taken to dispatch a single frame against the current layout */
+void FRAME_HOT_ATTR gravity_frames_latency_record(uint32_t cycles) {
+    ++frameLatency[frameLayout][frames_latency_bucket(cycles)];
+    if (cycles > frameLatencyMax[frameLayout]) {
+        frameLatencyMax[frameLayout] = cycles;
+    }
+}
+
+esp_err_t gravity_frames_set_layout(GravityFrameLayout layout) {
+    if (layout >= GRAVITY_FRAME_LAYOUT_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    frameLayout = layout;
+    return ESP_OK;
+}
+
+GravityFrameLayout gravity_frames_get_layout() {
+    return frameLayout;
+}
+
+esp_err_t gravity_frames_latency_reset() {
+    memset(frameLatency, 0, sizeof(frameLatency));
+    memset(frameLatencyMax, 0, sizeof(frameLatencyMax));
+    return ESP_OK;
+}
+
+/* Convert a cycle count into nanoseconds */
+static uint32_t frames_cycles_to_ns(uint32_t cycles) {
+    return (uint32_t)(((uint64_t)cycles * 1000) / CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+}
+
+/* Display the number of frames, median, 90th and 99th percentile and maximum
+   dispatch latency for each layout. Percentiles are reported as the lower bound
+   of the bucket they fall in. */
+esp_err_t gravity_frames_latency_report() {
+    const char *layoutNames[GRAVITY_FRAME_LAYOUT_COUNT] = { "IRAM", "FLASH" };
+    const uint8_t percentiles[] = { 50, 90, 99 };
+    const uint8_t percentileCount = sizeof(percentiles) / sizeof(uint8_t);
+
+    #ifndef CONFIG_FLIPPER
+        ESP_LOGI(FRAMES_TAG, "Frame dispatch latency (ns), current layout %s:", layoutNames[frameLayout]);
+        ESP_LOGI(FRAMES_TAG, "Layout  Frames       p50       p90       p99       Max");
+    #endif
+    for (int layout = 0; layout < GRAVITY_FRAME_LAYOUT_COUNT; ++layout) {
+        uint32_t total = 0;
+        for (int bucket = 0; bucket < GRAVITY_FRAME_LATENCY_BUCKETS; ++bucket) {
+            total += frameLatency[layout][bucket];
+        }
+        uint32_t results[percentileCount];
+        memset(results, 0, sizeof(results));
+        uint32_t seen = 0;
+        uint8_t nextPct = 0;
+        for (int bucket = 0; bucket < GRAVITY_FRAME_LATENCY_BUCKETS && nextPct < percentileCount && total > 0; ++bucket) {
+            seen += frameLatency[layout][bucket];
+            /* A bucket can satisfy several percentiles */
+            while (nextPct < percentileCount && (uint64_t)seen * 100 >= (uint64_t)total * percentiles[nextPct]) {
+                results[nextPct++] = frames_cycles_to_ns(frames_latency_bucket_floor(bucket));
+            }
+        }
+        #ifdef CONFIG_FLIPPER
+            printf("%s%s: %lu frames\np50 %lu p90 %lu\np99 %lu max %lu ns\n", layoutNames[layout],
+                    (layout == frameLayout)?"*":"", total, results[0], results[1], results[2],
+                    frames_cycles_to_ns(frameLatencyMax[layout]));
+        #else
+            ESP_LOGI(FRAMES_TAG, "%-6s%c %-8lu  %-8lu  %-8lu  %-8lu  %-8lu", layoutNames[layout],
+                    (layout == frameLayout)?'*':' ', total, results[0], results[1], results[2],
+                    frames_cycles_to_ns(frameLatencyMax[layout]));
+        #endif
+    }
+    return ESP_OK;
+}
+#endif
@@ -0,0 +1,85 @@
+#ifndef FRAMES_H
+#define FRAMES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <esp_err.h>
+#include <esp_wifi_types.h>
+#include <esp_attr.h>
+#include "common.h"
+
+/* Decoding of the first byte of the 802.11 Frame Control field
+   Bits 0-1 are the protocol version (always 0), bits 2-3 the frame
+   type and bits 4-7 the frame subtype. */
+#define FRAME_TYPE(fc) (((fc) >> 2) & 0x03)
+#define FRAME_SUBTYPE(fc) (((fc) >> 4) & 0x0F)
+#define FRAME_VERSION(fc) ((fc) & 0x03)
+
+/* Subtype masks used when subscribing to frames */
+#define FRAME_SUBTYPE_BIT(subtype) ((uint16_t)(1 << (subtype)))
+#define FRAME_SUBTYPES_NONE 0x0000
+#define FRAME_SUBTYPES_ALL 0xFFFF
+/* Control frames that carry a transmitter address (Address 2): BlockAckReq,
+   BlockAck, PS-Poll, RTS, CF-End and CF-End+CF-Ack */
+#define FRAME_CTRL_SUBTYPES_WITH_TA (FRAME_SUBTYPE_BIT(8) | FRAME_SUBTYPE_BIT(9) | \
+            FRAME_SUBTYPE_BIT(10) | FRAME_SUBTYPE_BIT(11) | FRAME_SUBTYPE_BIT(14) | \
+            FRAME_SUBTYPE_BIT(15))
+
+typedef enum GravityFrameType {
+    GRAVITY_FRAME_TYPE_MGMT = 0,
+    GRAVITY_FRAME_TYPE_CTRL,
+    GRAVITY_FRAME_TYPE_DATA,
+    GRAVITY_FRAME_TYPE_COUNT
+} GravityFrameType;
+
+/* The dispatch table stores a 16-bit consumer mask for each FC byte */
+#define GRAVITY_FRAME_MAX_CONSUMERS 16
+
+typedef esp_err_t (*gravity_frame_handler_t)(uint8_t *payload, wifi_pkt_rx_ctrl_t rx_ctrl);
+
+/* A frame consumer is a handler that is interested in a specific set of frame
+   types and subtypes, for as long as its associated feature is active */
+typedef struct gravity_frame_consumer_t {
+    AttackMode feature;
+    uint16_t subtypes[GRAVITY_FRAME_TYPE_COUNT];
+    gravity_frame_handler_t handler;
+} gravity_frame_consumer_t;
+
+/* Code on the frame hot path - the promiscuous callback, dispatch and header
+   decode - is placed in IRAM so that it doesn't stall on flash cache misses
+   while the console or Bluetooth stack are busy. Handlers remain in flash.
+   The dispatch table and consumer list are RAM variables, so need no attribute. */
+#ifdef CONFIG_FRAME_PATH_IRAM
+    #define FRAME_HOT_ATTR IRAM_ATTR
+#else
+    #define FRAME_HOT_ATTR
+#endif
+
+#ifdef CONFIG_FRAME_LATENCY_STATS
+/* Code layouts that can be compared when measuring callback latency */
+typedef enum GravityFrameLayout {
+    GRAVITY_FRAME_LAYOUT_IRAM = 0,
+    GRAVITY_FRAME_LAYOUT_FLASH,
+    GRAVITY_FRAME_LAYOUT_COUNT
+} GravityFrameLayout;
+
+/* Latency histogram buckets: 4 per power of two, covering all 32-bit cycle counts */
+#define GRAVITY_FRAME_LATENCY_BUCKETS 128
+
+esp_err_t gravity_frames_set_layout(GravityFrameLayout layout);
+GravityFrameLayout gravity_frames_get_layout();
+esp_err_t gravity_frames_latency_reset();
+esp_err_t gravity_frames_latency_report();
+void gravity_frames_latency_record(uint32_t cycles);
+#endif
+
+extern const char *FRAMES_TAG;
+
+esp_err_t gravity_frames_subscribe(AttackMode feature, uint16_t mgmtSubtypes, uint16_t ctrlSubtypes,
+                            uint16_t dataSubtypes, gravity_frame_handler_t handler);
+esp_err_t gravity_frames_rebuild();
+esp_err_t gravity_frames_apply_filter();
+bool gravity_frames_active();
+void gravity_frames_dispatch(uint8_t *payload, wifi_pkt_rx_ctrl_t rx_ctrl);
+
+#endif
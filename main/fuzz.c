@@ -2,6 +2,7 @@
 #include "beacon.h"
 #include "common.h"
 #include "esp_err.h"
+#include "frames.h"
 
 FuzzMode fuzzMode = FUZZ_MODE_OFF;
 FuzzPacketType fuzzPacketType = FUZZ_PACKET_NONE;
@@ -763,10 +764,15 @@ esp_err_t fuzz_start(FuzzMode newMode, FuzzPacketType newType, FuzzTarget newTar
 
 esp_err_t fuzz_stop() {
     fuzzCounter = 0;
+    attack_status[ATTACK_FUZZ] = false;
+    /* Update listeners and hopping before the task is deleted - fuzz_stop() is
+       also called from within fuzzTask, and vTaskDelete() doesn't return then */
+    gravity_frames_rebuild();
+    hop_state_refresh();
     if (fuzzTask != NULL) {
-        vTaskDelete(fuzzTask);
+        TaskHandle_t task = fuzzTask;
         fuzzTask = NULL;
+        vTaskDelete(task);
     }
-    attack_status[ATTACK_FUZZ] = false;
     return ESP_OK;
 }
\ No newline at end of file
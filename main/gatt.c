@@ -0,0 +1,544 @@
+#include "gatt.h"
+#include "common.h"
+#include "mem.h"
+#include "sig.h"
+#include "sdkconfig.h"
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <time.h>
+
+#if defined(CONFIG_BT_ENABLED)
+
+const char *GATT_TAG = "gatt@GRAVITY";
+
+#ifdef CONFIG_BLE_GATT_MAX_CONNECTIONS
+    #define GATT_MAX_CONNECTIONS CONFIG_BLE_GATT_MAX_CONNECTIONS
+#else
+    #define GATT_MAX_CONNECTIONS 3
+#endif
+#ifdef CONFIG_BLE_GATT_TIMEOUT
+    #define GATT_TIMEOUT_MILLIS (CONFIG_BLE_GATT_TIMEOUT * 1000)
+#else
+    #define GATT_TIMEOUT_MILLIS 8000
+#endif
+#ifdef CONFIG_BLE_GATT_QUEUE_LEN
+    #define GATT_QUEUE_LEN CONFIG_BLE_GATT_QUEUE_LEN
+#else
+    #define GATT_QUEUE_LEN 64
+#endif
+
+/* Services kept for each device while it is being discovered. Devices rarely
+   have more than a handful; any beyond these are counted but not stored */
+#define GATT_MAX_UUID16 24
+#define GATT_MAX_UUID128 12
+/* How often connections are checked for timeouts */
+#define GATT_TICK_MILLIS 250
+
+/* The Bluetooth Base UUID, least significant byte first, without the 32 bits
+   that hold a 16- or 32-bit UUID */
+static const uint8_t gattBaseUuid[12] = { 0xFB, 0x34, 0x9B, 0x5F, 0x80, 0x00, 0x00, 0x80, 0x00, 0x10, 0x00, 0x00 };
+
+typedef struct {
+    esp_bd_addr_t bda;
+    uint8_t addrType;
+} gatt_req_t;
+
+typedef enum {
+    GATT_SLOT_IDLE = 0,
+    GATT_SLOT_OPENING,      /* Waiting for the connection */
+    GATT_SLOT_DISCOVERING,  /* Connected; exchanging MTU and discovering services */
+    GATT_SLOT_CLOSING       /* Finished; waiting for the disconnection */
+} gatt_slot_state_t;
+
+typedef struct {
+    uint32_t startedAt;     /* Milliseconds (esp_timer) */
+    uint32_t deadline;
+    uint16_t connId;
+    uint16_t uuid16[GATT_MAX_UUID16];
+    uint8_t uuid128[GATT_MAX_UUID128][ESP_UUID_LEN_128];
+    esp_bd_addr_t bda;
+    gatt_slot_state_t state;
+    uint8_t uuid16Count;
+    uint8_t uuid128Count;
+    uint8_t found;          /* Including services that weren't stored */
+} gatt_slot_t;
+
+static gatt_req_t gattQueue[GATT_QUEUE_LEN];
+static uint16_t gattHead = 0;
+static uint16_t gattCount = 0;
+static gatt_slot_t gattSlots[GATT_MAX_CONNECTIONS];
+static esp_gatt_if_t gattIf = ESP_GATT_IF_NONE;
+static esp_timer_handle_t gattTimer = NULL;
+/* The pipeline is driven from the console, the GATTC callback and gattTimer.
+   The lock is created by the first request, which comes from the console
+   before either of the others has anything to do */
+static StaticSemaphore_t gattLockBuffer;
+static SemaphoreHandle_t gattLock = NULL;
+
+/* Statistics for the current or most recent batch */
+static bool gattRunning = false;
+static uint32_t gattBatchStart = 0;
+static uint32_t gattBatchEnd = 0;
+static uint32_t gattAttempted = 0;
+static uint32_t gattCompleted = 0;
+static uint32_t gattFailed = 0;
+static uint32_t gattTimeouts = 0;
+static uint32_t gattServices = 0;
+static uint32_t gattMtuSum = 0;
+static uint32_t gattMtuCount = 0;
+static uint64_t gattDeviceMillis = 0; /* Sum of the time taken by completed devices */
+
+static uint32_t gatt_now_millis() {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static gatt_slot_t *gatt_slot_with_bda(const esp_bd_addr_t bda) {
+    for (int i = 0; i < GATT_MAX_CONNECTIONS; ++i) {
+        if (gattSlots[i].state != GATT_SLOT_IDLE && !memcmp(gattSlots[i].bda, bda, ESP_BD_ADDR_LEN)) {
+            return &gattSlots[i];
+        }
+    }
+    return NULL;
+}
+
+static gatt_slot_t *gatt_slot_with_conn(uint16_t connId) {
+    for (int i = 0; i < GATT_MAX_CONNECTIONS; ++i) {
+        if ((gattSlots[i].state == GATT_SLOT_DISCOVERING || gattSlots[i].state == GATT_SLOT_CLOSING) &&
+                gattSlots[i].connId == connId) {
+            return &gattSlots[i];
+        }
+    }
+    return NULL;
+}
+
+/* Is bda queued or being discovered? */
+static bool gatt_pending(const esp_bd_addr_t bda) {
+    if (gatt_slot_with_bda(bda) != NULL) {
+        return true;
+    }
+    for (uint16_t i = 0; i < gattCount; ++i) {
+        if (!memcmp(gattQueue[(gattHead + i) % GATT_QUEUE_LEN].bda, bda, ESP_BD_ADDR_LEN)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Record a service found on slot's device. 32-bit UUIDs are widened to 128
+   bits, and 128-bit UUIDs derived from the Base UUID are narrowed to 16 */
+static void gatt_slot_add_uuid(gatt_slot_t *slot, const esp_bt_uuid_t *uuid) {
+    uint8_t uuid128[ESP_UUID_LEN_128];
+    uint16_t uuid16 = 0;
+    bool is16 = false;
+    switch (uuid->len) {
+        case ESP_UUID_LEN_16:
+            uuid16 = uuid->uuid.uuid16;
+            is16 = true;
+            break;
+        case ESP_UUID_LEN_32:
+            memcpy(uuid128, gattBaseUuid, sizeof(gattBaseUuid));
+            memcpy(&uuid128[sizeof(gattBaseUuid)], &uuid->uuid.uuid32, sizeof(uint32_t));
+            break;
+        case ESP_UUID_LEN_128:
+            memcpy(uuid128, uuid->uuid.uuid128, ESP_UUID_LEN_128);
+            if (!memcmp(uuid128, gattBaseUuid, sizeof(gattBaseUuid)) && uuid128[14] == 0 && uuid128[15] == 0) {
+                uuid16 = uuid128[12] | (uuid128[13] << 8);
+                is16 = true;
+            }
+            break;
+        default:
+            return;
+    }
+    if (slot->found < UINT8_MAX) {
+        ++slot->found;
+    }
+    if (is16 && slot->uuid16Count < GATT_MAX_UUID16) {
+        slot->uuid16[slot->uuid16Count++] = uuid16;
+    } else if (!is16 && slot->uuid128Count < GATT_MAX_UUID128) {
+        memcpy(slot->uuid128[slot->uuid128Count++], uuid128, ESP_UUID_LEN_128);
+    }
+}
+
+/* Replace the GATT services of slot's device with those discovered. The
+   device may have been purged while it was connected */
+static void gatt_slot_store(gatt_slot_t *slot) {
+    app_gap_cb_t *dev = deviceWithBDA(slot->bda);
+    if (dev == NULL) {
+        return;
+    }
+    size_t bytes = sizeof(grav_ble_gatt) + slot->uuid16Count * sizeof(uint16_t) + slot->uuid128Count * ESP_UUID_LEN_128;
+    grav_ble_gatt *gatt = gravity_mem_alloc(GRAVITY_MEM_COLD, bytes);
+    if (gatt == NULL) {
+        #ifdef CONFIG_FLIPPER
+            printf("%sfor GATT services\n", STRINGS_MALLOC_FAIL);
+        #else
+            ESP_LOGE(GATT_TAG, "%sfor %u GATT services.", STRINGS_MALLOC_FAIL, slot->uuid16Count + slot->uuid128Count);
+        #endif
+        return;
+    }
+    gatt->lastSeen = clock();
+    gatt->uuid16Count = slot->uuid16Count;
+    gatt->uuid128Count = slot->uuid128Count;
+    memcpy(gatt->uuids, slot->uuid16, slot->uuid16Count * sizeof(uint16_t));
+    memcpy(&gatt->uuids[slot->uuid16Count * sizeof(uint16_t)], slot->uuid128, slot->uuid128Count * ESP_UUID_LEN_128);
+    if (dev->bt_services.gatt != NULL) {
+        free(dev->bt_services.gatt);
+    }
+    dev->bt_services.gatt = gatt;
+}
+
+/* Finish with slot's device. A connected device is disconnected, and the
+   slot is reused once the disconnection completes. Must be called with
+   gattLock taken */
+static void gatt_slot_conclude(gatt_slot_t *slot, bool success, bool timedOut) {
+    uint32_t now = gatt_now_millis();
+    if (success) {
+        gatt_slot_store(slot);
+        ++gattCompleted;
+        gattServices += slot->found;
+        gattDeviceMillis += now - slot->startedAt;
+    } else {
+        ++gattFailed;
+        if (timedOut) {
+            ++gattTimeouts;
+        }
+    }
+    if (slot->state == GATT_SLOT_DISCOVERING) {
+        slot->state = GATT_SLOT_CLOSING;
+        slot->deadline = now + GATT_TIMEOUT_MILLIS;
+        if (esp_ble_gattc_close(gattIf, slot->connId) != ESP_OK) {
+            slot->state = GATT_SLOT_IDLE;
+        }
+    } else {
+        if (slot->state == GATT_SLOT_OPENING && timedOut) {
+            /* Give up on the pending connection */
+            esp_ble_gap_disconnect(slot->bda);
+        }
+        slot->state = GATT_SLOT_IDLE;
+    }
+}
+
+/* Start connecting to the next queued device if a slot is free. Only one
+   connection is opened at a time. Must be called with gattLock taken */
+static void gatt_dispatch() {
+    if (gattIf == ESP_GATT_IF_NONE) {
+        /* Registration hasn't completed; its event will dispatch */
+        return;
+    }
+    gatt_slot_t *slot = NULL;
+    for (int i = 0; i < GATT_MAX_CONNECTIONS; ++i) {
+        if (gattSlots[i].state == GATT_SLOT_OPENING) {
+            return;
+        }
+        if (slot == NULL && gattSlots[i].state == GATT_SLOT_IDLE) {
+            slot = &gattSlots[i];
+        }
+    }
+    while (slot != NULL && gattCount > 0) {
+        gatt_req_t *req = &gattQueue[gattHead];
+        gattHead = (gattHead + 1) % GATT_QUEUE_LEN;
+        --gattCount;
+
+        memcpy(slot->bda, req->bda, ESP_BD_ADDR_LEN);
+        slot->startedAt = gatt_now_millis();
+        slot->deadline = slot->startedAt + GATT_TIMEOUT_MILLIS;
+        slot->uuid16Count = 0;
+        slot->uuid128Count = 0;
+        slot->found = 0;
+        slot->state = GATT_SLOT_OPENING;
+        ++gattAttempted;
+        if (esp_ble_gattc_open(gattIf, slot->bda, req->addrType, true) == ESP_OK) {
+            return;
+        }
+        gatt_slot_conclude(slot, false, false);
+    }
+}
+
+/* End the batch once every device has been dealt with. Must be called with
+   gattLock taken */
+static void gatt_check_finished() {
+    if (!gattRunning || gattCount > 0) {
+        return;
+    }
+    for (int i = 0; i < GATT_MAX_CONNECTIONS; ++i) {
+        if (gattSlots[i].state != GATT_SLOT_IDLE) {
+            return;
+        }
+    }
+    gattRunning = false;
+    gattBatchEnd = gatt_now_millis();
+    esp_timer_stop(gattTimer);
+    gravity_gatt_report();
+}
+
+static void gatt_timer_cb(void *arg) {
+    xSemaphoreTake(gattLock, portMAX_DELAY);
+    uint32_t now = gatt_now_millis();
+    for (int i = 0; i < GATT_MAX_CONNECTIONS; ++i) {
+        gatt_slot_t *slot = &gattSlots[i];
+        if (slot->state == GATT_SLOT_IDLE || (int32_t)(now - slot->deadline) < 0) {
+            continue;
+        }
+        if (slot->state == GATT_SLOT_CLOSING) {
+            /* The disconnection was never reported */
+            slot->state = GATT_SLOT_IDLE;
+        } else {
+            gatt_slot_conclude(slot, false, true);
+        }
+    }
+    gatt_dispatch();
+    gatt_check_finished();
+    xSemaphoreGive(gattLock);
+}
+
+void gravity_gatt_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param) {
+    if (gattLock == NULL) {
+        /* Nothing has been requested */
+        if (event == ESP_GATTC_REG_EVT) {
+            gattIf = gattc_if;
+        }
+        return;
+    }
+    xSemaphoreTake(gattLock, portMAX_DELAY);
+    gatt_slot_t *slot = NULL;
+    switch (event) {
+        case ESP_GATTC_REG_EVT:
+            gattIf = gattc_if;
+            break;
+        case ESP_GATTC_OPEN_EVT:
+            slot = gatt_slot_with_bda(param->open.remote_bda);
+            if (slot == NULL || slot->state != GATT_SLOT_OPENING) {
+                /* A connection that timed out has completed after all */
+                if (param->open.status == ESP_GATT_OK) {
+                    esp_ble_gattc_close(gattc_if, param->open.conn_id);
+                }
+                break;
+            }
+            if (param->open.status != ESP_GATT_OK) {
+                gatt_slot_conclude(slot, false, false);
+                break;
+            }
+            slot->connId = param->open.conn_id;
+            slot->state = GATT_SLOT_DISCOVERING;
+            slot->deadline = gatt_now_millis() + GATT_TIMEOUT_MILLIS;
+            /* A larger MTU lets each response carry more services */
+            esp_ble_gattc_send_mtu_req(gattc_if, slot->connId);
+            break;
+        case ESP_GATTC_CFG_MTU_EVT:
+            if (gatt_slot_with_conn(param->cfg_mtu.conn_id) != NULL && param->cfg_mtu.status == ESP_GATT_OK) {
+                gattMtuSum += param->cfg_mtu.mtu;
+                ++gattMtuCount;
+            }
+            break;
+        case ESP_GATTC_DIS_SRVC_CMPL_EVT:
+            slot = gatt_slot_with_conn(param->dis_srvc_cmpl.conn_id);
+            if (slot == NULL || slot->state != GATT_SLOT_DISCOVERING) {
+                break;
+            }
+            if (param->dis_srvc_cmpl.status != ESP_GATT_OK ||
+                    esp_ble_gattc_search_service(gattc_if, slot->connId, NULL) != ESP_OK) {
+                gatt_slot_conclude(slot, false, false);
+            }
+            break;
+        case ESP_GATTC_SEARCH_RES_EVT:
+            slot = gatt_slot_with_conn(param->search_res.conn_id);
+            if (slot != NULL && slot->state == GATT_SLOT_DISCOVERING && param->search_res.is_primary) {
+                gatt_slot_add_uuid(slot, &param->search_res.srvc_id.uuid);
+            }
+            break;
+        case ESP_GATTC_SEARCH_CMPL_EVT:
+            slot = gatt_slot_with_conn(param->search_cmpl.conn_id);
+            if (slot != NULL && slot->state == GATT_SLOT_DISCOVERING) {
+                gatt_slot_conclude(slot, param->search_cmpl.status == ESP_GATT_OK, false);
+            }
+            break;
+        case ESP_GATTC_DISCONNECT_EVT:
+            slot = gatt_slot_with_bda(param->disconnect.remote_bda);
+            if (slot == NULL) {
+                break;
+            }
+            if (slot->state == GATT_SLOT_CLOSING) {
+                slot->state = GATT_SLOT_IDLE;
+            } else {
+                /* The device went away before discovery finished */
+                slot->state = GATT_SLOT_IDLE;
+                ++gattFailed;
+            }
+            break;
+        default:
+            break;
+    }
+    gatt_dispatch();
+    gatt_check_finished();
+    xSemaphoreGive(gattLock);
+}
+
+/* Queue devices for GATT service discovery and start discovering. Devices
+   that haven't been seen by BLE scanning are skipped */
+esp_err_t gravity_gatt_discover_services_for(app_gap_cb_t **devices, uint16_t deviceCount) {
+    esp_err_t err = gravity_ble_initialise();
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (gattLock == NULL) {
+        gattLock = xSemaphoreCreateMutexStatic(&gattLockBuffer);
+    }
+    if (gattTimer == NULL) {
+        esp_timer_create_args_t args = {
+            .callback = &gatt_timer_cb,
+            .name = "gattTimer"
+        };
+        err = esp_timer_create(&args, &gattTimer);
+        if (err != ESP_OK) {
+            #ifdef CONFIG_FLIPPER
+                printf("Failed to create GATT timer\n");
+            #else
+                ESP_LOGE(GATT_TAG, "Failed to create the GATT discovery timer: %s.", esp_err_to_name(err));
+            #endif
+            return err;
+        }
+    }
+
+    uint16_t queued = 0;
+    uint16_t skipped = 0;
+    xSemaphoreTake(gattLock, portMAX_DELAY);
+    if (!gattRunning) {
+        /* Start a new batch */
+        gattBatchStart = gatt_now_millis();
+        gattAttempted = 0;
+        gattCompleted = 0;
+        gattFailed = 0;
+        gattTimeouts = 0;
+        gattServices = 0;
+        gattMtuSum = 0;
+        gattMtuCount = 0;
+        gattDeviceMillis = 0;
+    }
+    for (uint16_t i = 0; i < deviceCount; ++i) {
+        if (!gravity_bt_dev_seen_on(devices[i], GRAVITY_BT_SCAN_BLE)) {
+            ++skipped;
+            continue;
+        }
+        if (gatt_pending(devices[i]->bda)) {
+            continue;
+        }
+        if (gattCount == GATT_QUEUE_LEN) {
+            err = ESP_ERR_NO_MEM;
+            break;
+        }
+        gatt_req_t *req = &gattQueue[(gattHead + gattCount++) % GATT_QUEUE_LEN];
+        memcpy(req->bda, devices[i]->bda, ESP_BD_ADDR_LEN);
+        req->addrType = devices[i]->bleAddrType;
+        ++queued;
+    }
+    if (queued > 0 && !gattRunning) {
+        gattRunning = true;
+        esp_timer_start_periodic(gattTimer, GATT_TICK_MILLIS * 1000);
+    }
+    gatt_dispatch();
+    uint16_t waiting = gattCount;
+    xSemaphoreGive(gattLock);
+
+    #ifdef CONFIG_FLIPPER
+        printf("GATT: %u queued\n%u not BLE\n", queued, skipped);
+    #else
+        ESP_LOGI(GATT_TAG, "Queued %u BLE devices for GATT service discovery, %u waiting; skipped %u devices not seen by BLE scanning.",
+                 queued, waiting, skipped);
+    #endif
+    if (err == ESP_ERR_NO_MEM) {
+        #ifdef CONFIG_FLIPPER
+            printf("GATT queue full\n");
+        #else
+            ESP_LOGW(GATT_TAG, "GATT discovery queue is full (%d devices); increase BLE_GATT_QUEUE_LEN to queue more.", GATT_QUEUE_LEN);
+        #endif
+    }
+    return err;
+}
+
+esp_err_t gravity_gatt_discover_all_services() {
+    return gravity_gatt_discover_services_for(gravity_bt_devices, gravity_bt_dev_count);
+}
+
+esp_err_t gravity_gatt_discover_selected_services() {
+    return gravity_gatt_discover_services_for(gravity_selected_bt, gravity_sel_bt_count);
+}
+
+/* Format a 128-bit UUID, stored least significant byte first, in the usual
+   8-4-4-4-12 form. strOutput must have space for 37 characters */
+static char *gatt_uuid128_str(const uint8_t *uuid, char *strOutput) {
+    char *pos = strOutput;
+    for (int i = ESP_UUID_LEN_128 - 1; i >= 0; --i) {
+        pos += sprintf(pos, "%02x", uuid[i]);
+        if (i == 12 || i == 10 || i == 8 || i == 6) {
+            *pos++ = '-';
+        }
+    }
+    *pos = '\0';
+    return strOutput;
+}
+
+/* Display the GATT services discovered for dev, if any */
+esp_err_t gravity_gatt_list_services(app_gap_cb_t *dev) {
+    grav_ble_gatt *gatt = dev->bt_services.gatt;
+    if (gatt == NULL) {
+        return ESP_OK;
+    }
+    #ifdef CONFIG_FLIPPER
+        printf("%u GATT services\n", gatt->uuid16Count + gatt->uuid128Count);
+    #else
+        ESP_LOGI(GATT_TAG, "%u GATT primary services", gatt->uuid16Count + gatt->uuid128Count);
+    #endif
+    for (uint8_t i = 0; i < gatt->uuid16Count; ++i) {
+        uint16_t uuid16;
+        memcpy(&uuid16, &gatt->uuids[i * sizeof(uint16_t)], sizeof(uint16_t));
+        const char *name = gravity_sig_service_name(uuid16);
+        #ifdef CONFIG_FLIPPER
+            printf("0x%04x:\n%s\n", uuid16, (name == NULL) ? "Unknown" : name);
+        #else
+            ESP_LOGI(GATT_TAG, "GATT 0x%04x: %s", uuid16, (name == NULL) ? "Unknown" : name);
+        #endif
+    }
+    const uint8_t *uuid128 = &gatt->uuids[gatt->uuid16Count * sizeof(uint16_t)];
+    for (uint8_t i = 0; i < gatt->uuid128Count; ++i) {
+        char strUuid[37];
+        gatt_uuid128_str(&uuid128[i * ESP_UUID_LEN_128], strUuid);
+        #ifdef CONFIG_FLIPPER
+            printf("%s\n", strUuid);
+        #else
+            ESP_LOGI(GATT_TAG, "GATT %s", strUuid);
+        #endif
+    }
+    return ESP_OK;
+}
+
+/* Display progress and throughput of the current or most recent batch */
+esp_err_t gravity_gatt_report() {
+    if (gattAttempted == 0 && !gattRunning) {
+        return ESP_OK;
+    }
+    uint32_t elapsed = (gattRunning ? gatt_now_millis() : gattBatchEnd) - gattBatchStart;
+    uint32_t done = gattCompleted + gattFailed;
+    /* Tenths of a device per minute */
+    uint32_t rate = (elapsed == 0) ? 0 : (uint32_t)((uint64_t)done * 600000 / elapsed);
+    uint32_t perDevice = (gattCompleted == 0) ? 0 : (uint32_t)(gattDeviceMillis / gattCompleted);
+    uint16_t connected = 0;
+    for (int i = 0; i < GATT_MAX_CONNECTIONS; ++i) {
+        if (gattSlots[i].state != GATT_SLOT_IDLE) {
+            ++connected;
+        }
+    }
+    #ifdef CONFIG_FLIPPER
+        printf("GATT %s, %u queued\n%lu done %lu failed\n%lu timeouts\n%lu svcs, %lu.%lu dev/min\n", gattRunning ? "ON" : "OFF",
+               gattCount, gattCompleted, gattFailed, gattTimeouts, gattServices, rate / 10, rate % 10);
+    #else
+        ESP_LOGI(GATT_TAG, "GATT service discovery %s with %u devices queued and %u in progress; %lu completed, %lu failed, %lu timed out",
+                 gattRunning ? "running" : "finished", gattCount, connected, gattCompleted, gattFailed, gattTimeouts);
+        ESP_LOGI(GATT_TAG, "%lu services found in %lu.%lus: %lu.%lu devices per minute, %lums per device, mean MTU %lu",
+                 gattServices, elapsed / 1000, (elapsed % 1000) / 100, rate / 10, rate % 10, perDevice,
+                 (gattMtuCount == 0) ? 0 : gattMtuSum / gattMtuCount);
+    #endif
+    return ESP_OK;
+}
+
+#endif
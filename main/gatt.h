@@ -0,0 +1,31 @@
+#ifndef GRAVITY_GATT_H
+#define GRAVITY_GATT_H
+
+#include "bluetooth.h"
+
+#if defined(CONFIG_BT_ENABLED)
+
+/* BLE GATT service discovery
+   Devices are queued, then connected to, their primary services discovered
+   and stored in the device record, and disconnected. Up to
+   CONFIG_BLE_GATT_MAX_CONNECTIONS devices are connected at once. The
+   controller can only establish one connection at a time, so the next device
+   is connected while earlier devices are exchanging MTU and discovering
+   services. Every device has CONFIG_BLE_GATT_TIMEOUT seconds to connect and
+   the same again to answer.
+*/
+
+/* GATT client application ID, and index into bluetooth.c's gl_profile_tab */
+#define GRAVITY_GATT_APP_ID 1
+
+extern const char *GATT_TAG;
+
+void gravity_gatt_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param);
+esp_err_t gravity_gatt_discover_services_for(app_gap_cb_t **devices, uint16_t deviceCount);
+esp_err_t gravity_gatt_discover_all_services();
+esp_err_t gravity_gatt_discover_selected_services();
+esp_err_t gravity_gatt_list_services(app_gap_cb_t *dev);
+esp_err_t gravity_gatt_report();
+
+#endif
+#endif
@@ -22,20 +22,26 @@
 
 #include "beacon.h"
 #include "bluetooth.h"
+#include "coex.h"
 #include "common.h"
 #include "deauth.h"
 #include "dos.h"
 #include "esp_err.h"
 #include "esp_wifi_types.h"
 #include "freertos/portmacro.h"
+#include "frames.h"
 #include "fuzz.h"
+#include "gatt.h"
 #include "hop.h"
 #include "mana.h"
+#include "mem.h"
+#include "output.h"
 #include "probe.h"
 #include "scan.h"
 #include "sdkconfig.h"
 #include "sniff.h"
 #include "stalk.h"
+#include "survey.h"
 #include "usage_const.h"
 
 char **user_ssids = NULL;
@@ -477,10 +483,16 @@ esp_err_t cmd_info(int argc, char **argv) {
                 ESP_LOGW(TAG, "Invalid command \"%s\", skipping...", argv[i]);
             #endif
         } else {
+            /* commands[] isn't in GravityCommand order, so find the command by name */
+            int idx = 0;
+            for (; idx < CMD_COUNT && strcasecmp(commands[idx].command, argv[i]); ++idx) { }
+            if (idx == CMD_COUNT) {
+                continue;
+            }
             #ifdef CONFIG_FLIPPER
-                printf("%s\n%s\n\n", commands[command].hint, commands[command].help);
+                printf("%s\n%s\n\n", commands[idx].hint, commands[idx].help);
             #else
-                printf("%15s:\t%s\n%15s\t%s\n\n", commands[command].command, commands[command].hint, "", commands[command].help);
+                printf("%15s:\t%s\n%15s\t%s\n\n", commands[idx].command, commands[idx].hint, "", commands[idx].help);
             #endif
         }
     }
@@ -586,6 +598,8 @@ esp_err_t cmd_fuzz(int argc, char **argv) {
     // Update attack_status[ATTACK_BEACON] appropriately
     attack_status[ATTACK_FUZZ] = strcasecmp(argv[argc - 1], "OFF");
 
+    /* Update the frames Gravity listens for */
+    gravity_frames_rebuild();
     /* Start/stop hopping as necessary */
     err = setHopForNewCommand();
     if (err != ESP_OK) {
@@ -604,10 +618,35 @@ esp_err_t cmd_fuzz(int argc, char **argv) {
 }
 
 /* Control channel hopping
-   Usage: hop [ MILLIS ] [ ON | OFF | DEFAULT | KILL ] [ SEQUENTIAL | RANDOM ]
-   Not specifying a parameter will report the status. KILL terminates the event loop.
+   Usage: hop [ MILLIS ] [ ON | OFF | DEFAULT | KILL ] [ SEQUENTIAL | RANDOM | ADAPTIVE | FOCUS ]
+          hop STATS [ RESET ]
+          hop SCHEDULE [ DEFAULT | ( <channel>[:<millis>] )+ ]
+   Not specifying a parameter will report the status. KILL deletes the hop timer.
+   STATS displays per-channel activity and dwell, channel switching overhead and
+   time taken to discover devices.
+   SCHEDULE displays or sets the channels to hop between and, optionally, how long
+   to spend on each. FOCUS restricts hopping to the channels of selected APs and STAs.
 */
 esp_err_t cmd_hop(int argc, char **argv) {
+    if (argc > 1 && !strcasecmp(argv[1], "SCHEDULE")) {
+        esp_err_t err = ESP_OK;
+        if (argc == 3 && !strcasecmp(argv[2], "DEFAULT")) {
+            err = hop_schedule_default();
+        } else if (argc > 2) {
+            err = hop_schedule_parse(argc - 2, &argv[2]);
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+        char scheduleStr[HOP_SCHEDULE_STRLEN + 1];
+        hop_schedule_to_string(scheduleStr);
+        #ifdef CONFIG_FLIPPER
+            printf("Schedule (ch/ms):\n%s\n", scheduleStr);
+        #else
+            ESP_LOGI(HOP_TAG, "Channel hopping schedule (channel/milliseconds): %s", scheduleStr);
+        #endif
+        return ESP_OK;
+    }
     if (argc > 4) {
         #ifdef CONFIG_FLIPPER
             printf("%s\n", SHORT_HOP);
@@ -644,16 +683,30 @@ esp_err_t cmd_hop(int argc, char **argv) {
         }
         char tempStr[19];
         hopModeToString(hopMode, tempStr);
+        char scheduleStr[HOP_SCHEDULE_STRLEN + 1];
+        hop_schedule_to_string(scheduleStr);
 
         #ifdef CONFIG_FLIPPER
             char hopStr[21];
             sprintf(hopStr, "Dwell time %ldms", hop_millis);
-            printf("Ch. hop %s\n%20s\nHop Mode: %s\n", hopMsg, hopStr, tempStr);
+            printf("Ch. hop %s\n%20s\nHop Mode: %s\nSchedule: %s\n", hopMsg, hopStr, tempStr, scheduleStr);
         #else
-            ESP_LOGI(HOP_TAG, "Channel hopping %s; Gravity will dwell on each channel for approximately %ldms\nChannel hopping mode: %s", hopMsg, hop_millis, tempStr);
+            ESP_LOGI(HOP_TAG, "Channel hopping %s; Gravity will dwell on each channel for approximately %ldms\nChannel hopping mode: %s\nSchedule (channel/milliseconds): %s", hopMsg, hop_millis, tempStr, scheduleStr);
         #endif
+    } else if (!strcasecmp(argv[1], "STATS")) {
+        if (argc == 3 && !strcasecmp(argv[2], "RESET")) {
+            return hop_stats_reset();
+        } else if (argc > 2) {
+            #ifdef CONFIG_FLIPPER
+                printf("%s\n", SHORT_HOP);
+            #else
+                ESP_LOGE(HOP_TAG, "Invalid arguments provided: %s", USAGE_HOP);
+            #endif
+            return ESP_ERR_INVALID_ARG;
+        }
+        return hop_stats_report();
     } else {
-        /* argv[1] could be a duration, "on", "default", "off", "kill", "sequential" or "random" */
+        /* argv[1] could be a duration, "on", "default", "off", "kill", "sequential", "random", "adaptive" or "focus" */
         /* To avoid starting hopping before updating hop_millis we need to check for duration first */
         long duration = atol(argv[1]);
         if (duration > 0) {
@@ -681,7 +734,6 @@ esp_err_t cmd_hop(int argc, char **argv) {
             #else
                 ESP_LOGI(HOP_TAG, "%s", strOutput);
             #endif
-            createHopTaskIfNeeded();
         } else if (!strcasecmp(argv[1], "OFF") || (argc > 2 && !strcasecmp(argv[2], "OFF")) || (argc == 4 && !strcasecmp(argv[3], "OFF"))) {
             hopStatus = HOP_STATUS_OFF;
             #ifdef CONFIG_FLIPPER
@@ -691,17 +743,16 @@ esp_err_t cmd_hop(int argc, char **argv) {
             #endif
         } else if (!strcasecmp(argv[1], "KILL") || (argc > 2 && !strcasecmp(argv[2], "KILL")) || (argc == 4 && !strcasecmp(argv[3], "KILL"))) {
             hopStatus = HOP_STATUS_OFF;
-            if (channelHopTask == NULL) {
-                ESP_LOGE(HOP_TAG, "Unable to locate the channel hop task. Is it running?");
+            if (channelHopTimer == NULL) {
+                ESP_LOGE(HOP_TAG, "Unable to locate the channel hop timer. Is it running?");
                 return ESP_ERR_INVALID_ARG;
             } else {
                 #ifdef CONFIG_FLIPPER
-                    printf("Killing hop task\n");
+                    printf("Killing hop timer\n");
                 #else
-                    ESP_LOGI(HOP_TAG, "Killing WiFi channel hopping event task %p...", &channelHopTask);
+                    ESP_LOGI(HOP_TAG, "Killing WiFi channel hopping timer %p...", channelHopTimer);
                 #endif
-                vTaskDelete(channelHopTask);
-                channelHopTask = NULL;
+                hop_timer_delete();
             }
         } else if (!strcasecmp(argv[1], "DEFAULT") || (argc > 2 && !strcasecmp(argv[2], "DEFAULT")) || (argc == 4 && !strcasecmp(argv[3], "DEFAULT"))) {
             hopStatus = HOP_STATUS_DEFAULT;
@@ -711,11 +762,14 @@ esp_err_t cmd_hop(int argc, char **argv) {
             #else
                 ESP_LOGI(HOP_TAG, "Channel hopping will use feature defaults.");
             #endif
-            createHopTaskIfNeeded();
         } else if (!strcasecmp(argv[1], "SEQUENTIAL") || (argc > 2 && !strcasecmp(argv[2], "SEQUENTIAL")) || (argc == 4 && !strcasecmp(argv[3], "SEQUENTIAL"))) {
             hopMode = HOP_MODE_SEQUENTIAL;
         } else if (!strcasecmp(argv[1], "RANDOM") || (argc > 2 && !strcasecmp(argv[2], "RANDOM")) || (argc == 4 && !strcasecmp(argv[3], "RANDOM"))) {
             hopMode = HOP_MODE_RANDOM;
+        } else if (!strcasecmp(argv[1], "ADAPTIVE") || (argc > 2 && !strcasecmp(argv[2], "ADAPTIVE")) || (argc == 4 && !strcasecmp(argv[3], "ADAPTIVE"))) {
+            hopMode = HOP_MODE_ADAPTIVE;
+        } else if (!strcasecmp(argv[1], "FOCUS") || (argc > 2 && !strcasecmp(argv[2], "FOCUS")) || (argc == 4 && !strcasecmp(argv[3], "FOCUS"))) {
+            hopMode = HOP_MODE_FOCUS;
         } else {
             /* Invalid argument */
             #ifdef CONFIG_FLIPPER
@@ -728,7 +782,8 @@ esp_err_t cmd_hop(int argc, char **argv) {
     }
     /* Recalculate hop_millis */
     hop_millis = dwellTime();       /* Cover your bases */
-    return ESP_OK;
+    /* Start or stop the hop timer to match the new settings */
+    return hop_state_refresh();
 }
 
 esp_err_t cmd_commands(int argc, char **argv) {
@@ -774,6 +829,8 @@ esp_err_t cmd_beacon(int argc, char **argv) {
         attack_status[ATTACK_BEACON] = true;
     }
 
+    /* Update the frames Gravity listens for */
+    gravity_frames_rebuild();
     /* Start/stop hopping task loop as needed */
     esp_err_t err = setHopForNewCommand();
     if (err != ESP_OK) {
@@ -924,6 +981,8 @@ esp_err_t cmd_probe(int argc, char **argv) {
     /* Set attack_status[ATTACK_PROBE] before checking channel hopping or starting/stopping */
     attack_status[ATTACK_PROBE] = strcasecmp(argv[1], "OFF");
 
+    /* Update the frames Gravity listens for */
+    gravity_frames_rebuild();
     /* Start hopping task loop if hopping is on by default */
     esp_err_t err = setHopForNewCommand();
     if (err != ESP_OK) {
@@ -1002,6 +1061,8 @@ esp_err_t cmd_sniff(int argc, char **argv) {
         return ESP_ERR_INVALID_ARG;
     }
 
+    /* Update the frames Gravity listens for */
+    gravity_frames_rebuild();
     /* Start hopping task loop if hopping is on by default */
     esp_err_t err = setHopForNewCommand();
     if (err != ESP_OK) {
@@ -1014,6 +1075,55 @@ esp_err_t cmd_sniff(int argc, char **argv) {
     return ESP_OK;
 }
 
+/* Survey WiFi channels
+   Usage: survey [ ON | OFF | RESET ]
+   Not specifying a parameter displays the results collected so far.
+*/
+esp_err_t cmd_survey(int argc, char **argv) {
+    if (argc > 2) {
+        #ifdef CONFIG_FLIPPER
+            printf("%s\n", SHORT_SURVEY);
+        #else
+            ESP_LOGE(SURVEY_TAG, "%s", USAGE_SURVEY);
+        #endif
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (argc == 1) {
+        return survey_report();
+    }
+
+    if (!strcasecmp(argv[1], "ON")) {
+        attack_status[ATTACK_SURVEY] = true;
+        survey_start();
+    } else if (!strcasecmp(argv[1], "OFF")) {
+        attack_status[ATTACK_SURVEY] = false;
+        survey_stop();
+    } else if (!strcasecmp(argv[1], "RESET")) {
+        return survey_reset();
+    } else {
+        #ifdef CONFIG_FLIPPER
+            printf("%s\n", SHORT_SURVEY);
+        #else
+            ESP_LOGE(SURVEY_TAG, "%s", USAGE_SURVEY);
+        #endif
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /* Update the frames Gravity listens for */
+    gravity_frames_rebuild();
+    /* Start hopping if hopping is on by default */
+    esp_err_t err = setHopForNewCommand();
+    if (err != ESP_OK) {
+        #ifdef CONFIG_FLIPPER
+            printf("%s%s\n", STRINGS_HOP_STATE_FAIL, esp_err_to_name(err));
+        #else
+            ESP_LOGW(HOP_TAG, "%s%s", STRINGS_HOP_STATE_FAIL, esp_err_to_name(err));
+        #endif
+    }
+    return ESP_OK;
+}
+
 esp_err_t cmd_deauth(int argc, char **argv) {
     /* Usage: deauth [ <millis> ] [ FRAME | DEVICE | SPOOF ] [ STA | AP | BROADCAST | OFF ] */
     if (argc > 4 || (argc == 4 && strcasecmp(argv[3], "STA") && strcasecmp(argv[3], "BROADCAST") &&
@@ -1115,6 +1225,8 @@ esp_err_t cmd_deauth(int argc, char **argv) {
     }
     attack_status[ATTACK_DEAUTH] = (dMode != DEAUTH_MODE_OFF);
 
+    /* Update the frames Gravity listens for */
+    gravity_frames_rebuild();
     /* Start/Stop channel hopping as required */
     esp_err_t err = setHopForNewCommand();
     if (err != ESP_OK) {
@@ -1221,6 +1333,8 @@ esp_err_t cmd_mana(int argc, char **argv) {
                 return ESP_ERR_INVALID_ARG;
             }
         }
+        /* Update the frames Gravity listens for */
+        gravity_frames_rebuild();
         /* Now that attack_status has been set correctly,
            start or stop channel hopping as needed
         */
@@ -1272,6 +1386,8 @@ esp_err_t cmd_stalk(int argc, char **argv) {
         #endif
     }
     attack_status[ATTACK_STALK] = strcasecmp(argv[1], "OFF");
+    /* Update the frames Gravity listens for */
+    gravity_frames_rebuild();
     if (attack_status[ATTACK_STALK]) {
         stalk_begin();
     } else {
@@ -1299,6 +1415,8 @@ esp_err_t cmd_ap_dos(int argc, char **argv) {
     /* Update attack_status[] */
     attack_status[ATTACK_AP_DOS] = strcasecmp(argv[1], "OFF");
 
+    /* Update the frames Gravity listens for */
+    gravity_frames_rebuild();
     /* Start/Stop hopping task loop if hopping is on by default */
     esp_err_t err = setHopForNewCommand();
     if (err != ESP_OK) {
@@ -1379,8 +1497,10 @@ esp_err_t cmd_scan(int argc, char **argv) {
                 // TODO: The following lines have been remediated to support SCAN BT SERVICES [selected]
                 // Validate them
                 // argc=3 && (!wifi && (BT && !services)) orr (argc>3 & ( (!BLE | !PURGE) & (!BT | !SERVICES | !selected))
-            (argc == 3 && ( (!strcasecmp(argv[1], "BT") && strcasecmp(argv[2], "SERVICES")) || (strcasecmp(argv[1], "BT") && strcasecmp(argv[2], "WIFI")))) ||
-            (argc > 3 && ( (!strcasecmp(argv[1], "BLE") && strcasecmp(argv[2], "PURGE")) || (!strcasecmp(argv[1], "BT") && (strcasecmp(argv[2], "SERVICES") || strcasecmp(argv[3], "SELECTED")))))) {
+            (argc == 3 && ( (!strcasecmp(argv[1], "BT") && strcasecmp(argv[2], "SERVICES")) || (!strcasecmp(argv[1], "BLE") && strcasecmp(argv[2], "SERVICES")) ||
+                (strcasecmp(argv[1], "BT") && strcasecmp(argv[1], "BLE") && strcasecmp(argv[2], "WIFI")))) ||
+            (argc > 3 && ( (!strcasecmp(argv[1], "BLE") && strcasecmp(argv[2], "PURGE") && (strcasecmp(argv[2], "SERVICES") || strcasecmp(argv[3], "SELECTED"))) ||
+                (!strcasecmp(argv[1], "BT") && (strcasecmp(argv[2], "SERVICES") || strcasecmp(argv[3], "SELECTED")))))) {
         #ifdef CONFIG_FLIPPER
             printf("%s\n", SHORT_SCAN);
         #else
@@ -1457,6 +1577,18 @@ esp_err_t cmd_scan(int argc, char **argv) {
         #else
             displayBluetoothUnsupported();
         #endif
+    } else if (!strcasecmp(argv[1], "BLE") && argc >= 3 && !strcasecmp(argv[2], "SERVICES")) {
+        /* Connect to BLE devices and discover their GATT services */
+        #if defined(CONFIG_BT_ENABLED)
+            bool selected = (argc > 3 && !strcasecmp(argv[3], "SELECTED"));
+            if (selected) {
+                err |= gravity_gatt_discover_selected_services();
+            } else {
+                err |= gravity_gatt_discover_all_services();
+            }
+        #else
+            displayBluetoothUnsupported();
+        #endif
     } else if (!strcasecmp(argv[1], "BLE")) {
         /* Initialise BT monitor mode and identify devices */
         #if defined(CONFIG_BT_ENABLED)
@@ -1559,6 +1691,10 @@ esp_err_t cmd_scan(int argc, char **argv) {
             ESP_LOGI(SCAN_TAG, "%s%s\n", strMsg, ssidMsg);
     #endif
 
+    /* Update the frames Gravity listens for */
+    gravity_frames_rebuild();
+    /* Share the radio between WiFi and Bluetooth scans as needed */
+    err |= gravity_coex_refresh();
     /* Start/stop hopping task loop as needed */
     err |= setHopForNewCommand();
     if (err != ESP_OK) {
@@ -1579,17 +1715,18 @@ esp_err_t cmd_scan(int argc, char **argv) {
    Allowed values for <variable> are:
       SCRAMBLE_WORDS, SSID_LEN_MIN, SSID_LEN_MAX, DEFAULT_SSID_COUNT, CHANNEL,
       MAC, ATTACK_MILLIS, MAC_RAND, EXPIRY, HOP_MODE, SCRAMBLE_WORDS,
-      BLE_PURGE_STRAT, BLE_PURGE_MAX_RSSI, BLE_PURGE_MIN_AGE */
+      BLE_PURGE_STRAT, BLE_PURGE_MAX_RSSI, BLE_PURGE_MIN_AGE, BLE_MEMORY_BUDGET,
+      BLE_SCAN_PROFILE, COEX_WEIGHTS, FRAME_LATENCY */
 /* Channel hopping is not catered for in this feature */
 esp_err_t cmd_set(int argc, char **argv) {
     if (argc != 3) {
         #ifdef CONFIG_FLIPPER
-            printf("%s\nSCRAMBLE_WORDS,\nSSID_LEN_MIN,\nSSID_LEN_MAX,\nDEFAULT_SSID_COUNT,\nCHANNEL,\nATTACK_MILLIS,MAC,\nMAC_RAND,EXPIRY,\nHOP_MODE,\nSCRAMBLE_WORDS,\nBLE_PURGE_STRAT,\nBLE_PURGE_MAX_RSSI,\nBLE_PURGE_MIN_AGE\n", SHORT_SET);
+            printf("%s\nSCRAMBLE_WORDS,\nSSID_LEN_MIN,\nSSID_LEN_MAX,\nDEFAULT_SSID_COUNT,\nCHANNEL,\nATTACK_MILLIS,MAC,\nMAC_RAND,EXPIRY,\nHOP_MODE,\nSCRAMBLE_WORDS,\nBLE_PURGE_STRAT,\nBLE_PURGE_MAX_RSSI,\nBLE_PURGE_MIN_AGE,\nBLE_MEMORY_BUDGET,\nBLE_SCAN_PROFILE,\nCOEX_WEIGHTS,\nFRAME_LATENCY\n", SHORT_SET);
         #else
             ESP_LOGE(TAG, "%s", USAGE_SET);
             ESP_LOGE(TAG, "<variable> : SSID_LEN_MIN | SSID_LEN_MAX | DEFAULT_SSID_COUNT | CHANNEL | HOP_MODE |");
             ESP_LOGE(TAG, "             MAC | ATTACK_MILLIS | MAC_RAND | EXPIRY | SCRAMBLE_WORDS |");
-            ESP_LOGE(TAG, "             BLE_PURGE_STRAT | BLE_PURGE_MAX_RSSI | BLE_PURGE_MIN_AGE");
+            ESP_LOGE(TAG, "             BLE_PURGE_STRAT | BLE_PURGE_MAX_RSSI | BLE_PURGE_MIN_AGE | BLE_MEMORY_BUDGET | BLE_SCAN_PROFILE | COEX_WEIGHTS | FRAME_LATENCY");
         #endif
         return ESP_ERR_INVALID_ARG;
     }
@@ -1620,11 +1757,15 @@ esp_err_t cmd_set(int argc, char **argv) {
             hopMode = HOP_MODE_SEQUENTIAL;
         } else if (!strcasecmp(argv[2], "RANDOM")) {
             hopMode = HOP_MODE_RANDOM;
+        } else if (!strcasecmp(argv[2], "ADAPTIVE")) {
+            hopMode = HOP_MODE_ADAPTIVE;
+        } else if (!strcasecmp(argv[2], "FOCUS")) {
+            hopMode = HOP_MODE_FOCUS;
         } else {
             #ifdef CONFIG_FLIPPER
-                printf("SET HOP_MODE ( SEQUENTIAL | RANDOM )\n");
+                printf("SET HOP_MODE ( SEQUENTIAL | RANDOM | ADAPTIVE | FOCUS )\n");
             #else
-                ESP_LOGE(HOP_TAG, "Invalid mode specified. Please use one of ( SEQUENTIAL , RANDOM )");
+                ESP_LOGE(HOP_TAG, "Invalid mode specified. Please use one of ( SEQUENTIAL , RANDOM , ADAPTIVE , FOCUS )");
             #endif
             return ESP_ERR_INVALID_ARG;
         }
@@ -1913,14 +2054,113 @@ esp_err_t cmd_set(int argc, char **argv) {
             displayBluetoothUnsupported();
             return ESP_ERR_NOT_SUPPORTED;
         #endif
+    } else if (!strcasecmp(argv[1], "BLE_MEMORY_BUDGET")) {
+        #if defined(CONFIG_BT_ENABLED)
+            char *endPtr = NULL;
+            long budgetSpec = 0;
+            if (!strcasecmp(argv[2], "AUTO")) {
+                budgetSpec = gravity_mem_auto_budget();
+                PURGE_MEMORY_BUDGET_AUTO = true;
+            } else {
+                budgetSpec = strtol(argv[2], &endPtr, 10);
+                if (endPtr == argv[2] || *endPtr != '\0' || budgetSpec < 0 || budgetSpec > MAX_16_BIT) {
+                    #ifdef CONFIG_FLIPPER
+                        printf("Invalid budget: \"%s\".\n", argv[2]);
+                    #else
+                        ESP_LOGE(TAG, "Invalid BLE memory budget \"%s\". Specify a number of KB, AUTO, or 0 for no budget.", argv[2]);
+                    #endif
+                    return ESP_ERR_INVALID_ARG;
+                }
+                PURGE_MEMORY_BUDGET_AUTO = false;
+            }
+            PURGE_MEMORY_BUDGET = budgetSpec;
+            #ifdef CONFIG_DEBUG
+                #ifdef CONFIG_FLIPPER
+                    printf("BLE budget: %ldKB\n", budgetSpec);
+                #else
+                    ESP_LOGI(TAG, "BLE memory budget set to %ld KB.", budgetSpec);
+                #endif
+            #endif
+        #else
+            displayBluetoothUnsupported();
+            return ESP_ERR_NOT_SUPPORTED;
+        #endif
+    } else if (!strcasecmp(argv[1], "BLE_SCAN_PROFILE")) {
+        /* Syntax: SET BLE_SCAN_PROFILE ( AGGRESSIVE | BALANCED | FILTERED | PASSIVE ) */
+        #if defined(CONFIG_BT_ENABLED)
+            gravity_ble_profile_t profile;
+            if (gravity_ble_profile_from_string(argv[2], &profile) != ESP_OK) {
+                #ifdef CONFIG_FLIPPER
+                    printf("SET BLE_SCAN_PROFILE ( AGGRESSIVE | BALANCED | FILTERED | PASSIVE )\n");
+                #else
+                    ESP_LOGE(BT_TAG, "Invalid profile specified. Please use one of ( AGGRESSIVE , BALANCED , FILTERED , PASSIVE )");
+                #endif
+                return ESP_ERR_INVALID_ARG;
+            }
+            esp_err_t err = gravity_ble_set_profile(profile);
+            if (err != ESP_OK) {
+                #ifdef CONFIG_FLIPPER
+                    printf("Failed to set profile:\n%s\n", esp_err_to_name(err));
+                #else
+                    ESP_LOGE(BT_TAG, "Failed to apply BLE scan profile %s: %s.", argv[2], esp_err_to_name(err));
+                #endif
+                return err;
+            }
+            #ifdef CONFIG_FLIPPER
+                printf("BLE_SCAN_PROFILE: %s\n", argv[2]);
+            #else
+                ESP_LOGI(BT_TAG, "BLE scan profile set to %s.", argv[2]);
+            #endif
+        #else
+            displayBluetoothUnsupported();
+            return ESP_ERR_NOT_SUPPORTED;
+        #endif
+    } else if (!strcasecmp(argv[1], "COEX_WEIGHTS")) {
+        /* Syntax: SET COEX_WEIGHTS <wifi>:<ble>:<classic> */
+        esp_err_t err = gravity_coex_weights_parse(argv[2]);
+        if (err != ESP_OK) {
+            return err;
+        }
+        char strWeights[COEX_WEIGHTS_STRLEN + 1];
+        gravity_coex_weights_to_string(strWeights);
+        #ifdef CONFIG_FLIPPER
+            printf("COEX_WEIGHTS: %s\n", strWeights);
+        #else
+            ESP_LOGI(COEX_TAG, "Radio weights (WiFi:BLE:Classic) set to %s.", strWeights);
+        #endif
+    } else if (!strcasecmp(argv[1], "FRAME_LATENCY")) {
+        /* Syntax: SET FRAME_LATENCY ( IRAM | FLASH | RESET ) */
+        #ifdef CONFIG_FRAME_LATENCY_STATS
+            if (!strcasecmp(argv[2], "IRAM")) {
+                gravity_frames_set_layout(GRAVITY_FRAME_LAYOUT_IRAM);
+            } else if (!strcasecmp(argv[2], "FLASH")) {
+                gravity_frames_set_layout(GRAVITY_FRAME_LAYOUT_FLASH);
+            } else if (!strcasecmp(argv[2], "RESET")) {
+                gravity_frames_latency_reset();
+            } else {
+                #ifdef CONFIG_FLIPPER
+                    printf("SET FRAME_LATENCY ( IRAM | FLASH | RESET )\n");
+                #else
+                    ESP_LOGE(FRAMES_TAG, "Invalid option specified. Please use one of ( IRAM , FLASH , RESET )");
+                #endif
+                return ESP_ERR_INVALID_ARG;
+            }
+        #else
+            #ifdef CONFIG_FLIPPER
+                printf("Latency stats disabled\n");
+            #else
+                ESP_LOGW(FRAMES_TAG, "Frame latency measurement is disabled. Enable CONFIG_FRAME_LATENCY_STATS to use it.");
+            #endif
+            return ESP_ERR_NOT_SUPPORTED;
+        #endif
     } else {
         #ifdef CONFIG_FLIPPER
-            printf("%s\nSSID_LEN_MIN,\nSSID_LEN_MAX,\nDEFAULT_SSID_COUNT,\nCHANNEL,\nATTACK_MILLIS,MAC,\nMAC_RAND,EXPIRY,\nHOP_MODE,\nSCRAMBLE_WORDS,\nBLE_PURGE_STRAT,\nBLE_PURGE_MAX_RSSI,\nBLE_PURGE_MIN_AGE\n", SHORT_SET);
+            printf("%s\nSSID_LEN_MIN,\nSSID_LEN_MAX,\nDEFAULT_SSID_COUNT,\nCHANNEL,\nATTACK_MILLIS,MAC,\nMAC_RAND,EXPIRY,\nHOP_MODE,\nSCRAMBLE_WORDS,\nBLE_PURGE_STRAT,\nBLE_PURGE_MAX_RSSI,\nBLE_PURGE_MIN_AGE,\nBLE_MEMORY_BUDGET,\nBLE_SCAN_PROFILE,\nCOEX_WEIGHTS,\nFRAME_LATENCY\n", SHORT_SET);
         #else
             ESP_LOGE(TAG, "Invalid variable specified. %s", USAGE_SET);
             ESP_LOGE(TAG, "<variable> : SSID_LEN_MIN | SSID_LEN_MAX | DEFAULT_SSID_COUNT | CHANNEL |");
             ESP_LOGE(TAG, "             MAC | ATTACK_MILLIS | MAC_RAND | EXPIRY | HOP_MODE");
-            ESP_LOGE(TAG, "             SCRAMBLE_WORDS | BLE_PURGE_STRAT | BLE_PURGE_MAX_RSSI | BLE_PURGE_MIN_AGE");
+            ESP_LOGE(TAG, "             SCRAMBLE_WORDS | BLE_PURGE_STRAT | BLE_PURGE_MAX_RSSI | BLE_PURGE_MIN_AGE | BLE_MEMORY_BUDGET | BLE_SCAN_PROFILE | COEX_WEIGHTS | FRAME_LATENCY");
         #endif
         return ESP_ERR_INVALID_ARG;
     }
@@ -1933,17 +2173,18 @@ esp_err_t cmd_set(int argc, char **argv) {
    Allowed values for <variable> are:
       SSID_LEN_MIN, SSID_LEN_MAX, DEFAULT_SSID_COUNT, CHANNEL, HOP_MODE
       MAC, EXPIRY, MAC_RAND, ATTACK_MILLIS, BLE_PURGE_STRAT
-      BLE_PURGE_MAX_RSSI, BLE_PURGE_MIN_AGE */
+      BLE_PURGE_MAX_RSSI, BLE_PURGE_MIN_AGE, BLE_MEMORY_BUDGET,
+      BLE_SCAN_PROFILE, COEX_WEIGHTS, FRAME_LATENCY */
 /* Channel hopping is not catered for in this feature */
 esp_err_t cmd_get(int argc, char **argv) {
     if (argc != 2) {
         #ifdef CONFIG_FLIPPER
-            printf("%s\nSCRAMBLE_WORDS,\nSSID_LEN_MIN,\nSSID_LEN_MAX,\nDEFAULT_SSID_COUNT,\nCHANNEL,\nATTACK_MILLIS,MAC,\nMAC_RAND,EXPIRY,\nHOP_MODE,\nBLE_PURGE_STRAT,\nBLE_PURGE_MAX_RSSI,\nBLE_PURGE_MIN_AGE\n", SHORT_GET);
+            printf("%s\nSCRAMBLE_WORDS,\nSSID_LEN_MIN,\nSSID_LEN_MAX,\nDEFAULT_SSID_COUNT,\nCHANNEL,\nATTACK_MILLIS,MAC,\nMAC_RAND,EXPIRY,\nHOP_MODE,\nBLE_PURGE_STRAT,\nBLE_PURGE_MAX_RSSI,\nBLE_PURGE_MIN_AGE,\nBLE_MEMORY_BUDGET,\nBLE_SCAN_PROFILE,\nCOEX_WEIGHTS,\nFRAME_LATENCY\n", SHORT_GET);
         #else
             ESP_LOGE(TAG, "%s", USAGE_GET);
             ESP_LOGE(TAG, "<variable> : SSID_LEN_MIN | SSID_LEN_MAX | DEFAULT_SSID_COUNT | CHANNEL | HOP_MODE | MAC |");
             ESP_LOGE(TAG, "             ATTACK_MILLIS | MAC_RAND | EXPIRY | SCRAMBLE_WORDS | BLE_PURGE_STRAT |");
-            ESP_LOGE(TAG, "             BLE_PURGE_MAX_RSSI | BLE_PURGE_MIN_AGE");
+            ESP_LOGE(TAG, "             BLE_PURGE_MAX_RSSI | BLE_PURGE_MIN_AGE | BLE_MEMORY_BUDGET | BLE_SCAN_PROFILE | COEX_WEIGHTS | FRAME_LATENCY");
         #endif
         return ESP_ERR_INVALID_ARG;
     }
@@ -2144,14 +2385,51 @@ esp_err_t cmd_get(int argc, char **argv) {
                 ESP_LOGW(TAG, "Bluetooth unsupported by this device.");
             #endif
         #endif
+    } else if (!strcasecmp(argv[1], "BLE_MEMORY_BUDGET")) {
+        #if defined(CONFIG_BT_ENABLED)
+            #ifdef CONFIG_FLIPPER
+                printf("BLE budget: %uKB%s\n", PURGE_MEMORY_BUDGET, PURGE_MEMORY_BUDGET_AUTO?" (auto)":"");
+            #else
+                if (PURGE_MEMORY_BUDGET == 0) {
+                    ESP_LOGI(BT_TAG, "No BLE memory budget; BLE devices are purged only when memory runs out.");
+                } else {
+                    ESP_LOGI(BT_TAG, "BLE devices will be purged to keep Bluetooth scan results within %u KB%s.", PURGE_MEMORY_BUDGET,
+                             PURGE_MEMORY_BUDGET_AUTO?", sized from available memory":"");
+                }
+                ESP_LOGI(BT_TAG, "Free memory: %u KB internal, %u KB PSRAM.", gravity_mem_internal_free() / 1024, gravity_mem_psram_free() / 1024);
+            #endif
+        #else
+            displayBluetoothUnsupported();
+            return ESP_ERR_NOT_SUPPORTED;
+        #endif
+    } else if (!strcasecmp(argv[1], "BLE_SCAN_PROFILE")) {
+        #if defined(CONFIG_BT_ENABLED)
+            gravity_ble_profile_report();
+        #else
+            displayBluetoothUnsupported();
+            return ESP_ERR_NOT_SUPPORTED;
+        #endif
+    } else if (!strcasecmp(argv[1], "COEX_WEIGHTS")) {
+        gravity_coex_report();
+    } else if (!strcasecmp(argv[1], "FRAME_LATENCY")) {
+        #ifdef CONFIG_FRAME_LATENCY_STATS
+            gravity_frames_latency_report();
+        #else
+            #ifdef CONFIG_FLIPPER
+                printf("Latency stats disabled\n");
+            #else
+                ESP_LOGW(FRAMES_TAG, "Frame latency measurement is disabled. Enable CONFIG_FRAME_LATENCY_STATS to use it.");
+            #endif
+            return ESP_ERR_NOT_SUPPORTED;
+        #endif
     } else {
         #ifdef CONFIG_FLIPPER
-            printf("%s\nSSID_LEN_MIN,\nSSID_LEN_MAX,\nDEFAULT_SSID_COUNT,\nCHANNEL,\nATTACK_MILLIS,MAC,\nMAC_RAND,EXPIRY,\nHOP_MODE,\nSCRAMBLE_WORDS,\nBLE_PURGE_STRAT,\nBLE_PURGE_MAX_RSSI,\nBLE_PURGE_MIN_AGE\n", SHORT_GET);
+            printf("%s\nSSID_LEN_MIN,\nSSID_LEN_MAX,\nDEFAULT_SSID_COUNT,\nCHANNEL,\nATTACK_MILLIS,MAC,\nMAC_RAND,EXPIRY,\nHOP_MODE,\nSCRAMBLE_WORDS,\nBLE_PURGE_STRAT,\nBLE_PURGE_MAX_RSSI,\nBLE_PURGE_MIN_AGE,\nBLE_MEMORY_BUDGET,\nBLE_SCAN_PROFILE,\nCOEX_WEIGHTS,\nFRAME_LATENCY\n", SHORT_GET);
         #else
             ESP_LOGE(TAG, "Invalid variable specified. %s", USAGE_GET);
             ESP_LOGE(TAG, "<variable> : SSID_LEN_MIN | SSID_LEN_MAX | DEFAULT_SSID_COUNT | CHANNEL |");
             ESP_LOGE(TAG, "             MAC | ATTACK_MILLIS | MAC_RAND | EXPIRY | HOP_MODE");
-            ESP_LOGE(TAG, "             SCRAMBLE_WORDS | BLE_PURGE_STRAT | BLE_PURGE_MAX_RSSI | BLE_PURGE_MIN_AGE");
+            ESP_LOGE(TAG, "             SCRAMBLE_WORDS | BLE_PURGE_STRAT | BLE_PURGE_MAX_RSSI | BLE_PURGE_MIN_AGE | BLE_MEMORY_BUDGET | BLE_SCAN_PROFILE | COEX_WEIGHTS | FRAME_LATENCY");
         #endif
         return ESP_ERR_INVALID_ARG;
     }
@@ -2163,7 +2441,7 @@ esp_err_t cmd_get(int argc, char **argv) {
 /* Usage: view ( ( AP [selectedSTA] ) | ( STA [selectedAP] ) | BT [ SERVICES [ SELECTED | KNOWN | UNKNOWN ] ] | SORT ( AGE | RSSI | SSID ) )+
 */
 esp_err_t cmd_view(int argc, char **argv) {
-    if (argc < 2 || argc > 12) {
+    if (argc < 2 || argc > 24) {
         #ifdef CONFIG_FLIPPER
             printf("%s\n", SHORT_VIEW);
         #else
@@ -2203,6 +2481,16 @@ esp_err_t cmd_view(int argc, char **argv) {
     sortResults[1] = currentSortTypes[1];
     sortResults[2] = currentSortTypes[2];
 
+    /* Capture filter clauses - WHERE, LIMIT, OFFSET and COLUMNS. These apply to
+       every list displayed by this command */
+    GravityFilter filter;
+    gravity_filter_init(&filter);
+    for (i = 1; i < argc; ++i) {
+        if (gravity_filter_is_keyword(argv[i]) && gravity_filter_parse(&filter, argc, argv, &i) != ESP_OK) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
     #ifdef CONFIG_DEBUG
         if (currentSortCount > 0) {
             char sortCriteria[25] = "";
@@ -2254,30 +2542,36 @@ esp_err_t cmd_view(int argc, char **argv) {
     for (i=1; i < argc; ++i) {
         /* Hide expired packets for display if scanResultExpiry has been set */
         if (!strcasecmp(argv[i], "AP")) {
+            if (gravity_filter_check(&filter, GRAVITY_FILTER_AP_FIELDS, GRAVITY_FILTER_AP_COLUMNS, "AP") != ESP_OK) {
+                return ESP_ERR_INVALID_ARG;
+            }
             /* Is this looking for APs, or for APs associated with selected STAs? */
             if (argc > (i + 1) && !strcasecmp(argv[i + 1], "selectedSTA")) {
                 /* Collate all APs that are associated with the selected STAs */
                 int apCount = 0;
                 ScanResultAP **selectedAPs = collateAPsOfSelectedSTAs(&apCount);
 
-                success = (success && (gravity_list_ap(selectedAPs, apCount, (scanResultExpiry != 0)) == ESP_OK));
+                success = (success && (gravity_list_ap(selectedAPs, apCount, (scanResultExpiry != 0), &filter) == ESP_OK));
 
                 free(selectedAPs);
                 ++i;
             } else {
-                success = (success && (gravity_list_all_aps((scanResultExpiry != 0)) == ESP_OK));
+                success = (success && (gravity_list_all_aps((scanResultExpiry != 0), &filter) == ESP_OK));
             }
         } else if (!strcasecmp(argv[i], "STA")) {
+            if (gravity_filter_check(&filter, GRAVITY_FILTER_STA_FIELDS, GRAVITY_FILTER_STA_COLUMNS, "STA") != ESP_OK) {
+                return ESP_ERR_INVALID_ARG;
+            }
             /* Are we looking for all STAs, or STAs associated with select APs? */
             if (argc > (i + 1) && !strcasecmp(argv[i + 1], "selectedAP")) {
                 /* Collate all STAs that are associated with the selected APs */
                 int staCount = 0;
                 ScanResultSTA **selectedSTAs = collateClientsOfSelectedAPs(&staCount);
-                success = (success && (gravity_list_sta(selectedSTAs, staCount, (scanResultExpiry != 0)) == ESP_OK));
+                success = (success && (gravity_list_sta(selectedSTAs, staCount, (scanResultExpiry != 0), &filter) == ESP_OK));
                 free(selectedSTAs);
                 ++i;
             } else {
-                success = (success && (gravity_list_all_stas((scanResultExpiry != 0)) == ESP_OK));
+                success = (success && (gravity_list_all_stas((scanResultExpiry != 0), &filter) == ESP_OK));
             }
         } else if (!strcasecmp(argv[i], "BT")) {
             #if defined(CONFIG_BT_ENABLED)
@@ -2301,13 +2595,21 @@ esp_err_t cmd_view(int argc, char **argv) {
                         bt_listAllServices();
                     }
                 } else {
-                    success = (success && gravity_bt_list_all_devices((scanResultExpiry != 0)) == ESP_OK);
+                    if (gravity_filter_check(&filter, GRAVITY_FILTER_BT_FIELDS, GRAVITY_FILTER_BT_COLUMNS, "BT") != ESP_OK) {
+                        return ESP_ERR_INVALID_ARG;
+                    }
+                    success = (success && gravity_bt_list_all_devices((scanResultExpiry != 0), &filter) == ESP_OK);
                 }
             #else
                 displayBluetoothUnsupported();
             #endif
         } else if (!strcasecmp(argv[i], "SORT")) {
             ++i; /* Skip "SORT" and specifier */
+        } else if (gravity_filter_is_keyword(argv[i])) {
+            /* Already captured; skip the clause */
+            GravityFilter clause;
+            gravity_filter_init(&clause);
+            gravity_filter_parse(&clause, argc, argv, &i);
         } else {
             #ifdef CONFIG_FLIPPER
                 printf("%s\n", SHORT_VIEW);
@@ -2323,6 +2625,91 @@ esp_err_t cmd_view(int argc, char **argv) {
     return ESP_ERR_NO_MEM;
 }
 
+/* Select scan results by predicate instead of by ID:
+   select ( AP | STA | BT ) [ WHERE <pred> [ AND <pred> ]* ] [ TOP <n> BY ( RSSI | AGE ) ]
+   Matching results are added to the selection - nothing is deselected. The
+   results are evaluated in a single pass and the selection updated in one step */
+static esp_err_t select_where(int argc, char **argv) {
+    GravityFilter filter;
+    gravity_filter_init(&filter);
+    uint32_t top = 0;
+    GRAVITY_SORT_TYPE rankBy = GRAVITY_SORT_RSSI;
+
+    for (int i = 2; i < argc; ++i) {
+        if (!strcasecmp(argv[i], "WHERE")) {
+            if (gravity_filter_parse(&filter, argc, argv, &i) != ESP_OK) {
+                return ESP_ERR_INVALID_ARG;
+            }
+        } else if (!strcasecmp(argv[i], "TOP") && i + 3 < argc && !strcasecmp(argv[i + 2], "BY")) {
+            char *end = NULL;
+            long count = strtol(argv[i + 1], &end, 10);
+            if (end == argv[i + 1] || *end != '\0' || count <= 0) {
+                #ifdef CONFIG_FLIPPER
+                    printf("Invalid TOP: \"%s\"\n", argv[i + 1]);
+                #else
+                    ESP_LOGE(TAG, "Invalid TOP count: \"%s\"", argv[i + 1]);
+                #endif
+                return ESP_ERR_INVALID_ARG;
+            }
+            top = count;
+            if (!strcasecmp(argv[i + 3], "RSSI")) {
+                rankBy = GRAVITY_SORT_RSSI;
+            } else if (!strcasecmp(argv[i + 3], "AGE")) {
+                rankBy = GRAVITY_SORT_AGE;
+            } else {
+                #ifdef CONFIG_FLIPPER
+                    printf("TOP is BY RSSI or AGE\n");
+                #else
+                    ESP_LOGE(TAG, "TOP can rank by RSSI or AGE, not \"%s\"", argv[i + 3]);
+                #endif
+                return ESP_ERR_INVALID_ARG;
+            }
+            i += 3;
+        } else {
+            #ifdef CONFIG_FLIPPER
+                printf("%s\n", SHORT_SELECT);
+            #else
+                ESP_LOGE(TAG, "%s", USAGE_SELECT);
+            #endif
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    esp_err_t err = ESP_OK;
+    uint32_t newCount = 0;
+    int selCount = 0;
+    if (!strcasecmp(argv[1], "AP")) {
+        if (gravity_filter_check(&filter, GRAVITY_FILTER_AP_FIELDS, GRAVITY_FILTER_AP_COLUMNS, "AP") != ESP_OK) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        err = gravity_select_aps_where(&filter, top, rankBy, &newCount);
+        selCount = gravity_sel_ap_count;
+    } else if (!strcasecmp(argv[1], "STA")) {
+        if (gravity_filter_check(&filter, GRAVITY_FILTER_STA_FIELDS, GRAVITY_FILTER_STA_COLUMNS, "STA") != ESP_OK) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        err = gravity_select_stas_where(&filter, top, rankBy, &newCount);
+        selCount = gravity_sel_sta_count;
+    } else {
+        #if defined(CONFIG_BT_ENABLED)
+            if (gravity_filter_check(&filter, GRAVITY_FILTER_BT_FIELDS, GRAVITY_FILTER_BT_COLUMNS, "BT") != ESP_OK) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            err = gravity_select_bt_where(&filter, top, rankBy, &newCount);
+            selCount = gravity_sel_bt_count;
+        #else
+            displayBluetoothUnsupported();
+            return ESP_ERR_NOT_SUPPORTED;
+        #endif
+    }
+    #ifdef CONFIG_FLIPPER
+        printf("%lu %s selected, %d total\n", newCount, argv[1], selCount);
+    #else
+        ESP_LOGI(TAG, "Selected %lu more %s elements, %d are now selected", newCount, argv[1], selCount);
+    #endif
+    return err;
+}
+
 /* Channel hopping is not catered for in this feature */
 esp_err_t cmd_select(int argc, char **argv) {
     if (argc < 3 || (strcasecmp(argv[1], "AP") && strcasecmp(argv[1], "STA") && strcasecmp(argv[1], "BT"))) {
@@ -2404,6 +2791,15 @@ esp_err_t cmd_select(int argc, char **argv) {
         }
     }
 
+    /* Select by predicate, e.g. select STA WHERE ap=3 AND rssi>-70 */
+    if (!strcasecmp(argv[2], "WHERE") || !strcasecmp(argv[2], "TOP")) {
+        esp_err_t err = select_where(argc, argv);
+        if (hatCount > 0) {
+            free(argv);
+        }
+        return err;
+    }
+
     /* Check whether 'ALL' is specified anywhere in the arguments */
     bool selectAll = false;
     for (int i = 2; i < argc && !selectAll; ++i) {
@@ -2506,16 +2902,16 @@ esp_err_t cmd_selected(int argc, char **argv) {
     /* Print APs if no args or "AP" */
     /* Hide expired packets only if scanResultExpiry has been set */
     if (argc == 1 || (argc > 1 && !strcasecmp(argv[1], "AP")) || (argc > 2 && !strcasecmp(argv[2], "AP")) || (argc == 4 && !strcasecmp(argv[3], "AP"))) {
-        retVal |= gravity_list_ap(gravity_selected_aps, gravity_sel_ap_count, (scanResultExpiry != 0));
+        retVal |= gravity_list_ap(gravity_selected_aps, gravity_sel_ap_count, (scanResultExpiry != 0), NULL);
         printf("\n");
     }
     if (argc == 1 || (argc > 1 && !strcasecmp(argv[1], "STA")) || (argc > 2 && !strcasecmp(argv[2], "STA")) || (argc == 4 && !strcasecmp(argv[3], "STA"))) {
-        retVal |= gravity_list_sta(gravity_selected_stas, gravity_sel_sta_count, (scanResultExpiry != 0));
+        retVal |= gravity_list_sta(gravity_selected_stas, gravity_sel_sta_count, (scanResultExpiry != 0), NULL);
         printf("\n");
     }
     if (argc == 1 || (argc > 1 && !strcasecmp(argv[1], "BT")) || (argc > 2 && !strcasecmp(argv[2], "BT")) || (argc == 4  && !strcasecmp(argv[3], "BT"))) {
         #if defined(CONIG_BT_ENABLED)
-            retVal |= gravity_bt_list_devices(gravity_selected_bt, gravity_sel_bt_count, (scanResultExpiry != 0));
+            retVal |= gravity_bt_list_devices(gravity_selected_bt, gravity_sel_bt_count, (scanResultExpiry != 0), NULL);
         #else
             displayBluetoothUnsupported();
         #endif
@@ -2594,6 +2990,8 @@ esp_err_t cmd_clear(int argc, char **argv) {
 esp_err_t cmd_handshake(int argc, char **argv) {
     /* TODO: Set attack_status appropriately */
 
+    /* Update the frames Gravity listens for */
+    gravity_frames_rebuild();
     /* Start hopping task loop if hopping is on by default */
     esp_err_t err = setHopForNewCommand();
     if (err != ESP_OK) {
@@ -2608,96 +3006,102 @@ esp_err_t cmd_handshake(int argc, char **argv) {
 }
 
 /* Does Gravity need to monitor frames as they arrive?
-   This is just a simple IF statement, but it keeps getting longer
-   and more complicated; I figured it could do with having its
-   own function
+   This used to be a long IF statement over attack_status[]; it is now
+   maintained by the frame-consumer registry whenever a feature is
+   started or stopped.
 */
 bool gravitySniffActive() {
-    //
+    return gravity_frames_active();
+}
+
+/* Frame consumer for the packet sniffer - Report the error, but continue */
+static esp_err_t sniffFrameHandler(uint8_t *payload, wifi_pkt_rx_ctrl_t rx_ctrl) {
+    esp_err_t err = sniffPacket(payload);
+    if (err != ESP_OK) {
+        #ifdef CONFIG_FLIPPER
+            printf("Packet sniffer returned %s\n", esp_err_to_name(err));
+        #else
+            ESP_LOGW(SNIFF_TAG, "Packet sniffer returned an error: %s", esp_err_to_name(err));
+        #endif
+    }
+    return err;
+}
 
-    return (attack_status[ATTACK_AP_DOS] || attack_status[ATTACK_AP_CLONE] ||
-        attack_status[ATTACK_SNIFF] || attack_status[ATTACK_MANA] || attack_status[ATTACK_SCAN] ||
-        attack_status[ATTACK_MANA_LOUD] || attack_status[ATTACK_STALK]);
+/* Frame consumer for AP-DOS and AP-Clone */
+static esp_err_t dosFrameHandler(uint8_t *payload, wifi_pkt_rx_ctrl_t rx_ctrl) {
+    esp_err_t err = dosParseFrame(payload);
+    if (err != ESP_OK) {
+        #ifdef CONFIG_FLIPPER
+            printf("DOS returned %s\n", esp_err_to_name(err));
+        #else
+            ESP_LOGW(DOS_TAG, "DOS returned %s", esp_err_to_name(err));
+        #endif
+    }
+    return err;
+}
+
+/* Frame consumer for Mana - Extract the SSID from a probe request */
+static esp_err_t manaFrameHandler(uint8_t *payload, wifi_pkt_rx_ctrl_t rx_ctrl) {
+    int ssid_len = payload[PROBE_SSID_OFFSET - 1];
+    char *ssid = malloc(sizeof(char) * (ssid_len + 1));
+    if (ssid == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory to hold probe request's SSID");
+        return ESP_ERR_NO_MEM;
+    }
+    strncpy(ssid, (char *)&payload[PROBE_SSID_OFFSET], ssid_len);
+    ssid[ssid_len] = '\0';
+
+    #ifdef CONFIG_DEBUG_VERBOSE
+        char srcMac[MAC_STRLEN + 1];
+        mac_bytes_to_string(&payload[PROBE_SRCADDR_OFFSET], srcMac);
+        ESP_LOGI(TAG, "Probe for \"%s\" from %s", ssid, srcMac);
+    #endif
+    esp_err_t err = mana_handleProbeRequest(payload, ssid, ssid_len);
+    free(ssid);
+    return err;
+}
+
+/* Register each module's interest in received frames
+   The order of registration is the order in which handlers are called for
+   a frame, matching the order of the old if-chain in wifi_pkt_rcvd().
+*/
+static esp_err_t register_frame_consumers() {
+    esp_err_t err = ESP_OK;
+    /* Scan parses beacons, probes, RTS/CTS and data frames, and refreshes
+       RSSI and channel from anything else with a transmitter address */
+    err |= gravity_frames_subscribe(ATTACK_SCAN, FRAME_SUBTYPES_ALL, FRAME_CTRL_SUBTYPES_WITH_TA |
+                        FRAME_SUBTYPE_BIT(FRAME_SUBTYPE(0xC4)), FRAME_SUBTYPES_ALL, scan_wifi_parse_frame);
+    err |= gravity_frames_subscribe(ATTACK_STALK, FRAME_SUBTYPES_ALL, FRAME_CTRL_SUBTYPES_WITH_TA,
+                        FRAME_SUBTYPES_ALL, stalk_frame);
+    err |= gravity_frames_subscribe(ATTACK_SNIFF, FRAME_SUBTYPES_ALL, FRAME_SUBTYPES_NONE,
+                        FRAME_SUBTYPES_NONE, sniffFrameHandler);
+    /* AP-Clone sets ATTACK_AP_DOS as well as ATTACK_AP_CLONE */
+    err |= gravity_frames_subscribe(ATTACK_AP_DOS, FRAME_SUBTYPES_ALL, FRAME_CTRL_SUBTYPES_WITH_TA,
+                        FRAME_SUBTYPES_ALL, dosFrameHandler);
+    err |= gravity_frames_subscribe(ATTACK_MANA, FRAME_SUBTYPE_BIT(FRAME_SUBTYPE(WIFI_FRAME_PROBE_REQ)),
+                        FRAME_SUBTYPES_NONE, FRAME_SUBTYPES_NONE, manaFrameHandler);
+    /* Survey counts every frame */
+    err |= gravity_frames_subscribe(ATTACK_SURVEY, FRAME_SUBTYPES_ALL, FRAME_SUBTYPES_ALL,
+                        FRAME_SUBTYPES_ALL, survey_frame);
+    return err;
 }
 
 /* Monitor mode callback
    This is the callback function invoked when the wireless interface receives any selected packet.
-   Currently it only responds to management packets.
-   This function:
-    - Displays packet info when sniffing is enabled
-    - Coordinates Mana probe responses when Mana is enabled
-    - Invokes relevant functions to manage scan results, if scanning is enabled
+   Frames are passed to the handlers that modules have registered with the frame-consumer
+   registry (see frames.c and register_frame_consumers()).
 */
-void wifi_pkt_rcvd(void *buf, wifi_promiscuous_pkt_type_t type) {
+void FRAME_HOT_ATTR wifi_pkt_rcvd(void *buf, wifi_promiscuous_pkt_type_t type) {
     wifi_promiscuous_pkt_t *data = (wifi_promiscuous_pkt_t *)buf;
 
-    if (!gravitySniffActive()) {
-        // No reason to listen to the packets
-        return;
-    }
-
     uint8_t *payload = data->payload;
     if (payload == NULL) {
         // Not necessarily an error, just a different payload
         return;
     }
 
-    /* Just send the whole packet to the scanner */
-    if (attack_status[ATTACK_SCAN]) {
-        scan_wifi_parse_frame(payload, data->rx_ctrl);
-    }
-    if (attack_status[ATTACK_STALK]) {
-        stalk_frame(payload, data->rx_ctrl);
-    }
-    /* Ditto for the sniffer */
-    if (attack_status[ATTACK_SNIFF]) {
-        esp_err_t err;
-        err = sniffPacket(payload);
-        /* Report the error, but continue */
-        if (err != ESP_OK) {
-            #ifdef CONFIG_FLIPPER
-                printf("Packet sniffer returned %s\n", esp_err_to_name(err));
-            #else
-                ESP_LOGW(SNIFF_TAG, "Packet sniffer returned an error: %s", esp_err_to_name(err));
-            #endif
-        }
-    }
-    /* DOS payload */
-    if (attack_status[ATTACK_AP_DOS]) {
-        esp_err_t err = dosParseFrame(payload);
-        if (err != ESP_OK) {
-            #ifdef CONFIG_FLIPPER
-                printf("DOS returned %s\n", esp_err_to_name(err));
-            #else
-                ESP_LOGW(DOS_TAG, "DOS returned %s", esp_err_to_name(err));
-            #endif
-        }
-    }
-    /* AP-CLONE - More like DOS+ than "clone", but ... */
-    if (attack_status[ATTACK_AP_CLONE]) {
-        // dosParseFrame() or cloneParseFrame() ?
-    }
-    if (payload[0] == WIFI_FRAME_PROBE_REQ) {
-        //printf("W00T! Got a probe request!\n");
-        int ssid_len = payload[PROBE_SSID_OFFSET - 1];
-        char *ssid = malloc(sizeof(char) * (ssid_len + 1));
-        if (ssid == NULL) {
-            ESP_LOGE(TAG, "Failed to allocate memory to hold probe request's SSID");
-            return;
-        }
-        strncpy(ssid, (char *)&payload[PROBE_SSID_OFFSET], ssid_len);
-        ssid[ssid_len] = '\0';
-
-        #ifdef CONFIG_DEBUG_VERBOSE
-            char srcMac[MAC_STRLEN + 1];
-            esp_err_t err = mac_bytes_to_string(&payload[PROBE_SRCADDR_OFFSET], srcMac);
-            ESP_LOGI(TAG, "Probe for \"%s\" from %s", ssid, srcMac);
-        #endif
-        if (attack_status[ATTACK_MANA]) {
-            mana_handleProbeRequest(payload, ssid, ssid_len);
-        }
-        free(ssid);
-    }
+    ++hopDwellFrames;
+    gravity_frames_dispatch(payload, data->rx_ctrl);
     return;
 }
 
@@ -2745,13 +3149,25 @@ void initPromiscuous() {
     };
 
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_AP, &ap_config));
+    #if CONFIG_HOP_MAX_CHANNEL > 11
+        /* The default country only permits channels 1-11 */
+        wifi_country_t country = {
+            .cc = "01",
+            .schan = 1,
+            .nchan = CONFIG_HOP_MAX_CHANNEL,
+            .policy = WIFI_COUNTRY_POLICY_MANUAL
+        };
+        ESP_ERROR_CHECK(esp_wifi_set_country(&country));
+    #endif
     ESP_ERROR_CHECK(esp_wifi_start());
     ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_PS_NONE));
 
-    wifi_promiscuous_filter_t filter = { .filter_mask = WIFI_PROMIS_FILTER_MASK_MGMT | WIFI_PROMIS_FILTER_MASK_CTRL | WIFI_PROMIS_FILTER_MASK_DATA };
-    esp_wifi_set_promiscuous_filter(&filter);
+    /* Only ask the driver for frame types that active features have subscribed to */
+    gravity_frames_apply_filter();
     esp_wifi_set_promiscuous_rx_cb(wifi_pkt_rcvd);
-    esp_wifi_set_promiscuous(true);
+    if (esp_wifi_set_promiscuous(true) == ESP_OK) {
+        gravity_coex_record_airtime(GRAVITY_COEX_WIFI, true);
+    }
 }
 
 static void initialize_filesystem(void)
@@ -2844,6 +3260,7 @@ void app_main(void)
             case ATTACK_HANDSHAKE:
             case ATTACK_BT:
             case ATTACK_STALK:
+            case ATTACK_SURVEY:
                 attack_status[i] = false;
                 break;
             case ATTACK_RANDOMISE_MAC:
@@ -2870,6 +3287,7 @@ void app_main(void)
             case ATTACK_AP_DOS:
             case ATTACK_AP_CLONE:
             case ATTACK_STALK:
+            case ATTACK_SURVEY:
                 hop_defaults[i] = true;
                 break;
             case ATTACK_DEAUTH:
@@ -2908,6 +3326,7 @@ void app_main(void)
             case ATTACK_AP_CLONE:                                   /* make sense be */
             case ATTACK_RANDOMISE_MAC:
             case ATTACK_BT:                             /* treated differently somehow? */
+            case ATTACK_SURVEY:
                 hop_millis_defaults[i] = CONFIG_DEFAULT_HOP_MILLIS;
                 break;
             case ATTACK_STALK:
@@ -2922,6 +3341,15 @@ void app_main(void)
         }
     }
 
+    /* Console output lock must exist before the REPL or any task renders */
+    gravity_out_init();
+
+    /* Register frame consumers and build the (empty) dispatch table */
+    if (register_frame_consumers() != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register frame consumers");
+    }
+    gravity_frames_rebuild();
+
     esp_console_repl_t *repl = NULL;
     esp_console_repl_config_t repl_config = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
     /* Prompt to be printed before each line.
@@ -2943,6 +3371,7 @@ void app_main(void)
         #endif
         esp_log_level_set(DEAUTH_TAG, ESP_LOG_ERROR);
         esp_log_level_set(DOS_TAG, ESP_LOG_ERROR);
+        esp_log_level_set(FRAMES_TAG, ESP_LOG_ERROR);
         esp_log_level_set(FUZZ_TAG, ESP_LOG_ERROR);
         esp_log_level_set(TAG, ESP_LOG_ERROR);
         esp_log_level_set(MANA_TAG, ESP_LOG_ERROR);
@@ -73,6 +73,7 @@ extern const char USAGE_CLEAR[];
 extern const char USAGE_HANDSHAKE[];
 extern const char USAGE_COMMANDS[];
 extern const char USAGE_SYNC[];
+extern const char USAGE_SURVEY[];
 
 /* Command specifications */
 esp_err_t cmd_bluetooth(int argc, char **argv);
@@ -101,6 +102,7 @@ esp_err_t cmd_info(int argc, char **argv);
 esp_err_t cmd_version(int argc, char **argv);
 esp_err_t cmd_sync(int argc, char **argv);
 esp_err_t cmd_raw_data(int argc, char **argv);
+esp_err_t cmd_survey(int argc, char **argv);
 
 bool gravitySniffActive();
 void initPromiscuous();
@@ -117,7 +119,7 @@ bool WIFI_INITIALISED = false;
 char scan_filter_ssid[MAX_SSID_LEN + 1] = "\0";
 uint8_t scan_filter_ssid_bssid[6] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
 
-#define CMD_COUNT 26
+#define CMD_COUNT 27
 esp_console_cmd_t commands[CMD_COUNT] = {
     {
         .command = "beacon",
@@ -177,7 +179,7 @@ esp_console_cmd_t commands[CMD_COUNT] = {
     }, {
         .command = "hop",
         .hint = USAGE_HOP,
-        .help = "Enable or disable channel hopping, and set the type and frequency of hops. The KILL option terminates the event loop.",
+        .help = "Enable or disable channel hopping, and set the type and frequency of hops. The KILL option deletes the hop timer. ADAPTIVE spends longer on busier channels while still visiting every channel. STATS displays per-channel activity, actual and scheduled dwell time, channel switching time and how long it took to discover 50% and 90% of devices, for comparing hop modes; STATS RESET starts a new measurement. SCHEDULE sets the channels to hop between, with an optional dwell time for each (e.g. hop SCHEDULE 1 6:2000 11), or displays the current schedule. FOCUS only visits the channels used by selected APs and STAs, with an occasional visit to other channels to follow targets that change channel.",
         .func = cmd_hop
     }, {
         .command = "set",
@@ -192,12 +194,12 @@ esp_console_cmd_t commands[CMD_COUNT] = {
     }, {
         .command = "view",
         .hint = USAGE_VIEW,
-        .help = "VIEW is a fundamental command in this framework, with the typical workflow being Scan-View-Select-Attack. Multiple result sets can be viewed in a single command, along with sort if desired using, for example, VIEW STA AP or VIEW AP selectedSTA SORT RSSI. Available SORT options are AGE, RSSI and SSID.",
+        .help = "VIEW is a fundamental command in this framework, with the typical workflow being Scan-View-Select-Attack. Multiple result sets can be viewed in a single command, along with sort if desired using, for example, VIEW STA AP or VIEW AP selectedSTA SORT RSSI. Available SORT options are AGE, RSSI and SSID. WHERE, LIMIT, OFFSET and COLUMNS filter, page and project the results, for example VIEW STA WHERE rssi>-70 AND associated LIMIT 20 COLUMNS id,rssi,mac,ap.",
         .func = cmd_view
     }, {
         .command = "select",
         .hint = USAGE_SELECT,
-        .help = "Select the specified element from the specified scan results. Usage: select ( AP | STA ) <elementId>.  Selects/deselects item <elementId> from the AP or STA list. Multiple items can be specified separated by spaces or the separator configured in ./fbt menuconfig.",
+        .help = "Select the specified element from the specified scan results. Usage: select ( AP | STA ) <elementId>.  Selects/deselects item <elementId> from the AP or STA list. Multiple items can be specified separated by spaces or the separator configured in ./fbt menuconfig. Alternatively select every matching item with WHERE and the predicates supported by VIEW, and/or the best n items with TOP n BY RSSI or TOP n BY AGE, for example select STA WHERE ap=3 AND rssi>-70 or select AP TOP 10 BY RSSI.",
         .func = cmd_select
     }, {
         .command = "selected",
@@ -249,6 +251,11 @@ esp_console_cmd_t commands[CMD_COUNT] = {
         .hint = USAGE_RAW_DATA,
         .help = "Synchronise Gravity application data and state with a client application",
         .func = cmd_raw_data
+    }, {
+        .command = "survey",
+        .hint = USAGE_SURVEY,
+        .help = "Survey WiFi channels to help choose one for a deployment. While running, Gravity hops channels and records, for each channel, the number of management, control and data frames, the percentage of frames that were retransmissions, the estimated percentage of airtime in use, the minimum and average noise floor, and an estimate of the number of networks (BSSIDs). Run without arguments to display the results, RESET to clear them.",
+        .func = cmd_survey
     }
 };
 
@@ -1,50 +1,475 @@
 #include "hop.h"
+#include "coex.h"
 #include "common.h"
+#include "survey.h"
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 
 const char *HOP_TAG = "hop@GRAVITY";
 long hop_millis = 0;
 HopStatus hopStatus = HOP_STATUS_DEFAULT;
 HopMode hopMode = HOP_MODE_SEQUENTIAL;
-TaskHandle_t channelHopTask = NULL;
+esp_timer_handle_t channelHopTimer = NULL;
 
-/* Channel hopping task  */
+/* esp_wifi_set_channel() can block, so the hop timer only wakes hopTask,
+   which changes channel. The task is created with the timer and kept
+   for the life of the firmware */
+#define HOP_TASK_STACK 3072
+/* Above the attack tasks so they don't delay hops and skew dwell times */
+#define HOP_TASK_PRIORITY 10
+static TaskHandle_t hopTask = NULL;
+/* Guards hopSchedule and the positions in it, which are replaced by the
+   console while hopTask is walking them, and re-arming channelHopTimer
+   against its deletion */
+static portMUX_TYPE hopLock = portMUX_INITIALIZER_UNLOCKED;
+
+/* Whether hopping is required, cached by hop_state_refresh() so the timer
+   callback doesn't evaluate isHopEnabled() on every hop */
+static volatile bool hopActive = false;
+/* When the next hop is due, and the dwell time requested for the current channel */
+static int64_t hopDeadline = 0;
+static long hopCurrentDwell = 0;
+
+/* Time spent in esp_wifi_set_channel(), in microseconds */
+static uint32_t hopSwitchCount = 0;
+static uint64_t hopSwitchTotal = 0;
+static uint32_t hopSwitchMax = 0;
+
+/* Channels visited when hopping. Populated by hop_schedule_default() when
+   the hop timer is created, unless a schedule has been specified */
+HopSchedule hopSchedule = { .count = 0 };
+/* Position in hopSchedule of the current channel */
+static uint8_t hopScheduleIdx = 0;
+/* HOP_MODE_FOCUS state: position in the focus channel list, focus visits
+   since the last sweep visit, and position of the sweep in hopSchedule */
+static uint8_t hopFocusIdx = 0;
+static uint8_t hopFocusVisits = 0;
+static uint8_t hopSweepIdx = 0;
+
+/* Packets received and devices discovered since the last hop. These are
+   incremented from the WiFi task and collected by the hop timer */
+volatile uint32_t hopDwellFrames = 0;
+static volatile uint32_t hopDwellDiscoveries = 0;
+static int64_t hopDwellStart = 0;
+
+/* Per-channel activity, indexed by channel number (index 0 is unused) */
+HopChannelStats hopChannelStats[MAX_CHANNEL + 1];
+
+/* Time at which each device was discovered, in milliseconds since the
+   statistics were reset. Used to report time-to-discover percentiles */
+static uint32_t hopDiscoveryLog[CONFIG_HOP_DISCOVERY_LOG_SIZE];
+static uint32_t hopDiscoveryCount = 0;
+static int64_t hopStatsStart = 0;
+
+/* Make newSchedule the schedule that hopTask follows, starting from its first entry */
+static void hop_schedule_publish(const HopSchedule *newSchedule) {
+    portENTER_CRITICAL(&hopLock);
+    hopSchedule = *newSchedule;
+    hopScheduleIdx = 0;
+    hopSweepIdx = 0;
+    portEXIT_CRITICAL(&hopLock);
+}
+
+/* Reset hopSchedule to visit channels 1 to CONFIG_HOP_MAX_CHANNEL, each for hop_millis */
+esp_err_t hop_schedule_default() {
+    HopSchedule newSchedule = { .count = CONFIG_HOP_MAX_CHANNEL };
+    for (uint8_t i = 0; i < CONFIG_HOP_MAX_CHANNEL; ++i) {
+        newSchedule.entries[i].channel = i + 1;
+        newSchedule.entries[i].dwell = 0;
+    }
+    hop_schedule_publish(&newSchedule);
+    return ESP_OK;
+}
+
+/* Replace hopSchedule with the channels specified in argv, each of the form
+   <channel>[:<millis>]. A channel without a dwell time uses hop_millis.
+   hopSchedule is unchanged if any element is invalid.
+*/
+esp_err_t hop_schedule_parse(int argc, char **argv) {
+    HopSchedule newSchedule = { .count = 0 };
+    char *endPtr;
+
+    if (argc < 1 || argc > HOP_SCHEDULE_MAX) {
+        #ifdef CONFIG_FLIPPER
+            printf("Schedule needs 1-%d channels\n", HOP_SCHEDULE_MAX);
+        #else
+            ESP_LOGE(HOP_TAG, "A hop schedule must contain between 1 and %d channels.", HOP_SCHEDULE_MAX);
+        #endif
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int i = 0; i < argc; ++i) {
+        long channel = strtol(argv[i], &endPtr, 10);
+        long dwell = 0;
+        if (endPtr[0] == ':') {
+            char *dwellStr = endPtr + 1;
+            dwell = strtol(dwellStr, &endPtr, 10);
+            if (endPtr == dwellStr || dwell <= 0 || dwell > UINT16_MAX) {
+                endPtr = dwellStr;      /* Force the error below */
+            }
+        }
+        if (endPtr == argv[i] || endPtr[0] != '\0' || channel < 1 || channel > CONFIG_HOP_MAX_CHANNEL) {
+            #ifdef CONFIG_FLIPPER
+                printf("Invalid channel \"%s\"\n", argv[i]);
+            #else
+                ESP_LOGE(HOP_TAG, "Invalid schedule entry \"%s\". Expected <channel>[:<millis>] with a channel from 1 to %d.",
+                            argv[i], CONFIG_HOP_MAX_CHANNEL);
+            #endif
+            return ESP_ERR_INVALID_ARG;
+        }
+        newSchedule.entries[newSchedule.count].channel = channel;
+        newSchedule.entries[newSchedule.count].dwell = dwell;
+        ++newSchedule.count;
+    }
+    hop_schedule_publish(&newSchedule);
+    return ESP_OK;
+}
+
+/* Format hopSchedule as a list of <channel>/<millis> pairs, e.g. "1/500,6/2000,11/500",
+   substituting hop_millis for entries without their own dwell time.
+   str must have space for HOP_SCHEDULE_STRLEN + 1 characters
+*/
+esp_err_t hop_schedule_to_string(char *str) {
+    str[0] = '\0';
+    if (hopSchedule.count == 0) {
+        hop_schedule_default();
+    }
+    portENTER_CRITICAL(&hopLock);
+    HopSchedule schedule = hopSchedule;
+    portEXIT_CRITICAL(&hopLock);
+    for (uint8_t i = 0; i < schedule.count; ++i) {
+        long dwell = (schedule.entries[i].dwell == 0) ? hop_millis : schedule.entries[i].dwell;
+        sprintf(str + strlen(str), "%s%u/%ld", (i == 0) ? "" : ",", schedule.entries[i].channel, dwell);
+    }
+    return ESP_OK;
+}
+
+/* Dwell time for hopSchedule.entries[idx]. Callers other than hopTask must hold hopLock */
+long hop_schedule_dwell(uint8_t idx) {
+    if (idx >= hopSchedule.count || hopSchedule.entries[idx].dwell == 0) {
+        return hop_millis;
+    }
+    return hopSchedule.entries[idx].dwell;
+}
+
+static bool hop_channel_in_list(uint8_t channel, uint8_t *channels, uint8_t count) {
+    uint8_t i = 0;
+    for (; i < count && channels[i] != channel; ++i) { }
+    return (i < count);
+}
+
+/* Collect the channels of selected APs and STAs into channels, which must have
+   space for MAX_CHANNEL elements. Returns the number of channels found.
+   A STA whose channel is unknown is assumed to be on its AP's channel */
+uint8_t hop_focus_channels(uint8_t *channels) {
+    uint8_t count = 0;
+    for (int i = 0; i < gravity_sel_ap_count && count < MAX_CHANNEL; ++i) {
+        uint8_t channel = gravity_selected_aps[i]->espRecord.primary;
+        if (channel >= 1 && channel <= MAX_CHANNEL && !hop_channel_in_list(channel, channels, count)) {
+            channels[count++] = channel;
+        }
+    }
+    for (int i = 0; i < gravity_sel_sta_count && count < MAX_CHANNEL; ++i) {
+        ScanResultSTA *sta = gravity_selected_stas[i];
+        uint8_t channel = sta->channel;
+        if (channel == 0 && sta->ap != NULL) {
+            channel = sta->ap->espRecord.primary;
+        }
+        if (channel >= 1 && channel <= MAX_CHANNEL && !hop_channel_in_list(channel, channels, count)) {
+            channels[count++] = channel;
+        }
+    }
+    return count;
+}
+
+/* Called when a new AP or STA is added to the scan results */
+void hop_record_discovery() {
+    ++hopDwellDiscoveries;
+    gravity_coex_record_discovery(GRAVITY_COEX_WIFI);
+    if (hopStatsStart == 0) {
+        hopStatsStart = esp_timer_get_time();
+    }
+    if (hopDiscoveryCount < CONFIG_HOP_DISCOVERY_LOG_SIZE) {
+        hopDiscoveryLog[hopDiscoveryCount] = (esp_timer_get_time() - hopStatsStart) / 1000;
+    }
+    ++hopDiscoveryCount;
+}
+
+/* Attribute the packets and discoveries since the last hop, which ended at
+   now, to channel ch and update its activity score */
+static void hop_account_dwell(uint8_t ch, int64_t now) {
+    int64_t elapsedMicros = now - hopDwellStart;
+    uint32_t elapsed = elapsedMicros / 1000;
+    uint32_t frames = hopDwellFrames;
+    uint32_t discoveries = hopDwellDiscoveries;
+    hopDwellFrames = 0;
+    hopDwellDiscoveries = 0;
+
+    if (ch < 1 || ch > MAX_CHANNEL || elapsed == 0) {
+        return;
+    }
+    HopChannelStats *stats = &hopChannelStats[ch];
+    stats->frames += frames;
+    stats->discoveries += discoveries;
+    stats->visits++;
+    stats->dwellMicros += elapsedMicros;
+    survey_dwell(ch, hopDwellStart, now);
+    stats->scheduledMicros += (int64_t)hopCurrentDwell * 1000;
+
+    /* Events per second during this visit, with a new device worth
+       CONFIG_HOP_ADAPTIVE_DISCOVERY_WEIGHT packets */
+    int32_t sample = ((int64_t)frames + (int64_t)discoveries * CONFIG_HOP_ADAPTIVE_DISCOVERY_WEIGHT) * 1000 / elapsed;
+    /* Exponential moving average, alpha = 1/4 */
+    stats->activity += (sample - stats->activity) / 4;
+}
+
+/* Dwell time for the next visit to hopSchedule.entries[idx] in HOP_MODE_ADAPTIVE.
+   Every channel in the schedule is visited once per cycle and receives at least
+   CONFIG_HOP_ADAPTIVE_MIN_DWELL_PERCENT of its scheduled dwell; the remaining
+   time is shared in proportion to activity. A cycle therefore always lasts as
+   long as a sequential cycle, which bounds how long any channel goes unvisited.
+*/
+static long hop_adaptive_dwell(uint8_t idx) {
+    int64_t spare = 0;
+    int64_t total = 0;
+    long retVal = hop_schedule_dwell(idx);
+    long minDwell = retVal * CONFIG_HOP_ADAPTIVE_MIN_DWELL_PERCENT / 100;
+
+    for (uint8_t i = 0; i < hopSchedule.count; ++i) {
+        long scheduled = hop_schedule_dwell(i);
+        spare += scheduled - (scheduled * CONFIG_HOP_ADAPTIVE_MIN_DWELL_PERCENT / 100);
+        total += hopChannelStats[hopSchedule.entries[i].channel].activity;
+    }
+    /* Without any activity fall back to the schedule */
+    if (total > 0 && idx < hopSchedule.count) {
+        retVal = minDwell + (long)(spare * hopChannelStats[hopSchedule.entries[idx].channel].activity / total);
+    }
+    if (retVal < portTICK_PERIOD_MS) {
+        retVal = portTICK_PERIOD_MS;
+    }
+    return retVal;
+}
+
+/* Choose the channel to visit after ch in HOP_MODE_FOCUS.
+   Gravity cycles through the channels of selected APs and STAs, and after every
+   CONFIG_HOP_FOCUS_SWEEP_INTERVAL of these visits it visits the next channel in
+   hopSchedule so that it notices targets changing channel. channels holds the
+   count channels in focus, from hop_focus_channels(). Called with hopLock held.
+*/
+static uint8_t hop_focus_next(uint8_t *channels, uint8_t count, long *dwell) {
+    *dwell = hop_millis;
+    if (hopFocusVisits >= CONFIG_HOP_FOCUS_SWEEP_INTERVAL) {
+        /* Sweep the next scheduled channel that isn't already in focus */
+        for (uint8_t i = 0; i < hopSchedule.count; ++i) {
+            hopSweepIdx = (hopSweepIdx + 1) % hopSchedule.count;
+            if (!hop_channel_in_list(hopSchedule.entries[hopSweepIdx].channel, channels, count)) {
+                hopFocusVisits = 0;
+                *dwell = hop_schedule_dwell(hopSweepIdx);
+                return hopSchedule.entries[hopSweepIdx].channel;
+            }
+        }
+        /* Every scheduled channel is in focus */
+    }
+    ++hopFocusVisits;
+    hopFocusIdx = (hopFocusIdx + 1) % count;
+    return channels[hopFocusIdx];
+}
+
+/* Choose the next channel and its dwell time according to hopMode */
+static uint8_t hop_next_channel(long *dwell) {
+    uint8_t ch;
+    uint8_t focusChannels[MAX_CHANNEL];
+    uint8_t focusCount = 0;
+    if (hopMode >= HOP_MODE_COUNT) {
+        #ifdef CONFIG_FLIPPER
+            printf("%s- reverting to sequential\n", STRINGS_HOPMODE_INVALID);
+        #else
+            ESP_LOGW(HOP_TAG, "%s(%d), reverting to HOP_MODE_SEQUENTIAL", STRINGS_HOPMODE_INVALID, hopMode);
+        #endif
+        hopMode = HOP_MODE_SEQUENTIAL;
+    }
+    /* Gather everything that isn't schedule state before taking hopLock,
+       so the critical section only walks hopSchedule */
+    HopMode mode = hopMode;
+    if (mode == HOP_MODE_FOCUS) {
+        focusCount = hop_focus_channels(focusChannels);
+    }
+    long randomIdx = (mode == HOP_MODE_RANDOM) ? random() : 0;
+
+    portENTER_CRITICAL(&hopLock);
+    /* Focus falls back to sequential hopping when nothing is selected */
+    if (focusCount > 0) {
+        ch = hop_focus_next(focusChannels, focusCount, dwell);
+    } else {
+        /* Changing to a random channel or the next channel? */
+        if (mode == HOP_MODE_RANDOM) {
+            hopScheduleIdx = randomIdx % hopSchedule.count;
+        } else {
+            hopScheduleIdx = (hopScheduleIdx + 1) % hopSchedule.count;
+        }
+        if (mode == HOP_MODE_ADAPTIVE) {
+            *dwell = hop_adaptive_dwell(hopScheduleIdx);
+        } else {
+            *dwell = hop_schedule_dwell(hopScheduleIdx);
+        }
+        ch = hopSchedule.entries[hopScheduleIdx].channel;
+    }
+    portEXIT_CRITICAL(&hopLock);
+    return ch;
+}
+
+/* Channel hopping timer callback, run from the esp_timer task when the
+   current dwell expires. Wakes hopTask to change channel.
+*/
 void channelHopCallback(void *pvParameter) {
+    if (hopActive && hopTask != NULL) {
+        xTaskNotifyGive(hopTask);
+    }
+}
+
+/* Change channel and re-arm the timer for the new channel's dwell time */
+static void hop_switch_channel() {
     uint8_t ch;
     wifi_second_chan_t sec;
-    if (hop_millis == 0) {
-        hop_millis = CONFIG_DEFAULT_HOP_MILLIS;
+    long dwell = hop_millis;
+
+    if (!hopActive) {
+        return;
     }
+    int64_t switchStart = esp_timer_get_time();
+    if (esp_wifi_get_channel(&ch, &sec) == ESP_OK) {
+        hop_account_dwell(ch, switchStart);
+    }
+    ch = hop_next_channel(&dwell);
+    esp_err_t err = esp_wifi_set_channel(ch, WIFI_SECOND_CHAN_NONE);
+    int64_t switchEnd = esp_timer_get_time();
 
+    uint32_t latency = switchEnd - switchStart;
+    ++hopSwitchCount;
+    hopSwitchTotal += latency;
+    if (latency > hopSwitchMax) {
+        hopSwitchMax = latency;
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to change to channel %d", ch);
+    }
+    hopDwellStart = switchEnd;
+    hopCurrentDwell = dwell;
+    hopChannelStats[ch].nextDwell = dwell;
+
+    /* Schedule the next hop relative to when this one was due rather than
+       when it ran, so timer latency and switching time don't accumulate.
+       If we've fallen more than a dwell behind, start afresh */
+    hopDeadline += (int64_t)dwell * 1000;
+    if (hopDeadline <= switchEnd) {
+        hopDeadline = switchEnd + (int64_t)dwell * 1000;
+    }
+    portENTER_CRITICAL(&hopLock);
+    if (hopActive && channelHopTimer != NULL) {
+        esp_timer_start_once(channelHopTimer, hopDeadline - switchEnd);
+    }
+    portEXIT_CRITICAL(&hopLock);
+}
+
+/* Task that changes channel each time channelHopCallback() wakes it */
+static void hopLoop(void *pvParameter) {
     while (true) {
-        // Delay hop_millis ms
-        vTaskDelay(hop_millis / portTICK_PERIOD_MS);
-
-        /* Check whether we should be hopping or not */
-        if (isHopEnabled()) {
-            ESP_ERROR_CHECK(esp_wifi_get_channel(&ch, &sec));
-            /* Changing to a random channel or the next channel? */
-            if (hopMode == HOP_MODE_RANDOM) {
-                ch = (random() % MAX_CHANNEL) + 1;
-            } else if (hopMode != HOP_MODE_SEQUENTIAL) {
-                /* Not random and not sequential */
-                #ifdef CONFIG_FLIPPER
-                    printf("%s- reverting to sequential\n", STRINGS_HOPMODE_INVALID);
-                #else
-                    ESP_LOGW(HOP_TAG, "%s(%d), reverting to HOP_MODE_SEQUENTIAL", STRINGS_HOPMODE_INVALID, hopMode);
-                #endif
-                hopMode = HOP_MODE_SEQUENTIAL;
-            }
-            if (hopMode == HOP_MODE_SEQUENTIAL) {
-                ch++;
-                if (ch >= MAX_CHANNEL) {
-                    ch -= (MAX_CHANNEL - 1);
-                }
-            }
-            if (esp_wifi_set_channel(ch, WIFI_SECOND_CHAN_NONE) != ESP_OK) {
-                ESP_LOGW(TAG, "Failed to change to channel %d", ch);
-            }
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        hop_switch_channel();
+    }
+}
+
+/* Clear channel activity and discovery times. To compare hop modes, clear
+   scan results and reset statistics before running each mode */
+esp_err_t hop_stats_reset() {
+    memset(hopChannelStats, 0, sizeof(hopChannelStats));
+    hopDiscoveryCount = 0;
+    hopDwellFrames = 0;
+    hopDwellDiscoveries = 0;
+    hopSwitchCount = 0;
+    hopSwitchTotal = 0;
+    hopSwitchMax = 0;
+    hopStatsStart = esp_timer_get_time();
+    /* The current visit starts afresh, so credit the survey with it so far */
+    uint8_t ch;
+    wifi_second_chan_t sec;
+    if (esp_wifi_get_channel(&ch, &sec) == ESP_OK) {
+        survey_dwell(ch, hopDwellStart, hopStatsStart);
+    }
+    hopDwellStart = hopStatsStart;
+    return ESP_OK;
+}
+
+/* Milliseconds taken to discover percent% of the devices discovered so far,
+   or UINT32_MAX if that discovery wasn't logged */
+static uint32_t hop_discovery_time(uint32_t percent) {
+    if (hopDiscoveryCount == 0) {
+        return 0;
+    }
+    uint32_t idx = (hopDiscoveryCount * percent + 99) / 100 - 1;
+    if (idx >= CONFIG_HOP_DISCOVERY_LOG_SIZE) {
+        return UINT32_MAX;
+    }
+    return hopDiscoveryLog[idx];
+}
+
+/* Format a discovery time as seconds, e.g. "12.3s" */
+static void hop_discovery_time_to_string(uint32_t millis, char *str) {
+    if (millis == UINT32_MAX) {
+        strcpy(str, "n/a");
+    } else {
+        sprintf(str, "%lu.%lus", millis / 1000, (millis % 1000) / 100);
+    }
+}
+
+/* Display channel activity, dwell accuracy, switching overhead and
+   time-to-discover for the current hop mode */
+esp_err_t hop_stats_report() {
+    char modeStr[19] = "";
+    char t50[16];
+    char t90[16];
+    uint32_t elapsed = (hopStatsStart == 0) ? 0 : (esp_timer_get_time() - hopStatsStart) / 1000;
+    uint64_t totalDwell = 0;
+    uint32_t switchAvg = (hopSwitchCount == 0) ? 0 : hopSwitchTotal / hopSwitchCount;
+    /* Airtime lost to switching, in tenths of a percent */
+    uint32_t switchLoss = (elapsed == 0) ? 0 : hopSwitchTotal / elapsed;
+
+    hopModeToString(hopMode, modeStr);
+    hop_discovery_time_to_string(hop_discovery_time(50), t50);
+    hop_discovery_time_to_string(hop_discovery_time(90), t90);
+    for (int i = 1; i <= MAX_CHANNEL; ++i) {
+        totalDwell += hopChannelStats[i].dwellMicros;
+    }
+
+    #ifdef CONFIG_FLIPPER
+        printf("%s %lus\n%lu new; T50 %s T90 %s\nSwitch %luus max %luus\nCh Dw%% AvgDw F/s New\n", modeStr,
+                elapsed / 1000, hopDiscoveryCount, t50, t90, switchAvg, hopSwitchMax);
+    #else
+        ESP_LOGI(HOP_TAG, "%s for %lu seconds. %lu devices discovered; 50%% within %s, 90%% within %s",
+                modeStr, elapsed / 1000, hopDiscoveryCount, t50, t90);
+        ESP_LOGI(HOP_TAG, "%lu channel switches averaging %luus (maximum %luus); %lu.%lu%% of airtime lost to switching",
+                hopSwitchCount, switchAvg, hopSwitchMax, switchLoss / 10, switchLoss % 10);
+        printf("Channel | Visits | Dwell %% | Avg Dwell | Scheduled | Packets/s | New Devices | Activity\n");
+        printf("========|========|=========|===========|===========|===========|=============|=========\n");
+    #endif
+    for (int i = 1; i <= MAX_CHANNEL; ++i) {
+        HopChannelStats *stats = &hopChannelStats[i];
+        /* Skip channels that have never been visited */
+        if (stats->visits == 0) {
+            continue;
         }
+        uint32_t dwellPct = (totalDwell == 0) ? 0 : stats->dwellMicros * 100 / totalDwell;
+        uint32_t rate = (stats->dwellMicros == 0) ? 0 : (uint64_t)stats->frames * 1000000 / stats->dwellMicros;
+        uint32_t avgDwell = stats->dwellMicros / stats->visits / 1000;
+        uint32_t avgScheduled = stats->scheduledMicros / stats->visits / 1000;
+        #ifdef CONFIG_FLIPPER
+            printf("%2d %3lu %5lu %5lu %3lu\n", i, dwellPct, avgDwell, rate, stats->discoveries);
+        #else
+            printf("%7d | %6lu | %7lu | %7lums | %7lums | %9lu | %11lu | %8ld\n", i, stats->visits, dwellPct,
+                    avgDwell, avgScheduled, rate, stats->discoveries, (long)stats->activity);
+        #endif
     }
+    return ESP_OK;
 }
 
 /* Convert the specified hopMode into a string.
@@ -58,6 +483,12 @@ esp_err_t hopModeToString(HopMode mode, char *str) {
         case HOP_MODE_RANDOM:
             strcpy(tmpStr, "HOP_MODE_RANDOM");
             break;
+        case HOP_MODE_ADAPTIVE:
+            strcpy(tmpStr, "HOP_MODE_ADAPTIVE");
+            break;
+        case HOP_MODE_FOCUS:
+            strcpy(tmpStr, "HOP_MODE_FOCUS");
+            break;
         case HOP_MODE_COUNT:
             strcpy(tmpStr, "HOP_MODE_COUNT");
             break;
@@ -130,10 +561,8 @@ esp_err_t setHopForNewCommand() {
 
     /* Start/stop hopping task loop as needed */
     hop_millis = dwellTime();
-    /* Make sure the hop task is running if it needs to be */
-    if (isHopEnabled()) {
-        createHopTaskIfNeeded();
-    }
+    /* Start or stop the hop timer as needed */
+    retVal = hop_state_refresh();
     #ifdef CONFIG_DEBUG
         char hopModeStr[19];
         hopModeToString(hopMode, hopModeStr);
@@ -146,9 +575,86 @@ esp_err_t setHopForNewCommand() {
     return retVal;
 }
 
-void createHopTaskIfNeeded() {
-    if (channelHopTask == NULL) {
-        ESP_LOGI(HOP_TAG, "Gravity's channel hopping event task is not running, starting it now.");
-        xTaskCreate(&channelHopCallback, "channelHopCallback", 2048, NULL, 5, &channelHopTask);
+esp_err_t createHopTimerIfNeeded() {
+    if (channelHopTimer != NULL) {
+        return ESP_OK;
     }
-}
\ No newline at end of file
+    ESP_LOGI(HOP_TAG, "Gravity's channel hopping timer is not running, starting it now.");
+    if (hop_millis == 0) {
+        hop_millis = CONFIG_DEFAULT_HOP_MILLIS;
+    }
+    if (hopSchedule.count == 0) {
+        hop_schedule_default();
+    }
+    if (hopStatsStart == 0) {
+        hopStatsStart = esp_timer_get_time();
+    }
+    if (hopTask == NULL && xTaskCreate(&hopLoop, "hopLoop", HOP_TASK_STACK, NULL, HOP_TASK_PRIORITY, &hopTask) != pdPASS) {
+        hopTask = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    const esp_timer_create_args_t timerArgs = {
+        .callback = &channelHopCallback,
+        .name = "channelHop"
+    };
+    return esp_timer_create(&timerArgs, &channelHopTimer);
+}
+
+/* Stop and delete the hop timer */
+esp_err_t hop_timer_delete() {
+    /* Detach the timer first so that hopTask can't re-arm it once it's deleted */
+    portENTER_CRITICAL(&hopLock);
+    hopActive = false;
+    esp_timer_handle_t timer = channelHopTimer;
+    channelHopTimer = NULL;
+    portEXIT_CRITICAL(&hopLock);
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_timer_stop(timer);
+    return esp_timer_delete(timer);
+}
+
+/* When the current visit to a channel began. The time since then is
+   credited to the channel when the hopper next leaves it */
+int64_t hop_dwell_start() {
+    return hopDwellStart;
+}
+
+/* Recompute whether hopping is required, and start or stop the hop timer to
+   match. Must be called whenever hopStatus or the active features change */
+esp_err_t hop_state_refresh() {
+    esp_err_t err = ESP_OK;
+    /* Hopping is suspended while the coexistence scheduler has given the radio to Bluetooth */
+    hopActive = isHopEnabled() && gravity_coex_radio_active(GRAVITY_COEX_WIFI);
+    if (hopActive) {
+        err = createHopTimerIfNeeded();
+    }
+    if (err != ESP_OK || channelHopTimer == NULL) {
+        return err;
+    }
+    /* Channel to credit if hopping resumes; fetched outside the critical section */
+    uint8_t ch = 0;
+    wifi_second_chan_t sec;
+    if (hopActive && !esp_timer_is_active(channelHopTimer) && esp_wifi_get_channel(&ch, &sec) != ESP_OK) {
+        ch = 0;
+    }
+    /* hopTask re-arms the timer after each hop; don't race it */
+    portENTER_CRITICAL(&hopLock);
+    if (hopActive && !esp_timer_is_active(channelHopTimer)) {
+        /* Begin dwelling on the current channel. Gravity has been on it,
+           without hopping, since the previous dwell began */
+        int64_t now = esp_timer_get_time();
+        survey_dwell(ch, hopDwellStart, now);
+        hopDwellFrames = 0;
+        hopDwellDiscoveries = 0;
+        hopDwellStart = now;
+        hopCurrentDwell = hop_millis;
+        hopDeadline = now + (int64_t)hop_millis * 1000;
+        err = esp_timer_start_once(channelHopTimer, (int64_t)hop_millis * 1000);
+    } else if (!hopActive && esp_timer_is_active(channelHopTimer)) {
+        err = esp_timer_stop(channelHopTimer);
+    }
+    portEXIT_CRITICAL(&hopLock);
+    return err;
+}
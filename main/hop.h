@@ -7,9 +7,15 @@
 #include <esp_system.h>
 #include <esp_err.h>
 #include <freertos/portmacro.h>
+#include <esp_timer.h>
 #include "common.h"
 
-#define MAX_CHANNEL 11
+/* Highest channel number Gravity can hop to. Which channels may be used
+   depends on region; CONFIG_HOP_MAX_CHANNEL limits the channels in use */
+#define MAX_CHANNEL 14
+#define HOP_SCHEDULE_MAX MAX_CHANNEL
+/* Space needed to format a schedule: "14/65535," for each entry */
+#define HOP_SCHEDULE_STRLEN (HOP_SCHEDULE_MAX * 9)
 
 typedef enum HopStatus {
     HOP_STATUS_OFF,
@@ -20,22 +26,62 @@ typedef enum HopStatus {
 typedef enum HopMode {
     HOP_MODE_SEQUENTIAL = 0,
     HOP_MODE_RANDOM,
+    HOP_MODE_ADAPTIVE,
+    HOP_MODE_FOCUS,
     HOP_MODE_COUNT
 } HopMode;
 
+/* A channel hopping schedule: the channels to visit, in order, and how
+   long to spend on each. A dwell of 0 means use hop_millis */
+typedef struct HopScheduleEntry {
+    uint8_t channel;
+    uint16_t dwell;
+} HopScheduleEntry;
+
+typedef struct HopSchedule {
+    uint8_t count;
+    HopScheduleEntry entries[HOP_SCHEDULE_MAX];
+} HopSchedule;
+
+/* Activity observed on a channel. HOP_MODE_ADAPTIVE shares out dwell time
+   in proportion to each channel's activity score */
+typedef struct HopChannelStats {
+    uint32_t frames;            /* Packets received while on the channel */
+    uint32_t discoveries;       /* New APs and STAs found while on the channel */
+    uint32_t visits;            /* Number of times the channel was visited */
+    uint64_t dwellMicros;       /* Total time actually spent on the channel */
+    uint64_t scheduledMicros;   /* Total dwell time requested for the channel */
+    int32_t activity;           /* Moving average of weighted events per second */
+    long nextDwell;             /* Dwell time allocated to the latest visit */
+} HopChannelStats;
+
 extern const char *HOP_TAG;
 extern long hop_millis;
 extern HopStatus hopStatus;
 extern HopMode hopMode;
-extern TaskHandle_t channelHopTask;
+extern esp_timer_handle_t channelHopTimer;
+extern HopSchedule hopSchedule;
+extern volatile uint32_t hopDwellFrames;
+extern HopChannelStats hopChannelStats[MAX_CHANNEL + 1];
 
 void channelHopCallback(void *pvParameter);
 bool isHopEnabledByDefault();
 bool isHopEnabled();
+int64_t hop_dwell_start();
 long dwellForCurrentFeatures();
 long dwellTime();
 esp_err_t hopModeToString(HopMode mode, char *str);
 esp_err_t setHopForNewCommand();
-void createHopTaskIfNeeded();
+esp_err_t createHopTimerIfNeeded();
+esp_err_t hop_timer_delete();
+esp_err_t hop_state_refresh();
+esp_err_t hop_schedule_default();
+esp_err_t hop_schedule_parse(int argc, char **argv);
+esp_err_t hop_schedule_to_string(char *str);
+long hop_schedule_dwell(uint8_t idx);
+uint8_t hop_focus_channels(uint8_t *channels);
+void hop_record_discovery();
+esp_err_t hop_stats_reset();
+esp_err_t hop_stats_report();
 
 #endif
\ No newline at end of file
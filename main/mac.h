@@ -0,0 +1,58 @@
+#ifndef GRAVITY_MAC_H
+#define GRAVITY_MAC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* A MAC address or Bluetooth device address packed into the low 48 bits
+   of an integer. Bytes are packed most significant first, so comparing two
+   keys gives the same ordering as memcmp() of the original bytes.
+   Records cache the key of their address so that finding a device is a
+   single integer comparison rather than a call to memcmp().
+*/
+typedef uint64_t gravity_mac_t;
+
+#define GRAVITY_MAC_LEN 6
+#define GRAVITY_MAC_NONE ((gravity_mac_t)0)
+#define GRAVITY_MAC_BROADCAST ((gravity_mac_t)0xFFFFFFFFFFFFULL)
+
+/* Pack the 6 bytes at mac into a key. mac need not be aligned */
+static inline gravity_mac_t gravity_mac_load(const uint8_t *mac) {
+    return ((gravity_mac_t)mac[0] << 40) | ((gravity_mac_t)mac[1] << 32) |
+            ((gravity_mac_t)mac[2] << 24) | ((gravity_mac_t)mac[3] << 16) |
+            ((gravity_mac_t)mac[4] << 8) | (gravity_mac_t)mac[5];
+}
+
+/* Unpack key into the 6 bytes at mac */
+static inline void gravity_mac_store(gravity_mac_t key, uint8_t *mac) {
+    for (int i = GRAVITY_MAC_LEN - 1; i >= 0; --i, key >>= 8) {
+        mac[i] = key & 0xFF;
+    }
+}
+
+static inline bool gravity_mac_equal(const uint8_t *one, const uint8_t *two) {
+    return gravity_mac_load(one) == gravity_mac_load(two);
+}
+
+static inline bool gravity_mac_is_broadcast(const uint8_t *mac) {
+    return gravity_mac_load(mac) == GRAVITY_MAC_BROADCAST;
+}
+
+/* Is the Universal/Local bit set? Locally-administered addresses are not
+   assigned by a vendor, and are usually randomised for privacy */
+static inline bool gravity_mac_key_is_local(gravity_mac_t key) {
+    return ((key >> 40) & 0x02) != 0;
+}
+
+/* Hash a key into 32 bits. The low bytes of a MAC (the NIC-specific part)
+   vary the most, so fold the OUI into them before multiplying */
+static inline uint32_t gravity_mac_hash(gravity_mac_t key) {
+    key ^= key >> 24;
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+/* Format key as "0A:1B:2C:3D:4E:5F". strMac must have space for
+   MAC_STRLEN + 1 characters */
+void gravity_mac_format(gravity_mac_t key, char *strMac);
+
+#endif
@@ -1,6 +1,7 @@
 #include "mana.h"
 #include "common.h"
 #include "hop.h"
+#include "mem.h"
 #include "probe.h"
 
 const char *MANA_TAG = "mana@GRAVITY";
@@ -24,11 +25,12 @@ esp_err_t mana_handleBroadcastProbe(uint8_t *payload, uint8_t bCurrentMac[6], ui
     /* Update to Mana Loud - Do NOT send duplicate packets where many STAs know an AP */
     int loudSSIDCount = 0;
     char **loudSSIDs = NULL;
+    gravity_mac_t destKey = gravity_mac_load(bDestMac);
     char strDestMac[MAC_STRLEN + 1];
-    mac_bytes_to_string(bDestMac, strDestMac);
+    gravity_mac_format(destKey, strDestMac);
     int i;
     for (i = 0; i < networkCount; ++i) {
-        if (!strcasecmp(strDestMac, networkList[i].strMac) || attack_status[ATTACK_MANA_LOUD]) {
+        if (networkList[i].macKey == destKey || attack_status[ATTACK_MANA_LOUD]) {
         /* Cycle through networkList[i]'s SSIDs */
             for (int j=0; j < networkList[i].ssidCount; ++j) {
                 if (!arrayContainsString(loudSSIDs, loudSSIDCount, networkList[i].ssids[j])) {
@@ -65,8 +67,9 @@ esp_err_t mana_handleBroadcastProbe(uint8_t *payload, uint8_t bCurrentMac[6], ui
 
 esp_err_t mana_handleDirectedProbe(uint8_t *payload, uint8_t bCurrentMac[6], uint8_t bDestMac[6], uint16_t seqNum, char *ssid, int ssid_len) {
     /* Directed probe request - Send a directed probe response in reply */
+    gravity_mac_t destKey = gravity_mac_load(bDestMac);
     char strDestMac[MAC_STRLEN + 1];
-    mac_bytes_to_string(bDestMac, strDestMac);
+    gravity_mac_format(destKey, strDestMac);
 
     #ifdef CONFIG_FLIPPER
         char shortSsid[MAX_SSID_LEN + 1];
@@ -85,14 +88,18 @@ esp_err_t mana_handleDirectedProbe(uint8_t *payload, uint8_t bCurrentMac[6], uin
 
     /* Mana attack - Add the current SSID to the station's preferred network
         list if it's not already there
+        Preferred network lists are only read when a probe arrives from their
+        station, so they are stored as cold data (see mem.h)
     */
     int i;
     /* Look for STA's MAC in networkList[] */
-    for (i=0; i < networkCount && strcmp(strDestMac, networkList[i].strMac); ++i) { }
+    for (i=0; i < networkCount && networkList[i].macKey != destKey; ++i) { }
     if (i < networkCount) {
         /* The station is in networkList[] - See if it contains the SSID */
         #ifdef CONFIG_DEBUG
-            ESP_LOGI(MANA_TAG, "STA %s matched to PNL for %s at networkList[%d]. PNL count: %d", strDestMac, networkList[i].strMac, i, networkList[i].ssidCount);
+            char strSrcMac[MAC_STRLEN + 1];
+            gravity_mac_format(gravity_mac_load(bCurrentMac), strSrcMac);
+            ESP_LOGI(MANA_TAG, "STA %s matched to PNL at networkList[%d], responding from %s. PNL count: %d", strDestMac, i, strSrcMac, networkList[i].ssidCount);
         #endif
         int j;
         for (j=0; j < networkList[i].ssidCount && strcmp(ssid, networkList[i].ssids[j]); ++j) { }
@@ -101,7 +108,7 @@ esp_err_t mana_handleDirectedProbe(uint8_t *payload, uint8_t bCurrentMac[6], uin
             #ifdef CONFIG_DEBUG
                 ESP_LOGI(MANA_TAG, "SSID \"%s\" not found in PNL, add it", ssid);
             #endif
-            char **newSsids = malloc(sizeof(char *) * (networkList[i].ssidCount + 1));
+            char **newSsids = gravity_mem_alloc(GRAVITY_MEM_COLD, sizeof(char *) * (networkList[i].ssidCount + 1));
             if (newSsids == NULL) {
                 ESP_LOGW(MANA_TAG, "Unable to add SSID \"%s\" to PNL for STA %s", ssid, strDestMac);
             } else {
@@ -110,7 +117,7 @@ esp_err_t mana_handleDirectedProbe(uint8_t *payload, uint8_t bCurrentMac[6], uin
                     newSsids[k] = networkList[i].ssids[k];
                 }
                 /* Append the new SSID */
-                newSsids[j] = malloc(sizeof(char) * (strlen(ssid) + 1));
+                newSsids[j] = gravity_mem_alloc(GRAVITY_MEM_COLD, sizeof(char) * (strlen(ssid) + 1));
                 if (newSsids[j] == NULL) {
                     ESP_LOGW(MANA_TAG, "Failed to allocate bytes to hold SSID \"%s\" for STA %s", ssid, strDestMac);
                     free(newSsids);
@@ -134,19 +141,19 @@ esp_err_t mana_handleDirectedProbe(uint8_t *payload, uint8_t bCurrentMac[6], uin
             for (int j=0; j < networkCount; ++j) {
                 newList[j].ssidCount = networkList[j].ssidCount;
                 newList[j].ssids = networkList[j].ssids;
-                strcpy(newList[j].strMac, networkList[j].strMac);
+                newList[j].macKey = networkList[j].macKey;
                 memcpy(newList[j].bMac, networkList[j].bMac, 6);
             }
             /* Initialise a new NetworkList for this station */
-            strcpy(newList[networkCount].strMac, strDestMac);
+            newList[networkCount].macKey = destKey;
             memcpy(newList[networkCount].bMac, bDestMac, 6);
             newList[networkCount].ssidCount = 1;
-            newList[networkCount].ssids = malloc(sizeof(char *));
+            newList[networkCount].ssids = gravity_mem_alloc(GRAVITY_MEM_COLD, sizeof(char *));
 
             if (newList[networkCount].ssids == NULL) {
                 ESP_LOGW(MANA_TAG, "Failed to allocate memory to hold SSID \"%s\" for STA %s. This SSID/STA pair will experience the Karma, not Mana, attack", ssid, strDestMac);
             } else {
-                newList[networkCount].ssids[0] = malloc(sizeof(char) * (strlen(ssid) + 1));
+                newList[networkCount].ssids[0] = gravity_mem_alloc(GRAVITY_MEM_COLD, sizeof(char) * (strlen(ssid) + 1));
                 if (newList[networkCount].ssids[0] == NULL) {
                     ESP_LOGW(MANA_TAG, "Failed to reserve bytes to hold SSID \"%s\" for STA %s. This SSID/STA tuple will get the Karma attack instead.", ssid, strDestMac);
                 } else {
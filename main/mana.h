@@ -10,7 +10,7 @@
 
 typedef struct NetworkList {
     uint8_t bMac[6];
-    char strMac[MAC_STRLEN + 1];
+    gravity_mac_t macKey;
     char **ssids;
     int ssidCount;
 } NetworkList;
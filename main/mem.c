@@ -0,0 +1,86 @@
+#include "mem.h"
+#include "sdkconfig.h"
+#include <stdlib.h>
+#include <esp_heap_caps.h>
+
+#ifdef CONFIG_INTERNAL_RAM_RESERVE
+    #define MEM_INTERNAL_RESERVE ((size_t)CONFIG_INTERNAL_RAM_RESERVE * 1024)
+#else
+    #define MEM_INTERNAL_RESERVE ((size_t)48 * 1024)
+#endif
+
+#define MEM_CAPS_INTERNAL (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+#define MEM_CAPS_PSRAM (MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT)
+
+/* Allocate bytes with the specified capabilities, aligned to alignment
+   bytes if it isn't 0 */
+static void *mem_caps_alloc(size_t alignment, size_t bytes, uint32_t caps) {
+    if (alignment == 0) {
+        return (caps == MALLOC_CAP_DEFAULT) ? malloc(bytes) : heap_caps_malloc(bytes, caps);
+    }
+    return heap_caps_aligned_alloc(alignment, bytes, caps);
+}
+
+/* Allocate bytes from the specified tier. If the preferred memory is
+   unavailable the other is used, so this only fails if neither has room */
+void *gravity_mem_alloc(gravity_mem_tier_t tier, size_t bytes) {
+    return gravity_mem_alloc_aligned(tier, 0, bytes);
+}
+
+/* As gravity_mem_alloc(), aligning the memory to alignment bytes, which must
+   be 0 or a power of two */
+void *gravity_mem_alloc_aligned(gravity_mem_tier_t tier, size_t alignment, size_t bytes) {
+    #if defined(CONFIG_SPIRAM)
+        void *retVal = NULL;
+        if (tier == GRAVITY_MEM_HOT && gravity_mem_internal_free() >= bytes + alignment + MEM_INTERNAL_RESERVE) {
+            retVal = mem_caps_alloc(alignment, bytes, MEM_CAPS_INTERNAL);
+        }
+        if (retVal == NULL) {
+            retVal = mem_caps_alloc(alignment, bytes, MEM_CAPS_PSRAM);
+        }
+        if (retVal == NULL) {
+            retVal = mem_caps_alloc(alignment, bytes, MALLOC_CAP_DEFAULT);
+        }
+        return retVal;
+    #else
+        (void)tier;
+        return mem_caps_alloc(alignment, bytes, MALLOC_CAP_DEFAULT);
+    #endif
+}
+
+/* Allocators with the signature used by GravitySlab.chunkAlloc */
+void *gravity_mem_hot_alloc(size_t alignment, size_t bytes) {
+    return gravity_mem_alloc_aligned(GRAVITY_MEM_HOT, alignment, bytes);
+}
+
+void *gravity_mem_cold_alloc(size_t alignment, size_t bytes) {
+    return gravity_mem_alloc_aligned(GRAVITY_MEM_COLD, alignment, bytes);
+}
+
+size_t gravity_mem_internal_free() {
+    return heap_caps_get_free_size(MEM_CAPS_INTERNAL);
+}
+
+/* Returns 0 if the board has no PSRAM or PSRAM support isn't enabled */
+size_t gravity_mem_psram_free() {
+    #if defined(CONFIG_SPIRAM)
+        return heap_caps_get_free_size(MEM_CAPS_PSRAM);
+    #else
+        return 0;
+    #endif
+}
+
+/* A memory budget for scan results, in KB, sized from the memory that is
+   currently free: half of the internal SRAM beyond the reserve, and three
+   quarters of any PSRAM. The rest is left for the console, attacks and
+   WiFi scan results. Never returns 0, which would mean no budget */
+uint16_t gravity_mem_auto_budget() {
+    size_t internalFree = gravity_mem_internal_free();
+    size_t bytes = (internalFree > MEM_INTERNAL_RESERVE) ? (internalFree - MEM_INTERNAL_RESERVE) / 2 : 0;
+    bytes += gravity_mem_psram_free() / 4 * 3;
+    size_t kb = bytes / 1024;
+    if (kb > UINT16_MAX) {
+        kb = UINT16_MAX;
+    }
+    return (kb == 0) ? 1 : kb;
+}
@@ -0,0 +1,30 @@
+#ifndef GRAVITY_MEM_H
+#define GRAVITY_MEM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Storage tiers for scan results
+   Hot data is used for every received frame: device records and the arrays
+   and indexes used to find them. It is placed in internal SRAM while that
+   leaves CONFIG_INTERNAL_RAM_RESERVE KB free for the WiFi and Bluetooth
+   stacks, and in PSRAM after that.
+   Cold data is only needed when results are displayed: names, EIR and
+   advertising data, service lists and SSID lists. It is placed in PSRAM.
+   On boards without PSRAM both tiers come from internal SRAM. Memory from
+   either tier is released with free()
+*/
+typedef enum {
+    GRAVITY_MEM_HOT = 0,
+    GRAVITY_MEM_COLD
+} gravity_mem_tier_t;
+
+void *gravity_mem_alloc(gravity_mem_tier_t tier, size_t bytes);
+void *gravity_mem_alloc_aligned(gravity_mem_tier_t tier, size_t alignment, size_t bytes);
+void *gravity_mem_hot_alloc(size_t alignment, size_t bytes);
+void *gravity_mem_cold_alloc(size_t alignment, size_t bytes);
+size_t gravity_mem_internal_free();
+size_t gravity_mem_psram_free();
+uint16_t gravity_mem_auto_budget();
+
+#endif
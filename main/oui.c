@@ -0,0 +1,86 @@
+#include "oui.h"
+#include "sdkconfig.h"
+
+#ifdef CONFIG_OUI_LOOKUP
+    /* Generated from oui.csv at build time by tools/gen_oui.py */
+    #include "oui_table.h"
+#endif
+
+static const char OUI_UNKNOWN[] = "";
+static const char OUI_RANDOM[] = "(Random)";
+
+/* Find the vendor that was assigned the OUI of the specified address
+   OUIs are sorted and stored in blocks, where the first OUI in each block
+   is stored in full and subsequent OUIs are encoded as deltas. Lookup is a
+   binary search over the first OUI of each block followed by a short scan
+   through the block.
+   Returns NULL if the vendor isn't known
+*/
+const char *gravity_oui_vendor(gravity_mac_t key) {
+    #if defined(CONFIG_OUI_LOOKUP) && OUI_ENTRY_COUNT > 0
+        uint32_t oui = (uint32_t)(key >> 24);
+        if (oui < oui_block_first[0]) {
+            return NULL;
+        }
+
+        /* Find the last block whose first OUI is <= oui */
+        int low = 0;
+        int high = OUI_BLOCK_COUNT - 1;
+        while (low < high) {
+            int mid = (low + high + 1) / 2;
+            if (oui_block_first[mid] <= oui) {
+                low = mid;
+            } else {
+                high = mid - 1;
+            }
+        }
+
+        int entry = low * OUI_BLOCK_SIZE;
+        int blockEnd = entry + OUI_BLOCK_SIZE;
+        if (blockEnd > OUI_ENTRY_COUNT) {
+            blockEnd = OUI_ENTRY_COUNT;
+        }
+        uint32_t thisOui = oui_block_first[low];
+        const uint8_t *delta = &oui_deltas[oui_block_offset[low]];
+        while (thisOui < oui && entry + 1 < blockEnd) {
+            /* Decode the next LEB128 delta */
+            uint32_t diff = 0;
+            uint8_t shift = 0;
+            do {
+                diff |= (uint32_t)(*delta & 0x7F) << shift;
+                shift += 7;
+            } while (*delta++ & 0x80);
+            thisOui += diff;
+            ++entry;
+        }
+        if (thisOui == oui) {
+            return &oui_vendor_names[oui_vendor_name_offset[oui_vendor[entry]]];
+        }
+    #else
+        (void)key;
+    #endif
+    return NULL;
+}
+
+/* Vendor text to display for the specified WiFi MAC
+   Locally-administered addresses have no OUI - they are almost always
+   randomised - and are flagged as such.
+   Never returns NULL.
+*/
+const char *gravity_oui_vendor_display(gravity_mac_t key) {
+    return gravity_oui_vendor_display_bda(key, gravity_mac_key_is_local(key));
+}
+
+/* Vendor text to display for the specified Bluetooth device address
+   The U/L bit means nothing in a BLE random address - its top two bits
+   give the random address subtype instead - so the caller states whether
+   the address is random, using the address type reported by the controller.
+   Never returns NULL.
+*/
+const char *gravity_oui_vendor_display_bda(gravity_mac_t key, bool randomAddr) {
+    if (randomAddr) {
+        return OUI_RANDOM;
+    }
+    const char *vendor = gravity_oui_vendor(key);
+    return (vendor == NULL) ? OUI_UNKNOWN : vendor;
+}
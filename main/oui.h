@@ -0,0 +1,16 @@
+#ifndef GRAVITY_OUI_H
+#define GRAVITY_OUI_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "mac.h"
+
+/* Width of the vendor column when listing devices */
+#define OUI_VENDOR_STRLEN 20
+
+const char *gravity_oui_vendor(gravity_mac_t key);
+const char *gravity_oui_vendor_display(gravity_mac_t key);
+const char *gravity_oui_vendor_display_bda(gravity_mac_t key, bool randomAddr);
+
+#endif
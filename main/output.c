@@ -0,0 +1,206 @@
+#include "output.h"
+#include "sdkconfig.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#ifdef CONFIG_CONSOLE_OUTPUT_BUFFER
+    #define OUT_BUFFER_LEN CONFIG_CONSOLE_OUTPUT_BUFFER
+#else
+    #define OUT_BUFFER_LEN 4096
+#endif
+
+/* Longest formatted int32_t: sign and 10 digits */
+#define OUT_INT_STRLEN 11
+
+static char outBuffer[OUT_BUFFER_LEN];
+static size_t outLen = 0;
+/* Number of gravity_out_begin() calls without a matching gravity_out_end() */
+static uint8_t outDepth = 0;
+/* Recursive, so that nested renderers can take it again */
+static StaticSemaphore_t outLockBuffer;
+static SemaphoreHandle_t outLock = NULL;
+
+static const char OUT_HEX_DIGITS[] = "0123456789abcdef";
+
+/* Create the output lock. Call before any task can render */
+void gravity_out_init() {
+    if (outLock == NULL) {
+        outLock = xSemaphoreCreateRecursiveMutexStatic(&outLockBuffer);
+    }
+}
+
+void gravity_out_begin() {
+    if (outLock != NULL) {
+        xSemaphoreTakeRecursive(outLock, portMAX_DELAY);
+    }
+    ++outDepth;
+}
+
+void gravity_out_end() {
+    if (outDepth > 0 && --outDepth == 0) {
+        gravity_out_flush();
+    }
+    if (outLock != NULL) {
+        xSemaphoreGiveRecursive(outLock);
+    }
+}
+
+/* Write the buffer to the console. stdout is flushed first so that anything
+   printed before the buffered output is displayed before it */
+void gravity_out_flush() {
+    fflush(stdout);
+    size_t written = 0;
+    while (written < outLen) {
+        ssize_t result = write(fileno(stdout), &outBuffer[written], outLen - written);
+        if (result <= 0) {
+            break;
+        }
+        written += result;
+    }
+    outLen = 0;
+}
+
+void gravity_out_write(const char *data, size_t len) {
+    while (len > 0) {
+        if (outLen == OUT_BUFFER_LEN) {
+            gravity_out_flush();
+        }
+        size_t chunk = OUT_BUFFER_LEN - outLen;
+        if (chunk > len) {
+            chunk = len;
+        }
+        memcpy(&outBuffer[outLen], data, chunk);
+        outLen += chunk;
+        data += chunk;
+        len -= chunk;
+    }
+}
+
+void gravity_out_str(const char *str) {
+    gravity_out_write(str, strlen(str));
+}
+
+void gravity_out_char(char c) {
+    if (outLen == OUT_BUFFER_LEN) {
+        gravity_out_flush();
+    }
+    outBuffer[outLen++] = c;
+}
+
+void gravity_out_repeat(char c, uint16_t count) {
+    while (count > 0) {
+        if (outLen == OUT_BUFFER_LEN) {
+            gravity_out_flush();
+        }
+        size_t chunk = OUT_BUFFER_LEN - outLen;
+        if (chunk > count) {
+            chunk = count;
+        }
+        memset(&outBuffer[outLen], c, chunk);
+        outLen += chunk;
+        count -= chunk;
+    }
+}
+
+/* Left-aligned str, padded with spaces to at least width characters (%-*s) */
+void gravity_out_padded(const char *str, uint16_t width) {
+    size_t len = strlen(str);
+    gravity_out_write(str, len);
+    if (len < width) {
+        gravity_out_repeat(' ', width - len);
+    }
+}
+
+/* Right-aligned value, padded with spaces to at least width characters (%*d) */
+void gravity_out_int(int32_t value, uint8_t width) {
+    char str[OUT_INT_STRLEN + 1];
+    uint8_t len = gravity_format_int(str, value, 0);
+    if (len < width) {
+        gravity_out_repeat(' ', width - len);
+    }
+    gravity_out_write(str, len);
+}
+
+/* Right-aligned value, padded with spaces to at least width characters (%*u) */
+void gravity_out_uint(uint32_t value, uint8_t width) {
+    char str[OUT_INT_STRLEN + 1];
+    uint8_t len = gravity_format_uint(str, value);
+    if (len < width) {
+        gravity_out_repeat(' ', width - len);
+    }
+    gravity_out_write(str, len);
+}
+
+/* Lower-case hex value, zero-padded to at least digits digits (%0*x) */
+void gravity_out_hex(uint32_t value, uint8_t digits) {
+    char str[8];
+    uint8_t len = 0;
+    do {
+        str[7 - len++] = OUT_HEX_DIGITS[value & 0x0F];
+        value >>= 4;
+    } while (value != 0);
+    if (len < digits) {
+        gravity_out_repeat('0', digits - len);
+    }
+    gravity_out_write(&str[8 - len], len);
+}
+
+void gravity_out_printf(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(&outBuffer[outLen], OUT_BUFFER_LEN - outLen, format, args);
+    va_end(args);
+    if (len < 0 || len < (int)(OUT_BUFFER_LEN - outLen)) {
+        outLen += (len < 0) ? 0 : len;
+        return;
+    }
+    /* It didn't fit. Make room and format it again */
+    gravity_out_flush();
+    va_start(args, format);
+    if (len < OUT_BUFFER_LEN) {
+        outLen = vsnprintf(outBuffer, OUT_BUFFER_LEN, format, args);
+    } else {
+        /* Longer than the whole buffer */
+        vprintf(format, args);
+        fflush(stdout);
+    }
+    va_end(args);
+}
+
+/* Format value in decimal, without vsnprintf. str must have space for 11
+   characters. Returns the length of the string */
+uint8_t gravity_format_uint(char *str, uint32_t value) {
+    char digits[OUT_INT_STRLEN];
+    uint8_t len = 0;
+    do {
+        digits[len++] = '0' + (value % 10);
+        value /= 10;
+    } while (value != 0);
+    for (uint8_t i = 0; i < len; ++i) {
+        str[i] = digits[len - 1 - i];
+    }
+    str[len] = '\0';
+    return len;
+}
+
+/* Format value in decimal right-aligned to at least width characters, like
+   sprintf's %*d. str must have space for the larger of width and 11, plus
+   the terminator. Returns the length of the string */
+uint8_t gravity_format_int(char *str, int32_t value, uint8_t width) {
+    char digits[OUT_INT_STRLEN + 1];
+    uint8_t len = 0;
+    if (value < 0) {
+        digits[0] = '-';
+        len = 1 + gravity_format_uint(&digits[1], (uint32_t)0 - (uint32_t)value);
+    } else {
+        len = gravity_format_uint(digits, value);
+    }
+    uint8_t pad = (len < width) ? width - len : 0;
+    memset(str, ' ', pad);
+    memcpy(&str[pad], digits, len + 1);
+    return pad + len;
+}
@@ -0,0 +1,41 @@
+#ifndef GRAVITY_OUTPUT_H
+#define GRAVITY_OUTPUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Buffered console output
+   Renderers that print a line for every scan result (VIEW, SELECTED, sync and
+   stalk) write into a static buffer of CONFIG_CONSOLE_OUTPUT_BUFFER bytes
+   rather than calling printf for every row. The buffer is handed to the
+   console driver in a single write() whenever it fills and when rendering
+   ends, so a long table costs a handful of driver calls. Integers, hex and
+   padded strings are formatted straight into the buffer without vfprintf.
+
+   Wrap rendering in gravity_out_begin() and gravity_out_end(). These nest, so
+   a renderer may call another renderer, and the buffer is only written out
+   by the outermost gravity_out_end(). While one task is rendering, other
+   tasks calling gravity_out_begin() wait for it to finish. printf and
+   ESP_LOGx output from inside a begin/end pair would appear before the
+   buffered output, so call gravity_out_flush() first if they're needed
+*/
+
+void gravity_out_init();
+void gravity_out_begin();
+void gravity_out_end();
+void gravity_out_flush();
+
+void gravity_out_write(const char *data, size_t len);
+void gravity_out_str(const char *str);
+void gravity_out_char(char c);
+void gravity_out_repeat(char c, uint16_t count);
+void gravity_out_padded(const char *str, uint16_t width);
+void gravity_out_int(int32_t value, uint8_t width);
+void gravity_out_uint(uint32_t value, uint8_t width);
+void gravity_out_hex(uint32_t value, uint8_t digits);
+void gravity_out_printf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+uint8_t gravity_format_uint(char *str, uint32_t value);
+uint8_t gravity_format_int(char *str, int32_t value, uint8_t width);
+
+#endif
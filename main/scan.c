@@ -1,5 +1,9 @@
 #include "scan.h"
 #include "common.h"
+#include "filter.h"
+#include "output.h"
+#include "mem.h"
+#include "oui.h"
 #include "esp_err.h"
 #include "esp_wifi_types.h"
 #include <time.h>
@@ -221,11 +225,11 @@ void print_stas() {
     char strSsid[MAX_SSID_LEN + 1];
     memset(strSsid, '\0', MAX_SSID_LEN + 1);
     for (int i=0; i < gravity_sta_count; ++i) {
-        mac_bytes_to_string(gravity_stas[i].mac, strMac);
+        gravity_mac_format(gravity_stas[i].macKey, strMac);
         printf("STA %s", strMac);
         if (gravity_stas[i].ap != NULL) {
             char mac2[MAC_STRLEN + 1];
-            mac_bytes_to_string(gravity_stas[i].apMac, mac2);
+            gravity_mac_format(gravity_stas[i].apKey, mac2);
             strcpy(strSsid, (char *)gravity_stas[i].ap->espRecord.ssid);
             printf(", AP %s (%s)", mac2, strSsid);
         }
@@ -238,7 +242,7 @@ void print_aps() {
     char strSsid[MAX_SSID_LEN + 1];
     memset(strSsid, '\0', MAX_SSID_LEN + 1);
     for (int i=0; i < gravity_ap_count; ++i) {
-        mac_bytes_to_string(gravity_aps[i].espRecord.bssid, strMac);
+        gravity_mac_format(gravity_aps[i].bssidKey, strMac);
         strcpy(strSsid, (char *)gravity_aps[i].espRecord.ssid);
         /* YAGNI: Review whether this needs to be shortened for Flipper */
         printf("AP %s (%s)\t%d stations\n", strMac, strSsid, gravity_aps[i].stationCount);
@@ -303,13 +307,13 @@ esp_err_t update_links() {
         if (gravity_stas[idxSTA].ap != NULL) {
             /* Find the new address for gravity_stas[idxSTA].apMac */
             for (idxAPSearch = 0; idxAPSearch < gravity_ap_count &&
-                    memcmp(gravity_stas[idxSTA].apMac, gravity_aps[idxAPSearch].espRecord.bssid, 6);
+                    gravity_stas[idxSTA].apKey != gravity_aps[idxAPSearch].bssidKey;
                     ++idxAPSearch) { }
             if (idxAPSearch == gravity_ap_count) {
                 char strSTA[MAC_STRLEN + 1];
                 char strAP[MAC_STRLEN + 1];
-                ESP_ERROR_CHECK(mac_bytes_to_string(gravity_stas[idxSTA].apMac, strAP));
-                ESP_ERROR_CHECK(mac_bytes_to_string(gravity_stas[idxSTA].mac, strSTA));
+                gravity_mac_format(gravity_stas[idxSTA].apKey, strAP);
+                gravity_mac_format(gravity_stas[idxSTA].macKey, strSTA);
                 ESP_LOGW(SCAN_TAG, "Unable to find AP %s that STA %s claims to be associated with. Continuing",
                                     strAP, strSTA);
             } else {
@@ -358,7 +362,7 @@ esp_err_t purge_sta_rssi(int32_t maxRssi) {
     }
     /* Allocate memory for new array */
     if (newCount > 0) {
-        newSta = malloc(sizeof(ScanResultSTA) * newCount);
+        newSta = gravity_mem_alloc(GRAVITY_MEM_HOT, sizeof(ScanResultSTA) * newCount);
         if (newSta == NULL) {
             #ifdef CONFIG_FLIPPER
                 printf("%s\n", STRINGS_MALLOC_FAIL);
@@ -407,7 +411,7 @@ esp_err_t purge_ap_rssi(int32_t maxRssi) {
         return ESP_ERR_NOT_FOUND;
     }
     if (newCount > 0) {
-        newAps = malloc(sizeof(ScanResultAP) * newCount);
+        newAps = gravity_mem_alloc(GRAVITY_MEM_HOT, sizeof(ScanResultAP) * newCount);
         if (newAps == NULL) {
             #ifdef CONFIG_FLIPPER
                 printf("%s\n", STRINGS_MALLOC_FAIL);
@@ -457,7 +461,7 @@ esp_err_t purge_sta_age(uint16_t minAge) {
         return ESP_ERR_NOT_FOUND;
     }
     if (newCount > 0) {
-        newSta = malloc(sizeof(ScanResultSTA) * newCount);
+        newSta = gravity_mem_alloc(GRAVITY_MEM_HOT, sizeof(ScanResultSTA) * newCount);
         if (newSta == NULL) {
             #ifdef CONFIG_FLIPPER
                 printf("%s\n", STRINGS_MALLOC_FAIL);
@@ -509,7 +513,7 @@ esp_err_t purge_ap_age(uint16_t minAge) {
         return ESP_ERR_NOT_FOUND;
     }
     if (newCount > 0) {
-        newAp = malloc(sizeof(ScanResultAP) * newCount);
+        newAp = gravity_mem_alloc(GRAVITY_MEM_HOT, sizeof(ScanResultAP) * newCount);
         if (newAp == NULL) {
             #ifdef CONFIG_FLIPPER
                 printf("%s\n", STRINGS_MALLOC_FAIL);
@@ -560,7 +564,7 @@ esp_err_t purge_sta_unassoc() {
     }
     /* Allocate new STA array */
     if (assocCount > 0) {
-        newSta = malloc(sizeof(ScanResultSTA) * assocCount);
+        newSta = gravity_mem_alloc(GRAVITY_MEM_HOT, sizeof(ScanResultSTA) * assocCount);
         if (newSta == NULL) {
             #ifdef CONFIG_FLIPPER
                 printf("%s\n", STRINGS_MALLOC_FAIL);
@@ -608,7 +612,7 @@ esp_err_t purge_ap_unnamed() {
     }
     /* Reserve memory for new array if needed */
     if (namedCount > 0) {
-        newAps = malloc(sizeof(ScanResultAP) * namedCount);
+        newAps = gravity_mem_alloc(GRAVITY_MEM_HOT, sizeof(ScanResultAP) * namedCount);
         if (newAps == NULL) {
             #ifdef CONFIG_FLIPPER
                 printf("%s\n", STRINGS_MALLOC_FAIL);
@@ -652,7 +656,7 @@ esp_err_t purge_sta_unselected() {
     esp_err_t err = ESP_OK;
     ScanResultSTA *newStas = NULL;
     if (gravity_sel_sta_count > 0) {
-        newStas = malloc(sizeof(ScanResultSTA) * gravity_sel_sta_count);
+        newStas = gravity_mem_alloc(GRAVITY_MEM_HOT, sizeof(ScanResultSTA) * gravity_sel_sta_count);
         if (newStas == NULL) {
             #ifdef CONFIG_FLIPPER
                 printf("%s\n", STRINGS_MALLOC_FAIL);
@@ -705,7 +709,7 @@ esp_err_t purge_ap_unselected() {
     esp_err_t err = ESP_OK;
     ScanResultAP *newAps = NULL;
     if (gravity_sel_ap_count > 0) {
-        newAps = malloc(sizeof(ScanResultAP) * gravity_sel_ap_count);
+        newAps = gravity_mem_alloc(GRAVITY_MEM_HOT, sizeof(ScanResultAP) * gravity_sel_ap_count);
         if (newAps == NULL) {
             #ifdef CONFIG_FLIPPER
                 printf("%s\n", STRINGS_MALLOC_FAIL);
@@ -927,7 +931,163 @@ esp_err_t gravity_select_sta(int selIndex) {
     return ESP_OK;
 }
 
-esp_err_t gravity_list_all_aps(bool hideExpiredPackets) {
+/* Has a result last seen elapsed seconds ago expired? */
+static bool scan_result_expired(bool hideExpiredPackets, unsigned long elapsed) {
+    return hideExpiredPackets && scanResultExpiry != 0 && (elapsed / 60.0) >= scanResultExpiry;
+}
+
+/* Record the row at position as a match for a predicate selection. With top
+   of 0 every match is kept in table order, otherwise only the top
+   highest-keyed matches are kept, highest first */
+static void select_collect(uint32_t *positions, int32_t *keys, uint32_t *found, uint32_t top, uint32_t position, int32_t key) {
+    if (top == 0) {
+        positions[(*found)++] = position;
+    } else {
+        gravity_filter_rank(positions, keys, found, top, position, key);
+    }
+}
+
+/* Key used to rank results for TOP n BY rankBy - stronger RSSI and more
+   recently seen rank higher */
+static int32_t select_rank_key(GRAVITY_SORT_TYPE rankBy, int8_t rssi, unsigned long elapsed) {
+    return (rankBy == GRAVITY_SORT_AGE) ? -(int32_t)elapsed : rssi;
+}
+
+/* Select every AP that satisfies filter, or if top is non-zero the top best
+   of them ranked by rankBy (GRAVITY_SORT_RSSI or GRAVITY_SORT_AGE). Unlike
+   gravity_select_ap() this never deselects - matching APs that are already
+   selected stay selected. The table is evaluated in a single pass and
+   gravity_selected_aps is reallocated once for the whole batch.
+   If newCount is not NULL it receives the number of APs newly selected */
+esp_err_t gravity_select_aps_where(const GravityFilter *filter, uint32_t top, GRAVITY_SORT_TYPE rankBy, uint32_t *newCount) {
+    if (newCount != NULL) {
+        *newCount = 0;
+    }
+    if (gravity_ap_count == 0) {
+        return ESP_OK;
+    }
+    uint32_t capacity = (top == 0 || top > (uint32_t)gravity_ap_count) ? (uint32_t)gravity_ap_count : top;
+    uint32_t *positions = malloc(sizeof(uint32_t) * capacity);
+    int32_t *keys = malloc(sizeof(int32_t) * capacity);
+    if (positions == NULL || keys == NULL) {
+        ESP_LOGE(SCAN_TAG, "Failed to allocate memory to select %lu APs", capacity);
+        free(positions);
+        free(keys);
+        return ESP_ERR_NO_MEM;
+    }
+
+    /* Single pass over the APs, counting those not yet selected */
+    uint32_t found = 0;
+    for (int i = 0; i < gravity_ap_count; ++i) {
+        unsigned long elapsed = (clock() - gravity_aps[i].lastSeen) / CLOCKS_PER_SEC;
+        if (!scan_result_expired(true, elapsed) && gravity_ap_matches(filter, &gravity_aps[i], elapsed)) {
+            select_collect(positions, keys, &found, (top == 0) ? 0 : capacity, i,
+                            select_rank_key(rankBy, gravity_aps[i].espRecord.rssi, elapsed));
+        }
+    }
+    uint32_t adding = 0;
+    for (uint32_t i = 0; i < found; ++i) {
+        if (!gravity_aps[positions[i]].selected) {
+            ++adding;
+        }
+    }
+
+    /* Grow gravity_selected_aps once and append the new selections */
+    esp_err_t err = ESP_OK;
+    if (adding > 0) {
+        ScanResultAP **newSel = malloc(sizeof(ScanResultAP *) * (gravity_sel_ap_count + adding));
+        if (newSel == NULL) {
+            ESP_LOGE(SCAN_TAG, "Failed to allocate memory for new selected APs array[%lu]", gravity_sel_ap_count + adding);
+            err = ESP_ERR_NO_MEM;
+        } else {
+            if (gravity_selected_aps != NULL) {
+                memcpy(newSel, gravity_selected_aps, sizeof(ScanResultAP *) * gravity_sel_ap_count);
+                free(gravity_selected_aps);
+            }
+            for (uint32_t i = 0; i < found; ++i) {
+                ScanResultAP *ap = &gravity_aps[positions[i]];
+                if (!ap->selected) {
+                    ap->selected = true;
+                    newSel[gravity_sel_ap_count++] = ap;
+                }
+            }
+            gravity_selected_aps = newSel;
+            if (newCount != NULL) {
+                *newCount = adding;
+            }
+        }
+    }
+    free(positions);
+    free(keys);
+    return err;
+}
+
+/* Select every STA that satisfies filter, or the top best of them ranked by
+   rankBy. See gravity_select_aps_where() */
+esp_err_t gravity_select_stas_where(const GravityFilter *filter, uint32_t top, GRAVITY_SORT_TYPE rankBy, uint32_t *newCount) {
+    if (newCount != NULL) {
+        *newCount = 0;
+    }
+    if (gravity_sta_count == 0) {
+        return ESP_OK;
+    }
+    uint32_t capacity = (top == 0 || top > (uint32_t)gravity_sta_count) ? (uint32_t)gravity_sta_count : top;
+    uint32_t *positions = malloc(sizeof(uint32_t) * capacity);
+    int32_t *keys = malloc(sizeof(int32_t) * capacity);
+    if (positions == NULL || keys == NULL) {
+        ESP_LOGE(SCAN_TAG, "Failed to allocate memory to select %lu STAs", capacity);
+        free(positions);
+        free(keys);
+        return ESP_ERR_NO_MEM;
+    }
+
+    /* Single pass over the STAs, counting those not yet selected */
+    uint32_t found = 0;
+    for (int i = 0; i < gravity_sta_count; ++i) {
+        unsigned long elapsed = (clock() - gravity_stas[i].lastSeen) / CLOCKS_PER_SEC;
+        if (!scan_result_expired(true, elapsed) && gravity_sta_matches(filter, &gravity_stas[i], elapsed)) {
+            select_collect(positions, keys, &found, (top == 0) ? 0 : capacity, i,
+                            select_rank_key(rankBy, gravity_stas[i].rssi, elapsed));
+        }
+    }
+    uint32_t adding = 0;
+    for (uint32_t i = 0; i < found; ++i) {
+        if (!gravity_stas[positions[i]].selected) {
+            ++adding;
+        }
+    }
+
+    /* Grow gravity_selected_stas once and append the new selections */
+    esp_err_t err = ESP_OK;
+    if (adding > 0) {
+        ScanResultSTA **newSel = malloc(sizeof(ScanResultSTA *) * (gravity_sel_sta_count + adding));
+        if (newSel == NULL) {
+            ESP_LOGE(SCAN_TAG, "Failed to allocate memory for new selected STAs array[%lu]", gravity_sel_sta_count + adding);
+            err = ESP_ERR_NO_MEM;
+        } else {
+            if (gravity_selected_stas != NULL) {
+                memcpy(newSel, gravity_selected_stas, sizeof(ScanResultSTA *) * gravity_sel_sta_count);
+                free(gravity_selected_stas);
+            }
+            for (uint32_t i = 0; i < found; ++i) {
+                ScanResultSTA *sta = &gravity_stas[positions[i]];
+                if (!sta->selected) {
+                    sta->selected = true;
+                    newSel[gravity_sel_sta_count++] = sta;
+                }
+            }
+            gravity_selected_stas = newSel;
+            if (newCount != NULL) {
+                *newCount = adding;
+            }
+        }
+    }
+    free(positions);
+    free(keys);
+    return err;
+}
+
+esp_err_t gravity_list_all_aps(bool hideExpiredPackets, const GravityFilter *filter) {
     if (gravity_ap_count == 0) {
         #ifdef CONFIG_FLIPPER
             printf("No APs in scan results\n");
@@ -951,12 +1111,12 @@ esp_err_t gravity_list_all_aps(bool hideExpiredPackets) {
     }
     // Sort?
 
-    esp_err_t err = gravity_list_ap(retVal, gravity_ap_count, hideExpiredPackets);
+    esp_err_t err = gravity_list_ap(retVal, gravity_ap_count, hideExpiredPackets, filter);
     free(retVal);
     return err;
 }
 
-esp_err_t gravity_list_all_stas(bool hideExpiredPackets) {
+esp_err_t gravity_list_all_stas(bool hideExpiredPackets, const GravityFilter *filter) {
     if (gravity_sta_count == 0) {
         #ifdef CONFIG_FLIPPER
             printf("No STAs in scan results\n");
@@ -978,76 +1138,180 @@ esp_err_t gravity_list_all_stas(bool hideExpiredPackets) {
     for (int i = 0; i < gravity_sta_count; ++i) {
         retVal[i] = &(gravity_stas[i]);
     }
-    esp_err_t err = gravity_list_sta(retVal, gravity_sta_count, hideExpiredPackets);
+    esp_err_t err = gravity_list_sta(retVal, gravity_sta_count, hideExpiredPackets, filter);
     free(retVal);
     return err;
 }
 
+/* Does ap satisfy every predicate in filter? elapsed is the number of seconds
+   since it was last seen */
+bool gravity_ap_matches(const GravityFilter *filter, ScanResultAP *ap, unsigned long elapsed) {
+    if (filter == NULL) {
+        return true;
+    }
+    for (int i = 0; i < filter->predicateCount; ++i) {
+        const gravity_predicate_t *predicate = &filter->predicates[i];
+        bool match = false;
+        switch (predicate->field) {
+            case GRAVITY_FIELD_RSSI:
+                match = gravity_filter_match_number(predicate, ap->espRecord.rssi);
+                break;
+            case GRAVITY_FIELD_CHANNEL:
+                match = gravity_filter_match_number(predicate, ap->espRecord.primary);
+                break;
+            case GRAVITY_FIELD_AGE:
+                match = gravity_filter_match_number(predicate, elapsed);
+                break;
+            case GRAVITY_FIELD_SELECTED:
+                match = gravity_filter_match_number(predicate, ap->selected);
+                break;
+            case GRAVITY_FIELD_ASSOCIATED:
+                match = gravity_filter_match_number(predicate, ap->stationCount > 0);
+                break;
+            case GRAVITY_FIELD_VENDOR:
+                match = gravity_filter_match_text(predicate, gravity_oui_vendor(ap->bssidKey));
+                break;
+            case GRAVITY_FIELD_NAME:
+                match = gravity_filter_match_text(predicate, (char *)ap->espRecord.ssid);
+                break;
+            default:
+                break;
+        }
+        if (!match) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool gravity_sta_matches(const GravityFilter *filter, ScanResultSTA *sta, unsigned long elapsed) {
+    if (filter == NULL) {
+        return true;
+    }
+    for (int i = 0; i < filter->predicateCount; ++i) {
+        const gravity_predicate_t *predicate = &filter->predicates[i];
+        bool match = false;
+        switch (predicate->field) {
+            case GRAVITY_FIELD_RSSI:
+                match = gravity_filter_match_number(predicate, sta->rssi);
+                break;
+            case GRAVITY_FIELD_CHANNEL:
+                match = gravity_filter_match_number(predicate, sta->channel);
+                break;
+            case GRAVITY_FIELD_AGE:
+                match = gravity_filter_match_number(predicate, elapsed);
+                break;
+            case GRAVITY_FIELD_SELECTED:
+                match = gravity_filter_match_number(predicate, sta->selected);
+                break;
+            case GRAVITY_FIELD_ASSOCIATED:
+                match = gravity_filter_match_number(predicate, sta->ap != NULL);
+                break;
+            case GRAVITY_FIELD_AP:
+                match = gravity_filter_match_number(predicate, (sta->ap == NULL) ? -1 : sta->ap->index);
+                break;
+            case GRAVITY_FIELD_VENDOR:
+                match = gravity_filter_match_text(predicate, gravity_oui_vendor(sta->macKey));
+                break;
+            default:
+                break;
+        }
+        if (!match) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Display the columns of ap requested by filter */
+static void ap_list_projected(const GravityFilter *filter, ScanResultAP *ap, unsigned long elapsed) {
+    char cell[GRAVITY_FILTER_CELL_LEN + 1];
+    for (uint8_t col = 0; col < filter->columnCount; ++col) {
+        switch (filter->columns[col]) {
+            case GRAVITY_COL_ID:
+                cell[0] = (ap->selected) ? '*' : ' ';
+                gravity_format_uint(&cell[1], ap->index);
+                break;
+            case GRAVITY_COL_RSSI:
+                gravity_format_int(cell, ap->espRecord.rssi, 4);
+                break;
+            case GRAVITY_COL_NAME:
+                snprintf(cell, sizeof(cell), "%s", (ap->espRecord.ssid[0] == '\0') ? "<hidden>" : (char *)ap->espRecord.ssid);
+                break;
+            case GRAVITY_COL_MAC:
+                gravity_mac_format(ap->bssidKey, cell);
+                break;
+            case GRAVITY_COL_VENDOR:
+                snprintf(cell, sizeof(cell), "%s", gravity_oui_vendor_display(ap->bssidKey));
+                break;
+            case GRAVITY_COL_CLIENTS:
+                gravity_format_int(cell, ap->stationCount, 3);
+                break;
+            case GRAVITY_COL_CHANNEL:
+                gravity_format_int(cell, ap->espRecord.primary, 2);
+                break;
+            case GRAVITY_COL_AGE:
+                gravity_filter_format_age(elapsed, cell);
+                break;
+            case GRAVITY_COL_WPS:
+                strcpy(cell, (ap->espRecord.wps<<5 != 0)?"Yes":"No");
+                break;
+            default:
+                cell[0] = '\0';
+                break;
+        }
+        gravity_filter_print_cell(filter, col, cell);
+    }
+}
+
 /* Display found APs
    Attributes available for display are:
    authmode, bssid, index, lastSeen, primary, rssi, second, selected, ssid, wps
    Will display: selected (*), index, ssid, bssid, lastseen, primary, wps
-   YAGNI: Make display configurable - if not through console then menuconfig! :)
+   unless filter specifies columns. Rows are tested against filter's
+   predicates, OFFSET and LIMIT before they are formatted
 */
-esp_err_t gravity_list_ap(ScanResultAP **aps, int apCount, bool hideExpiredPackets) {
+esp_err_t gravity_list_ap(ScanResultAP **aps, int apCount, bool hideExpiredPackets, const GravityFilter *filter) {
     // Attributes: lastSeen, index, selected, espRecord.authmode, espRecord.bssid, espRecord.primary,
     //             espRecord.rssi, espRecord.second, espRecord.ssid, espRecord.wps
-    #ifdef CONFIG_FLIPPER
-        printf(" ID | RSSI | Cli |  SSID\n");
-        printf("===|====|===|=======\n");
-    #else
-        printf(" ID | RSSI | SSID                             | BSSID             | Cli | Last Seen                | Ch | WPS \n");
-        printf("====|======|==================================|===================|=====|==========================|====|=====\n");
-    #endif
+    gravity_out_begin();
+    bool projected = gravity_filter_projected(filter);
+    if (projected) {
+        gravity_filter_print_header(filter);
+    } else {
+        #ifdef CONFIG_FLIPPER
+            gravity_out_str(" ID | RSSI | Cli |  SSID\n");
+            gravity_out_str("===|====|===|=======\n");
+        #else
+            gravity_out_str(" ID | RSSI | SSID                             | BSSID             | Vendor               | Cli | Last Seen                | Ch | WPS \n");
+            gravity_out_str("====|======|==================================|===================|======================|=====|==========================|====|=====\n");
+        #endif
+    }
     char strBssid[MAC_STRLEN + 1];
     char strTime[26];
     char strSsid[36];
-    unsigned long nowTime;
     unsigned long elapsed;
-    double minutes;
+    uint32_t matched = 0;
+    bool done = false;
 
     /* Apply the sort to selectedAPs */
     qsort(aps, apCount, sizeof(ScanResultAP *), &ap_comparator);
 
-    for (int i=0; i < apCount; ++i) {
-        ESP_ERROR_CHECK(mac_bytes_to_string(aps[i]->espRecord.bssid, strBssid));
-
-        /* Stringify timestamp */
-        nowTime = clock();
-        elapsed = (nowTime - aps[i]->lastSeen) / CLOCKS_PER_SEC;
-        #ifdef CONFIG_DISPLAY_FRIENDLY_AGE
-            if (elapsed < 60.0) {
-                strcpy(strTime, "Under a minute ago");
-            } else if (elapsed < 3600.0) {
-                sprintf(strTime, "%d %s ago", (int)elapsed/60, (elapsed >= 120)?"minutes":"minute");
-            } else {
-                sprintf(strTime, "%d %s ago", (int)elapsed/3600, (elapsed >= 7200)?"hours":"hour");
-            }
-        #else
-            /* Display precise time */
-            char strTmp[16] = "";
-            unsigned long tmp = elapsed;
-            strcpy(strTime, "");
-            if (tmp >= 3600.0) {
-                sprintf(strTmp, "%2dh ", (int)tmp/3600);
-                strcat(strTime, strTmp);
-                tmp = tmp % 3600;
-            }
-            if (tmp >= 60) {
-                sprintf(strTmp, "%2dm ", (int)tmp/60);
-                strcat(strTime, strTmp);
-                tmp = tmp % 60;
-            }
-            sprintf(strTmp, "%2lds", tmp);
-            strcat(strTime, strTmp);
-        #endif
-
-        /* Skip the rest of this loop iteration if the packet has expired */
-        minutes = (elapsed / 60.0);
-        if (hideExpiredPackets && scanResultExpiry != 0 && minutes >= scanResultExpiry) {
+    for (int i=0; i < apCount && !done; ++i) {
+        /* Skip expired and filtered APs before formatting anything */
+        elapsed = (clock() - aps[i]->lastSeen) / CLOCKS_PER_SEC;
+        if (scan_result_expired(hideExpiredPackets, elapsed) || !gravity_ap_matches(filter, aps[i], elapsed) ||
+                !gravity_filter_page(filter, &matched, &done)) {
+            continue;
+        }
+        if (projected) {
+            ap_list_projected(filter, aps[i], elapsed);
             continue;
         }
 
+        gravity_mac_format(aps[i]->bssidKey, strBssid);
+        gravity_filter_format_age(elapsed, strTime);
+
         /* Format SSID for output */
         if (aps[i]->espRecord.ssid[0] == '\0') {
             strcpy(strSsid, "<hidden>");
@@ -1064,104 +1328,183 @@ esp_err_t gravity_list_ap(ScanResultAP **aps, int apCount, bool hideExpiredPacke
                 }
             }
             /* Am I using freed/no-longer-allocated memory here? That could be why I have strings and byte[]s but weird rssi values */
-            printf("%s%2d | %4d | %3d |\n%20s\n", (aps[i]->selected)?"*":" ", aps[i]->index,
-                    aps[i]->espRecord.rssi, aps[i]->stationCount, strSsid);
+            gravity_out_char((aps[i]->selected) ? '*' : ' ');
+            gravity_out_int(aps[i]->index, 2);
+            gravity_out_write(" | ", 3);
+            gravity_out_int(aps[i]->espRecord.rssi, 4);
+            gravity_out_write(" | ", 3);
+            gravity_out_int(aps[i]->stationCount, 3);
+            gravity_out_write(" |\n", 3);
+            size_t ssidLen = strlen(strSsid);
+            gravity_out_repeat(' ', (ssidLen < 20) ? 20 - ssidLen : 0);
+            gravity_out_str(strSsid);
+            gravity_out_char('\n');
         #else
-            printf("%s%2d | %4d | %-32s | %-17s | %3d | %-24s | %2u | %s\n", (aps[i]->selected)?"*":" ", aps[i]->index,
-                    aps[i]->espRecord.rssi, strSsid, strBssid, aps[i]->stationCount, strTime,
-                    aps[i]->espRecord.primary, (aps[i]->espRecord.wps<<5 != 0)?"Yes":"No");
+            gravity_out_char((aps[i]->selected) ? '*' : ' ');
+            gravity_out_int(aps[i]->index, 2);
+            gravity_out_write(" | ", 3);
+            gravity_out_int(aps[i]->espRecord.rssi, 4);
+            gravity_out_write(" | ", 3);
+            gravity_out_padded(strSsid, 32);
+            gravity_out_write(" | ", 3);
+            gravity_out_padded(strBssid, 17);
+            gravity_out_write(" | ", 3);
+            gravity_out_padded(gravity_oui_vendor_display(aps[i]->bssidKey), 20);
+            gravity_out_write(" | ", 3);
+            gravity_out_int(aps[i]->stationCount, 3);
+            gravity_out_write(" | ", 3);
+            gravity_out_padded(strTime, 24);
+            gravity_out_write(" | ", 3);
+            gravity_out_uint(aps[i]->espRecord.primary, 2);
+            gravity_out_write(" | ", 3);
+            gravity_out_str((aps[i]->espRecord.wps<<5 != 0) ? "Yes\n" : "No\n");
         #endif
     }
+    gravity_out_end();
     return ESP_OK;
 }
 
-/* Available attributes are selected, index, MAC, channel, lastSeen, assocAP */
-esp_err_t gravity_list_sta(ScanResultSTA **stas, int staCount, bool hideExpiredPackets) {
-    char strTime[26];
-    unsigned long nowTime;
-    unsigned long elapsed;
-
+/* Describe the AP sta is associated with. strAp must have space for 53
+   characters: SSID (32) + " (" + MAC (17) + ")\0" */
+static void sta_format_ap(ScanResultSTA *sta, char *strAp) {
+    char strApMac[MAC_STRLEN + 1] = "";
+    memset(strAp, 0, 53);
+    if (sta->ap == NULL) {
+        strcpy(strAp, "Unknown");
+        return;
+    }
+    /* Flipper: Display SSID if present, otherwise MAC (retain existing truncation in output - %20s)
+       Console: Display SSID along with MAC if present, otherwise only MAC */
+    gravity_mac_format(sta->apKey, strApMac);
     #ifdef CONFIG_FLIPPER
-        printf(" ID | RSSI |  MAC  | AP\n");
-        printf("==|====|=====|===\n");
+        if (strlen((char *)sta->ap->espRecord.ssid) > 0) {
+            strncpy(strAp, (char *)sta->ap->espRecord.ssid, MAX_SSID_LEN);
+            /* Truncate SSID if necessary to retain formatting */
+            if (strlen(strAp) > 20) {
+                strAp[20] = '\0';
+            }
+        } else {
+            strncpy(strAp, strApMac, MAC_STRLEN);
+        }
     #else
-        printf(" ID | RSSI | MAC               | Access Point                         | Ch | Last Seen               \n");
-        printf("====|======|===================|======================================|====|=========================\n");
+        strncpy(strAp, strApMac, MAC_STRLEN);
+        if (strlen((char *)sta->ap->espRecord.ssid) > 0) {
+            strcat(strAp, " (");
+            strncat(strAp, (char *)sta->ap->espRecord.ssid, MAX_SSID_LEN);
+            strcat(strAp, ")");
+        }
+        /* Arbitrarily truncate this somewhere. Allocating 36 chars to AP isn't too fat in a console */
+        if (strlen(strAp) > 36) {
+            strAp[36] = '\0';
+        }
     #endif
+}
 
-    for (int i=0; i < staCount; ++i) {
-        /* Stringify timestamp */
-        nowTime = clock();
-        elapsed = (nowTime - stas[i]->lastSeen) / CLOCKS_PER_SEC;
-        #ifdef CONFIG_DISPLAY_FRIENDLY_AGE
-            if (elapsed < 60.0) {
-                strcpy(strTime, "Under a minute ago");
-            } else if (elapsed < 3600.0) {
-                sprintf(strTime, "%d %s ago", (int)elapsed / 60, (elapsed > 120)?"minutes":"minute");
-            } else {
-                sprintf(strTime, "%d %s ago", (int)elapsed / 3600, (elapsed > 7200)?"hours":"hour");
-            }
+/* Display the columns of sta requested by filter */
+static void sta_list_projected(const GravityFilter *filter, ScanResultSTA *sta, unsigned long elapsed) {
+    char cell[GRAVITY_FILTER_CELL_LEN + 1];
+    for (uint8_t col = 0; col < filter->columnCount; ++col) {
+        switch (filter->columns[col]) {
+            case GRAVITY_COL_ID:
+                cell[0] = (sta->selected) ? '*' : ' ';
+                gravity_format_uint(&cell[1], sta->index);
+                break;
+            case GRAVITY_COL_RSSI:
+                gravity_format_int(cell, sta->rssi, 4);
+                break;
+            case GRAVITY_COL_MAC:
+                gravity_mac_format(sta->macKey, cell);
+                break;
+            case GRAVITY_COL_VENDOR:
+                snprintf(cell, sizeof(cell), "%s", gravity_oui_vendor_display(sta->macKey));
+                break;
+            case GRAVITY_COL_AP:
+                sta_format_ap(sta, cell);
+                break;
+            case GRAVITY_COL_CHANNEL:
+                gravity_format_int(cell, sta->channel, 2);
+                break;
+            case GRAVITY_COL_AGE:
+                gravity_filter_format_age(elapsed, cell);
+                break;
+            default:
+                cell[0] = '\0';
+                break;
+        }
+        gravity_filter_print_cell(filter, col, cell);
+    }
+}
+
+/* Available attributes are selected, index, MAC, channel, lastSeen, assocAP */
+esp_err_t gravity_list_sta(ScanResultSTA **stas, int staCount, bool hideExpiredPackets, const GravityFilter *filter) {
+    char strTime[26];
+    unsigned long elapsed;
+    uint32_t matched = 0;
+    bool done = false;
+
+    gravity_out_begin();
+    bool projected = gravity_filter_projected(filter);
+    if (projected) {
+        gravity_filter_print_header(filter);
+    } else {
+        #ifdef CONFIG_FLIPPER
+            gravity_out_str(" ID | RSSI |  MAC  | AP\n");
+            gravity_out_str("==|====|=====|===\n");
         #else
-            /* Display precise time */
-            char strTmp[16] = "";
-            unsigned long tmp = elapsed;
-            strcpy(strTime, "");
-            if (tmp >= 3600.0) {
-                sprintf(strTmp, "%2dh ", (int)tmp/3600);
-                strcat(strTime, strTmp);
-                tmp = tmp % 3600;
-            }
-            if (tmp >= 60) {
-                sprintf(strTmp, "%2dm ", (int)tmp/60);
-                strcat(strTime, strTmp);
-                tmp = tmp % 60;
-            }
-            sprintf(strTmp, "%2lds", tmp);
-            strcat(strTime, strTmp);
+            gravity_out_str(" ID | RSSI | MAC               | Vendor               | Access Point                         | Ch | Last Seen               \n");
+            gravity_out_str("====|======|===================|======================|======================================|====|=========================\n");
         #endif
-        char strAp[53] = ""; // 53 == SSID (32) + " (" + MAC (17) + ")\0"
-        char strApMac[MAC_STRLEN + 1] = "";
-        memset(strAp, 0, 53);
-        if (stas[i]->ap == NULL) {
-            strcpy(strAp, "Unknown");
-        } else {
-            /* Flipper: Display SSID if present, otherwise MAC (retain existing truncation in output - %20s)
-               Console: Display SSID along with MAC if present, otherwise only MAC */
-            
-            ESP_ERROR_CHECK(mac_bytes_to_string(stas[i]->apMac, strApMac));
-            #ifdef CONFIG_FLIPPER
-                if (strlen((char *)stas[i]->ap->espRecord.ssid) > 0) {
-                    strncpy(strAp, (char *)stas[i]->ap->espRecord.ssid, MAX_SSID_LEN);
-                    /* Truncate SSID if necessary to retain formatting */
-                    if (strlen(strAp) > 20) {
-                        strAp[20] = '\0';
-                    }
-                } else {
-                    strncpy(strAp, strApMac, MAC_STRLEN);
-                }
-            #else
-                strncpy(strAp, strApMac, MAC_STRLEN);
-                if (strlen((char *)stas[i]->ap->espRecord.ssid) > 0) {
-                    strcat(strAp, " (");
-                    strncat(strAp, (char *)stas[i]->ap->espRecord.ssid, MAX_SSID_LEN);
-                    strcat(strAp, ")");
-                }
-                /* Arbitrarily truncate this somewhere. Allocating 36 chars to AP isn't too fat in a console */
-                if (strlen(strAp) > 36) {
-                    strAp[36] = '\0';
-                }
-            #endif
+    }
+
+    for (int i=0; i < staCount && !done; ++i) {
+        /* Skip expired and filtered STAs before formatting anything */
+        elapsed = (clock() - stas[i]->lastSeen) / CLOCKS_PER_SEC;
+        if (scan_result_expired(hideExpiredPackets, elapsed) || !gravity_sta_matches(filter, stas[i], elapsed) ||
+                !gravity_filter_page(filter, &matched, &done)) {
+            continue;
+        }
+        if (projected) {
+            sta_list_projected(filter, stas[i], elapsed);
+            continue;
         }
+
+        gravity_filter_format_age(elapsed, strTime);
+        char strAp[53] = ""; // 53 == SSID (32) + " (" + MAC (17) + ")\0"
+        sta_format_ap(stas[i], strAp);
+        gravity_out_char((stas[i]->selected) ? '*' : ' ');
+        gravity_out_int(stas[i]->index, 2);
+        gravity_out_write(" | ", 3);
+        gravity_out_int(stas[i]->rssi, 4);
         #ifdef CONFIG_FLIPPER
-            printf("%s%2d | %4d |%02x%02x:%02x%02x:%02x%02x\n%20s\n", (stas[i]->selected)?"*":" ",
-                stas[i]->index, stas[i]->rssi, stas[i]->mac[0], stas[i]->mac[1],
-                stas[i]->mac[2], stas[i]->mac[3], stas[i]->mac[4],
-                stas[i]->mac[5], strAp);
+            gravity_out_write(" |", 2);
+            for (int j = 0; j < 6; ++j) {
+                if (j == 2 || j == 4) {
+                    gravity_out_char(':');
+                }
+                gravity_out_hex(stas[i]->mac[j], 2);
+            }
+            gravity_out_char('\n');
+            size_t apLen = strlen(strAp);
+            gravity_out_repeat(' ', (apLen < 20) ? 20 - apLen : 0);
+            gravity_out_str(strAp);
+            gravity_out_char('\n');
         #else
-            printf("%s%2d | %4d | %-17s | %-36s | %2d | %-24s\n", (stas[i]->selected)?"*":" ", stas[i]->index,
-                    stas[i]->rssi, stas[i]->strMac, strAp, stas[i]->channel, strTime);
+            char strMac[MAC_STRLEN + 1];
+            gravity_mac_format(stas[i]->macKey, strMac);
+            gravity_out_write(" | ", 3);
+            gravity_out_padded(strMac, 17);
+            gravity_out_write(" | ", 3);
+            gravity_out_padded(gravity_oui_vendor_display(stas[i]->macKey), 20);
+            gravity_out_write(" | ", 3);
+            gravity_out_padded(strAp, 36);
+            gravity_out_write(" | ", 3);
+            gravity_out_int(stas[i]->channel, 2);
+            gravity_out_write(" | ", 3);
+            gravity_out_padded(strTime, 24);
+            gravity_out_char('\n');
         #endif
     }
+    gravity_out_end();
     return ESP_OK;
 }
 
@@ -1203,7 +1546,7 @@ esp_err_t gravity_clear_ap_selected() {
     }
     ScanResultAP *newAPs = NULL;
     if (newCount > 0) {
-        newAPs = malloc(sizeof(ScanResultAP) * newCount);
+        newAPs = gravity_mem_alloc(GRAVITY_MEM_HOT, sizeof(ScanResultAP) * newCount);
         if (newAPs == NULL) {
             #ifdef CONFIG_FLIPPER
                 printf("%s\n", STRINGS_MALLOC_FAIL);
@@ -1255,7 +1598,7 @@ esp_err_t gravity_clear_sta_selected() {
     }
     ScanResultSTA *newSTA = NULL;
     if (newCount > 0) {
-        newSTA = malloc(sizeof(ScanResultSTA) * newCount);
+        newSTA = gravity_mem_alloc(GRAVITY_MEM_HOT, sizeof(ScanResultSTA) * newCount);
         if (newSTA == NULL) {
             #ifdef CONFIG_FLIPPER
                 printf("%s\n", STRINGS_MALLOC_FAIL);
@@ -1315,7 +1658,7 @@ printf("begin merge. Orig count %d, new count %d\n",gravity_ap_count, newCount);
     }
 
     /* Allocate resultCount elements for the future AP array */
-    ScanResultAP *resultAP = malloc(sizeof(ScanResultAP) * resultCount);
+    ScanResultAP *resultAP = gravity_mem_alloc(GRAVITY_MEM_HOT, sizeof(ScanResultAP) * resultCount);
     int resultIndex;
     if (resultAP == NULL) {
         ESP_LOGE(SCAN_TAG, "Unable to allocate memory to hold %d ScanResultAP objects", resultCount);
@@ -1325,6 +1668,7 @@ printf("begin merge. Orig count %d, new count %d\n",gravity_ap_count, newCount);
     /* Start with the current set */
     for (int i=0; i < gravity_ap_count; ++i) {
         resultAP[i].espRecord = gravity_aps[i].espRecord;
+        resultAP[i].bssidKey = gravity_aps[i].bssidKey;
         resultAP[i].lastSeen = gravity_aps[i].lastSeen;
         printf("copying orig element %d (ID %d) to new array\n", i, resultAP[i].index);
     }
@@ -1342,11 +1686,13 @@ printf("checking new AP \"%s\"\n", (char *)newAPs[i].espRecord.ssid);
             if (newAPs[i].lastSeen >= gravity_aps[j].lastSeen) {
                 resultAP[j].lastSeen = newAPs[i].lastSeen;
                 resultAP[j].espRecord = newAPs[i].espRecord;
+                resultAP[j].bssidKey = gravity_mac_load(newAPs[i].espRecord.bssid);
             }
         } else {
             printf("Not found in orig array, adding it to element %d\n", resultIndex);
             /* newAPs[i] isn't in gravity_aps[] - Add it */
             resultAP[resultIndex].espRecord = newAPs[resultIndex].espRecord;
+            resultAP[resultIndex].bssidKey = gravity_mac_load(newAPs[resultIndex].espRecord.bssid);
             resultAP[resultIndex].stationCount = 0;
             resultAP[resultIndex].stations = NULL;
             resultAP[resultIndex].lastSeen = clock();
@@ -1367,16 +1713,14 @@ printf("checking new AP \"%s\"\n", (char *)newAPs[i].espRecord.ssid);
 }
 
 esp_err_t gravity_add_ap(uint8_t newAP[6], char *newSSID, int channel) {
+    gravity_mac_t newKey = gravity_mac_load(newAP);
     /* Don't store the broadcast address */
-    if (!memcmp(BROADCAST, newAP, 6)) {
+    if (newKey == GRAVITY_MAC_BROADCAST) {
         return ESP_OK;
     }
     /* First make sure the MAC doesn't exist (multiple APs can share a SSID) */
     int i;
-    char strMac[MAC_STRLEN + 1];
-    mac_bytes_to_string(newAP, strMac);
-
-    for (i=0; i < gravity_ap_count && memcmp(newAP, gravity_aps[i].espRecord.bssid, 6); ++i) {}
+    for (i=0; i < gravity_ap_count && gravity_aps[i].bssidKey != newKey; ++i) {}
     if (i < gravity_ap_count) {
         /* Found the MAC. Update SSID if necessary and update lastSeen */
         if (newSSID != NULL && strcasecmp(newSSID, (char *)gravity_aps[i].espRecord.ssid)) {
@@ -1390,6 +1734,8 @@ esp_err_t gravity_add_ap(uint8_t newAP[6], char *newSSID, int channel) {
             gravity_aps[i].espRecord.primary = channel;
         }
     } else {
+        char strMac[MAC_STRLEN + 1];
+        gravity_mac_format(newKey, strMac);
         #ifdef CONFIG_DEBUG
             if (newSSID != NULL && strlen(newSSID) > 0) {
                 #ifdef CONFIG_FLIPPER
@@ -1400,7 +1746,7 @@ esp_err_t gravity_add_ap(uint8_t newAP[6], char *newSSID, int channel) {
             }
         #endif
         /* AP is a new device */
-        ScanResultAP *newAPs = malloc(sizeof(ScanResultAP) * (gravity_ap_count + 1));
+        ScanResultAP *newAPs = gravity_mem_alloc(GRAVITY_MEM_HOT, sizeof(ScanResultAP) * (gravity_ap_count + 1));
         if (newAPs == NULL) {
             ESP_LOGE(SCAN_TAG, "Insufficient memmory to cache new AP %s", strMac);
             return ESP_ERR_NO_MEM;
@@ -1412,6 +1758,7 @@ esp_err_t gravity_add_ap(uint8_t newAP[6], char *newSSID, int channel) {
             newAPs[j].stationCount = gravity_aps[j].stationCount;
             newAPs[j].stations = gravity_aps[j].stations;
             newAPs[j].espRecord = gravity_aps[j].espRecord;
+            newAPs[j].bssidKey = gravity_aps[j].bssidKey;
             newAPs[j].index = gravity_aps[j].index;
             newAPs[j].lastSeen = gravity_aps[j].lastSeen;
             newAPs[j].selected = gravity_aps[j].selected;
@@ -1432,8 +1779,10 @@ esp_err_t gravity_add_ap(uint8_t newAP[6], char *newSSID, int channel) {
             newAPs[gravity_ap_count].espRecord.ssid[0] = '\0';
         }
         memcpy(newAPs[gravity_ap_count].espRecord.bssid, newAP, 6);
+        newAPs[gravity_ap_count].bssidKey = newKey;
 
         ++gravity_ap_count;
+        hop_record_discovery();
 
         if (gravity_aps != NULL) {
             free(gravity_aps);
@@ -1445,13 +1794,14 @@ esp_err_t gravity_add_ap(uint8_t newAP[6], char *newSSID, int channel) {
 }
 
 esp_err_t gravity_add_sta(uint8_t newSTA[6], int channel) {
+    gravity_mac_t newKey = gravity_mac_load(newSTA);
     /* Don't store the broadcast address */
-    if (!memcmp(BROADCAST, newSTA, 6)) {
+    if (newKey == GRAVITY_MAC_BROADCAST) {
         return ESP_OK;
     }
     /* First make sure the MAC doesn't exist */
     int i;
-    for (i=0; i < gravity_sta_count && memcmp(newSTA, gravity_stas[i].mac, 6); ++i) {}
+    for (i=0; i < gravity_sta_count && gravity_stas[i].macKey != newKey; ++i) {}
 
     if (i < gravity_sta_count) {
         /* Found the MAC. Update lastSeen */
@@ -1462,7 +1812,7 @@ esp_err_t gravity_add_sta(uint8_t newSTA[6], int channel) {
     } else {
         /* STA is a new device */
         char strNewSTA[MAC_STRLEN + 1];
-        ESP_ERROR_CHECK(mac_bytes_to_string(newSTA, strNewSTA));
+        gravity_mac_format(newKey, strNewSTA);
 
         #ifdef CONFIG_DEBUG
             #ifdef CONFIG_FLIPPER
@@ -1472,7 +1822,7 @@ esp_err_t gravity_add_sta(uint8_t newSTA[6], int channel) {
             #endif
         #endif
 
-        ScanResultSTA *newSTAs = malloc(sizeof(ScanResultSTA) * (gravity_sta_count + 1));
+        ScanResultSTA *newSTAs = gravity_mem_alloc(GRAVITY_MEM_HOT, sizeof(ScanResultSTA) * (gravity_sta_count + 1));
         if (newSTAs == NULL) {
             ESP_LOGE(SCAN_TAG, "Insufficient memmory to cache new STA %s", strNewSTA);
             return ESP_ERR_NO_MEM;
@@ -1484,12 +1834,13 @@ esp_err_t gravity_add_sta(uint8_t newSTA[6], int channel) {
             /* newSTAs[j] = gravity_stas[j]; ID10T */
             newSTAs[j].ap = gravity_stas[j].ap;
             memcpy(newSTAs[j].apMac, gravity_stas[j].apMac, 6);
+            newSTAs[j].apKey = gravity_stas[j].apKey;
             newSTAs[j].channel = gravity_stas[j].channel;
             newSTAs[j].index = gravity_stas[j].index;
             newSTAs[j].lastSeen = gravity_stas[j].lastSeen;
             newSTAs[j].selected = gravity_stas[j].selected;
             memcpy(newSTAs[j].mac, gravity_stas[j].mac, 6);
-            strcpy(newSTAs[j].strMac, gravity_stas[j].strMac);
+            newSTAs[j].macKey = gravity_stas[j].macKey;
             if (newSTAs[j].index > maxIndex) {
                 maxIndex = newSTAs[j].index;
             }
@@ -1501,10 +1852,12 @@ esp_err_t gravity_add_sta(uint8_t newSTA[6], int channel) {
         newSTAs[gravity_sta_count].channel = channel;
         newSTAs[gravity_sta_count].ap = NULL;
         newSTAs[gravity_sta_count].apMac[0] = 0;
+        newSTAs[gravity_sta_count].apKey = GRAVITY_MAC_NONE;
         memcpy(newSTAs[gravity_sta_count].mac, newSTA, 6);
-        ESP_ERROR_CHECK(mac_bytes_to_string(newSTA, newSTAs[gravity_sta_count].strMac));
+        newSTAs[gravity_sta_count].macKey = newKey;
 
         ++gravity_sta_count;
+        hop_record_discovery();
 
         if (gravity_stas != NULL) {
             free(gravity_stas);
@@ -1517,8 +1870,10 @@ esp_err_t gravity_add_sta(uint8_t newSTA[6], int channel) {
 /* Found a station association. Typically this is a data packet to/from the router.
    Record this association in: ap.stations, sta.apMac, sta.ap */
 esp_err_t gravity_add_sta_ap(uint8_t *sta, uint8_t *ap) {
+    gravity_mac_t staKey = gravity_mac_load(sta);
+    gravity_mac_t apKey = gravity_mac_load(ap);
     /* Don't store the broadcast address */
-    if (!memcmp(BROADCAST, sta, 6) || !memcmp(BROADCAST, ap, 6)) {
+    if (staKey == GRAVITY_MAC_BROADCAST || apKey == GRAVITY_MAC_BROADCAST) {
         return ESP_OK;
     }
 
@@ -1527,36 +1882,32 @@ esp_err_t gravity_add_sta_ap(uint8_t *sta, uint8_t *ap) {
     int idxAp = 0;
     ScanResultSTA *specSTA;
     ScanResultAP *specAP;
-    for (idxSta = 0; idxSta < gravity_sta_count && memcmp(gravity_stas[idxSta].mac, sta, 6); ++idxSta) { }
+    for (idxSta = 0; idxSta < gravity_sta_count && gravity_stas[idxSta].macKey != staKey; ++idxSta) { }
     if (idxSta == gravity_sta_count) {
         char strSTA[MAC_STRLEN + 1];
-        ESP_ERROR_CHECK(mac_bytes_to_string(sta, strSTA));
+        gravity_mac_format(staKey, strSTA);
         ESP_LOGE(SCAN_TAG, "Unable to find specified STA %s", strSTA);
         return ESP_ERR_INVALID_ARG;
     }
     specSTA = &gravity_stas[idxSta];
 
-    for (idxAp = 0; idxAp < gravity_ap_count && memcmp(gravity_aps[idxAp].espRecord.bssid, ap, 6); ++idxAp) { }
+    for (idxAp = 0; idxAp < gravity_ap_count && gravity_aps[idxAp].bssidKey != apKey; ++idxAp) { }
     if (idxAp == gravity_ap_count) {
         char strAP[MAC_STRLEN + 1];
-        ESP_ERROR_CHECK(mac_bytes_to_string(ap, strAP));
+        gravity_mac_format(apKey, strAP);
         ESP_LOGE(SCAN_TAG, "Unable to find specified AP %s", strAP);
         return ESP_ERR_INVALID_ARG;
     }
     specAP = &gravity_aps[idxAp];
-    char strMacAP[MAC_STRLEN + 1];
-    mac_bytes_to_string(specAP->espRecord.bssid, strMacAP);
 
     /* Is the STA already associated with an AP? */
     if (specSTA->ap != NULL) {
         /* Maintain specAP.stations array before anything else */
         /* Check whether the STA is already present in the AP */
-        if (!memcmp(ap, specSTA->apMac, 6)) {
+        if (specSTA->apKey == apKey) {
             /* The STA is already associated with the AP */
             return ESP_OK;
         } else {
-            char strOldAp[MAC_STRLEN + 1];
-            mac_bytes_to_string(specSTA->apMac, strOldAp);
             /* STA has moved from one AP to another */
             /* First shrink specSTA->ap->stations */
             ScanResultSTA **oldSTA = (ScanResultSTA **)specSTA->ap->stations;
@@ -1573,7 +1924,7 @@ esp_err_t gravity_add_sta_ap(uint8_t *sta, uint8_t *ap) {
             int idxNew = 0;
             for (; idxOld < specSTA->ap->stationCount; ++idxOld) {
                 /* Copy across everything except sta */
-                if (memcmp(sta, oldSTA[idxOld]->mac, 6)) {
+                if (oldSTA[idxOld]->macKey != staKey) {
                     newSTA[idxNew++] = oldSTA[idxOld];
                 }
             }
@@ -1597,6 +1948,7 @@ esp_err_t gravity_add_sta_ap(uint8_t *sta, uint8_t *ap) {
             ++specAP->stationCount;
             specSTA->ap = specAP;
             memcpy(specSTA->apMac, ap, 6);
+            specSTA->apKey = apKey;
 
             /* Finally move newSTA into place */
             if (specAP->stations != NULL) {
@@ -1625,6 +1977,7 @@ esp_err_t gravity_add_sta_ap(uint8_t *sta, uint8_t *ap) {
 
         specSTA->ap = specAP;
         memcpy(specSTA->apMac, ap, 6);
+        specSTA->apKey = apKey;
     }
     return ESP_OK;
 }
@@ -1678,9 +2031,6 @@ esp_err_t parse_beacon(uint8_t *payload) {
     memcpy(ssid, &payload[ssid_offset], ssid_len);
     ssid[ssid_len] = '\0';
 
-    char strAp[MAC_STRLEN + 1];
-    mac_bytes_to_string(ap, strAp);
-
     int channel = parseChannel(payload);
     gravity_add_ap(ap, ssid, channel);
 
@@ -1741,6 +2091,8 @@ esp_err_t parse_data(uint8_t *payload) {
     uint8_t ap[6];
     memcpy(sta, &payload[sta_offset], 6);
     memcpy(ap, &payload[ap_offset], 6);
+    gravity_mac_t staKey = gravity_mac_load(sta);
+    gravity_mac_t apKey = gravity_mac_load(ap);
 
     bool adding = false;
     uint8_t *adding_sta = NULL;
@@ -1748,15 +2100,15 @@ esp_err_t parse_data(uint8_t *payload) {
 
     /* If we know Rx or Tx is a STA we might have a new AP */
     int idxSearch = 0;
-    for (idxSearch = 0; idxSearch < gravity_sta_count && memcmp(sta, gravity_stas[idxSearch].mac, 6) &&
-            memcmp(ap, gravity_stas[idxSearch].mac, 6); ++idxSearch) { }
+    for (idxSearch = 0; idxSearch < gravity_sta_count && gravity_stas[idxSearch].macKey != staKey &&
+            gravity_stas[idxSearch].macKey != apKey; ++idxSearch) { }
     if (idxSearch < gravity_sta_count) {
         /* We found a known station */
-        if (!memcmp(sta, gravity_stas[idxSearch].mac, 6)) {
+        if (gravity_stas[idxSearch].macKey == staKey) {
             adding = true;
             adding_sta = sta;
             adding_ap = ap;
-        } else if (!memcmp(ap, gravity_stas[idxSearch].mac, 6)) {
+        } else if (gravity_stas[idxSearch].macKey == apKey) {
             adding = true;
             adding_ap = sta;
             adding_sta = ap;
@@ -1770,15 +2122,15 @@ esp_err_t parse_data(uint8_t *payload) {
     adding = false;
 
     /* If we know Rx or Tx is an AP we might have a new STA */
-    for (idxSearch = 0; idxSearch < gravity_ap_count && memcmp(sta, gravity_aps[idxSearch].espRecord.bssid, 6) &&
-            memcmp(ap, gravity_aps[idxSearch].espRecord.bssid, 6); ++idxSearch) { }
+    for (idxSearch = 0; idxSearch < gravity_ap_count && gravity_aps[idxSearch].bssidKey != staKey &&
+            gravity_aps[idxSearch].bssidKey != apKey; ++idxSearch) { }
     if (idxSearch < gravity_ap_count) {
         /* We found a known AP */
-        if (!memcmp(sta, gravity_aps[idxSearch].espRecord.bssid, 6)) {
+        if (gravity_aps[idxSearch].bssidKey == staKey) {
             adding = true;
             adding_ap = sta;
             adding_sta = ap;
-        } else if (!memcmp(ap, gravity_aps[idxSearch].espRecord.bssid, 6)) {
+        } else if (gravity_aps[idxSearch].bssidKey == apKey) {
             adding = true;
             adding_ap = ap;
             adding_sta = sta;
@@ -1826,7 +2178,7 @@ esp_err_t parse_cts(uint8_t *payload) {
     memcpy(ap, &payload[ap_offset], 6);
     int channel = parseChannel(payload);
     ESP_ERROR_CHECK(gravity_add_sta(sta, channel));
-    if (memcmp(ap, BROADCAST, 6)) {
+    if (!gravity_mac_is_broadcast(ap)) {
         /* Destination was not BROADCAST so it must be an AP */
         ESP_ERROR_CHECK(gravity_add_ap(ap, "", channel));
         ESP_ERROR_CHECK(gravity_add_sta_ap(sta, ap));
@@ -1861,10 +2213,7 @@ esp_err_t scan_wifi_parse_frame(uint8_t *payload, wifi_pkt_rx_ctrl_t rx_ctrl) {
           // 20:E8:82:EE:D7:D4 - Whymper2.4
     if (strlen(scan_filter_ssid) > 0) {
         /* Do we know the MAC associated with the SSID? */
-        // TODO Do I need to check all bytes or can I just do the first?
-        if (scan_filter_ssid_bssid[0] == 0x00 && scan_filter_ssid_bssid[1] == 0x00 &&
-                scan_filter_ssid_bssid[2] == 0x00 && scan_filter_ssid_bssid[3] == 0x00 &&
-                scan_filter_ssid_bssid[4] == 0x00 && scan_filter_ssid_bssid[5] == 0x00) {
+        if (gravity_mac_load(scan_filter_ssid_bssid) == GRAVITY_MAC_NONE) {
             /* No MAC yet. Is there one in the current packet? */
             if (payload[0] == WIFI_FRAME_PROBE_RESP || payload[0] == WIFI_FRAME_BEACON) {
                 /* Probe response or beacon - Is it directed? Check SSID length field */
@@ -1892,19 +2241,18 @@ esp_err_t scan_wifi_parse_frame(uint8_t *payload, wifi_pkt_rx_ctrl_t rx_ctrl) {
             }
         } else {
             /* AP's MAC is in scan_filter_ssid_bssid - see if this frame involves it */
-            uint8_t destAddr[6];
-            uint8_t srcAddr[6];
-            memcpy(destAddr, &payload[4], 6);
-            memcpy(srcAddr, &payload[10], 6);
-            if (memcmp(scan_filter_ssid_bssid, destAddr, 6) && memcmp(scan_filter_ssid_bssid, srcAddr, 6)) {
+            gravity_mac_t filterKey = gravity_mac_load(scan_filter_ssid_bssid);
+            gravity_mac_t destKey = gravity_mac_load(&payload[4]);
+            gravity_mac_t srcKey = gravity_mac_load(&payload[10]);
+            if (filterKey != destKey && filterKey != srcKey) {
                 /* AP isn't a direct sender or receiver. Check whether any known stations are */
                 /* First find the struct instance representing the AP */
                 int apIdx;
                 for (apIdx = 0; apIdx < gravity_ap_count &&
-                            memcmp(gravity_aps[apIdx].espRecord.bssid, scan_filter_ssid_bssid, 6); ++apIdx) { }
+                            gravity_aps[apIdx].bssidKey != filterKey; ++apIdx) { }
                 if (apIdx == gravity_ap_count) {
                     char strAP[MAC_STRLEN + 1];
-                    mac_bytes_to_string(scan_filter_ssid_bssid, strAP);
+                    gravity_mac_format(filterKey, strAP);
                     ESP_LOGE(SCAN_TAG, "Unable to find object representing selected AP %s", strAP);
                     return ESP_OK;
                 }
@@ -1913,8 +2261,8 @@ esp_err_t scan_wifi_parse_frame(uint8_t *payload, wifi_pkt_rx_ctrl_t rx_ctrl) {
                 ScanResultSTA **stations = (ScanResultSTA **)selectedAP->stations;
                 int idxStations;
                 for (idxStations = 0; idxStations < selectedAP->stationCount &&
-                                memcmp(stations[idxStations]->mac, destAddr, 6) &&
-                                memcmp(stations[idxStations]->mac, srcAddr, 6); ++idxStations) { }
+                                stations[idxStations]->macKey != destKey &&
+                                stations[idxStations]->macKey != srcKey; ++idxStations) { }
                 if (idxStations == selectedAP->stationCount) {
                     /* No AP clients have been observed */
                     return ESP_OK; // TODO? Braindead...
@@ -1964,8 +2312,9 @@ esp_err_t scan_wifi_parse_frame(uint8_t *payload, wifi_pkt_rx_ctrl_t rx_ctrl) {
        Find the struct with MAC payload[10] and set its values based on rx_ctrl
     */
     int i = 0;
+    gravity_mac_t srcKey = gravity_mac_load(&payload[10]);
     /* Look for the MAC in gravityAPs[] */
-    for( ; i < gravity_ap_count && memcmp(&payload[10], gravity_aps[i].espRecord.bssid, 6); ++i) { }
+    for( ; i < gravity_ap_count && gravity_aps[i].bssidKey != srcKey; ++i) { }
     if (i < gravity_ap_count) {
         /* Found the AP in index i. Update it */
         gravity_aps[i].espRecord.primary = rx_ctrl.channel;
@@ -1976,7 +2325,7 @@ esp_err_t scan_wifi_parse_frame(uint8_t *payload, wifi_pkt_rx_ctrl_t rx_ctrl) {
             gravity_aps[i].espRecord.second = rx_ctrl.secondary_channel;
         #endif
     } else {
-        for (i = 0; i < gravity_sta_count && memcmp(&payload[10], gravity_stas[i].mac, 6); ++i) { }
+        for (i = 0; i < gravity_sta_count && gravity_stas[i].macKey != srcKey; ++i) { }
         if (i < gravity_sta_count) {
             /* Found the STA in index i. Update it */
             gravity_stas[i].channel = rx_ctrl.channel;
@@ -1989,7 +2338,7 @@ esp_err_t scan_wifi_parse_frame(uint8_t *payload, wifi_pkt_rx_ctrl_t rx_ctrl) {
         } else {
             #ifdef CONFIG_DEBUG_VERBOSE
                 char theMac[MAC_STRLEN + 1] = "";
-                mac_bytes_to_string(&payload[10], theMac); // TODO: check result
+                gravity_mac_format(srcKey, theMac);
                 #ifdef CONFIG_FLIPPER
                     printf("Packet from %s has not been parsed!\n", theMac);
                 #else
@@ -24,17 +24,21 @@ esp_err_t purgeSTA(gravity_bt_purge_strategy_t strategy, uint16_t minAge, int32_
 esp_err_t gravity_merge_results_ap(uint16_t newCount, ScanResultAP *newAPs);
 esp_err_t gravity_clear_ap();
 esp_err_t gravity_clear_ap_selected();
-esp_err_t gravity_list_ap(ScanResultAP **aps, int apCount, bool hideExpiredPackets);
-esp_err_t gravity_list_all_aps(bool hideExpiredPackets);
+esp_err_t gravity_list_ap(ScanResultAP **aps, int apCount, bool hideExpiredPackets, const GravityFilter *filter);
+bool gravity_ap_matches(const GravityFilter *filter, ScanResultAP *ap, unsigned long elapsed);
+esp_err_t gravity_list_all_aps(bool hideExpiredPackets, const GravityFilter *filter);
 esp_err_t gravity_select_ap(int selIndex);
+esp_err_t gravity_select_aps_where(const GravityFilter *filter, uint32_t top, GRAVITY_SORT_TYPE rankBy, uint32_t *newCount);
 esp_err_t gravity_add_ap(uint8_t newAP[6], char *newSSID, int channel);
 esp_err_t gravity_add_sta(uint8_t newSTA[6], int channel);
 esp_err_t gravity_add_sta_ap(uint8_t *sta, uint8_t *ap);
 esp_err_t gravity_clear_sta();
 esp_err_t gravity_clear_sta_selected();
-esp_err_t gravity_list_sta(ScanResultSTA **stas, int staCount, bool hideExpiredPackets);
-esp_err_t gravity_list_all_stas(bool hideExpiredPackets);
+esp_err_t gravity_list_sta(ScanResultSTA **stas, int staCount, bool hideExpiredPackets, const GravityFilter *filter);
+bool gravity_sta_matches(const GravityFilter *filter, ScanResultSTA *sta, unsigned long elapsed);
+esp_err_t gravity_list_all_stas(bool hideExpiredPackets, const GravityFilter *filter);
 esp_err_t gravity_select_sta(int selIndex);
+esp_err_t gravity_select_stas_where(const GravityFilter *filter, uint32_t top, GRAVITY_SORT_TYPE rankBy, uint32_t *newCount);
 bool gravity_sta_isSelected(int index);
 bool gravity_ap_isSelected(int index);
 
@@ -0,0 +1,59 @@
+#include "sig.h"
+#include "sdkconfig.h"
+#include <stddef.h>
+
+#ifdef CONFIG_DECODE_UUIDS
+    /* Generated from the assigned_numbers_*.yaml files at build time by tools/gen_sig.py */
+    #include "sig_table.h"
+
+/* Binary search of a sorted key table
+   Returns the name for key from the pooled names, or NULL if key isn't present */
+static const char *sig_find(const uint16_t *keys, const uint32_t *names, int count, uint16_t key) {
+    int low = 0;
+    int high = count - 1;
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        if (keys[mid] == key) {
+            return &sig_name_pool[names[mid]];
+        } else if (keys[mid] < key) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return NULL;
+}
+#endif
+
+const char *gravity_sig_service_name(uint16_t uuid16) {
+    #ifdef CONFIG_DECODE_UUIDS
+        return sig_find(sig_service_keys, sig_service_names, SIG_SERVICE_COUNT, uuid16);
+    #else
+        (void)uuid16;
+        return NULL;
+    #endif
+}
+
+const char *gravity_sig_company_name(uint16_t companyId) {
+    #ifdef CONFIG_DECODE_UUIDS
+        return sig_find(sig_company_keys, sig_company_names, SIG_COMPANY_COUNT, companyId);
+    #else
+        (void)companyId;
+        return NULL;
+    #endif
+}
+
+/* Name of the specified appearance, falling back to the name of its
+   category when the subcategory isn't known */
+const char *gravity_sig_appearance_name(uint16_t appearance) {
+    #ifdef CONFIG_DECODE_UUIDS
+        const char *name = sig_find(sig_appearance_keys, sig_appearance_names, SIG_APPEARANCE_COUNT, appearance);
+        if (name == NULL && (appearance & 0x3F) != 0) {
+            name = sig_find(sig_appearance_keys, sig_appearance_names, SIG_APPEARANCE_COUNT, appearance & ~0x3F);
+        }
+        return name;
+    #else
+        (void)appearance;
+        return NULL;
+    #endif
+}
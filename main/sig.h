@@ -0,0 +1,17 @@
+#ifndef GRAVITY_SIG_H
+#define GRAVITY_SIG_H
+
+#include <stdint.h>
+
+/* Names for Bluetooth SIG assigned numbers
+   The tables are generated at build time from the SIG's YAML files by
+   tools/gen_sig.py. They are sorted and const, so they live in flash and
+   are searched in O(log n). Each function returns NULL if the number isn't
+   known, or if CONFIG_DECODE_UUIDS is disabled.
+*/
+
+const char *gravity_sig_service_name(uint16_t uuid16);
+const char *gravity_sig_company_name(uint16_t companyId);
+const char *gravity_sig_appearance_name(uint16_t appearance);
+
+#endif
@@ -0,0 +1,91 @@
+#include "slab.h"
+#include <stdlib.h>
+#include <stdbool.h>
+
+/* A chunk is a single allocation, aligned to its size, holding its header
+   followed by its blocks */
+static uint8_t *slab_chunk_blocks(GravitySlabChunk *chunk) {
+    return (uint8_t *)chunk + GRAVITY_SLAB_HEADER_SIZE;
+}
+
+/* The chunk holding block, found by rounding its address down to a multiple of chunkBytes */
+static GravitySlabChunk *slab_chunk_for(GravitySlab *slab, void *block) {
+    return (GravitySlabChunk *)((uintptr_t)block & ~((uintptr_t)slab->chunkBytes - 1));
+}
+
+/* Add a chunk to slab, placing all of its blocks on the free list */
+static GravitySlabChunk *slab_grow(GravitySlab *slab) {
+    if (slab->blocksPerChunk == 0) {
+        return NULL;
+    }
+    GravitySlabChunk *chunk = (slab->chunkAlloc == NULL) ? aligned_alloc(slab->chunkBytes, slab->chunkBytes) :
+                                                           slab->chunkAlloc(slab->chunkBytes, slab->chunkBytes);
+    if (chunk == NULL) {
+        return NULL;
+    }
+    chunk->inUse = 0;
+    chunk->next = slab->chunks;
+    slab->chunks = chunk;
+    ++slab->chunkCount;
+    for (int i = slab->blocksPerChunk - 1; i >= 0; --i) {
+        void **block = (void **)(slab_chunk_blocks(chunk) + (size_t)i * slab->blockSize);
+        *block = slab->freeList;
+        slab->freeList = block;
+    }
+    return chunk;
+}
+
+/* Allocate a block from slab. Returns NULL if a new chunk was needed and
+   could not be allocated */
+void *gravity_slab_alloc(GravitySlab *slab) {
+    /* chunkAlloc may free memory, including blocks from this slab, so
+       check the free list only after it has run */
+    if (slab->freeList == NULL && slab_grow(slab) == NULL) {
+        return NULL;
+    }
+    void **block = (void **)slab->freeList;
+    slab->freeList = *block;
+    ++slab_chunk_for(slab, block)->inUse;
+    ++slab->inUse;
+    return block;
+}
+
+/* Return block, which must have been allocated from slab, to its free list */
+void gravity_slab_free(GravitySlab *slab, void *block) {
+    if (block == NULL) {
+        return;
+    }
+    --slab_chunk_for(slab, block)->inUse;
+    --slab->inUse;
+    *(void **)block = slab->freeList;
+    slab->freeList = block;
+}
+
+/* Return chunks with no blocks in use to the heap */
+void gravity_slab_trim(GravitySlab *slab) {
+    /* Unlink the blocks of empty chunks from the free list */
+    void **freeLink = &slab->freeList;
+    while (*freeLink != NULL) {
+        if (slab_chunk_for(slab, *freeLink)->inUse == 0) {
+            *freeLink = *(void **)*freeLink;
+        } else {
+            freeLink = (void **)*freeLink;
+        }
+    }
+    GravitySlabChunk **link = &slab->chunks;
+    while (*link != NULL) {
+        GravitySlabChunk *chunk = *link;
+        if (chunk->inUse > 0) {
+            link = &chunk->next;
+            continue;
+        }
+        *link = chunk->next;
+        --slab->chunkCount;
+        free(chunk);
+    }
+}
+
+/* Number of bytes of heap held by slab, including free blocks */
+size_t gravity_slab_bytes(GravitySlab *slab) {
+    return (size_t)slab->chunkCount * slab->chunkBytes;
+}
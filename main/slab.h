@@ -0,0 +1,52 @@
+#ifndef GRAVITY_SLAB_H
+#define GRAVITY_SLAB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Slab allocator for large numbers of small, fixed-size records
+   Blocks are carved from chunks of chunkBytes bytes, so a record costs
+   exactly blockSize bytes rather than its size plus a heap header and
+   alignment padding. Freed blocks are kept on a free list for reuse;
+   gravity_slab_trim() returns chunks that are entirely free to the heap.
+   chunkBytes is a power of two and chunks are aligned to it, so the chunk
+   holding a block is found by masking the block's address.
+*/
+
+typedef struct GravitySlabChunk {
+    struct GravitySlabChunk *next;
+    uint16_t inUse;
+} GravitySlabChunk;
+
+typedef struct GravitySlab {
+    uint16_t blockSize;
+    uint16_t blocksPerChunk;
+    uint16_t chunkBytes;
+    /* Used to allocate chunks aligned to chunkBytes. If NULL, aligned_alloc() is used */
+    void *(*chunkAlloc)(size_t alignment, size_t bytes);
+    GravitySlabChunk *chunks;
+    void *freeList;
+    uint32_t inUse;
+    uint32_t chunkCount;
+} GravitySlab;
+
+/* Initialiser for a slab of blocks of the specified size, carved from chunks
+   of chunkSize bytes, which must be a power of two. Block sizes are rounded
+   up so that every block is suitably aligned for any record. Each chunk
+   starts with a GravitySlabChunk header, so the space left after the last
+   whole block is wasted; choose chunkSize so that this is small */
+#define GRAVITY_SLAB_ALIGN 8
+#define GRAVITY_SLAB_ROUND(size) ((((size) + GRAVITY_SLAB_ALIGN - 1) / GRAVITY_SLAB_ALIGN) * GRAVITY_SLAB_ALIGN)
+#define GRAVITY_SLAB_HEADER_SIZE GRAVITY_SLAB_ROUND(sizeof(GravitySlabChunk))
+#define GRAVITY_SLAB_INIT(size, chunkSize, allocator) { \
+    .blockSize = GRAVITY_SLAB_ROUND(size), \
+    .blocksPerChunk = ((chunkSize) - GRAVITY_SLAB_HEADER_SIZE) / GRAVITY_SLAB_ROUND(size), \
+    .chunkBytes = (chunkSize), .chunkAlloc = (allocator), .chunks = NULL, \
+    .freeList = NULL, .inUse = 0, .chunkCount = 0 }
+
+void *gravity_slab_alloc(GravitySlab *slab);
+void gravity_slab_free(GravitySlab *slab, void *block);
+void gravity_slab_trim(GravitySlab *slab);
+size_t gravity_slab_bytes(GravitySlab *slab);
+
+#endif
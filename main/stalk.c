@@ -2,6 +2,7 @@
 #include "beacon.h"
 #include "bluetooth.h"
 #include "common.h"
+#include "output.h"
 #include "freertos/portmacro.h"
 #include "probe.h"
 #include <stdio.h>
@@ -10,12 +11,31 @@
 static TaskHandle_t stalkTask = NULL;
 const char *STALK_TAG = "stalk@GRAVITY";
 
-#define CLEAR() printf("\033[H\033[J")
-#define GOTOXY(x,y) printf("\033[%d;%dH", (y), (x))
-#define CURSOR_UP(n) printf("\033[%dA", (n))
-#define CURSOR_DOWN(n) printf("\033[%dB", (n))
-#define CURSOR_RIGHT(n) printf("\033[%dC", (n))
-#define CURSOR_LEFT(n) printf("\033[%dD", (n))
+#define CLEAR() gravity_out_str("\033[H\033[J")
+#define GOTOXY(x,y) stalk_goto((x), (y))
+#define CURSOR_UP(n) gravity_out_printf("\033[%dA", (n))
+#define CURSOR_DOWN(n) gravity_out_printf("\033[%dB", (n))
+#define CURSOR_RIGHT(n) gravity_out_printf("\033[%dC", (n))
+#define CURSOR_LEFT(n) gravity_out_printf("\033[%dD", (n))
+
+static void stalk_goto(int x, int y) {
+    gravity_out_write("\033[", 2);
+    gravity_out_int(y, 0);
+    gravity_out_char(';');
+    gravity_out_int(x, 0);
+    gravity_out_char('H');
+}
+
+/* Display a row of the Flipper's stalk UI - "<label><i> | <rssi>dB  |<age>s" */
+static void stalk_flipper_row(const char *label, int i, int32_t rssi, unsigned long elapsed) {
+    gravity_out_str(label);
+    gravity_out_int(i, 0);
+    gravity_out_str((i == 1) ? "  | " : " | ");
+    gravity_out_int(rssi, 3);
+    gravity_out_write("dB  |", 5);
+    gravity_out_uint(elapsed, 3);
+    gravity_out_write("s\n", 2);
+}
 
 /* (Hopefully) create a workable UI without cursor positioning commands */
 /* MAC takes up an entire row - 20% of the screen
@@ -25,14 +45,16 @@ const char *STALK_TAG = "stalk@GRAVITY";
    HCI1 | -43dB  | 21s
    BLE1 | -54dB  |  7s
     AP1 | -96dB  |118s
+   The whole screen is buffered and written to the console at once
 */
 esp_err_t drawStalkFlipper() {
-    printf("\n\n\n\n\n\n\n");
+    gravity_out_begin();
+    gravity_out_repeat('\n', 7);
     for (int i = 0; i < gravity_sel_sta_count; ++i) {
         clock_t nowTime = clock();
         unsigned long elapsed = (nowTime - gravity_selected_stas[i]->lastSeen) / CLOCKS_PER_SEC;
 
-        printf("STA%d%s| %3ddB  |%3lds\n", i, (i == 1)?"  ":" ", gravity_selected_stas[i]->rssi, elapsed);
+        stalk_flipper_row("STA", i, gravity_selected_stas[i]->rssi, elapsed);
     }
 
     for (int i = 0; i < gravity_sel_ap_count; ++i) {
@@ -40,7 +62,7 @@ esp_err_t drawStalkFlipper() {
         clock_t nowTime = clock();
         unsigned long elapsed = (nowTime - gravity_selected_aps[i]->lastSeen) / CLOCKS_PER_SEC;
 
-        printf("%3sAP%d%s| %3ddB  |%3lds\n", " ", i, (i == 1)?"  ":" ", gravity_selected_aps[i]->espRecord.rssi, elapsed);
+        stalk_flipper_row("   AP", i, gravity_selected_aps[i]->espRecord.rssi, elapsed);
     }
 
     #if defined(CONFIG_BT_ENABLED)
@@ -48,55 +70,68 @@ esp_err_t drawStalkFlipper() {
             clock_t nowTime = clock();
             unsigned long elapsed = (nowTime - gravity_selected_bt[i]->lastSeen) / CLOCKS_PER_SEC;
 
-            printf("%3sBT%d%s| %3lddB  |%3lds\n", " ", i, (i == 1)?"  ":" ", gravity_selected_bt[i]->rssi, elapsed);
+            stalk_flipper_row("   BT", i, gravity_selected_bt[i]->rssi, elapsed);
         }
     #endif
+    gravity_out_end();
     return ESP_OK;
 }
 
-/* Clear the screen and redraw stalking UI with latest data */
+/* Clear the screen and redraw stalking UI with latest data. The screen is
+   buffered and written to the console at once, so it doesn't flicker */
 esp_err_t drawStalk() {
     esp_err_t err = ESP_OK;
 
+    gravity_out_begin();
     CLEAR();
     /* Display selectedSTA */
     GOTOXY(1, 2);
-    printf("Stations          |  dB  | Age");
+    gravity_out_str("Stations          |  dB  | Age");
     GOTOXY(1, 3);
-    printf("------------------|------|------");
+    gravity_out_str("------------------|------|------");
     for (int i = 0; i < gravity_sel_sta_count; ++i) {
         GOTOXY(1, i + 4);
-        printf("%s", gravity_selected_stas[i]->strMac);
+        char staStr[MAC_STRLEN + 1];
+        gravity_mac_format(gravity_selected_stas[i]->macKey, staStr);
+        gravity_out_str(staStr);
         GOTOXY(19, i + 4);
-        printf("| %4d |", gravity_selected_stas[i]->rssi);
+        gravity_out_write("| ", 2);
+        gravity_out_int(gravity_selected_stas[i]->rssi, 4);
+        gravity_out_write(" |", 2);
         GOTOXY(27, i + 4);
         /* Stringify timestamp */
         clock_t nowTime = clock();
         unsigned long elapsed = (nowTime - gravity_selected_stas[i]->lastSeen) / CLOCKS_PER_SEC;
-        printf(" %2lds", elapsed);
+        gravity_out_char(' ');
+        gravity_out_uint(elapsed, 2);
+        gravity_out_char('s');
     }
     GOTOXY(1, gravity_sel_sta_count + 5);
-    printf("Access Points     |  dB  | Age");
+    gravity_out_str("Access Points     |  dB  | Age");
     GOTOXY(1, gravity_sel_sta_count + 6); // TODO: Look up cursor up/down commands
-    printf("------------------|------|------");
+    gravity_out_str("------------------|------|------");
     for (int i = 0; i < gravity_sel_ap_count; ++i) {
         GOTOXY(1, gravity_sel_sta_count + i + 7);
         char bssidStr[MAC_STRLEN + 1] = "";
-        mac_bytes_to_string(gravity_selected_aps[i]->espRecord.bssid, bssidStr);
-        printf("%s", bssidStr);
+        gravity_mac_format(gravity_selected_aps[i]->bssidKey, bssidStr);
+        gravity_out_str(bssidStr);
         GOTOXY(19, gravity_sel_sta_count + i + 7);
-        printf("| %4d |", gravity_selected_aps[i]->espRecord.rssi);
+        gravity_out_write("| ", 2);
+        gravity_out_int(gravity_selected_aps[i]->espRecord.rssi, 4);
+        gravity_out_write(" |", 2);
         GOTOXY(27, gravity_sel_sta_count + i + 7);
         /* Stringify timestamp */
         clock_t nowTime = clock();
         unsigned long elapsed = (nowTime - gravity_selected_aps[i]->lastSeen) / CLOCKS_PER_SEC;
-        printf(" %2lds", elapsed);
+        gravity_out_char(' ');
+        gravity_out_uint(elapsed, 2);
+        gravity_out_char('s');
     }
     #if defined(CONFIG_BT_ENABLED)
         GOTOXY(1, gravity_sel_sta_count + gravity_sel_ap_count + 8);
-        printf(" Device Name               |  dB  | Age");
+        gravity_out_str(" Device Name               |  dB  | Age");
         GOTOXY(1, gravity_sel_ap_count + gravity_sel_sta_count + 9);
-        printf("---------------------------|------|------");
+        gravity_out_str("---------------------------|------|------");
         for (int i = 0; i < gravity_sel_bt_count; ++i) {
             /* Stringify timestamp */
             clock_t nowTime = clock();
@@ -105,11 +140,18 @@ esp_err_t drawStalk() {
             memset(shortName, '\0', 26);
             strncpy(shortName, gravity_selected_bt[i]->bdName, 25);
             GOTOXY(1, gravity_sel_ap_count + gravity_sel_sta_count + 10 + i);
-            printf(" %-25s | %4ld | %2lds", shortName, gravity_selected_bt[i]->rssi, elapsed);
+            gravity_out_char(' ');
+            gravity_out_padded(shortName, 25);
+            gravity_out_write(" | ", 3);
+            gravity_out_int(gravity_selected_bt[i]->rssi, 4);
+            gravity_out_write(" | ", 3);
+            gravity_out_uint(elapsed, 2);
+            gravity_out_char('s');
         }
     #endif
     GOTOXY(1,1);
-    printf("Try to get dB up to zero:\n");
+    gravity_out_str("Try to get dB up to zero:\n");
+    gravity_out_end();
 
     return err;
 }
@@ -140,10 +182,10 @@ void stalkLoop(void *pvParameter) {
 esp_err_t stalk_frame(uint8_t *payload, wifi_pkt_rx_ctrl_t rx_ctrl) {
     esp_err_t err = ESP_OK;
 
-    uint8_t *srcAddr = &payload[BEACON_SRCADDR_OFFSET]; /* As long as we only take 6 bytes */
+    gravity_mac_t srcKey = gravity_mac_load(&payload[BEACON_SRCADDR_OFFSET]);
     /* Is srcAddr one of the selectedAPs? */
     int index = 0;
-    for ( ; index < gravity_sel_ap_count && memcmp(srcAddr, gravity_selected_aps[index]->espRecord.bssid, 6); ++index) { }
+    for ( ; index < gravity_sel_ap_count && gravity_selected_aps[index]->bssidKey != srcKey; ++index) { }
     if (index < gravity_sel_ap_count) { /* Found an AP matching current frame - update age & RSSI */
         gravity_selected_aps[index]->lastSeen = clock();
         gravity_selected_aps[index]->espRecord.rssi = rx_ctrl.rssi;
@@ -156,7 +198,7 @@ esp_err_t stalk_frame(uint8_t *payload, wifi_pkt_rx_ctrl_t rx_ctrl) {
         #endif
     } else {
         /* No matching selectedAP, is there a matching selectedSTA? */
-        for (index = 0; index < gravity_sel_sta_count && memcmp(srcAddr, gravity_selected_stas[index]->mac, 6); ++index) { }
+        for (index = 0; index < gravity_sel_sta_count && gravity_selected_stas[index]->macKey != srcKey; ++index) { }
         if (index < gravity_sel_sta_count) { /* Found a STA matching current frame - update age & RSSI */
             gravity_selected_stas[index]->lastSeen = clock();
             gravity_selected_stas[index]->rssi = rx_ctrl.rssi;
@@ -0,0 +1,231 @@
+#include "survey.h"
+#include "frames.h"
+#include <math.h>
+#include <esp_timer.h>
+
+const char *SURVEY_TAG = "survey@GRAVITY";
+
+/* Survey statistics, indexed by channel number (index 0 is unused) */
+static SurveyChannel surveyChannels[MAX_CHANNEL + 1];
+/* When the results were reset, and when surveying last started (0 while
+   stopped). Observation time is credited by the hopper as it leaves each
+   channel, through survey_dwell() */
+static int64_t surveyStart = 0;
+static int64_t surveyActiveSince = 0;
+
+/* Legacy (802.11b/g) rates indexed by rx_ctrl.rate, in units of 100kbps.
+   0x00-0x03 are long-preamble DSSS, 0x05-0x07 short-preamble DSSS and
+   0x08-0x0F OFDM */
+static const uint16_t surveyLegacyRates[16] = {
+    10, 20, 55, 110, 0, 20, 55, 110, 480, 240, 120, 60, 540, 360, 180, 90
+};
+#if !CONFIG_SOC_WIFI_HE_SUPPORT
+/* 802.11n MCS 0-7 for one spatial stream with a long guard interval, at
+   20MHz and 40MHz, in units of 100kbps */
+static const uint16_t surveyHtRates[2][8] = {
+    { 65, 130, 195, 260, 390, 520, 585, 650 },
+    { 135, 270, 405, 540, 810, 1080, 1215, 1350 }
+};
+#endif
+
+/* Estimate how long a frame occupied the medium, in microseconds, from its
+   length and rate. This includes the PHY preamble but not interframe spacing
+   or backoff, so it slightly underestimates true utilisation */
+static uint32_t survey_airtime(wifi_pkt_rx_ctrl_t *rx_ctrl) {
+    uint32_t rate;
+    uint32_t preamble;
+    #if !CONFIG_SOC_WIFI_HE_SUPPORT
+        if (rx_ctrl->sig_mode != 0) {
+            /* HT or VHT */
+            rate = surveyHtRates[rx_ctrl->cwb][rx_ctrl->mcs % 8] * (rx_ctrl->mcs / 8 + 1);
+            if (rx_ctrl->sgi) {
+                rate = rate * 10 / 9;
+            }
+            preamble = 36;
+        } else
+    #endif
+    {
+        uint8_t idx = rx_ctrl->rate & 0x0F;
+        rate = surveyLegacyRates[idx];
+        preamble = (idx <= 0x03) ? 192 : (idx <= 0x07) ? 96 : 20;
+    }
+    if (rate == 0) {
+        return preamble;
+    }
+    /* Bits / Mbps = microseconds; rate is in units of 0.1Mbps */
+    return preamble + (rx_ctrl->sig_len * 80) / rate;
+}
+
+/* Credit channel ch with the time from start to end, which Gravity spent on
+   it. Time before surveying started isn't counted */
+void survey_dwell(uint8_t ch, int64_t start, int64_t end) {
+    if (surveyActiveSince == 0 || ch < 1 || ch > MAX_CHANNEL) {
+        return;
+    }
+    if (start < surveyActiveSince) {
+        start = surveyActiveSince;
+    }
+    if (end > start) {
+        surveyChannels[ch].observedMicros += end - start;
+    }
+}
+
+/* The channel Gravity is on, and since when it has been observed there, or 0
+   if that isn't known or the survey isn't running. The hopper only credits
+   a visit when it leaves the channel */
+static uint8_t survey_current_channel(int64_t *since) {
+    uint8_t ch;
+    wifi_second_chan_t sec;
+    if (surveyActiveSince == 0 || esp_wifi_get_channel(&ch, &sec) != ESP_OK || ch < 1 || ch > MAX_CHANNEL) {
+        return 0;
+    }
+    *since = hop_dwell_start();
+    if (*since < surveyActiveSince) {
+        *since = surveyActiveSince;
+    }
+    return ch;
+}
+
+/* Estimate the number of distinct BSSIDs recorded in a channel's bitmap */
+static uint32_t survey_bssid_estimate(SurveyChannel *stats) {
+    uint32_t zeros = 0;
+    for (int i = 0; i < SURVEY_BSSID_BITS / 8; ++i) {
+        zeros += 8 - __builtin_popcount(stats->bssids[i]);
+    }
+    if (zeros == 0) {
+        /* Saturated; report the largest value we can distinguish */
+        zeros = 1;
+    }
+    return (uint32_t)(SURVEY_BSSID_BITS * logf((float)SURVEY_BSSID_BITS / zeros) + 0.5f);
+}
+
+/* Frame handler. Receives every frame while the survey is active */
+esp_err_t survey_frame(uint8_t *payload, wifi_pkt_rx_ctrl_t rx_ctrl) {
+    uint8_t ch = rx_ctrl.channel;
+    if (ch < 1 || ch > MAX_CHANNEL) {
+        return ESP_OK;
+    }
+    SurveyChannel *stats = &surveyChannels[ch];
+
+    uint8_t type = FRAME_TYPE(payload[0]);
+    if (type < GRAVITY_FRAME_TYPE_COUNT) {
+        ++stats->frames[type];
+    }
+    /* Retry bit of the second Frame Control byte */
+    if (payload[1] & 0x08) {
+        ++stats->retries;
+    }
+    stats->airtimeMicros += survey_airtime(&rx_ctrl);
+
+    if (stats->noiseCount == 0 || rx_ctrl.noise_floor < stats->noiseMin) {
+        stats->noiseMin = rx_ctrl.noise_floor;
+    }
+    stats->noiseSum += rx_ctrl.noise_floor;
+    ++stats->noiseCount;
+
+    /* Find the BSSID. Management frames carry it in Address 3; in data
+       frames its position depends on the ToDS and FromDS bits */
+    uint8_t *bssid = NULL;
+    if (rx_ctrl.sig_len >= 24) {
+        if (type == GRAVITY_FRAME_TYPE_MGMT) {
+            bssid = &payload[16];
+        } else if (type == GRAVITY_FRAME_TYPE_DATA) {
+            switch (payload[1] & 0x03) {
+                case 0x00:
+                    bssid = &payload[16];
+                    break;
+                case 0x01:          /* ToDS */
+                    bssid = &payload[4];
+                    break;
+                case 0x02:          /* FromDS */
+                    bssid = &payload[10];
+                    break;
+                default:            /* WDS - no BSSID */
+                    break;
+            }
+        }
+    }
+    if (bssid != NULL) {
+        gravity_mac_t key = gravity_mac_load(bssid);
+        if (key != GRAVITY_MAC_BROADCAST) {
+            uint32_t bit = gravity_mac_hash(key) % SURVEY_BSSID_BITS;
+            stats->bssids[bit / 8] |= (1 << (bit % 8));
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t survey_reset() {
+    memset(surveyChannels, 0, sizeof(surveyChannels));
+    surveyStart = esp_timer_get_time();
+    if (surveyActiveSince != 0) {
+        surveyActiveSince = surveyStart;
+    }
+    return ESP_OK;
+}
+
+/* Begin surveying, continuing any existing results */
+esp_err_t survey_start() {
+    if (surveyStart == 0) {
+        survey_reset();
+    }
+    if (surveyActiveSince == 0) {
+        surveyActiveSince = esp_timer_get_time();
+    }
+    return ESP_OK;
+}
+
+/* Credit the current visit, which the hopper hasn't finished, and stop */
+esp_err_t survey_stop() {
+    int64_t since;
+    uint8_t ch = survey_current_channel(&since);
+    if (ch != 0) {
+        survey_dwell(ch, since, esp_timer_get_time());
+    }
+    surveyActiveSince = 0;
+    return ESP_OK;
+}
+
+/* Display a table of survey results for each channel that has been observed */
+esp_err_t survey_report() {
+    int64_t now = esp_timer_get_time();
+    uint32_t elapsed = (surveyStart == 0) ? 0 : (now - surveyStart) / 1000000;
+
+    #ifdef CONFIG_FLIPPER
+        printf("Survey %s %lus\nCh Frm  Rt%% Air%% NF  BSS\n", (attack_status[ATTACK_SURVEY]) ? "ON" : "OFF", elapsed);
+    #else
+        ESP_LOGI(SURVEY_TAG, "Channel survey is %s; %lu seconds of data", (attack_status[ATTACK_SURVEY]) ? "running" : "stopped", elapsed);
+        printf("Channel | Mgmt    | Ctrl    | Data    | Retry %% | Airtime %% | Noise Min / Avg | BSSIDs\n");
+        printf("========|=========|=========|=========|=========|===========|=================|=======\n");
+    #endif
+    int64_t since = now;
+    uint8_t current = survey_current_channel(&since);
+    for (int i = 1; i <= MAX_CHANNEL; ++i) {
+        SurveyChannel *stats = &surveyChannels[i];
+        if (stats->noiseCount == 0) {
+            continue;
+        }
+        uint64_t observed = stats->observedMicros;
+        if (i == current && now > since) {
+            observed += now - since;
+        }
+        uint32_t retryBase = stats->frames[GRAVITY_FRAME_TYPE_MGMT] + stats->frames[GRAVITY_FRAME_TYPE_DATA];
+        uint32_t retryPct = (retryBase == 0) ? 0 : (uint64_t)stats->retries * 100 / retryBase;
+        uint32_t airtimePct = (observed == 0) ? 0 : stats->airtimeMicros * 100 / observed;
+        if (airtimePct > 100) {
+            airtimePct = 100;
+        }
+        long noiseAvg = stats->noiseSum / (int32_t)stats->noiseCount;
+        uint32_t bssids = survey_bssid_estimate(stats);
+        #ifdef CONFIG_FLIPPER
+            printf("%2d %5lu %3lu %3lu %4ld %3lu\n", i, stats->frames[0] + stats->frames[1] + stats->frames[2],
+                    retryPct, airtimePct, noiseAvg, bssids);
+        #else
+            printf("%7d | %7lu | %7lu | %7lu | %7lu | %9lu | %5d / %7ld | %6lu\n", i,
+                    stats->frames[GRAVITY_FRAME_TYPE_MGMT], stats->frames[GRAVITY_FRAME_TYPE_CTRL],
+                    stats->frames[GRAVITY_FRAME_TYPE_DATA], retryPct, airtimePct, stats->noiseMin,
+                    noiseAvg, bssids);
+        #endif
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,41 @@
+#ifndef SURVEY_H
+#define SURVEY_H
+
+#include <stdint.h>
+#include <esp_err.h>
+#include <esp_wifi_types.h>
+#include "common.h"
+#include "hop.h"
+
+/* Channel survey
+   Accumulates per-channel statistics from every received frame while
+   Gravity hops, to help choose a channel for a deployment. All counters
+   are fixed-size; nothing is allocated per frame.
+*/
+
+/* Unique BSSIDs are estimated by linear counting over a bitmap of this
+   many bits per channel. Estimates are good to within a few percent up
+   to several hundred BSSIDs */
+#define SURVEY_BSSID_BITS 512
+
+typedef struct SurveyChannel {
+    uint32_t frames[3];             /* Management, control and data frames */
+    uint32_t retries;               /* Frames with the Retry bit set */
+    uint64_t airtimeMicros;         /* Estimated time the medium was busy */
+    uint64_t observedMicros;        /* Time Gravity spent on the channel */
+    int32_t noiseSum;
+    uint32_t noiseCount;
+    int8_t noiseMin;
+    uint8_t bssids[SURVEY_BSSID_BITS / 8];
+} SurveyChannel;
+
+extern const char *SURVEY_TAG;
+
+esp_err_t survey_start();
+esp_err_t survey_stop();
+esp_err_t survey_reset();
+esp_err_t survey_report();
+esp_err_t survey_frame(uint8_t *payload, wifi_pkt_rx_ctrl_t rx_ctrl);
+void survey_dwell(uint8_t ch, int64_t start, int64_t end);
+
+#endif
@@ -1,35 +1,40 @@
 #include "sync.h"
+#include "output.h"
 
 /* Format a string to be interpreted by the client for sync purposes
    Resultant string is of the form (<item>:<value>) e.g. (4:11) to
-   represent channel 11.
+   represent channel 11. Output is buffered, and written to the console
+   once the item (or with gravity_sync_items() every item) is complete
 */
 esp_err_t gravity_sync_item(GravitySyncItem item, bool flushBuffer) {
     esp_err_t result = ESP_OK;
     esp_err_t tmpErr;
-    printf("(%d:", item);
+    gravity_out_begin();
+    gravity_out_char('(');
+    gravity_out_int(item, 0);
+    gravity_out_char(':');
     switch (item) {
         case GRAVITY_SYNC_HOP_ON:
-            printf("%d", hopStatus);
+            gravity_out_int(hopStatus, 0);
             break;
         case GRAVITY_SYNC_SSID_MIN:
-            printf("%d", SSID_LEN_MIN);
+            gravity_out_int(SSID_LEN_MIN, 0);
             break;
         case GRAVITY_SYNC_SSID_MAX:
-            printf("%d", SSID_LEN_MAX);
+            gravity_out_int(SSID_LEN_MAX, 0);
             break;
         case GRAVITY_SYNC_SSID_COUNT:
-            printf("%d", DEFAULT_SSID_COUNT);
+            gravity_out_int(DEFAULT_SSID_COUNT, 0);
             break;
         case GRAVITY_SYNC_CHANNEL:
             uint8_t channel;
             wifi_second_chan_t second;
             tmpErr = esp_wifi_get_channel(&channel, &second);
             if (tmpErr != ESP_OK) {
-                printf("ERROR");
+                gravity_out_str("ERROR");
                 result |= tmpErr;
             } else {
-                printf("%u", channel);
+                gravity_out_uint(channel, 0);
             }
             break;
         case GRAVITY_SYNC_MAC:
@@ -37,64 +42,82 @@ esp_err_t gravity_sync_item(GravitySyncItem item, bool flushBuffer) {
             char strMac[MAC_STRLEN + 1];
             tmpErr = esp_wifi_get_mac(WIFI_IF_AP, bMac);
             if (tmpErr != ESP_OK) {
-                printf("ERROR");
+                gravity_out_str("ERROR");
                 result |= tmpErr;
             } else {
                 tmpErr = mac_bytes_to_string(bMac, strMac);
                 if (tmpErr != ESP_OK) {
-                    printf("ERROR");
+                    gravity_out_str("ERROR");
                     result |= tmpErr;
                 } else {
-                    printf("%s", strMac);
+                    gravity_out_str(strMac);
                 }
             }
             break;
         case GRAVITY_SYNC_ATTACK_MILLIS:
-            printf("%ld", ATTACK_MILLIS);
+            gravity_out_int(ATTACK_MILLIS, 0);
             break;
         case GRAVITY_SYNC_MAC_RAND:
             // Broken, but *is* implemented *shrugs*
-            printf("%d", attack_status[ATTACK_RANDOMISE_MAC]);
+            gravity_out_int(attack_status[ATTACK_RANDOMISE_MAC], 0);
             break;
         case GRAVITY_SYNC_PKT_EXPIRY:
-            printf("%.0f", scanResultExpiry);
+            gravity_out_printf("%.0f", scanResultExpiry);
             break;
         case GRAVITY_SYNC_HOP_MODE:
-            printf("%d", hopMode);
+            gravity_out_int(hopMode, 0);
             break;
         case GRAVITY_SYNC_DICT_DISABLED:
-            printf("%d", scrambledWords);
+            gravity_out_int(scrambledWords, 0);
             break;
         case GRAVITY_SYNC_PURGE_STRAT:
-            printf("%d", purgeStrategy);
+            gravity_out_int(purgeStrategy, 0);
             break;
         case GRAVITY_SYNC_PURGE_RSSI_MAX:
-            printf("%ld", PURGE_MAX_RSSI);
+            gravity_out_int(PURGE_MAX_RSSI, 0);
             break;
         case GRAVITY_SYNC_PURGE_AGE_MIN:
-            printf("%d", PURGE_MIN_AGE);
+            gravity_out_int(PURGE_MIN_AGE, 0);
+            break;
+        case GRAVITY_SYNC_HOP_SCHEDULE:
+            /* Comma-separated <channel>/<millis> pairs */
+            char scheduleStr[HOP_SCHEDULE_STRLEN + 1];
+            hop_schedule_to_string(scheduleStr);
+            gravity_out_str(scheduleStr);
+            break;
+        case GRAVITY_SYNC_HOP_FOCUS:
+            /* Comma-separated channels of selected APs and STAs */
+            uint8_t focusChannels[MAX_CHANNEL];
+            uint8_t focusCount = hop_focus_channels(focusChannels);
+            for (uint8_t i = 0; i < focusCount; ++i) {
+                if (i > 0) {
+                    gravity_out_char(',');
+                }
+                gravity_out_uint(focusChannels[i], 0);
+            }
             break;
         default:
-            printf("ERROR");
+            gravity_out_str("ERROR");
             result = ESP_ERR_INVALID_ARG;
             break;
     }
-    printf(")");
-    /* Send newline and flush stdout buffer if needed */
+    gravity_out_char(')');
+    /* Send newline if needed */
     if (flushBuffer) {
-        printf("\n");
-        fflush(stdout);
+        gravity_out_char('\n');
     }
+    gravity_out_end();
     return result;
 }
 
 esp_err_t gravity_sync_items(GravitySyncItem *items, uint8_t itemCount) {
     esp_err_t result = ESP_OK;
+    gravity_out_begin();
     for (int i = 0; i < itemCount; ++i) {
         result |= gravity_sync_item(items[i], false);
     }
-    printf("\n");
-    fflush(stdout);
+    gravity_out_char('\n');
+    gravity_out_end();
     return result;
 }
 
@@ -44,6 +44,8 @@ typedef enum GravitySyncItem {
     GRAVITY_SYNC_PURGE_STRAT,
     GRAVITY_SYNC_PURGE_RSSI_MAX,
     GRAVITY_SYNC_PURGE_AGE_MIN,
+    GRAVITY_SYNC_HOP_SCHEDULE,
+    GRAVITY_SYNC_HOP_FOCUS,
     GRAVITY_SYNC_ITEM_COUNT
 } GravitySyncItem;
 
@@ -13,12 +13,12 @@ const char SHORT_MANA[] = "Mana attack. Usage: mana [ CLEAR ] [ VERBOSE ] [ LOUD
 const char SHORT_STALK[] = "Toggle target tracking/homing. Usage: stalk [ ON | OFF ]";
 const char SHORT_AP_DOS[] = "Denial-of-service attack on selectedAPs. Usage: ap-dos [ ON | OFF ]";
 const char SHORT_AP_CLONE[] = "Clone and attempt takeover of the specified AP.\n\tUsage: ap-clone [ ( ON | OFF ) ( OPEN | WEP | WPA )+ ]";
-const char SHORT_SCAN[] = "scan [ ( [ <ssid> ] WIFI ) | BT [ SERVICES ] |\n\t\tBLE [ PURGE ( RSSI [ <maxRSSI> ] | AGE [ <minAge> ] |\n\t\tUNNAMED | UNSELECTED | NONE )+ ] | OFF ]";
-const char SHORT_HOP[] = "Configure channel hopping. Usage: hop [ <millis> ] [ ON | OFF | DEFAULT | KILL ]\n\t\t[ SEQUENTIAL | RANDOM ]";
+const char SHORT_SCAN[] = "scan [ ( [ <ssid> ] WIFI ) | BT [ SERVICES ] |\n\t\tBLE [ SERVICES | PURGE ( RSSI [ <maxRSSI> ] | AGE [ <minAge> ] |\n\t\tUNNAMED | UNSELECTED | NONE )+ ] | OFF ]";
+const char SHORT_HOP[] = "Configure channel hopping. Usage: hop [ <millis> ] [ ON | OFF | DEFAULT | KILL ]\n\t\t[ SEQUENTIAL | RANDOM | ADAPTIVE | FOCUS ] | hop STATS [ RESET ] | hop SCHEDULE [ DEFAULT | ( <channel>[:<millis>] )+ ]";
 const char SHORT_SET[] = "Set a variable. Usage: set <variable> <value>";
 const char SHORT_GET[] = "Get a variable. Usage: get <variable>";
-const char SHORT_VIEW[] = "List available targets. Usage: view ( ( AP [ selectedSTA ] ) |\n\t\t( STA [ selectedAP ] ) | BT [ SERVICES [ SELECTED | KNOWN | UNKNOWN ] ] |\n\t\tSORT ( AGE | RSSI | SSID ) )+";
-const char SHORT_SELECT[] = "Select an element. Usage: select ( AP | STA | BT ) <elementId>+";
+const char SHORT_VIEW[] = "List available targets. Usage: view ( ( AP [ selectedSTA ] ) |\n\t\t( STA [ selectedAP ] ) | BT [ SERVICES [ SELECTED | KNOWN | UNKNOWN ] ] |\n\t\tSORT ( AGE | RSSI | SSID ) )+\n\t\t[ WHERE <pred> [ AND <pred> ]* ] [ LIMIT <n> ]\n\t\t[ OFFSET <n> ] [ COLUMNS <col>[,<col>]* ]";
+const char SHORT_SELECT[] = "Select an element. Usage: select ( AP | STA | BT ) ( <elementId>+ | [ WHERE <pred> [ AND <pred> ]* ] [ TOP <n> BY ( RSSI | AGE ) ] )";
 const char SHORT_SELECTED[] = "Display selected elements. Usage: selected ( AP | STA | BT )";
 const char SHORT_CLEAR[] = "Clear stored APs, STAs or HCIs. Usage: clear ( AP [ SELECTED ] | STA [ SELECTED ] | BT [ SERVICES | SELECTED ] | ALL )";
 const char SHORT_HANDSHAKE[] = "Toggle monitoring for encryption material. Usage handshake [ ON | OFF ]";
@@ -27,6 +27,7 @@ const char SHORT_INFO[] = "Provide help information for the specified command. U
 const char SHORT_VERSION[] = "Display esp32-Gravity version information. Usage: gravity-version";
 const char SHORT_BT_STRAT[] = "BLE Purge Strategy. Permitted values: RSSI AGE UNNAMED UNSELECTED NONE.\n\t\tAlternatively can be specified by providing a total value where\n\t\tRSSI is 1, AGE 2, UNNAMED 4, UNSELECTED 8, and NONE 16.";
 const char SHORT_PURGE[] = "Purge cached devices based on criteria. Usage: purge [ AP | STA | BT | BLE ]+\n\t\t[ RSSI [ <maxRSSI> ] | AGE [ <minAge> ] | UNNAMED | UNSELECTED | NONE ]+";
+const char SHORT_SURVEY[] = "Channel survey. Usage: survey [ ON | OFF | RESET ]";
 const char SHORT_SYNC[] = "Retrieve Gravity settings, configuration and state details for programmatic use. Usage: sync [syncItem]*";
 const char SHORT_RAW_DATA[] = "Get/Set Gravity cached data and application state details for programmatic use. Usage: raw-data [ SET <dataSpec> ]";
 
@@ -43,18 +44,19 @@ const char USAGE_MANA[] = "mana [ CLEAR ] [ VERBOSE ] [ LOUD ] [ AUTH [ NONE | W
 const char USAGE_STALK[] = "stalk [ ON | OFF ]";
 const char USAGE_AP_DOS[] = "ap-dos [ ON | OFF ]";
 const char USAGE_AP_CLONE[] = "ap-clone [ ( ON | OFF ) ( OPEN | WEP | WPA )+ ]";
-const char USAGE_SCAN[] = "scan [ ( [ <ssid> ] WIFI ) | BT [ SERVICES ] | BLE [ PURGE ( RSSI [ <maxRSSI> ] | AGE [ <minAge> ] | UNNAMED | UNSELECTED | NONE )+ ] | OFF ]";
-const char USAGE_HOP[] = "hop [ <millis> ] [ ON | OFF | DEFAULT | KILL ] [ SEQUENTIAL | RANDOM ]";
+const char USAGE_SCAN[] = "scan [ ( [ <ssid> ] WIFI ) | BT [ SERVICES ] | BLE [ SERVICES | PURGE ( RSSI [ <maxRSSI> ] | AGE [ <minAge> ] | UNNAMED | UNSELECTED | NONE )+ ] | OFF ]";
+const char USAGE_HOP[] = "hop [ <millis> ] [ ON | OFF | DEFAULT | KILL ] [ SEQUENTIAL | RANDOM | ADAPTIVE | FOCUS ] | hop STATS [ RESET ] | hop SCHEDULE [ DEFAULT | ( <channel>[:<millis>] )+ ]";
 const char USAGE_SET[] = "set <variable> <value>";
 const char USAGE_GET[] = "get <variable>";
-const char USAGE_VIEW[] = "VIEW ( ( AP [ selectedSTA ] ) | ( STA [ selectedAP ] ) | BT [ SERVICES [ SELECTED | KNOWN | UNKNOWN ] ] | SORT ( AGE | RSSI | SSID ) )+";
-char USAGE_SELECT[] = "select ( AP | STA | BT ) <id>+ sep. ~";
+const char USAGE_VIEW[] = "VIEW ( ( AP [ selectedSTA ] ) | ( STA [ selectedAP ] ) | BT [ SERVICES [ SELECTED | KNOWN | UNKNOWN ] ] | SORT ( AGE | RSSI | SSID ) )+ [ WHERE <predicate> [ AND <predicate> ]* ] [ LIMIT <n> ] [ OFFSET <n> ] [ COLUMNS <column>[,<column>]* ]";
+char USAGE_SELECT[] = "select ( AP | STA | BT ) [ WHERE <pred> [ AND <pred> ]* ] [ TOP <n> BY ( RSSI | AGE ) ] or <id>+ sep. ~";
 const char USAGE_SELECTED[] = "selected ( AP | STA | BT )";
 const char USAGE_CLEAR[] = "clear ( AP [ SELECTED ] | STA [ SELECTED ] | BT [ SERVICES | SELECTED ] | ALL )";
 const char USAGE_HANDSHAKE[] = "handshake [ ON | OFF ]";
 const char USAGE_COMMANDS[] = "Brief command summary";
 const char USAGE_INFO[] = "Command help. info <cmd>";
 const char USAGE_VERSION[] = "gravity-version";
+const char USAGE_SURVEY[] = "survey [ ON | OFF | RESET ]";
 const char USAGE_SYNC[] = "sync [syncItem]*";
 const char USAGE_RAW_DATA[] = "raw-data [ SET <dataSpec> ]";
 
@@ -0,0 +1,210 @@
+/* Tests for dual-mode Bluetooth devices: a device found by both Classic
+   discovery and BLE scanning is held in one record, with separate RSSI,
+   lastSeen and payload for each transport. Results are delivered through
+   the GAP callbacks, as the Bluetooth stack delivers them */
+
+#include "host_test.h"
+#include "../../main/bluetooth.c"
+
+static void dual_bda(uint32_t n, esp_bd_addr_t bda) {
+    bda[0] = 0x00;
+    bda[1] = 0x1A;
+    bda[2] = 0x7D;
+    bda[3] = n >> 16;
+    bda[4] = n >> 8;
+    bda[5] = n;
+}
+
+/* Deliver a Classic discovery result. name may be NULL, and eirLen 0 */
+static void dual_classic_result(esp_bd_addr_t bda, uint32_t cod, int8_t rssi, const char *name, const uint8_t *eir,
+                                uint8_t eirLen) {
+    esp_bt_gap_dev_prop_t props[4];
+    int count = 0;
+    props[count++] = (esp_bt_gap_dev_prop_t){ ESP_BT_GAP_DEV_PROP_COD, sizeof(cod), &cod };
+    props[count++] = (esp_bt_gap_dev_prop_t){ ESP_BT_GAP_DEV_PROP_RSSI, sizeof(rssi), &rssi };
+    if (name != NULL) {
+        props[count++] = (esp_bt_gap_dev_prop_t){ ESP_BT_GAP_DEV_PROP_BDNAME, strlen(name), (void *)name };
+    }
+    if (eirLen > 0) {
+        props[count++] = (esp_bt_gap_dev_prop_t){ ESP_BT_GAP_DEV_PROP_EIR, eirLen, (void *)eir };
+    }
+    esp_bt_gap_cb_param_t param = { 0 };
+    memcpy(param.disc_res.bda, bda, ESP_BD_ADDR_LEN);
+    param.disc_res.num_prop = count;
+    param.disc_res.prop = props;
+    bt_gap_cb(ESP_BT_GAP_DISC_RES_EVT, &param);
+}
+
+/* Deliver a BLE advertising report */
+static void dual_ble_report(esp_bd_addr_t bda, esp_ble_addr_type_t addrType, int rssi, const uint8_t *adv,
+                            uint8_t advLen) {
+    esp_ble_gap_cb_param_t param = { 0 };
+    param.scan_rst.search_evt = ESP_GAP_SEARCH_INQ_RES_EVT;
+    memcpy(param.scan_rst.bda, bda, ESP_BD_ADDR_LEN);
+    param.scan_rst.ble_addr_type = addrType;
+    param.scan_rst.rssi = rssi;
+    memcpy(param.scan_rst.ble_adv, adv, advLen);
+    param.scan_rst.adv_data_len = advLen;
+    esp_gap_cb(ESP_GAP_BLE_SCAN_RESULT_EVT, &param);
+}
+
+static app_gap_cb_t *dual_find(esp_bd_addr_t bda) {
+    return bt_dev_find(gravity_mac_load(bda));
+}
+
+/* EIR listing the A2DP sink service */
+static const uint8_t classicEir[] = { 3, 0x03, 0x0B, 0x11 };
+/* Advertisement with an appearance (generic headset) and a complete name */
+static const uint8_t bleAdv[] = { 3, 0x19, 0x41, 0x03, 5, 0x09, 'b', 'u', 'd', 's' };
+/* Advertisement with flags only */
+static const uint8_t bleFlags[] = { 2, 0x01, 0x06 };
+
+/* Found by Classic discovery, then advertising over BLE */
+static void test_classic_then_ble() {
+    esp_bd_addr_t bda;
+    dual_bda(1, bda);
+    dual_classic_result(bda, 0x240404, -50, "headset", classicEir, sizeof(classicEir));
+    app_gap_cb_t *dev = dual_find(bda);
+    HOST_CHECK(dev != NULL && gravity_bt_dev_count == 1);
+    HOST_CHECK(gravity_bt_dev_seen_on(dev, GRAVITY_BT_SCAN_CLASSIC_DISCOVERY));
+    HOST_CHECK(!gravity_bt_dev_seen_on(dev, GRAVITY_BT_SCAN_BLE));
+    HOST_CHECK((dev->adv.present & GRAVITY_ADV_HAS_UUID16) && dev->adv.uuid16 == 0x110B);
+
+    dual_ble_report(bda, BLE_ADDR_TYPE_PUBLIC, -70, bleAdv, sizeof(bleAdv));
+    HOST_CHECK(gravity_bt_dev_count == 1 && dual_find(bda) == dev);
+    HOST_CHECK(btDeviceSlab.inUse == 1);
+    HOST_CHECK(gravity_bt_dev_seen_on(dev, GRAVITY_BT_SCAN_CLASSIC_DISCOVERY));
+    HOST_CHECK(gravity_bt_dev_seen_on(dev, GRAVITY_BT_SCAN_BLE));
+    /* Each transport keeps its own RSSI and payload */
+    HOST_CHECK(dev->transport[GRAVITY_BT_SCAN_CLASSIC_DISCOVERY].rssi == -50);
+    HOST_CHECK(dev->transport[GRAVITY_BT_SCAN_BLE].rssi == -70);
+    HOST_CHECK(dev->rssi == -70);
+    HOST_CHECK(dev->transport[GRAVITY_BT_SCAN_CLASSIC_DISCOVERY].eir_len == sizeof(classicEir));
+    HOST_CHECK(dev->transport[GRAVITY_BT_SCAN_BLE].eir_len == sizeof(bleAdv));
+    HOST_CHECK(!memcmp(dev->transport[GRAVITY_BT_SCAN_CLASSIC_DISCOVERY].eir, classicEir, sizeof(classicEir)));
+    /* The summary comes from the BLE advertisement */
+    HOST_CHECK(dev->adv.present & GRAVITY_ADV_HAS_APPEARANCE);
+    HOST_CHECK(!(dev->adv.present & GRAVITY_ADV_HAS_UUID16));
+    /* The Class of Device survives the BLE sighting */
+    HOST_CHECK(dev->cod == 0x240404);
+
+    /* A Classic result with no RSSI doesn't disturb the BLE state */
+    bool updated[BT_PARAM_COUNT] = { false };
+    HOST_CHECK(updateDevice(updated, dev, bda, 0, -127, 0, NULL, 0, NULL, GRAVITY_BT_SCAN_CLASSIC_DISCOVERY) == ESP_OK);
+    HOST_CHECK(dev->transport[GRAVITY_BT_SCAN_BLE].rssi == -70);
+    HOST_CHECK(dev->transport[GRAVITY_BT_SCAN_BLE].eir_len == sizeof(bleAdv));
+}
+
+/* Advertising over BLE first, then found by Classic discovery. The record is
+   created as a BLE device */
+static void test_ble_then_classic() {
+    esp_bd_addr_t bda;
+    dual_bda(2, bda);
+    dual_ble_report(bda, BLE_ADDR_TYPE_PUBLIC, -60, bleAdv, sizeof(bleAdv));
+    app_gap_cb_t *dev = dual_find(bda);
+    HOST_CHECK(dev != NULL);
+    HOST_CHECK(gravity_bt_dev_seen_on(dev, GRAVITY_BT_SCAN_BLE));
+    HOST_CHECK(!gravity_bt_dev_seen_on(dev, GRAVITY_BT_SCAN_CLASSIC_DISCOVERY));
+    HOST_CHECK(dev->bdname_len == 4 && !strcmp(dev->bdName, "buds"));
+
+    uint16_t count = gravity_bt_dev_count;
+    dual_classic_result(bda, 0x240404, -45, NULL, classicEir, sizeof(classicEir));
+    HOST_CHECK(gravity_bt_dev_count == count && dual_find(bda) == dev);
+    HOST_CHECK(gravity_bt_dev_seen_on(dev, GRAVITY_BT_SCAN_CLASSIC_DISCOVERY));
+    HOST_CHECK(dev->rssi == -45);
+    HOST_CHECK(dev->transport[GRAVITY_BT_SCAN_BLE].rssi == -60);
+    /* The BLE name is kept when Classic doesn't report one */
+    HOST_CHECK(!strcmp(dev->bdName, "buds"));
+    /* The BLE advertisement is still the one summarised */
+    HOST_CHECK(dev->adv.present & GRAVITY_ADV_HAS_APPEARANCE);
+}
+
+/* A repeated advertisement is recognised and changes only the RSSI */
+static void test_repeated_advertisement() {
+    esp_bd_addr_t bda;
+    dual_bda(3, bda);
+    dual_ble_report(bda, BLE_ADDR_TYPE_PUBLIC, -80, bleFlags, sizeof(bleFlags));
+    app_gap_cb_t *dev = dual_find(bda);
+    HOST_CHECK(dev != NULL);
+    uint8_t *eir = dev->transport[GRAVITY_BT_SCAN_BLE].eir;
+    uint32_t unchanged = btAdvUnchanged;
+    dual_ble_report(bda, BLE_ADDR_TYPE_PUBLIC, -75, bleFlags, sizeof(bleFlags));
+    HOST_CHECK(btAdvUnchanged == unchanged + 1);
+    HOST_CHECK(dev->transport[GRAVITY_BT_SCAN_BLE].eir == eir);
+    HOST_CHECK(dev->transport[GRAVITY_BT_SCAN_BLE].rssi == -75);
+}
+
+/* Only BLE-only devices can have random addresses */
+static void test_random_address() {
+    esp_bd_addr_t bda;
+    dual_bda(4, bda);
+    bda[0] = 0xC4; /* Static random */
+    dual_ble_report(bda, BLE_ADDR_TYPE_RANDOM, -65, bleFlags, sizeof(bleFlags));
+    app_gap_cb_t *dev = dual_find(bda);
+    HOST_CHECK(dev != NULL && bt_dev_random_addr(dev));
+    HOST_CHECK(bt_dev_vendor(dev) == NULL);
+    dual_classic_result(bda, 0x5a020c, -55, "phone", NULL, 0);
+    HOST_CHECK(!bt_dev_random_addr(dev));
+}
+
+/* Purges only forget the purged transport; the record goes with the last one */
+static void test_purge_by_transport() {
+    esp_bd_addr_t classicOnly, bleOnly, dual;
+    dual_bda(10, classicOnly);
+    dual_bda(11, bleOnly);
+    dual_bda(12, dual);
+    dual_classic_result(classicOnly, 0x240404, -90, "speaker", NULL, 0);
+    dual_ble_report(bleOnly, BLE_ADDR_TYPE_PUBLIC, -90, bleFlags, sizeof(bleFlags));
+    dual_ble_report(dual, BLE_ADDR_TYPE_PUBLIC, -90, bleAdv, sizeof(bleAdv));
+    dual_classic_result(dual, 0x240404, -40, "earbuds", classicEir, sizeof(classicEir));
+
+    /* RSSI purges use the RSSI seen on the purged transport: the dual device's
+       strong Classic signal, its most recent, doesn't keep its weak BLE state */
+    HOST_CHECK(purgeRSSI(GRAVITY_DEV_BLE, -85) == ESP_OK);
+    app_gap_cb_t *dev = dual_find(dual);
+    HOST_CHECK(dev != NULL && !gravity_bt_dev_seen_on(dev, GRAVITY_BT_SCAN_BLE));
+    HOST_CHECK(dev->transport[GRAVITY_BT_SCAN_BLE].eir == NULL);
+    HOST_CHECK(dev->transport[GRAVITY_BT_SCAN_CLASSIC_DISCOVERY].eir_len == sizeof(classicEir));
+    HOST_CHECK((dev->adv.present & GRAVITY_ADV_HAS_UUID16) && dev->adv.uuid16 == 0x110B);
+    HOST_CHECK(dev->rssi == -40);
+    HOST_CHECK(dual_find(bleOnly) == NULL);
+    HOST_CHECK(dual_find(classicOnly) != NULL);
+
+    /* Seen again over BLE, then aged out of BLE only */
+    dual_ble_report(dual, BLE_ADDR_TYPE_PUBLIC, -60, bleAdv, sizeof(bleAdv));
+    HOST_CHECK(gravity_bt_dev_seen_on(dev, GRAVITY_BT_SCAN_BLE));
+    for (uint16_t i = 0; i < gravity_bt_dev_count; ++i) {
+        if (gravity_bt_dev_seen_on(gravity_bt_devices[i], GRAVITY_BT_SCAN_BLE)) {
+            gravity_bt_devices[i]->transport[GRAVITY_BT_SCAN_BLE].lastSeen = clock() - 60 * CLOCKS_PER_SEC;
+        }
+    }
+    HOST_CHECK(purgeAge(GRAVITY_DEV_BLE, 30) == ESP_OK);
+    HOST_CHECK(dual_find(dual) == dev && !gravity_bt_dev_seen_on(dev, GRAVITY_BT_SCAN_BLE));
+
+    /* Purging Classic removes the records that are left */
+    HOST_CHECK(purgeUnselected(GRAVITY_DEV_BT) == ESP_OK);
+    HOST_CHECK(dual_find(dual) == NULL && dual_find(classicOnly) == NULL);
+    for (uint16_t i = 0; i < gravity_bt_dev_count; ++i) {
+        HOST_CHECK(gravity_bt_devices[i]->transports != 0);
+        HOST_CHECK(bt_dev_find(gravity_bt_devices[i]->bdaKey) == gravity_bt_devices[i]);
+        HOST_CHECK(bt_dev_with_index(gravity_bt_devices[i]->index) == gravity_bt_devices[i]);
+    }
+}
+
+int main() {
+    attack_status = calloc(ATTACKS_COUNT, sizeof(bool));
+    HOST_CHECK(attack_status != NULL);
+
+    test_classic_then_ble();
+    test_ble_then_classic();
+    test_repeated_advertisement();
+    test_random_address();
+    HOST_CHECK(gravity_clear_bt() == ESP_OK);
+    test_purge_by_transport();
+
+    HOST_CHECK(gravity_clear_bt() == ESP_OK);
+    HOST_CHECK(bt_pool_bytes() == 0);
+    free(attack_status);
+    puts("bt_dual: ok");
+    return 0;
+}
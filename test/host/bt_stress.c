@@ -0,0 +1,214 @@
+/* Stress test for the Bluetooth device store: 10,000 synthetic BLE
+   advertisers are added, re-advertised, selected and purged, checking after
+   each stage that the device count, the BDA index, index lookups and the
+   selection count agree with the device array */
+
+#include "host_test.h"
+#include "../../main/bluetooth.c"
+
+#define STRESS_DEVICES 10000
+#define STRESS_UPDATE_ROUNDS 5
+#define STRESS_SELECTED 600
+#define STRESS_AGED 250
+
+static void stress_bda(uint32_t n, esp_bd_addr_t bda) {
+    bda[0] = 0xC0;
+    bda[1] = 0x11;
+    bda[2] = n >> 24;
+    bda[3] = n >> 16;
+    bda[4] = n >> 8;
+    bda[5] = n;
+}
+
+static int32_t stress_rssi() {
+    return -30 - rand() % 70;
+}
+
+/* Every device must be found by its BDA and by its index, indices must be
+   ascending, and gravity_sel_bt_count must match the selected flags */
+static void stress_check() {
+    uint16_t selected = 0;
+    for (uint16_t i = 0; i < gravity_bt_dev_count; ++i) {
+        app_gap_cb_t *dev = gravity_bt_devices[i];
+        HOST_CHECK(dev != NULL);
+        HOST_CHECK(bt_dev_find(dev->bdaKey) == dev);
+        HOST_CHECK(bt_dev_with_index(dev->index) == dev);
+        HOST_CHECK(i == 0 || gravity_bt_devices[i - 1]->index < dev->index);
+        selected += dev->selected;
+    }
+    HOST_CHECK(selected == gravity_sel_bt_count);
+}
+
+static void stress_add() {
+    for (uint32_t n = 0; n < STRESS_DEVICES; ++n) {
+        esp_bd_addr_t bda;
+        stress_bda(n, bda);
+        /* Flags AD structure followed by filler, 4 to 30 bytes long */
+        uint8_t eir[31];
+        memset(eir, n, sizeof(eir));
+        eir[0] = 2;
+        eir[1] = 0x01;
+        eir[2] = 0x06;
+        eir[3] = 0;
+        char name[12];
+        int nameLen = (n % 3 == 0) ? 0 : snprintf(name, sizeof(name), "dev%u", (unsigned)n);
+        HOST_CHECK(bt_dev_add_components(bda, name, nameLen, eir, 4 + n % 27, 0, stress_rssi(),
+                                         GRAVITY_BT_SCAN_BLE) == ESP_OK);
+    }
+    HOST_CHECK(gravity_bt_dev_count == STRESS_DEVICES);
+    HOST_CHECK(gravity_bt_devices[STRESS_DEVICES - 1]->index == STRESS_DEVICES);
+    stress_check();
+}
+
+/* Every device re-advertises, in a scattered order; one in five changes its
+   advertisement to a longer one */
+static void stress_update() {
+    for (int round = 0; round < STRESS_UPDATE_ROUNDS; ++round) {
+        for (uint32_t n = 0; n < STRESS_DEVICES; ++n) {
+            esp_bd_addr_t bda;
+            stress_bda((n * 7919) % STRESS_DEVICES, bda);
+            app_gap_cb_t *dev = bt_dev_find(gravity_mac_load(bda));
+            HOST_CHECK(dev != NULL);
+            uint8_t eir[62];
+            memset(eir, round + n, sizeof(eir));
+            bool unchanged = (n % 5 != 0);
+            uint8_t eirLen = unchanged ? dev->transport[GRAVITY_BT_SCAN_BLE].eir_len : 40;
+            uint8_t *theEir = unchanged ? dev->transport[GRAVITY_BT_SCAN_BLE].eir : eir;
+            bool updated[4];
+            HOST_CHECK(updateDevice(updated, dev, bda, 0, stress_rssi(), 0, NULL, eirLen, theEir,
+                                    GRAVITY_BT_SCAN_BLE) == ESP_OK);
+        }
+    }
+    HOST_CHECK(gravity_bt_dev_count == STRESS_DEVICES);
+    stress_check();
+}
+
+/* Select more devices than fit in a uint8_t, then deselect every other one */
+static void stress_select() {
+    for (uint16_t i = 1; i <= STRESS_SELECTED; ++i) {
+        HOST_CHECK(gravity_select_bt(i * 13) == ESP_OK);
+    }
+    HOST_CHECK(gravity_sel_bt_count == STRESS_SELECTED);
+    stress_check();
+    for (uint16_t i = 1; i <= STRESS_SELECTED; i += 2) {
+        HOST_CHECK(gravity_select_bt(i * 13) == ESP_OK);
+    }
+    HOST_CHECK(gravity_sel_bt_count == STRESS_SELECTED / 2);
+    HOST_CHECK(gravity_bt_isSelected(26) && !gravity_bt_isSelected(13));
+    stress_check();
+}
+
+static void stress_purge() {
+    /* Age: make some unselected devices look long unseen */
+    clock_t old = clock() - 10 * CLOCKS_PER_SEC;
+    uint16_t aged = 0;
+    for (uint16_t i = 0; i < gravity_bt_dev_count && aged < STRESS_AGED; ++i) {
+        if (!gravity_bt_devices[i]->selected) {
+            gravity_bt_devices[i]->transport[GRAVITY_BT_SCAN_BLE].lastSeen = old;
+            ++aged;
+        }
+    }
+    uint16_t before = gravity_bt_dev_count;
+    HOST_CHECK(purgeAge(GRAVITY_DEV_BLE, 5) == ESP_OK);
+    HOST_CHECK(gravity_bt_dev_count == before - STRESS_AGED);
+    HOST_CHECK(gravity_sel_bt_count == STRESS_SELECTED / 2);
+    stress_check();
+    HOST_CHECK(purgeAge(GRAVITY_DEV_BLE, 5) == ESP_ERR_NOT_FOUND);
+
+    /* RSSI: each pass removes the weakest devices weaker than -40 */
+    before = gravity_bt_dev_count;
+    HOST_CHECK(purgeRSSI(GRAVITY_DEV_BLE, -40) == ESP_OK);
+    HOST_CHECK(gravity_bt_dev_count < before);
+    stress_check();
+    for (int pass = 0; pass < 20; ++pass) {
+        purgeRSSI(GRAVITY_DEV_BLE, -40);
+        stress_check();
+    }
+    printf("RSSI purges removed %u devices\n", (unsigned)(before - gravity_bt_dev_count));
+
+    /* Unnamed, then everything that isn't selected */
+    HOST_CHECK(purgeUnnamed(GRAVITY_DEV_BLE) == ESP_OK);
+    stress_check();
+    for (uint16_t i = 0; i < gravity_bt_dev_count; ++i) {
+        HOST_CHECK(gravity_bt_devices[i]->bdname_len > 0 || gravity_bt_devices[i]->selected);
+    }
+    HOST_CHECK(purgeUnselected(GRAVITY_DEV_BLE) == ESP_OK);
+    stress_check();
+    HOST_CHECK(gravity_bt_dev_count == gravity_sel_bt_count);
+    printf("%u devices remain, all selected\n", (unsigned)gravity_bt_dev_count);
+}
+
+/* A sorted VIEW lists the devices in RSSI order without reordering
+   gravity_bt_devices, which must stay in index order */
+static void stress_sorted_view() {
+    static char output[256 * 1024];
+    char *argv[] = { "view", "BT", "SORT", "RSSI" };
+    host_capture_begin();
+    HOST_CHECK(cmd_view(4, argv) == ESP_OK);
+    host_capture_end(output, sizeof(output));
+    sortCount = 0;
+    stress_check();
+
+    int rows = 0;
+    int lastRssi = INT32_MIN;
+    const char *line = strchr(strchr(output, '\n') + 1, '\n') + 1;
+    for (; *line != '\0'; line = strchr(line, '\n') + 1) {
+        int index;
+        int rssi;
+        HOST_CHECK(sscanf(line + 1, "%d | %d", &index, &rssi) == 2);
+        HOST_CHECK(bt_dev_with_index(index) != NULL && bt_dev_with_index(index)->rssi == rssi);
+        HOST_CHECK(rssi >= lastRssi);
+        lastRssi = rssi;
+        ++rows;
+    }
+    HOST_CHECK(rows == gravity_bt_dev_count);
+}
+
+/* Indices continue upward after a purge, and are renumbered from 1 when
+   they would exceed GRAVITY_BT_MAX_DEVICES */
+static void stress_renumber() {
+    uint16_t last = gravity_bt_devices[gravity_bt_dev_count - 1]->index;
+    for (uint32_t n = STRESS_DEVICES; n < STRESS_DEVICES + 5000; ++n) {
+        esp_bd_addr_t bda;
+        stress_bda(n, bda);
+        HOST_CHECK(bt_dev_add_components(bda, NULL, 0, NULL, 0, 0, -60, GRAVITY_BT_SCAN_BLE) == ESP_OK);
+    }
+    stress_check();
+    HOST_CHECK(gravity_bt_devices[gravity_bt_dev_count - 1]->index == last + 5000);
+
+    gravity_bt_devices[gravity_bt_dev_count - 1]->index = GRAVITY_BT_MAX_DEVICES;
+    esp_bd_addr_t bda;
+    stress_bda(STRESS_DEVICES * 100, bda);
+    HOST_CHECK(bt_dev_add_components(bda, NULL, 0, NULL, 0, 0, -60, GRAVITY_BT_SCAN_BLE) == ESP_OK);
+    stress_check();
+    HOST_CHECK(gravity_bt_devices[gravity_bt_dev_count - 1]->index == gravity_bt_dev_count);
+}
+
+int main() {
+    srand(42);
+
+    clock_t start = clock();
+    stress_add();
+    double addMs = host_elapsed_ms(start);
+    size_t poolBytes = bt_pool_bytes();
+    printf("%d devices: pool %zu bytes, %.1f devices/KB (host struct layout)\n", STRESS_DEVICES, poolBytes,
+           STRESS_DEVICES * 1024.0 / poolBytes);
+
+    start = clock();
+    stress_update();
+    double updateMs = host_elapsed_ms(start);
+
+    start = clock();
+    stress_select();
+    stress_purge();
+    stress_sorted_view();
+    stress_renumber();
+    printf("add %.1f ms, %d updates %.1f ms, select/purge/renumber %.1f ms\n", addMs,
+           STRESS_DEVICES * STRESS_UPDATE_ROUNDS, updateMs, host_elapsed_ms(start));
+
+    HOST_CHECK(gravity_clear_bt() == ESP_OK);
+    HOST_CHECK(gravity_bt_dev_count == 0 && gravity_sel_bt_count == 0);
+    HOST_CHECK(bt_pool_bytes() == 0);
+    puts("bt_stress: ok");
+    return 0;
+}
@@ -0,0 +1,117 @@
+/* Tests for the radio scheduler's airtime measurement. WiFi and BLE scans
+   share the radio under simulated time, and BLE and Bluetooth Classic events
+   are delivered through bluetooth.c's callbacks as the stack delivers them.
+   BLE takes COEX_BLE_START_MILLIS to start scanning after each resume, so
+   the airtime it achieves is less than it was scheduled */
+
+#include "host_test.h"
+#include "../../main/coex.c"
+#include "../../main/bluetooth.c"
+
+#define COEX_PERIODS 10
+#define COEX_BLE_START_MILLIS 200
+/* Slices of CONFIG_COEX_PERIOD_MILLIS for weights 2:1:1 */
+#define COEX_WIFI_SLICE_MILLIS 2666
+#define COEX_BLE_SLICE_MILLIS 1333
+
+static void coex_advance(int64_t millis) {
+    hostTimeUs += millis * 1000;
+}
+
+static void coex_ble_event(esp_gap_ble_cb_event_t event) {
+    esp_ble_gap_cb_param_t param;
+    memset(&param, 0, sizeof(param));
+    param.scan_start_cmpl.status = ESP_BT_STATUS_SUCCESS;
+    param.scan_stop_cmpl.status = ESP_BT_STATUS_SUCCESS;
+    esp_gap_cb(event, &param);
+}
+
+static void coex_classic_event(esp_bt_gap_discovery_state_t state) {
+    esp_bt_gap_cb_param_t param;
+    memset(&param, 0, sizeof(param));
+    param.disc_st_chg.state = state;
+    bt_gap_cb(ESP_BT_GAP_DISC_STATE_CHANGED_EVT, &param);
+}
+
+static void test_wifi_ble() {
+    /* Promiscuous mode is enabled at startup */
+    gravity_coex_record_airtime(GRAVITY_COEX_WIFI, true);
+    attack_status[ATTACK_SCAN] = true;
+    attack_status[ATTACK_SCAN_BLE] = true;
+    HOST_CHECK(gravity_coex_refresh() == ESP_OK);
+    HOST_CHECK(coexRunning && coexCurrent == GRAVITY_COEX_WIFI && coexPaused[GRAVITY_COEX_BLE]);
+
+    for (int i = 0; i < COEX_PERIODS; ++i) {
+        coex_advance(COEX_WIFI_SLICE_MILLIS);
+        HOST_CHECK(host_timer_fire(coexTimer));
+        HOST_CHECK(coexCurrent == GRAVITY_COEX_BLE && coexPaused[GRAVITY_COEX_WIFI]);
+        coex_advance(COEX_BLE_START_MILLIS);
+        coex_ble_event(ESP_GAP_BLE_SCAN_START_COMPLETE_EVT);
+        coex_advance(COEX_BLE_SLICE_MILLIS - COEX_BLE_START_MILLIS);
+        HOST_CHECK(host_timer_fire(coexTimer));
+        coex_ble_event(ESP_GAP_BLE_SCAN_STOP_COMPLETE_EVT);
+    }
+
+    /* Scheduled slices are credited in full; airtime only once scanning */
+    HOST_CHECK(coexScheduledMicros[GRAVITY_COEX_BLE] == (COEX_PERIODS * COEX_BLE_SLICE_MILLIS) * 1000ULL);
+    HOST_CHECK(coexAirMicros[GRAVITY_COEX_BLE] ==
+               (COEX_PERIODS * (COEX_BLE_SLICE_MILLIS - COEX_BLE_START_MILLIS)) * 1000ULL);
+    HOST_CHECK(coexAirMicros[GRAVITY_COEX_WIFI] == (COEX_PERIODS * COEX_WIFI_SLICE_MILLIS) * 1000ULL);
+    HOST_CHECK(coexAirOn[GRAVITY_COEX_WIFI] && !coexAirOn[GRAVITY_COEX_BLE]);
+
+    /* Stopping the BLE scan stops the scheduler and freezes the statistics */
+    coex_advance(1000);
+    attack_status[ATTACK_SCAN_BLE] = false;
+    HOST_CHECK(gravity_coex_refresh() == ESP_OK);
+    HOST_CHECK(!coexRunning && !coexPaused[GRAVITY_COEX_WIFI]);
+    uint64_t wifiMicros = coexAirMicros[GRAVITY_COEX_WIFI];
+    HOST_CHECK(wifiMicros == (COEX_PERIODS * COEX_WIFI_SLICE_MILLIS + 1000) * 1000ULL);
+    coex_advance(5000);
+    coex_ble_event(ESP_GAP_BLE_SCAN_START_COMPLETE_EVT);
+    coex_advance(5000);
+    coex_ble_event(ESP_GAP_BLE_SCAN_STOP_COMPLETE_EVT);
+    HOST_CHECK(coexAirMicros[GRAVITY_COEX_WIFI] == wifiMicros);
+    HOST_CHECK(coexAirMicros[GRAVITY_COEX_BLE] ==
+               (COEX_PERIODS * (COEX_BLE_SLICE_MILLIS - COEX_BLE_START_MILLIS)) * 1000ULL);
+    HOST_CHECK(coexStatsEnd - coexStatsStart == (COEX_PERIODS * (COEX_WIFI_SLICE_MILLIS + COEX_BLE_SLICE_MILLIS) +
+                                                 1000) * 1000LL);
+    HOST_CHECK(gravity_coex_report() == ESP_OK);
+    attack_status[ATTACK_SCAN] = false;
+}
+
+/* Classic discovery is measured from its state changes, and a restart
+   starts counting afresh */
+static void test_classic() {
+    attack_status[ATTACK_SCAN] = true;
+    attack_status[ATTACK_SCAN_BT_DISCOVERY] = true;
+    HOST_CHECK(gravity_coex_refresh() == ESP_OK);
+    HOST_CHECK(coexRunning && coexAirMicros[GRAVITY_COEX_WIFI] == 0);
+    coex_advance(COEX_WIFI_SLICE_MILLIS);
+    HOST_CHECK(host_timer_fire(coexTimer));
+    HOST_CHECK(coexCurrent == GRAVITY_COEX_BT_CLASSIC);
+    coex_advance(100);
+    coex_classic_event(ESP_BT_GAP_DISCOVERY_STARTED);
+    coex_advance(500);
+    coex_classic_event(ESP_BT_GAP_DISCOVERY_STOPPED);
+    HOST_CHECK(coexAirMicros[GRAVITY_COEX_BT_CLASSIC] == 500000);
+    HOST_CHECK(coexAirMicros[GRAVITY_COEX_WIFI] == COEX_WIFI_SLICE_MILLIS * 1000ULL);
+
+    attack_status[ATTACK_SCAN_BT_DISCOVERY] = false;
+    HOST_CHECK(gravity_coex_refresh() == ESP_OK);
+    HOST_CHECK(!coexRunning && coexAirOn[GRAVITY_COEX_WIFI]);
+    attack_status[ATTACK_SCAN] = false;
+}
+
+int main() {
+    attack_status = calloc(ATTACKS_COUNT, sizeof(bool));
+    HOST_CHECK(attack_status != NULL);
+    hostTimeUs = 1000000;
+    /* Channel hopping's defaults are only set up by the app */
+    hopStatus = HOP_STATUS_OFF;
+
+    test_wifi_ble();
+    test_classic();
+    free(attack_status);
+    puts("coex_airtime: ok");
+    return 0;
+}
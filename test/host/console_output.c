@@ -0,0 +1,245 @@
+/* Tests and a benchmark for the buffered console writer. The formatters are
+   checked against printf, and the AP list is checked byte for byte against
+   a printf renderer in the style it replaced, then both are timed printing
+   1,000 rows */
+
+#include "host_test.h"
+#include "../../main/output.c"
+#include "../../main/common.h"
+#include "../../main/oui.h"
+#include "../../main/scan.h"
+
+#include <fcntl.h>
+
+#define OUTPUT_ROWS 1000
+#define OUTPUT_REPEATS 20
+#define OUTPUT_LEN (512 * 1024)
+
+static char outputA[OUTPUT_LEN];
+static char outputB[OUTPUT_LEN];
+
+/* Milliseconds of wall-clock time since start, from CLOCK_MONOTONIC */
+static double output_wall_ms(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static void test_format() {
+    int32_t values[] = { 0, 1, -1, 9, 10, -99, 12345, INT32_MIN, INT32_MAX };
+    char str[32];
+    char expected[32];
+    for (int i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+        for (int width = 0; width < 14; ++width) {
+            snprintf(expected, sizeof(expected), "%*ld", width, (long)values[i]);
+            HOST_CHECK(gravity_format_int(str, values[i], width) == strlen(expected));
+            HOST_CHECK(!strcmp(str, expected));
+        }
+    }
+    uint32_t unsignedValues[] = { 0, 7, 10, 65535, UINT32_MAX };
+    for (int i = 0; i < sizeof(unsignedValues) / sizeof(unsignedValues[0]); ++i) {
+        snprintf(expected, sizeof(expected), "%lu", (unsigned long)unsignedValues[i]);
+        HOST_CHECK(gravity_format_uint(str, unsignedValues[i]) == strlen(expected));
+        HOST_CHECK(!strcmp(str, expected));
+    }
+}
+
+/* Output that doesn't fit in the buffer: long strings, repeats and
+   printf, which must come out intact and in order */
+static void output_misc() {
+    static char big[10000];
+    memset(big, 'z', sizeof(big) - 1);
+    gravity_out_begin();
+    gravity_out_hex(0xab, 2);
+    gravity_out_hex(0x5, 2);
+    gravity_out_hex(0, 1);
+    gravity_out_hex(0xdeadbeef, 2);
+    gravity_out_printf("|%.0f|%s", 12.6, "x");
+    gravity_out_int(INT32_MIN, 0);
+    gravity_out_uint(UINT32_MAX, 12);
+    gravity_out_padded("ab", 4);
+    gravity_out_padded("abc", 4);
+    gravity_out_padded("abcd", 4);
+    gravity_out_padded("abcdef", 4);
+    gravity_out_printf("%s", big);
+    gravity_out_str(big);
+    gravity_out_repeat('-', 5000);
+    gravity_out_end();
+}
+
+static void test_misc() {
+    host_capture_begin();
+    output_misc();
+    host_capture_end(outputA, sizeof(outputA));
+    int len = snprintf(outputB, sizeof(outputB), "ab050deadbeef|13|x%ld%12lu%-4s%-4s%-4s%-4s",
+                       (long)INT32_MIN, (unsigned long)UINT32_MAX, "ab", "abc", "abcd", "abcdef");
+    memset(&outputB[len], 'z', 9999 * 2);
+    len += 9999 * 2;
+    memset(&outputB[len], '-', 5000);
+    outputB[len + 5000] = '\0';
+    HOST_CHECK(!strcmp(outputA, outputB));
+}
+
+/* Nested renderers are written out by the outermost gravity_out_end() */
+static void test_nesting() {
+    host_capture_begin();
+    gravity_out_begin();
+    gravity_out_str("outer ");
+    gravity_out_begin();
+    gravity_out_str("inner ");
+    gravity_out_end();
+    HOST_CHECK(outLen == 12);
+    gravity_out_str("done\n");
+    gravity_out_end();
+    HOST_CHECK(outLen == 0 && outDepth == 0);
+    host_capture_end(outputA, sizeof(outputA));
+    HOST_CHECK(!strcmp(outputA, "outer inner done\n"));
+}
+
+/* 1,000 APs with a mix of hidden SSIDs, known vendors, ages and WPS */
+static void output_populate() {
+    gravity_ap_count = OUTPUT_ROWS;
+    gravity_aps = calloc(OUTPUT_ROWS, sizeof(ScanResultAP));
+    HOST_CHECK(gravity_aps != NULL);
+    clock_t now = clock();
+    for (int i = 0; i < OUTPUT_ROWS; ++i) {
+        ScanResultAP *ap = &gravity_aps[i];
+        uint8_t bssid[6] = { 0x02, 0xCC, 0, 0, i >> 8, i };
+        if (i % 3 == 0) {
+            bssid[0] = 0x00;
+            bssid[1] = 0x03;
+            bssid[2] = 0x93;
+        }
+        memcpy(ap->espRecord.bssid, bssid, 6);
+        ap->bssidKey = gravity_mac_load(bssid);
+        if (i % 10 != 0) {
+            snprintf((char *)ap->espRecord.ssid, sizeof(ap->espRecord.ssid), "Network %d", i);
+        }
+        ap->espRecord.rssi = -30 - i % 70;
+        ap->espRecord.primary = 1 + i % 13;
+        ap->espRecord.wps = i & 1;
+        ap->index = i + 1;
+        ap->selected = (i % 7 == 0);
+        ap->stationCount = i % 12;
+        ap->lastSeen = now - (clock_t)(i % 4) * 3000 * CLOCKS_PER_SEC;
+    }
+}
+
+/* The AP list rendered a row per printf, with the age built by sprintf,
+   as it was before the buffered writer. The Vendor column has been added
+   to match the current layout */
+static void output_list_ap_printf(ScanResultAP **aps, int apCount) {
+    printf(" ID | RSSI | SSID                             | BSSID             | Vendor               | Cli | Last Seen                | Ch | WPS \n");
+    printf("====|======|==================================|===================|======================|=====|==========================|====|=====\n");
+    char strBssid[MAC_STRLEN + 1];
+    char strTime[26];
+    char strSsid[36];
+    for (int i = 0; i < apCount; ++i) {
+        mac_bytes_to_string(aps[i]->espRecord.bssid, strBssid);
+        unsigned long elapsed = (clock() - aps[i]->lastSeen) / CLOCKS_PER_SEC;
+        #ifdef CONFIG_DISPLAY_FRIENDLY_AGE
+            if (elapsed < 60.0) {
+                strcpy(strTime, "Under a minute ago");
+            } else if (elapsed < 3600.0) {
+                sprintf(strTime, "%d %s ago", (int)elapsed/60, (elapsed >= 120)?"minutes":"minute");
+            } else {
+                sprintf(strTime, "%d %s ago", (int)elapsed/3600, (elapsed >= 7200)?"hours":"hour");
+            }
+        #else
+            char strTmp[16] = "";
+            unsigned long tmp = elapsed;
+            strcpy(strTime, "");
+            if (tmp >= 3600.0) {
+                sprintf(strTmp, "%2dh ", (int)tmp/3600);
+                strcat(strTime, strTmp);
+                tmp = tmp % 3600;
+            }
+            if (tmp >= 60) {
+                sprintf(strTmp, "%2dm ", (int)tmp/60);
+                strcat(strTime, strTmp);
+                tmp = tmp % 60;
+            }
+            sprintf(strTmp, "%2lds", tmp);
+            strcat(strTime, strTmp);
+        #endif
+        if (aps[i]->espRecord.ssid[0] == '\0') {
+            strcpy(strSsid, "<hidden>");
+        } else {
+            strcpy(strSsid, (char *)aps[i]->espRecord.ssid);
+        }
+        printf("%s%2d | %4d | %-32s | %-17s | %-20s | %3d | %-24s | %2u | %s\n", (aps[i]->selected)?"*":" ",
+                aps[i]->index, aps[i]->espRecord.rssi, strSsid, strBssid,
+                gravity_oui_vendor_display(aps[i]->bssidKey), aps[i]->stationCount, strTime,
+                aps[i]->espRecord.primary, (aps[i]->espRecord.wps<<5 != 0)?"Yes":"No");
+    }
+}
+
+/* Both renderers print the same bytes */
+static void test_rows(ScanResultAP **aps) {
+    host_capture_begin();
+    output_list_ap_printf(aps, OUTPUT_ROWS);
+    host_capture_end(outputA, sizeof(outputA));
+    host_capture_begin();
+    HOST_CHECK(gravity_list_ap(aps, OUTPUT_ROWS, false, NULL) == ESP_OK);
+    host_capture_end(outputB, sizeof(outputB));
+    HOST_CHECK(host_line_count(outputA) == 2 + OUTPUT_ROWS);
+    HOST_CHECK(!strcmp(outputA, outputB));
+    HOST_CHECK(strstr(outputB, "<hidden>") != NULL && strstr(outputB, "Apple") != NULL);
+    HOST_CHECK(strstr(outputB, "1 hour ago") != NULL && strstr(outputB, "50 minutes ago") != NULL);
+}
+
+/* Best of OUTPUT_REPEATS runs of each renderer, writing to /dev/null with
+   stdout line buffered as it is on a console. The buffered writer makes a
+   driver write per CONFIG_CONSOLE_OUTPUT_BUFFER bytes instead of one per
+   line */
+static void test_timing(ScanResultAP **aps) {
+    size_t bytes = strlen(outputB);
+    int devNull = open("/dev/null", O_WRONLY);
+    HOST_CHECK(devNull >= 0);
+    fflush(stdout);
+    int savedStdout = dup(STDOUT_FILENO);
+    dup2(devNull, STDOUT_FILENO);
+    setvbuf(stdout, NULL, _IOLBF, BUFSIZ);
+
+    double printfMs = 1e9;
+    double bufferedMs = 1e9;
+    for (int repeat = 0; repeat < OUTPUT_REPEATS; ++repeat) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        output_list_ap_printf(aps, OUTPUT_ROWS);
+        fflush(stdout);
+        double elapsed = output_wall_ms(&start);
+        printfMs = (elapsed < printfMs) ? elapsed : printfMs;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        gravity_list_ap(aps, OUTPUT_ROWS, false, NULL);
+        elapsed = output_wall_ms(&start);
+        bufferedMs = (elapsed < bufferedMs) ? elapsed : bufferedMs;
+    }
+    fflush(stdout);
+    dup2(savedStdout, STDOUT_FILENO);
+    close(savedStdout);
+    close(devNull);
+
+    printf("%d rows, %zu bytes: printf %.3f ms (%d writes), buffered %.3f ms (%zu writes)\n", OUTPUT_ROWS, bytes,
+           printfMs, 2 + OUTPUT_ROWS, bufferedMs, (bytes + OUT_BUFFER_LEN - 1) / OUT_BUFFER_LEN);
+}
+
+int main() {
+    gravity_out_init();
+    test_format();
+    test_misc();
+    test_nesting();
+
+    output_populate();
+    ScanResultAP **aps = malloc(sizeof(ScanResultAP *) * OUTPUT_ROWS);
+    HOST_CHECK(aps != NULL);
+    for (int i = 0; i < OUTPUT_ROWS; ++i) {
+        aps[i] = &gravity_aps[i];
+    }
+    test_rows(aps);
+    test_timing(aps);
+    free(aps);
+    puts("console_output: ok");
+    return 0;
+}
@@ -0,0 +1,555 @@
+/* Host implementations of the ESP-IDF and FreeRTOS functions declared in
+   stubs/. Radio and task APIs succeed without doing anything; the rest
+   behave enough like the real thing for the code under test */
+
+#include "host_test.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <cmd_system.h>
+#include <cmd_wifi.h>
+#include <esp_bt.h>
+#include <esp_bt_device.h>
+#include <esp_bt_main.h>
+#include <esp_console.h>
+#include <esp_cpu.h>
+#include <esp_gap_ble_api.h>
+#include <esp_gap_bt_api.h>
+#include <esp_gatt_common_api.h>
+#include <esp_gattc_api.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_vfs_fat.h>
+#include <esp_wifi.h>
+#include <freertos/task.h>
+#include <nvs_flash.h>
+
+size_t hostHeapFree = 64 * 1024 * 1024;
+int64_t hostTimeUs = -1;
+HostGattcCalls hostGattc;
+
+const char *esp_err_to_name(esp_err_t code) {
+    static char name[16];
+    snprintf(name, sizeof(name), "ERR_0x%x", code);
+    return name;
+}
+
+void esp_log_buffer_hex(const char *tag, const void *buffer, uint16_t length) {
+    (void)tag;
+    (void)buffer;
+    (void)length;
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level) {
+    (void)tag;
+    (void)level;
+}
+
+/* Start-up: app_main() isn't run on the host, but gravity.c must link */
+
+esp_err_t nvs_flash_init(void) {
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void) {
+    return ESP_OK;
+}
+
+esp_err_t esp_vfs_fat_spiflash_mount_rw_wl(const char *base_path, const char *partition_label,
+                                           const esp_vfs_fat_mount_config_t *mount_config, wl_handle_t *wl_handle) {
+    (void)base_path;
+    (void)partition_label;
+    (void)mount_config;
+    (void)wl_handle;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_netif_init(void) {
+    return ESP_OK;
+}
+
+esp_err_t esp_event_loop_create_default(void) {
+    return ESP_OK;
+}
+
+esp_netif_t *esp_netif_create_default_wifi_ap(void) {
+    return NULL;
+}
+
+esp_err_t esp_console_cmd_register(const esp_console_cmd_t *cmd) {
+    (void)cmd;
+    return ESP_OK;
+}
+
+esp_err_t esp_console_register_help_command(void) {
+    return ESP_OK;
+}
+
+esp_err_t esp_console_new_repl_uart(const esp_console_dev_uart_config_t *dev_config,
+                                    const esp_console_repl_config_t *repl_config, esp_console_repl_t **ret_repl) {
+    (void)dev_config;
+    (void)repl_config;
+    *ret_repl = NULL;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_console_start_repl(esp_console_repl_t *repl) {
+    (void)repl;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+void register_system(void) {
+}
+
+void register_wifi(void) {
+}
+
+/* Memory */
+
+void *heap_caps_malloc(size_t size, uint32_t caps) {
+    (void)caps;
+    return malloc(size);
+}
+
+void *heap_caps_aligned_alloc(size_t alignment, size_t size, uint32_t caps) {
+    (void)caps;
+    return aligned_alloc(alignment, size);
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+    (void)caps;
+    return hostHeapFree;
+}
+
+/* Time */
+
+int64_t esp_timer_get_time(void) {
+    if (hostTimeUs >= 0) {
+        return hostTimeUs;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+uint32_t esp_cpu_get_cycle_count(void) {
+    return (uint32_t)(esp_timer_get_time() * 240);
+}
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void *arg;
+    bool active;
+};
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle) {
+    *handle = calloc(1, sizeof(struct esp_timer));
+    if (*handle == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    (*handle)->callback = args->callback;
+    (*handle)->arg = args->arg;
+    return ESP_OK;
+}
+
+bool host_timer_fire(esp_timer_handle_t timer) {
+    if (timer == NULL || !timer->active) {
+        return false;
+    }
+    timer->callback(timer->arg);
+    return true;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    (void)timeout_us;
+    timer->active = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) {
+    (void)period;
+    timer->active = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    if (!timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->active = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    free(timer);
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer) {
+    return timer->active;
+}
+
+/* Tasks. Nothing is scheduled; tests drive the code directly */
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *param, UBaseType_t priority,
+                       TaskHandle_t *handle) {
+    (void)fn;
+    (void)name;
+    (void)stack;
+    (void)param;
+    (void)priority;
+    if (handle != NULL) {
+        *handle = (TaskHandle_t)fn;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    (void)task;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    (void)ticks;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    (void)task;
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks) {
+    (void)clear;
+    (void)ticks;
+    return 0;
+}
+
+/* Wi-Fi */
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config) {
+    (void)config;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_storage(wifi_storage_t storage) {
+    (void)storage;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode) {
+    (void)mode;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf) {
+    (void)interface;
+    (void)conf;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_country(const wifi_country_t *country) {
+    (void)country;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void) {
+    return ESP_OK;
+}
+
+static uint8_t hostChannel = 1;
+static uint8_t hostMac[2][6] = { { 0x24, 0x0a, 0xc4, 0x00, 0x00, 0x01 }, { 0x24, 0x0a, 0xc4, 0x00, 0x00, 0x02 } };
+
+esp_err_t esp_wifi_get_channel(uint8_t *primary, wifi_second_chan_t *second) {
+    *primary = hostChannel;
+    if (second != NULL) {
+        *second = WIFI_SECOND_CHAN_NONE;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_channel(uint8_t primary, wifi_second_chan_t second) {
+    (void)second;
+    hostChannel = primary;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_mac(wifi_interface_t ifx, uint8_t mac[6]) {
+    memcpy(mac, hostMac[ifx == WIFI_IF_AP], 6);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mac(wifi_interface_t ifx, const uint8_t mac[6]) {
+    memcpy(hostMac[ifx == WIFI_IF_AP], mac, 6);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_80211_tx(wifi_interface_t ifx, const void *buffer, int len, bool en_sys_seq) {
+    (void)ifx;
+    (void)buffer;
+    (void)len;
+    (void)en_sys_seq;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_promiscuous(bool en) {
+    (void)en;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_promiscuous_filter(const wifi_promiscuous_filter_t *filter) {
+    (void)filter;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_promiscuous_ctrl_filter(const wifi_promiscuous_filter_t *filter) {
+    (void)filter;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_promiscuous_rx_cb(wifi_promiscuous_cb_t cb) {
+    (void)cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type) {
+    (void)type;
+    return ESP_OK;
+}
+
+/* Bluetooth controller and GAP */
+
+/* Find the AD structure of type in data, a sequence of length-type-value
+   structures as used by both BLE advertisements and Classic EIR */
+static uint8_t *host_resolve_ad(uint8_t *data, size_t dataLen, uint8_t type, uint8_t *length) {
+    size_t i = 0;
+    while (data != NULL && i + 1 < dataLen && data[i] != 0) {
+        uint8_t len = data[i];
+        if (i + 1 + len > dataLen) {
+            break;
+        }
+        if (data[i + 1] == type) {
+            *length = len - 1;
+            return &data[i + 2];
+        }
+        i += 1 + len;
+    }
+    *length = 0;
+    return NULL;
+}
+
+uint8_t *esp_ble_resolve_adv_data(uint8_t *adv_data, uint8_t type, uint8_t *length) {
+    return host_resolve_ad(adv_data, ESP_BLE_ADV_DATA_LEN_MAX + ESP_BLE_SCAN_RSP_DATA_LEN_MAX, type, length);
+}
+
+uint8_t *esp_bt_gap_resolve_eir_data(uint8_t *eir, esp_bt_eir_type_t type, uint8_t *length) {
+    return host_resolve_ad(eir, ESP_BT_GAP_EIR_DATA_LEN, type, length);
+}
+
+uint32_t esp_bt_gap_get_cod_major_dev(uint32_t cod) {
+    return (cod >> 8) & 0x1f;
+}
+
+bool esp_bt_gap_is_valid_cod(uint32_t cod) {
+    return (cod & 0x3) == 0;
+}
+
+esp_err_t esp_bt_controller_init(esp_bt_controller_config_t *cfg) {
+    (void)cfg;
+    return ESP_OK;
+}
+
+esp_err_t esp_bt_controller_enable(esp_bt_mode_t mode) {
+    (void)mode;
+    return ESP_OK;
+}
+
+esp_err_t esp_bt_controller_mem_release(esp_bt_mode_t mode) {
+    (void)mode;
+    return ESP_OK;
+}
+
+esp_err_t esp_bt_dev_set_device_name(const char *name) {
+    (void)name;
+    return ESP_OK;
+}
+
+esp_err_t esp_bluedroid_init(void) {
+    return ESP_OK;
+}
+
+esp_err_t esp_bluedroid_enable(void) {
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_register_callback(esp_gap_ble_cb_t callback) {
+    (void)callback;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_set_scan_params(esp_ble_scan_params_t *scan_params) {
+    (void)scan_params;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_start_scanning(uint32_t duration) {
+    (void)duration;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_stop_scanning(void) {
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_disconnect(esp_bd_addr_t remote_device) {
+    (void)remote_device;
+    ++hostGattc.disconnects;
+    return ESP_OK;
+}
+
+esp_err_t esp_bt_gap_register_callback(esp_bt_gap_cb_t callback) {
+    (void)callback;
+    return ESP_OK;
+}
+
+esp_err_t esp_bt_gap_set_scan_mode(esp_bt_connection_mode_t c_mode, esp_bt_discovery_mode_t d_mode) {
+    (void)c_mode;
+    (void)d_mode;
+    return ESP_OK;
+}
+
+esp_err_t esp_bt_gap_start_discovery(esp_bt_inq_mode_t mode, uint8_t inq_len, uint8_t num_rsps) {
+    (void)mode;
+    (void)inq_len;
+    (void)num_rsps;
+    return ESP_OK;
+}
+
+esp_err_t esp_bt_gap_cancel_discovery(void) {
+    return ESP_OK;
+}
+
+esp_err_t esp_bt_gap_get_remote_services(esp_bd_addr_t remote_bda) {
+    (void)remote_bda;
+    return ESP_OK;
+}
+
+/* GATT client. Calls are counted in hostGattc. Connections never complete
+   on the host; tests that need GATT events deliver them to the callback */
+
+esp_err_t esp_ble_gatt_set_local_mtu(uint16_t mtu) {
+    (void)mtu;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_register_callback(esp_gattc_cb_t callback) {
+    (void)callback;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_app_register(uint16_t app_id) {
+    (void)app_id;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_open(esp_gatt_if_t gattc_if, esp_bd_addr_t remote_bda, esp_ble_addr_type_t remote_addr_type,
+                             bool is_direct) {
+    (void)gattc_if;
+    (void)remote_addr_type;
+    (void)is_direct;
+    ++hostGattc.opens;
+    memcpy(hostGattc.lastOpen, remote_bda, ESP_BD_ADDR_LEN);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_close(esp_gatt_if_t gattc_if, uint16_t conn_id) {
+    (void)gattc_if;
+    (void)conn_id;
+    ++hostGattc.closes;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_send_mtu_req(esp_gatt_if_t gattc_if, uint16_t conn_id) {
+    (void)gattc_if;
+    (void)conn_id;
+    ++hostGattc.mtuRequests;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_search_service(esp_gatt_if_t gattc_if, uint16_t conn_id, esp_bt_uuid_t *filter_uuid) {
+    (void)gattc_if;
+    (void)conn_id;
+    (void)filter_uuid;
+    ++hostGattc.searches;
+    return ESP_OK;
+}
+
+esp_gatt_status_t esp_ble_gattc_get_attr_count(esp_gatt_if_t gattc_if, uint16_t conn_id, esp_gatt_db_attr_type_t type,
+                                               uint16_t start_handle, uint16_t end_handle, uint16_t char_handle,
+                                               uint16_t *count) {
+    (void)gattc_if;
+    (void)conn_id;
+    (void)type;
+    (void)start_handle;
+    (void)end_handle;
+    (void)char_handle;
+    *count = 0;
+    return ESP_GATT_OK;
+}
+
+esp_gatt_status_t esp_ble_gattc_get_char_by_uuid(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t start_handle,
+                                                 uint16_t end_handle, esp_bt_uuid_t char_uuid,
+                                                 esp_gattc_char_elem_t *result, uint16_t *count) {
+    (void)gattc_if;
+    (void)conn_id;
+    (void)start_handle;
+    (void)end_handle;
+    (void)char_uuid;
+    (void)result;
+    *count = 0;
+    return ESP_GATT_OK;
+}
+
+esp_gatt_status_t esp_ble_gattc_get_descr_by_char_handle(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t char_handle,
+                                                         esp_bt_uuid_t descr_uuid, esp_gattc_descr_elem_t *result,
+                                                         uint16_t *count) {
+    (void)gattc_if;
+    (void)conn_id;
+    (void)char_handle;
+    (void)descr_uuid;
+    (void)result;
+    *count = 0;
+    return ESP_GATT_OK;
+}
+
+esp_err_t esp_ble_gattc_register_for_notify(esp_gatt_if_t gattc_if, esp_bd_addr_t server_bda, uint16_t handle) {
+    (void)gattc_if;
+    (void)server_bda;
+    (void)handle;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_write_char(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t handle, uint16_t value_len,
+                                   uint8_t *value, esp_gatt_write_type_t write_type, esp_gatt_auth_req_t auth_req) {
+    (void)gattc_if;
+    (void)conn_id;
+    (void)handle;
+    (void)value_len;
+    (void)value;
+    (void)write_type;
+    (void)auth_req;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_write_char_descr(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t handle, uint16_t value_len,
+                                         uint8_t *value, esp_gatt_write_type_t write_type,
+                                         esp_gatt_auth_req_t auth_req) {
+    (void)gattc_if;
+    (void)conn_id;
+    (void)handle;
+    (void)value_len;
+    (void)value;
+    (void)write_type;
+    (void)auth_req;
+    return ESP_OK;
+}
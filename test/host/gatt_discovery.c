@@ -0,0 +1,292 @@
+/* Tests for BLE GATT service discovery. GATT client events are delivered
+   through bluetooth.c's esp_gattc_cb(), as the Bluetooth stack delivers them,
+   and time is simulated so that connection timeouts and throughput can be
+   checked */
+
+#include "host_test.h"
+#include "../../main/bluetooth.c"
+#include "../../main/gatt.c"
+
+#define TEST_GATT_IF 4
+/* The simulated devices take this long to connect, and then to exchange MTU
+   and report their services */
+#define SIM_CONNECT_MILLIS 400
+#define SIM_DISCOVER_MILLIS 600
+#define SIM_STEP_MILLIS 50
+
+static void test_bda(uint32_t n, esp_bd_addr_t bda) {
+    bda[0] = 0x5C;
+    bda[1] = 0xF3;
+    bda[2] = 0x70;
+    bda[3] = n >> 16;
+    bda[4] = n >> 8;
+    bda[5] = n;
+}
+
+static app_gap_cb_t *test_add_device(uint32_t n, gravity_bt_scan_t transport) {
+    esp_bd_addr_t bda;
+    test_bda(n, bda);
+    HOST_CHECK(bt_dev_add_components(bda, NULL, 0, NULL, 0, 0, -60, transport) == ESP_OK);
+    return bt_dev_find(gravity_mac_load(bda));
+}
+
+static void test_set_millis(uint32_t millis) {
+    hostTimeUs = (int64_t)millis * 1000;
+}
+
+static void test_event(esp_gattc_cb_event_t event, esp_ble_gattc_cb_param_t *param) {
+    esp_gattc_cb(event, TEST_GATT_IF, param);
+}
+
+static void test_open(const esp_bd_addr_t bda, esp_gatt_status_t status, uint16_t connId) {
+    esp_ble_gattc_cb_param_t param = { 0 };
+    memcpy(param.open.remote_bda, bda, ESP_BD_ADDR_LEN);
+    param.open.status = status;
+    param.open.conn_id = connId;
+    test_event(ESP_GATTC_OPEN_EVT, &param);
+}
+
+static void test_service(uint16_t connId, const esp_bt_uuid_t *uuid) {
+    esp_ble_gattc_cb_param_t param = { 0 };
+    param.search_res.conn_id = connId;
+    param.search_res.is_primary = true;
+    param.search_res.srvc_id.uuid = *uuid;
+    test_event(ESP_GATTC_SEARCH_RES_EVT, &param);
+}
+
+static void test_discovered(uint16_t connId, uint16_t mtu) {
+    esp_ble_gattc_cb_param_t param = { 0 };
+    param.cfg_mtu.conn_id = connId;
+    param.cfg_mtu.mtu = mtu;
+    param.cfg_mtu.status = ESP_GATT_OK;
+    test_event(ESP_GATTC_CFG_MTU_EVT, &param);
+    memset(&param, 0, sizeof(param));
+    param.dis_srvc_cmpl.conn_id = connId;
+    param.dis_srvc_cmpl.status = ESP_GATT_OK;
+    test_event(ESP_GATTC_DIS_SRVC_CMPL_EVT, &param);
+}
+
+static void test_search_complete(uint16_t connId) {
+    esp_ble_gattc_cb_param_t param = { 0 };
+    param.search_cmpl.conn_id = connId;
+    param.search_cmpl.status = ESP_GATT_OK;
+    test_event(ESP_GATTC_SEARCH_CMPL_EVT, &param);
+}
+
+static void test_disconnect(const esp_bd_addr_t bda) {
+    esp_ble_gattc_cb_param_t param = { 0 };
+    memcpy(param.disconnect.remote_bda, bda, ESP_BD_ADDR_LEN);
+    test_event(ESP_GATTC_DISCONNECT_EVT, &param);
+}
+
+static void test_register() {
+    HOST_CHECK(gravity_ble_initialise() == ESP_OK);
+    esp_ble_gattc_cb_param_t param = { 0 };
+    param.reg.app_id = GRAVITY_GATT_APP_ID;
+    param.reg.status = ESP_GATT_OK;
+    test_event(ESP_GATTC_REG_EVT, &param);
+}
+
+/* Services are stored compactly: 16-bit UUIDs, including 128-bit UUIDs built
+   from the Base UUID, then full 128-bit UUIDs with 32-bit UUIDs widened */
+static void test_uuids() {
+    app_gap_cb_t *dev = test_add_device(1, GRAVITY_BT_SCAN_BLE);
+    app_gap_cb_t *classic = test_add_device(2, GRAVITY_BT_SCAN_CLASSIC_DISCOVERY);
+    app_gap_cb_t *batch[] = { dev, classic };
+    HOST_CHECK(gravity_gatt_discover_services_for(batch, 2) == ESP_OK);
+    /* The Classic-only device is skipped */
+    HOST_CHECK(hostGattc.opens == 1 && !memcmp(hostGattc.lastOpen, dev->bda, ESP_BD_ADDR_LEN));
+
+    test_open(dev->bda, ESP_GATT_OK, 10);
+    HOST_CHECK(hostGattc.mtuRequests == 1);
+    test_discovered(10, 247);
+    HOST_CHECK(hostGattc.searches == 1);
+    esp_bt_uuid_t battery = { .len = ESP_UUID_LEN_16, .uuid.uuid16 = 0x180F };
+    esp_bt_uuid_t deviceInfo = { .len = ESP_UUID_LEN_128 };
+    memcpy(deviceInfo.uuid.uuid128, gattBaseUuid, sizeof(gattBaseUuid));
+    deviceInfo.uuid.uuid128[12] = 0x0A;
+    deviceInfo.uuid.uuid128[13] = 0x18;
+    esp_bt_uuid_t vendor32 = { .len = ESP_UUID_LEN_32, .uuid.uuid32 = 0x12345678 };
+    test_service(10, &battery);
+    test_service(10, &deviceInfo);
+    test_service(10, &vendor32);
+    test_search_complete(10);
+    HOST_CHECK(hostGattc.closes == 1);
+
+    grav_ble_gatt *gatt = dev->bt_services.gatt;
+    HOST_CHECK(gatt != NULL && gatt->uuid16Count == 2 && gatt->uuid128Count == 1);
+    uint16_t uuid16;
+    memcpy(&uuid16, &gatt->uuids[0], sizeof(uuid16));
+    HOST_CHECK(uuid16 == 0x180F);
+    memcpy(&uuid16, &gatt->uuids[2], sizeof(uuid16));
+    HOST_CHECK(uuid16 == 0x180A);
+    const uint8_t *uuid128 = &gatt->uuids[2 * sizeof(uint16_t)];
+    HOST_CHECK(!memcmp(uuid128, gattBaseUuid, sizeof(gattBaseUuid)));
+    HOST_CHECK(uuid128[12] == 0x78 && uuid128[15] == 0x12);
+    char strUuid[37];
+    HOST_CHECK(!strcmp(gatt_uuid128_str(uuid128, strUuid), "12345678-0000-1000-8000-00805f9b34fb"));
+
+    test_disconnect(dev->bda);
+    HOST_CHECK(!gattRunning && gattCompleted == 1 && gattFailed == 0 && gattServices == 3);
+}
+
+/* Devices that time out, fail to connect or disconnect early are counted as
+   failures and don't hold up the rest of the batch */
+static void test_failures() {
+    app_gap_cb_t *devs[4];
+    for (uint32_t i = 0; i < 4; ++i) {
+        devs[i] = test_add_device(100 + i, GRAVITY_BT_SCAN_BLE);
+    }
+    test_set_millis(1000);
+    uint32_t opens = hostGattc.opens;
+    HOST_CHECK(gravity_gatt_discover_services_for(devs, 4) == ESP_OK);
+    HOST_CHECK(hostGattc.opens == opens + 1);
+
+    /* The first device never connects */
+    test_set_millis(1000 + GATT_TIMEOUT_MILLIS);
+    HOST_CHECK(host_timer_fire(gattTimer));
+    HOST_CHECK(gattTimeouts == 1 && hostGattc.disconnects == 1);
+    HOST_CHECK(!memcmp(hostGattc.lastOpen, devs[1]->bda, ESP_BD_ADDR_LEN));
+
+    /* The second refuses the connection */
+    test_open(devs[1]->bda, ESP_GATT_ERROR, 0);
+    HOST_CHECK(!memcmp(hostGattc.lastOpen, devs[2]->bda, ESP_BD_ADDR_LEN));
+
+    /* The third connects and goes away during discovery */
+    test_open(devs[2]->bda, ESP_GATT_OK, 11);
+    HOST_CHECK(!memcmp(hostGattc.lastOpen, devs[3]->bda, ESP_BD_ADDR_LEN));
+    test_disconnect(devs[2]->bda);
+
+    /* The fourth connects but doesn't answer */
+    test_open(devs[3]->bda, ESP_GATT_OK, 12);
+    uint32_t closes = hostGattc.closes;
+    test_set_millis(1000 + 3 * GATT_TIMEOUT_MILLIS);
+    HOST_CHECK(host_timer_fire(gattTimer));
+    HOST_CHECK(hostGattc.closes == closes + 1);
+    test_disconnect(devs[3]->bda);
+
+    HOST_CHECK(!gattRunning && !host_timer_fire(gattTimer));
+    HOST_CHECK(gattAttempted == 4 && gattCompleted == 0 && gattFailed == 4 && gattTimeouts == 2);
+    HOST_CHECK(devs[3]->bt_services.gatt == NULL);
+
+    /* The first device's connection completes after it timed out */
+    test_open(devs[0]->bda, ESP_GATT_OK, 13);
+    HOST_CHECK(hostGattc.closes == closes + 2);
+}
+
+/* Devices beyond the queue's capacity are refused */
+static void test_queue_full() {
+    uint16_t count = GATT_QUEUE_LEN + GATT_MAX_CONNECTIONS + 5;
+    app_gap_cb_t **devs = malloc(count * sizeof(app_gap_cb_t *));
+    HOST_CHECK(devs != NULL);
+    for (uint16_t i = 0; i < count; ++i) {
+        devs[i] = test_add_device(1000 + i, GRAVITY_BT_SCAN_BLE);
+    }
+    HOST_CHECK(gravity_gatt_discover_services_for(devs, count) == ESP_ERR_NO_MEM);
+    /* The first is being connected to */
+    HOST_CHECK(gattCount == GATT_QUEUE_LEN - 1 && gatt_slot_with_bda(devs[0]->bda) != NULL);
+    HOST_CHECK(!gatt_pending(devs[GATT_QUEUE_LEN]->bda));
+    /* Queuing devices again doesn't duplicate them */
+    HOST_CHECK(gravity_gatt_discover_services_for(devs, 2) == ESP_OK);
+    HOST_CHECK(gattCount == GATT_QUEUE_LEN - 1);
+    free(devs);
+
+    /* Let everything time out */
+    for (uint32_t t = 1; gattRunning; ++t) {
+        test_set_millis(100000 + t * GATT_TIMEOUT_MILLIS);
+        HOST_CHECK(host_timer_fire(gattTimer));
+        for (int i = 0; i < GATT_MAX_CONNECTIONS; ++i) {
+            if (gattSlots[i].state == GATT_SLOT_CLOSING) {
+                test_disconnect(gattSlots[i].bda);
+            }
+        }
+    }
+}
+
+/* Discover 50 devices that each take a second to connect and answer. With
+   CONFIG_BLE_GATT_MAX_CONNECTIONS connections overlapping, the batch takes
+   a fraction of the time it would one device at a time */
+static void test_throughput() {
+    const uint16_t count = 50;
+    app_gap_cb_t *devs[50];
+    for (uint16_t i = 0; i < count; ++i) {
+        devs[i] = test_add_device(5000 + i, GRAVITY_BT_SCAN_BLE);
+    }
+    uint32_t now = 1000000;
+    test_set_millis(now);
+    HOST_CHECK(gravity_gatt_discover_services_for(devs, count) == ESP_OK);
+
+    /* When each slot entered its current state */
+    gatt_slot_state_t simState[GATT_MAX_CONNECTIONS] = { GATT_SLOT_IDLE };
+    uint32_t simSince[GATT_MAX_CONNECTIONS] = { 0 };
+    uint16_t nextConnId = 100;
+    uint16_t mostConnected = 0;
+    esp_bt_uuid_t battery = { .len = ESP_UUID_LEN_16, .uuid.uuid16 = 0x180F };
+    for (uint32_t step = 0; gattRunning; ++step) {
+        HOST_CHECK(step < 10000);
+        now += SIM_STEP_MILLIS;
+        test_set_millis(now);
+        for (int i = 0; i < GATT_MAX_CONNECTIONS; ++i) {
+            gatt_slot_t *slot = &gattSlots[i];
+            if (slot->state != simState[i]) {
+                simState[i] = slot->state;
+                simSince[i] = now;
+            }
+            uint32_t elapsed = now - simSince[i];
+            if (slot->state == GATT_SLOT_OPENING && elapsed >= SIM_CONNECT_MILLIS) {
+                test_open(slot->bda, ESP_GATT_OK, nextConnId++);
+            } else if (slot->state == GATT_SLOT_DISCOVERING && elapsed >= SIM_DISCOVER_MILLIS) {
+                uint16_t connId = slot->connId;
+                test_discovered(connId, 247);
+                test_service(connId, &battery);
+                test_search_complete(connId);
+            } else if (slot->state == GATT_SLOT_CLOSING) {
+                test_disconnect(slot->bda);
+            }
+        }
+        uint16_t connected = 0;
+        uint16_t opening = 0;
+        for (int i = 0; i < GATT_MAX_CONNECTIONS; ++i) {
+            connected += (gattSlots[i].state != GATT_SLOT_IDLE);
+            opening += (gattSlots[i].state == GATT_SLOT_OPENING);
+        }
+        /* The controller only establishes one connection at a time */
+        HOST_CHECK(opening <= 1);
+        if (connected > mostConnected) {
+            mostConnected = connected;
+        }
+        if (step % (GATT_TICK_MILLIS / SIM_STEP_MILLIS) == 0) {
+            host_timer_fire(gattTimer);
+        }
+    }
+    uint32_t elapsed = gattBatchEnd - gattBatchStart;
+    uint32_t serial = count * (SIM_CONNECT_MILLIS + SIM_DISCOVER_MILLIS);
+    printf("%u devices in %lu.%lus simulated (%lu.%lus one at a time), up to %u connected\n", count,
+           (unsigned long)(elapsed / 1000), (unsigned long)(elapsed % 1000 / 100), (unsigned long)(serial / 1000),
+           (unsigned long)(serial % 1000 / 100), mostConnected);
+    HOST_CHECK(gattCompleted == count && gattFailed == 0 && gattServices == count);
+    HOST_CHECK(gattMtuCount == count && gattMtuSum / gattMtuCount == 247);
+    HOST_CHECK(mostConnected == GATT_MAX_CONNECTIONS);
+    HOST_CHECK(elapsed < serial / 2);
+    for (uint16_t i = 0; i < count; ++i) {
+        HOST_CHECK(devs[i]->bt_services.gatt != NULL && devs[i]->bt_services.gatt->uuid16Count == 1);
+    }
+}
+
+int main() {
+    attack_status = calloc(ATTACKS_COUNT, sizeof(bool));
+    HOST_CHECK(attack_status != NULL);
+    test_set_millis(0);
+
+    test_register();
+    HOST_CHECK(gattIf == TEST_GATT_IF);
+    test_uuids();
+    test_failures();
+    test_queue_full();
+    test_throughput();
+
+    HOST_CHECK(gravity_clear_bt() == ESP_OK);
+    free(attack_status);
+    puts("gatt_discovery: ok");
+    return 0;
+}
@@ -0,0 +1,92 @@
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+/* Shared helpers for the host tests. Each test is a single translation unit
+   that includes the firmware source it exercises, so static functions can
+   be called directly */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <esp_timer.h>
+
+/* Fail the test, reporting the condition, when cond is false. Unlike
+   assert() this is never compiled out */
+#define HOST_CHECK(cond)                                                              \
+    do {                                                                              \
+        if (!(cond)) {                                                                \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            exit(1);                                                                  \
+        }                                                                             \
+    } while (0)
+
+/* Bytes reported free by heap_caps_get_free_size() */
+extern size_t hostHeapFree;
+
+/* Microseconds returned by esp_timer_get_time(). While negative, the host's
+   monotonic clock is used */
+extern int64_t hostTimeUs;
+
+/* Run timer's callback, as if it had expired. Returns false, without running
+   it, if the timer isn't started */
+bool host_timer_fire(esp_timer_handle_t timer);
+
+/* Calls made to the GATT client and GAP connection APIs */
+typedef struct {
+    uint32_t opens;
+    uint32_t closes;
+    uint32_t disconnects;
+    uint32_t mtuRequests;
+    uint32_t searches;
+    uint8_t lastOpen[6];
+} HostGattcCalls;
+extern HostGattcCalls hostGattc;
+
+/* Milliseconds of CPU time since start */
+static inline double host_elapsed_ms(clock_t start) {
+    return (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+/* Capture everything written to stdout, including the firmware's buffered
+   console output, until host_capture_end() */
+static FILE *hostCaptureFile = NULL;
+static int hostCaptureFd = -1;
+
+static inline void host_capture_begin() {
+    fflush(stdout);
+    hostCaptureFile = tmpfile();
+    HOST_CHECK(hostCaptureFile != NULL);
+    hostCaptureFd = dup(STDOUT_FILENO);
+    dup2(fileno(hostCaptureFile), STDOUT_FILENO);
+}
+
+/* Stop capturing and copy what was written, NUL terminated, into buffer.
+   Returns the number of bytes written, which may exceed size */
+static inline size_t host_capture_end(char *buffer, size_t size) {
+    fflush(stdout);
+    dup2(hostCaptureFd, STDOUT_FILENO);
+    close(hostCaptureFd);
+    size_t total = lseek(fileno(hostCaptureFile), 0, SEEK_END);
+    rewind(hostCaptureFile);
+    size_t len = fread(buffer, 1, size - 1, hostCaptureFile);
+    buffer[len] = '\0';
+    fclose(hostCaptureFile);
+    return total;
+}
+
+/* Number of lines in text */
+static inline int host_line_count(const char *text) {
+    int lines = 0;
+    for (; *text != '\0'; ++text) {
+        lines += (*text == '\n');
+    }
+    return lines;
+}
+
+#endif
@@ -0,0 +1,237 @@
+/* Tests for selection by predicate: select ( AP | STA | BT ) WHERE ... and
+   TOP n BY ( RSSI | AGE ). Commands are run through cmd_select, and the
+   selected flags checked against the selected arrays */
+
+#include "host_test.h"
+#include "../../main/filter.c"
+#include "../../main/common.h"
+#include "../../main/scan.h"
+
+#define SELECT_APS 10
+#define SELECT_STAS 2000
+
+/* Run a select command */
+static esp_err_t select_cmd(const char *line) {
+    static char words[256];
+    char *argv[32];
+    int argc = 0;
+    strcpy(words, line);
+    for (char *word = strtok(words, " "); word != NULL; word = strtok(NULL, " ")) {
+        argv[argc++] = word;
+    }
+    return cmd_select(argc, argv);
+}
+
+/* AP j (from 0) has ID j + 1 and RSSI -90 + 5j. STA n has ID n + 1, RSSI
+   -30 - n % 70, and is associated with AP n % SELECT_APS when n is even */
+static void select_populate() {
+    gravity_ap_count = SELECT_APS;
+    gravity_aps = calloc(SELECT_APS, sizeof(ScanResultAP));
+    gravity_sta_count = SELECT_STAS;
+    gravity_stas = calloc(SELECT_STAS, sizeof(ScanResultSTA));
+    HOST_CHECK(gravity_aps != NULL && gravity_stas != NULL);
+    for (int j = 0; j < SELECT_APS; ++j) {
+        gravity_aps[j].index = j + 1;
+        gravity_aps[j].espRecord.rssi = -90 + j * 5;
+        gravity_aps[j].lastSeen = clock();
+    }
+    for (int n = 0; n < SELECT_STAS; ++n) {
+        gravity_stas[n].index = n + 1;
+        gravity_stas[n].rssi = -30 - n % 70;
+        gravity_stas[n].lastSeen = clock();
+        if (n % 2 == 0) {
+            gravity_stas[n].ap = &gravity_aps[n % SELECT_APS];
+        }
+    }
+}
+
+static void select_reset() {
+    for (int j = 0; j < gravity_ap_count; ++j) {
+        gravity_aps[j].selected = false;
+    }
+    for (int n = 0; n < gravity_sta_count; ++n) {
+        gravity_stas[n].selected = false;
+    }
+    free(gravity_selected_aps);
+    gravity_selected_aps = NULL;
+    gravity_sel_ap_count = 0;
+    free(gravity_selected_stas);
+    gravity_selected_stas = NULL;
+    gravity_sel_sta_count = 0;
+}
+
+/* The selected array holds exactly the results flagged as selected, once
+   each */
+static void select_check() {
+    int flagged = 0;
+    for (int j = 0; j < gravity_ap_count; ++j) {
+        flagged += gravity_aps[j].selected;
+    }
+    HOST_CHECK(flagged == gravity_sel_ap_count);
+    for (int i = 0; i < gravity_sel_ap_count; ++i) {
+        HOST_CHECK(gravity_selected_aps[i]->selected);
+        for (int j = 0; j < i; ++j) {
+            HOST_CHECK(gravity_selected_aps[i] != gravity_selected_aps[j]);
+        }
+    }
+    flagged = 0;
+    for (int n = 0; n < gravity_sta_count; ++n) {
+        flagged += gravity_stas[n].selected;
+    }
+    HOST_CHECK(flagged == gravity_sel_sta_count);
+    for (int i = 0; i < gravity_sel_sta_count; ++i) {
+        HOST_CHECK(gravity_selected_stas[i]->selected);
+    }
+}
+
+/* TOP keeps the highest keys, highest first, and ties in the order offered */
+static void test_rank() {
+    uint32_t ranked[3];
+    int32_t keys[3];
+    uint32_t count = 0;
+    int32_t offered[] = { 5, 9, 1, 9, 7, 3, 10 };
+    for (uint32_t i = 0; i < 7; ++i) {
+        gravity_filter_rank(ranked, keys, &count, 3, i, offered[i]);
+    }
+    HOST_CHECK(count == 3 && ranked[0] == 6 && ranked[1] == 1 && ranked[2] == 3);
+
+    /* WHERE ends at TOP */
+    char *argv[] = { "select", "AP", "WHERE", "rssi>-70", "TOP", "2", "BY", "RSSI" };
+    GravityFilter filter;
+    gravity_filter_init(&filter);
+    int i = 2;
+    HOST_CHECK(gravity_filter_parse(&filter, 8, argv, &i) == ESP_OK);
+    HOST_CHECK(i == 3 && filter.predicateCount == 1);
+}
+
+static void test_ap() {
+    HOST_CHECK(select_cmd("select AP TOP 3 BY RSSI") == ESP_OK);
+    HOST_CHECK(gravity_sel_ap_count == 3);
+    HOST_CHECK(gravity_selected_aps[0]->index == 10 && gravity_selected_aps[1]->index == 9 &&
+               gravity_selected_aps[2]->index == 8);
+    select_check();
+
+    /* Matches that are already selected stay selected and aren't added again */
+    select_reset();
+    HOST_CHECK(gravity_select_ap(10) == ESP_OK);
+    HOST_CHECK(select_cmd("select AP WHERE rssi>-70") == ESP_OK);
+    HOST_CHECK(gravity_sel_ap_count == 5);
+    for (int j = 0; j < SELECT_APS; ++j) {
+        HOST_CHECK(gravity_aps[j].selected == (j >= 5));
+    }
+    HOST_CHECK(gravity_selected_aps[0]->index == 10 && gravity_selected_aps[1]->index == 6);
+    select_check();
+    HOST_CHECK(select_cmd("select AP WHERE rssi>-70") == ESP_OK);
+    HOST_CHECK(gravity_sel_ap_count == 5);
+
+    /* WHERE and TOP together */
+    select_reset();
+    HOST_CHECK(select_cmd("select AP WHERE rssi<-60 TOP 2 BY RSSI") == ESP_OK);
+    HOST_CHECK(gravity_sel_ap_count == 2);
+    HOST_CHECK(gravity_selected_aps[0]->index == 6 && gravity_selected_aps[1]->index == 5);
+    select_check();
+
+    /* Invalid commands change nothing */
+    HOST_CHECK(select_cmd("select AP TOP 0 BY RSSI") == ESP_ERR_INVALID_ARG);
+    HOST_CHECK(select_cmd("select AP TOP 3 BY NAME") == ESP_ERR_INVALID_ARG);
+    HOST_CHECK(select_cmd("select AP WHERE ap=1") == ESP_ERR_INVALID_ARG);
+    HOST_CHECK(select_cmd("select AP WHERE rssi>x") == ESP_ERR_INVALID_ARG);
+    HOST_CHECK(gravity_sel_ap_count == 2);
+    select_check();
+    select_reset();
+}
+
+static void test_sta() {
+    /* STAs of AP 3 (n % 10 == 2) with RSSI over -70 (n % 70 < 40) */
+    HOST_CHECK(select_cmd("select STA WHERE ap=3 AND rssi>-70") == ESP_OK);
+    int expected = 0;
+    for (int n = 0; n < SELECT_STAS; ++n) {
+        bool match = (n % SELECT_APS == 2 && n % 70 < 40);
+        HOST_CHECK(gravity_stas[n].selected == match);
+        expected += match;
+    }
+    HOST_CHECK(gravity_sel_sta_count == expected);
+    select_check();
+
+    /* Most recently seen: the others are aged 10 seconds, and these 1 to 3 */
+    select_reset();
+    clock_t now = clock();
+    for (int n = 0; n < SELECT_STAS; ++n) {
+        gravity_stas[n].lastSeen = now - 10 * CLOCKS_PER_SEC;
+    }
+    gravity_stas[700].lastSeen = now - 3 * CLOCKS_PER_SEC;
+    gravity_stas[500].lastSeen = now - 1 * CLOCKS_PER_SEC;
+    gravity_stas[900].lastSeen = now - 2 * CLOCKS_PER_SEC;
+    HOST_CHECK(select_cmd("select STA TOP 2 BY AGE") == ESP_OK);
+    HOST_CHECK(gravity_sel_sta_count == 2);
+    HOST_CHECK(gravity_selected_stas[0] == &gravity_stas[500] && gravity_selected_stas[1] == &gravity_stas[900]);
+
+    /* Expired STAs are never selected */
+    select_reset();
+    scanResultExpiry = 0.1;
+    HOST_CHECK(select_cmd("select STA WHERE !associated") == ESP_OK);
+    HOST_CHECK(gravity_sel_sta_count == 0);
+    gravity_stas[701].lastSeen = clock();
+    HOST_CHECK(select_cmd("select STA WHERE !associated") == ESP_OK);
+    HOST_CHECK(gravity_sel_sta_count == 1 && gravity_stas[701].selected);
+    scanResultExpiry = 0;
+    for (int n = 0; n < SELECT_STAS; ++n) {
+        gravity_stas[n].lastSeen = clock();
+    }
+    select_reset();
+}
+
+static void test_bt() {
+    const char *names[] = { "JBL Flip 5", "Pixel", "jbl charge", NULL, "JBL Go" };
+    int8_t rssis[] = { -70, -40, -50, -60, -90 };
+    for (int i = 0; i < 5; ++i) {
+        esp_bd_addr_t bda = { 0xC0, 0x33, 0, 0, 0, i };
+        uint8_t nameLen = (names[i] == NULL) ? 0 : strlen(names[i]);
+        HOST_CHECK(bt_dev_add_components(bda, (char *)names[i], nameLen, NULL, 0, 0, rssis[i],
+                                         GRAVITY_BT_SCAN_BLE) == ESP_OK);
+    }
+    HOST_CHECK(select_cmd("select BT WHERE name~jbl TOP 2 BY RSSI") == ESP_OK);
+    HOST_CHECK(gravity_sel_bt_count == 2);
+    HOST_CHECK(gravity_selected_bt[0]->index == 3 && gravity_selected_bt[1]->index == 1);
+    HOST_CHECK(select_cmd("select BT WHERE name~JBL") == ESP_OK);
+    HOST_CHECK(gravity_sel_bt_count == 3);
+    HOST_CHECK(gravity_bt_isSelected(1) && !gravity_bt_isSelected(2) && gravity_bt_isSelected(3) &&
+               !gravity_bt_isSelected(4) && gravity_bt_isSelected(5));
+    HOST_CHECK(select_cmd("select BT WHERE ch=1") == ESP_ERR_INVALID_ARG);
+    HOST_CHECK(gravity_clear_bt() == ESP_OK);
+}
+
+/* One batch selection against selecting the same STAs one ID at a time */
+static void test_cost() {
+    clock_t start = clock();
+    for (int n = 0; n < SELECT_STAS; ++n) {
+        HOST_CHECK(gravity_select_sta(n + 1) == ESP_OK);
+    }
+    double oneMs = host_elapsed_ms(start);
+    HOST_CHECK(gravity_sel_sta_count == SELECT_STAS);
+    select_reset();
+
+    start = clock();
+    HOST_CHECK(select_cmd("select STA WHERE rssi<0") == ESP_OK);
+    double batchMs = host_elapsed_ms(start);
+    HOST_CHECK(gravity_sel_sta_count == SELECT_STAS);
+    for (int n = 0; n < SELECT_STAS; ++n) {
+        HOST_CHECK(gravity_selected_stas[n] == &gravity_stas[n]);
+    }
+    printf("%d STAs: one ID at a time %.2f ms, WHERE %.2f ms\n", SELECT_STAS, oneMs, batchMs);
+    select_reset();
+}
+
+int main() {
+    attack_status = calloc(ATTACKS_COUNT, sizeof(bool));
+    HOST_CHECK(attack_status != NULL);
+    select_populate();
+
+    test_rank();
+    test_ap();
+    test_sta();
+    test_bt();
+    test_cost();
+    puts("select_where: ok");
+    return 0;
+}
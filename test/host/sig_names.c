@@ -0,0 +1,26 @@
+/* Test for the Bluetooth assigned-numbers lookups with a name pool larger
+   than 64KB, as the complete company list produces. The table is generated
+   from SIG_NAMES_COMPANIES synthetic companies by the Makefile */
+
+#include "host_test.h"
+#include "../../main/sig.c"
+
+#define SIG_NAMES_COMPANIES 4000
+
+int main() {
+    HOST_CHECK(SIG_COMPANY_COUNT == SIG_NAMES_COMPANIES);
+    HOST_CHECK(sig_company_names[SIG_COMPANY_COUNT - 1] > 0xFFFF);
+
+    /* Company i has ID 16i + 1 and a 40-character name */
+    char expected[48];
+    for (int i = 0; i < SIG_NAMES_COMPANIES; ++i) {
+        snprintf(expected, sizeof(expected), "Synthetic Company %04d of the Test Suite", i);
+        const char *name = gravity_sig_company_name(i * 16 + 1);
+        HOST_CHECK(name != NULL && !strcmp(name, expected));
+        HOST_CHECK(gravity_sig_company_name(i * 16) == NULL);
+    }
+    HOST_CHECK(gravity_sig_company_name(0xFFFF) == NULL);
+    HOST_CHECK(gravity_sig_service_name(0x180F) == NULL && gravity_sig_appearance_name(0x0040) == NULL);
+    puts("sig_names: ok");
+    return 0;
+}
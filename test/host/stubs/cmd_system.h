@@ -0,0 +1,6 @@
+#ifndef HOST_CMD_SYSTEM_H
+#define HOST_CMD_SYSTEM_H
+
+void register_system(void);
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef HOST_CMD_WIFI_H
+#define HOST_CMD_WIFI_H
+
+void register_wifi(void);
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef HOST_ESP_BT_DEVICE_H
+#define HOST_ESP_BT_DEVICE_H
+
+#include "esp_bt_defs.h"
+
+esp_err_t esp_bt_dev_set_device_name(const char *name);
+
+#endif
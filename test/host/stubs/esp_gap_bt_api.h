@@ -0,0 +1,97 @@
+#ifndef HOST_ESP_GAP_BT_API_H
+#define HOST_ESP_GAP_BT_API_H
+
+#include "esp_bt_defs.h"
+
+#define ESP_BT_GAP_MAX_BDNAME_LEN 248
+#define ESP_BT_GAP_EIR_DATA_LEN 240
+
+typedef enum {
+    ESP_BT_COD_MAJOR_DEV_MISC = 0,
+    ESP_BT_COD_MAJOR_DEV_COMPUTER = 1,
+    ESP_BT_COD_MAJOR_DEV_PHONE = 2,
+    ESP_BT_COD_MAJOR_DEV_LAN_NAP = 3,
+    ESP_BT_COD_MAJOR_DEV_AV = 4,
+    ESP_BT_COD_MAJOR_DEV_PERIPHERAL = 5,
+    ESP_BT_COD_MAJOR_DEV_IMAGING = 6,
+    ESP_BT_COD_MAJOR_DEV_WEARABLE = 7,
+    ESP_BT_COD_MAJOR_DEV_TOY = 8,
+    ESP_BT_COD_MAJOR_DEV_HEALTH = 9,
+    ESP_BT_COD_MAJOR_DEV_UNCATEGORIZED = 31
+} esp_bt_cod_major_dev_t;
+
+typedef enum {
+    ESP_BT_GAP_DEV_PROP_BDNAME = 1,
+    ESP_BT_GAP_DEV_PROP_COD,
+    ESP_BT_GAP_DEV_PROP_RSSI,
+    ESP_BT_GAP_DEV_PROP_EIR
+} esp_bt_gap_dev_prop_type_t;
+
+typedef struct {
+    esp_bt_gap_dev_prop_type_t type;
+    int len;
+    void *val;
+} esp_bt_gap_dev_prop_t;
+
+typedef enum {
+    ESP_BT_GAP_DISCOVERY_STOPPED,
+    ESP_BT_GAP_DISCOVERY_STARTED
+} esp_bt_gap_discovery_state_t;
+
+typedef enum {
+    ESP_BT_EIR_TYPE_SHORT_LOCAL_NAME = 0x08,
+    ESP_BT_EIR_TYPE_CMPL_LOCAL_NAME = 0x09
+} esp_bt_eir_type_t;
+
+typedef enum {
+    ESP_BT_INQ_MODE_GENERAL_INQUIRY,
+    ESP_BT_INQ_MODE_LIMITED_INQUIRY
+} esp_bt_inq_mode_t;
+
+typedef enum {
+    ESP_BT_NON_CONNECTABLE,
+    ESP_BT_CONNECTABLE
+} esp_bt_connection_mode_t;
+
+typedef enum {
+    ESP_BT_NON_DISCOVERABLE,
+    ESP_BT_LIMITED_DISCOVERABLE,
+    ESP_BT_GENERAL_DISCOVERABLE
+} esp_bt_discovery_mode_t;
+
+typedef enum {
+    ESP_BT_GAP_DISC_RES_EVT = 0,
+    ESP_BT_GAP_DISC_STATE_CHANGED_EVT,
+    ESP_BT_GAP_RMT_SRVCS_EVT,
+    ESP_BT_GAP_RMT_SRVC_REC_EVT
+} esp_bt_gap_cb_event_t;
+
+typedef union {
+    struct {
+        esp_bd_addr_t bda;
+        int num_prop;
+        esp_bt_gap_dev_prop_t *prop;
+    } disc_res;
+    struct {
+        esp_bt_gap_discovery_state_t state;
+    } disc_st_chg;
+    struct {
+        esp_bd_addr_t bda;
+        esp_bt_status_t stat;
+        int num_uuids;
+        esp_bt_uuid_t *uuid_list;
+    } rmt_srvcs;
+} esp_bt_gap_cb_param_t;
+
+typedef void (*esp_bt_gap_cb_t)(esp_bt_gap_cb_event_t event, esp_bt_gap_cb_param_t *param);
+
+uint32_t esp_bt_gap_get_cod_major_dev(uint32_t cod);
+bool esp_bt_gap_is_valid_cod(uint32_t cod);
+uint8_t *esp_bt_gap_resolve_eir_data(uint8_t *eir, esp_bt_eir_type_t type, uint8_t *length);
+esp_err_t esp_bt_gap_register_callback(esp_bt_gap_cb_t callback);
+esp_err_t esp_bt_gap_set_scan_mode(esp_bt_connection_mode_t c_mode, esp_bt_discovery_mode_t d_mode);
+esp_err_t esp_bt_gap_start_discovery(esp_bt_inq_mode_t mode, uint8_t inq_len, uint8_t num_rsps);
+esp_err_t esp_bt_gap_cancel_discovery(void);
+esp_err_t esp_bt_gap_get_remote_services(esp_bd_addr_t remote_bda);
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef HOST_ESP_GATT_COMMON_API_H
+#define HOST_ESP_GATT_COMMON_API_H
+
+#include "esp_gatt_defs.h"
+
+esp_err_t esp_ble_gatt_set_local_mtu(uint16_t mtu);
+
+#endif
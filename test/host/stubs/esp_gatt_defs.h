@@ -0,0 +1,59 @@
+#ifndef HOST_ESP_GATT_DEFS_H
+#define HOST_ESP_GATT_DEFS_H
+
+#include "esp_bt_defs.h"
+
+#define ESP_GATT_IF_NONE 0xff
+#define ESP_GATT_UUID_CHAR_CLIENT_CONFIG 0x2902
+#define ESP_GATT_CHAR_PROP_BIT_NOTIFY (1 << 4)
+
+typedef uint8_t esp_gatt_if_t;
+typedef uint8_t esp_gatt_char_prop_t;
+
+typedef enum {
+    ESP_GATT_OK = 0x0,
+    ESP_GATT_ERROR = 0x85,
+    ESP_GATT_INVALID_HANDLE = 0x01
+} esp_gatt_status_t;
+
+typedef enum {
+    ESP_GATT_AUTH_REQ_NONE = 0
+} esp_gatt_auth_req_t;
+
+typedef enum {
+    ESP_GATT_WRITE_TYPE_NO_RSP = 1,
+    ESP_GATT_WRITE_TYPE_RSP
+} esp_gatt_write_type_t;
+
+typedef enum {
+    ESP_GATT_DB_PRIMARY_SERVICE,
+    ESP_GATT_DB_SECONDARY_SERVICE,
+    ESP_GATT_DB_CHARACTERISTIC,
+    ESP_GATT_DB_DESCRIPTOR,
+    ESP_GATT_DB_INCLUDED_SERVICE,
+    ESP_GATT_DB_ALL
+} esp_gatt_db_attr_type_t;
+
+typedef enum {
+    ESP_GATT_SERVICE_FROM_REMOTE_DEVICE = 0,
+    ESP_GATT_SERVICE_FROM_NVS_FLASH,
+    ESP_GATT_SERVICE_FROM_UNKNOWN
+} esp_service_source_t;
+
+typedef struct {
+    esp_bt_uuid_t uuid;
+    uint8_t inst_id;
+} esp_gatt_id_t;
+
+typedef struct {
+    uint16_t char_handle;
+    esp_gatt_char_prop_t properties;
+    esp_bt_uuid_t uuid;
+} esp_gattc_char_elem_t;
+
+typedef struct {
+    uint16_t handle;
+    esp_bt_uuid_t uuid;
+} esp_gattc_descr_elem_t;
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef HOST_ESP_INTERFACE_H
+#define HOST_ESP_INTERFACE_H
+
+typedef enum {
+    ESP_IF_WIFI_STA = 0,
+    ESP_IF_WIFI_AP,
+    ESP_IF_MAX
+} esp_interface_t;
+
+#endif
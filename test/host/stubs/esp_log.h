@@ -0,0 +1,27 @@
+#ifndef HOST_ESP_LOG_H
+#define HOST_ESP_LOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+/* Logging is discarded so that test output only shows test results */
+#define ESP_LOGE(tag, ...) do { (void)(tag); if (0) printf(__VA_ARGS__); } while (0)
+#define ESP_LOGW(tag, ...) do { (void)(tag); if (0) printf(__VA_ARGS__); } while (0)
+#define ESP_LOGI(tag, ...) do { (void)(tag); if (0) printf(__VA_ARGS__); } while (0)
+#define ESP_LOGD(tag, ...) do { (void)(tag); if (0) printf(__VA_ARGS__); } while (0)
+#define ESP_LOGV(tag, ...) do { (void)(tag); if (0) printf(__VA_ARGS__); } while (0)
+
+void esp_log_level_set(const char *tag, esp_log_level_t level);
+void esp_log_buffer_hex(const char *tag, const void *buffer, uint16_t length);
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef HOST_ESP_VFS_FAT_H
+#define HOST_ESP_VFS_FAT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef int32_t wl_handle_t;
+
+typedef struct {
+    bool format_if_mount_failed;
+    int max_files;
+    size_t allocation_unit_size;
+} esp_vfs_fat_mount_config_t;
+
+esp_err_t esp_vfs_fat_spiflash_mount_rw_wl(const char *base_path, const char *partition_label,
+                                           const esp_vfs_fat_mount_config_t *mount_config, wl_handle_t *wl_handle);
+
+#endif
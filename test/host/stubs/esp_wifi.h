@@ -0,0 +1,48 @@
+#ifndef HOST_ESP_WIFI_H
+#define HOST_ESP_WIFI_H
+
+#include "esp_err.h"
+#include "esp_wifi_types.h"
+#include "esp_wifi_default.h"
+
+typedef struct {
+    int unused;
+} wifi_init_config_t;
+
+#define WIFI_INIT_CONFIG_DEFAULT() { 0 }
+
+typedef struct {
+    uint8_t ssid[32];
+    uint8_t password[64];
+    uint8_t ssid_len;
+    uint8_t channel;
+    wifi_auth_mode_t authmode;
+    uint8_t ssid_hidden;
+    uint8_t max_connection;
+    uint16_t beacon_interval;
+} wifi_ap_config_t;
+
+typedef union {
+    wifi_ap_config_t ap;
+} wifi_config_t;
+
+typedef void (*wifi_promiscuous_cb_t)(void *buf, wifi_promiscuous_pkt_type_t type);
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config);
+esp_err_t esp_wifi_set_storage(wifi_storage_t storage);
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode);
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf);
+esp_err_t esp_wifi_set_country(const wifi_country_t *country);
+esp_err_t esp_wifi_start(void);
+esp_err_t esp_wifi_get_channel(uint8_t *primary, wifi_second_chan_t *second);
+esp_err_t esp_wifi_set_channel(uint8_t primary, wifi_second_chan_t second);
+esp_err_t esp_wifi_get_mac(wifi_interface_t ifx, uint8_t mac[6]);
+esp_err_t esp_wifi_set_mac(wifi_interface_t ifx, const uint8_t mac[6]);
+esp_err_t esp_wifi_80211_tx(wifi_interface_t ifx, const void *buffer, int len, bool en_sys_seq);
+esp_err_t esp_wifi_set_promiscuous(bool en);
+esp_err_t esp_wifi_set_promiscuous_filter(const wifi_promiscuous_filter_t *filter);
+esp_err_t esp_wifi_set_promiscuous_ctrl_filter(const wifi_promiscuous_filter_t *filter);
+esp_err_t esp_wifi_set_promiscuous_rx_cb(wifi_promiscuous_cb_t cb);
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef HOST_ESP_WIFI_DEFAULT_H
+#define HOST_ESP_WIFI_DEFAULT_H
+
+#include "esp_err.h"
+
+typedef struct esp_netif_obj esp_netif_t;
+
+esp_err_t esp_netif_init(void);
+esp_err_t esp_event_loop_create_default(void);
+esp_netif_t *esp_netif_create_default_wifi_ap(void);
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef HOST_ESP_WIFI_TYPES_H
+#define HOST_ESP_WIFI_TYPES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum {
+    WIFI_MODE_NULL = 0,
+    WIFI_MODE_STA,
+    WIFI_MODE_AP,
+    WIFI_MODE_APSTA
+} wifi_mode_t;
+
+typedef enum {
+    WIFI_IF_STA = 0,
+    WIFI_IF_AP
+} wifi_interface_t;
+
+typedef enum {
+    WIFI_SECOND_CHAN_NONE = 0,
+    WIFI_SECOND_CHAN_ABOVE,
+    WIFI_SECOND_CHAN_BELOW
+} wifi_second_chan_t;
+
+typedef enum {
+    WIFI_AUTH_OPEN = 0,
+    WIFI_AUTH_WEP,
+    WIFI_AUTH_WPA_PSK,
+    WIFI_AUTH_WPA2_PSK,
+    WIFI_AUTH_WPA_WPA2_PSK,
+    WIFI_AUTH_WPA2_ENTERPRISE,
+    WIFI_AUTH_WPA3_PSK,
+    WIFI_AUTH_WPA2_WPA3_PSK,
+    WIFI_AUTH_MAX
+} wifi_auth_mode_t;
+
+typedef enum {
+    WIFI_PS_NONE,
+    WIFI_PS_MIN_MODEM,
+    WIFI_PS_MAX_MODEM
+} wifi_ps_type_t;
+
+typedef enum {
+    WIFI_STORAGE_FLASH,
+    WIFI_STORAGE_RAM
+} wifi_storage_t;
+
+typedef enum {
+    WIFI_COUNTRY_POLICY_AUTO,
+    WIFI_COUNTRY_POLICY_MANUAL
+} wifi_country_policy_t;
+
+typedef struct {
+    char cc[3];
+    uint8_t schan;
+    uint8_t nchan;
+    int8_t max_tx_power;
+    wifi_country_policy_t policy;
+} wifi_country_t;
+
+typedef struct {
+    uint8_t bssid[6];
+    uint8_t ssid[33];
+    uint8_t primary;
+    wifi_second_chan_t second;
+    int8_t rssi;
+    wifi_auth_mode_t authmode;
+    uint32_t wps:1;
+} wifi_ap_record_t;
+
+typedef enum {
+    WIFI_PKT_MGMT,
+    WIFI_PKT_CTRL,
+    WIFI_PKT_DATA,
+    WIFI_PKT_MISC
+} wifi_promiscuous_pkt_type_t;
+
+typedef struct {
+    signed rssi:8;
+    unsigned rate:5;
+    unsigned sig_mode:2;
+    unsigned mcs:7;
+    unsigned cwb:1;
+    unsigned sgi:1;
+    unsigned channel:4;
+    unsigned secondary_channel:4;
+    unsigned second:4;
+    signed noise_floor:8;
+    unsigned sig_len:12;
+    uint32_t timestamp;
+} wifi_pkt_rx_ctrl_t;
+
+typedef struct {
+    wifi_pkt_rx_ctrl_t rx_ctrl;
+    uint8_t payload[0];
+} wifi_promiscuous_pkt_t;
+
+typedef struct {
+    uint32_t filter_mask;
+} wifi_promiscuous_filter_t;
+
+#define WIFI_PROMIS_FILTER_MASK_MGMT (1 << 0)
+#define WIFI_PROMIS_FILTER_MASK_CTRL (1 << 1)
+#define WIFI_PROMIS_FILTER_MASK_DATA (1 << 2)
+#define WIFI_PROMIS_CTRL_FILTER_MASK_WRAPPER (1 << 23)
+#define WIFI_PROMIS_CTRL_FILTER_MASK_BAR (1 << 24)
+#define WIFI_PROMIS_CTRL_FILTER_MASK_BA (1 << 25)
+#define WIFI_PROMIS_CTRL_FILTER_MASK_PSPOLL (1 << 26)
+#define WIFI_PROMIS_CTRL_FILTER_MASK_RTS (1 << 27)
+#define WIFI_PROMIS_CTRL_FILTER_MASK_CTS (1 << 28)
+#define WIFI_PROMIS_CTRL_FILTER_MASK_ACK (1 << 29)
+#define WIFI_PROMIS_CTRL_FILTER_MASK_CFEND (1 << 30)
+#define WIFI_PROMIS_CTRL_FILTER_MASK_CFENDACK (1U << 31)
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+/* Single-threaded stand-ins for the FreeRTOS primitives used by main/ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "freertos/portmacro.h"
+
+typedef int32_t BaseType_t;
+typedef uint32_t UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+#endif
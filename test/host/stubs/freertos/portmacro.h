@@ -0,0 +1,12 @@
+#ifndef HOST_PORTMACRO_H
+#define HOST_PORTMACRO_H
+
+typedef struct {
+    int count;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED { 0 }
+#define portENTER_CRITICAL(mux) (++(mux)->count)
+#define portEXIT_CRITICAL(mux) (--(mux)->count)
+
+#endif
@@ -0,0 +1 @@
+/* Nothing declared here is used by the firmware sources */
@@ -0,0 +1,50 @@
+/* Configuration for the host tests: the defaults from main/Kconfig.projbuild,
+   with Bluetooth, including Classic, enabled as on the ESP32 */
+#ifndef HOST_SDKCONFIG_H
+#define HOST_SDKCONFIG_H
+
+#define CONFIG_IDF_TARGET_ESP32 1
+#define CONFIG_BT_ENABLED 1
+#define CONFIG_BT_CLASSIC_ENABLED 1
+
+#define CONFIG_DEFAULT_HOP_MILLIS 500
+#define CONFIG_DEFAULT_MANA_HOP_MILLIS 5000
+#define CONFIG_HOP_MAX_CHANNEL 11
+#define CONFIG_HOP_FOCUS_SWEEP_INTERVAL 4
+#define CONFIG_HOP_ADAPTIVE_MIN_DWELL_PERCENT 25
+#define CONFIG_HOP_ADAPTIVE_DISCOVERY_WEIGHT 50
+#define CONFIG_HOP_DISCOVERY_LOG_SIZE 256
+#define CONFIG_BLE_SCAN_SECONDS 10
+#define CONFIG_BLE_DUPLICATE_RESET_SECONDS 5
+#define CONFIG_COEX_PERIOD_MILLIS 4000
+#define CONFIG_COEX_WEIGHT_WIFI 2
+#define CONFIG_COEX_WEIGHT_BLE 1
+#define CONFIG_COEX_WEIGHT_BT_CLASSIC 1
+#define CONFIG_BT_SCAN_DURATION 16
+#define CONFIG_BLE_PURGE_MIN_AGE 30
+#define CONFIG_BLE_PURGE_MAX_RSSI -70
+#define CONFIG_BLE_MEMORY_BUDGET 0
+#define CONFIG_INTERNAL_RAM_RESERVE 48
+#define CONFIG_BT_SVC_DISC_QUEUE_LEN 256
+#define CONFIG_BT_SVC_DISC_TIMEOUT 10
+#define CONFIG_BT_SVC_DISC_RETRIES 2
+#define CONFIG_BLE_GATT_MAX_CONNECTIONS 3
+#define CONFIG_BLE_GATT_TIMEOUT 8
+#define CONFIG_BLE_GATT_QUEUE_LEN 64
+#define CONFIG_DEFAULT_ATTACK_MILLIS 5
+#define CONFIG_MALFORMED_FROM 16
+#define CONFIG_DECODE_UUIDS 1
+#define CONFIG_DISPLAY_FRIENDLY_AGE 1
+#define CONFIG_OUI_LOOKUP 1
+#define CONFIG_MIN_ATTACK_MILLIS 50
+#define CONFIG_FLIPPER_SEPARATOR "~"
+#define CONFIG_DEBUG 1
+#define CONFIG_SSID_LEN_MIN 8
+#define CONFIG_SSID_LEN_MAX 32
+#define CONFIG_DEFAULT_SSID_COUNT 20
+#define CONFIG_CONSOLE_STORE_HISTORY 1
+#define CONFIG_ESP_CONSOLE_UART_DEFAULT 1
+#define CONFIG_CONSOLE_MAX_COMMAND_LINE_LENGTH 1024
+#define CONFIG_CONSOLE_OUTPUT_BUFFER 4096
+
+#endif
@@ -0,0 +1,139 @@
+/* Tests for the channel survey's observation time, which comes from the
+   hopper's channel switches. Frames are only received on channel 1, so
+   time on the quiet channels must not be credited to it */
+
+#include "host_test.h"
+#include "../../main/hop.c"
+#include "../../main/survey.c"
+
+#define SURVEY_CYCLES 20
+/* Each switch takes this long beyond the scheduled dwell */
+#define SURVEY_LATENCY_MILLIS 7
+
+static const uint8_t surveyHopChannels[] = { 1, 6, 11 };
+static const long surveyHopDwells[] = { 300, 500, 200 };
+
+static void survey_advance(int64_t millis) {
+    hostTimeUs += millis * 1000;
+}
+
+/* A 1,000 byte management frame at 6Mbps */
+static void survey_receive() {
+    static uint8_t payload[1000];
+    uint8_t ch;
+    wifi_second_chan_t sec;
+    esp_wifi_get_channel(&ch, &sec);
+    wifi_pkt_rx_ctrl_t rx_ctrl;
+    memset(&rx_ctrl, 0, sizeof(rx_ctrl));
+    rx_ctrl.channel = ch;
+    rx_ctrl.sig_len = sizeof(payload);
+    rx_ctrl.rate = 0x0B;
+    rx_ctrl.noise_floor = -95;
+    payload[0] = 0x80;
+    memset(&payload[16], 0x24, 6);
+    HOST_CHECK(survey_frame(payload, rx_ctrl) == ESP_OK);
+}
+
+static uint64_t survey_observed_total() {
+    uint64_t total = 0;
+    for (int i = 1; i <= MAX_CHANNEL; ++i) {
+        total += surveyChannels[i].observedMicros;
+    }
+    return total;
+}
+
+static void test_hopping() {
+    char *schedule[] = { "1:300", "6:500", "11:200" };
+    HOST_CHECK(hop_schedule_parse(3, schedule) == ESP_OK);
+    hop_millis = surveyHopDwells[0];
+    esp_wifi_set_channel(1, WIFI_SECOND_CHAN_NONE);
+
+    int64_t start = hostTimeUs;
+    attack_status[ATTACK_SURVEY] = true;
+    HOST_CHECK(survey_start() == ESP_OK);
+    hopStatus = HOP_STATUS_ON;
+    HOST_CHECK(hop_state_refresh() == ESP_OK && hopActive);
+
+    for (int cycle = 0; cycle < SURVEY_CYCLES; ++cycle) {
+        for (int i = 0; i < sizeof(surveyHopChannels); ++i) {
+            if (surveyHopChannels[i] == 1) {
+                survey_receive();
+            }
+            survey_advance(surveyHopDwells[i] + SURVEY_LATENCY_MILLIS);
+            hop_switch_channel();
+        }
+    }
+
+    /* Completed visits are credited as the hopper records them */
+    for (int i = 0; i < sizeof(surveyHopChannels); ++i) {
+        uint8_t ch = surveyHopChannels[i];
+        HOST_CHECK(surveyChannels[ch].observedMicros == hopChannelStats[ch].dwellMicros);
+        HOST_CHECK(hopChannelStats[ch].dwellMicros ==
+                   SURVEY_CYCLES * (surveyHopDwells[i] + SURVEY_LATENCY_MILLIS) * 1000ULL);
+    }
+    HOST_CHECK(survey_observed_total() == hostTimeUs - start);
+
+    /* The visit in progress is credited when the survey stops */
+    survey_advance(100);
+    attack_status[ATTACK_SURVEY] = false;
+    HOST_CHECK(survey_stop() == ESP_OK);
+    HOST_CHECK(surveyChannels[1].observedMicros == hopChannelStats[1].dwellMicros + 100000);
+    HOST_CHECK(survey_observed_total() == hostTimeUs - start);
+
+    /* Time while the survey is stopped isn't counted */
+    uint64_t total = survey_observed_total();
+    survey_advance(300);
+    hop_switch_channel();
+    survey_advance(500);
+    hop_switch_channel();
+    HOST_CHECK(survey_observed_total() == total);
+
+    char report[4096];
+    host_capture_begin();
+    HOST_CHECK(survey_report() == ESP_OK);
+    host_capture_end(report, sizeof(report));
+    HOST_CHECK(host_line_count(report) == 3);
+}
+
+/* While hopping is off Gravity stays on one channel, and that time is
+   credited when hopping resumes */
+static void test_paused() {
+    HOST_CHECK(survey_reset() == ESP_OK);
+    attack_status[ATTACK_SURVEY] = true;
+    HOST_CHECK(survey_start() == ESP_OK);
+    uint8_t ch;
+    wifi_second_chan_t sec;
+    esp_wifi_get_channel(&ch, &sec);
+    int64_t start = hostTimeUs;
+
+    hopStatus = HOP_STATUS_OFF;
+    HOST_CHECK(hop_state_refresh() == ESP_OK && !hopActive);
+    survey_advance(2000);
+    hopStatus = HOP_STATUS_ON;
+    HOST_CHECK(hop_state_refresh() == ESP_OK && hopActive);
+    HOST_CHECK(surveyChannels[ch].observedMicros == hostTimeUs - start);
+    survey_advance(400);
+    hop_switch_channel();
+    HOST_CHECK(surveyChannels[ch].observedMicros == hostTimeUs - start);
+    HOST_CHECK(survey_observed_total() == hostTimeUs - start);
+
+    /* Resetting the hopper's statistics doesn't lose the current visit */
+    survey_advance(50);
+    HOST_CHECK(hop_stats_reset() == ESP_OK);
+    survey_advance(50);
+    HOST_CHECK(survey_stop() == ESP_OK);
+    HOST_CHECK(survey_observed_total() == hostTimeUs - start);
+    attack_status[ATTACK_SURVEY] = false;
+}
+
+int main() {
+    attack_status = calloc(ATTACKS_COUNT, sizeof(bool));
+    HOST_CHECK(attack_status != NULL);
+    hostTimeUs = 1000000;
+
+    test_hopping();
+    test_paused();
+    free(attack_status);
+    puts("survey_hop: ok");
+    return 0;
+}
@@ -0,0 +1,327 @@
+/* Tests for VIEW's filters: WHERE predicates, LIMIT, OFFSET and COLUMNS are
+   parsed, checked against the table being viewed and applied by the AP, STA
+   and Bluetooth lists. Commands are run through cmd_view and their console
+   output captured */
+
+#include "host_test.h"
+#include "../../main/filter.c"
+#include "../../main/common.h"
+
+#define VIEW_APS 8
+#define VIEW_STAS 2000
+#define VIEW_OUTPUT_LEN (512 * 1024)
+
+static char viewOutput[VIEW_OUTPUT_LEN];
+
+static const char *viewSsids[VIEW_APS] = { "Home", "Guest-1", "Guest-2", "office", "", "GUESTNET", "cafe", "lab" };
+
+/* Split line into words, in a buffer that lasts until the next call */
+static int view_split(const char *line, char **argv) {
+    static char words[256];
+    int argc = 0;
+    strcpy(words, line);
+    for (char *word = strtok(words, " "); word != NULL; word = strtok(NULL, " ")) {
+        argv[argc++] = word;
+    }
+    return argc;
+}
+
+/* Run a view command, capturing its output in viewOutput */
+static esp_err_t view(const char *line) {
+    char *argv[32];
+    int argc = view_split(line, argv);
+    host_capture_begin();
+    esp_err_t err = cmd_view(argc, argv);
+    host_capture_end(viewOutput, sizeof(viewOutput));
+    return err;
+}
+
+/* Parse the filter clauses of a command, as cmd_view does */
+static esp_err_t view_parse(GravityFilter *filter, const char *line) {
+    char *argv[32];
+    int argc = view_split(line, argv);
+    gravity_filter_init(filter);
+    for (int i = 0; i < argc; ++i) {
+        if (gravity_filter_is_keyword(argv[i])) {
+            esp_err_t err = gravity_filter_parse(filter, argc, argv, &i);
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+/* The IDs of the rows in viewOutput, which has a two line header and ID as
+   its first column. Returns the number of rows */
+static int view_ids(int *ids, int capacity) {
+    int count = 0;
+    const char *line = viewOutput;
+    for (int lineNum = 0; *line != '\0'; ++lineNum) {
+        if (lineNum >= 2) {
+            HOST_CHECK(count < capacity);
+            HOST_CHECK(sscanf(line + 1, "%d", &ids[count]) == 1);
+            ++count;
+        }
+        line = strchr(line, '\n');
+        HOST_CHECK(line != NULL);
+        ++line;
+    }
+    return count;
+}
+
+/* Set of the IDs in viewOutput, as a bitmask */
+static uint32_t view_id_set() {
+    int ids[32];
+    int count = view_ids(ids, 32);
+    uint32_t set = 0;
+    for (int i = 0; i < count; ++i) {
+        set |= 1 << ids[i];
+    }
+    return set;
+}
+
+/* APs have IDs 1 to VIEW_APS. STA n (from 0) has ID n + 1, and is associated
+   with AP n % VIEW_APS when n is even. Every fourth STA has an Apple OUI */
+static void view_populate() {
+    gravity_ap_count = VIEW_APS;
+    gravity_aps = calloc(VIEW_APS, sizeof(ScanResultAP));
+    gravity_sta_count = VIEW_STAS;
+    gravity_stas = calloc(VIEW_STAS, sizeof(ScanResultSTA));
+    HOST_CHECK(gravity_aps != NULL && gravity_stas != NULL);
+
+    for (int k = 0; k < VIEW_APS; ++k) {
+        ScanResultAP *ap = &gravity_aps[k];
+        uint8_t bssid[6] = { 0x02, 0xAA, 0, 0, 0, k };
+        memcpy(ap->espRecord.bssid, bssid, 6);
+        ap->bssidKey = gravity_mac_load(bssid);
+        strcpy((char *)ap->espRecord.ssid, viewSsids[k]);
+        ap->espRecord.rssi = -40 - k * 5;
+        ap->espRecord.primary = k + 1;
+        ap->index = k + 1;
+        ap->lastSeen = clock();
+        ap->stationCount = (k % 2 == 0) ? VIEW_STAS / VIEW_APS : 0;
+    }
+    for (int n = 0; n < VIEW_STAS; ++n) {
+        ScanResultSTA *sta = &gravity_stas[n];
+        uint8_t mac[6] = { 0x02, 0xBB, 0, 0, n >> 8, n };
+        if (n % 4 == 0) {
+            mac[0] = 0x00;
+            mac[1] = 0x03;
+            mac[2] = 0x93;
+        }
+        memcpy(sta->mac, mac, 6);
+        sta->macKey = gravity_mac_load(mac);
+        sta->index = n + 1;
+        sta->rssi = -30 - n % 70;
+        sta->channel = 1 + n % 13;
+        sta->lastSeen = clock();
+        if (n % 2 == 0) {
+            sta->ap = &gravity_aps[n % VIEW_APS];
+            memcpy(sta->apMac, sta->ap->espRecord.bssid, 6);
+            sta->apKey = sta->ap->bssidKey;
+        }
+    }
+}
+
+static void test_parse() {
+    GravityFilter filter;
+    HOST_CHECK(view_parse(&filter, "view STA WHERE rssi>-70 AND associated AP LIMIT 5 OFFSET 2") == ESP_OK);
+    HOST_CHECK(filter.predicateCount == 2);
+    HOST_CHECK(filter.predicates[0].field == GRAVITY_FIELD_RSSI && filter.predicates[0].op == GRAVITY_OP_GT &&
+               filter.predicates[0].number == -70);
+    HOST_CHECK(filter.predicates[1].field == GRAVITY_FIELD_ASSOCIATED && filter.predicates[1].op == GRAVITY_OP_NE);
+    HOST_CHECK(filter.limit == 5 && filter.offset == 2);
+
+    HOST_CHECK(view_parse(&filter, "view BT WHERE name~JBL !selected ssid=foo") == ESP_OK);
+    HOST_CHECK(filter.predicateCount == 3);
+    HOST_CHECK(filter.predicates[1].op == GRAVITY_OP_EQ && filter.predicates[2].field == GRAVITY_FIELD_NAME);
+    HOST_CHECK(gravity_filter_match_text(&filter.predicates[0], "my jbl flip"));
+    HOST_CHECK(!gravity_filter_match_text(&filter.predicates[0], NULL));
+    HOST_CHECK(gravity_filter_match_number(&filter.predicates[1], 0));
+    HOST_CHECK(!gravity_filter_match_number(&filter.predicates[1], 1));
+
+    HOST_CHECK(view_parse(&filter, "view STA WHERE rssi<=-50 ch=6 ap=3 age<60") == ESP_OK);
+    HOST_CHECK(filter.predicateCount == 4 && filter.predicates[2].field == GRAVITY_FIELD_AP);
+    HOST_CHECK(view_parse(&filter, "view STA COLUMNS id,rssi,bssid,ap") == ESP_OK);
+    HOST_CHECK(filter.columnCount == 4 && filter.columns[2] == GRAVITY_COL_MAC);
+
+    HOST_CHECK(view_parse(&filter, "view STA WHERE rssi>abc") == ESP_ERR_INVALID_ARG);
+    HOST_CHECK(view_parse(&filter, "view STA WHERE AP") == ESP_ERR_INVALID_ARG);
+    HOST_CHECK(view_parse(&filter, "view STA WHERE vendor<x") == ESP_ERR_INVALID_ARG);
+    HOST_CHECK(view_parse(&filter, "view STA WHERE rssi<-1 rssi<-2 rssi<-3 rssi<-4 rssi<-5 rssi<-6 rssi<-7") ==
+               ESP_ERR_INVALID_ARG);
+    HOST_CHECK(view_parse(&filter, "view STA LIMIT") == ESP_ERR_INVALID_ARG);
+    HOST_CHECK(view_parse(&filter, "view STA LIMIT -1") == ESP_ERR_INVALID_ARG);
+    HOST_CHECK(view_parse(&filter, "view STA COLUMNS id,,rssi") == ESP_ERR_INVALID_ARG);
+    HOST_CHECK(view_parse(&filter, "view STA COLUMNS id,bogus") == ESP_ERR_INVALID_ARG);
+
+    HOST_CHECK(view_parse(&filter, "view STA WHERE name~JBL") == ESP_OK);
+    HOST_CHECK(gravity_filter_check(&filter, GRAVITY_FILTER_STA_FIELDS, GRAVITY_FILTER_STA_COLUMNS, "STA") ==
+               ESP_ERR_INVALID_ARG);
+    HOST_CHECK(gravity_filter_check(&filter, GRAVITY_FILTER_BT_FIELDS, GRAVITY_FILTER_BT_COLUMNS, "BT") == ESP_OK);
+
+    char strTime[26];
+    gravity_filter_format_age(30, strTime);
+    HOST_CHECK(!strcmp(strTime, "Under a minute ago"));
+    gravity_filter_format_age(90, strTime);
+    HOST_CHECK(!strcmp(strTime, "1 minute ago"));
+    gravity_filter_format_age(7300, strTime);
+    HOST_CHECK(!strcmp(strTime, "2 hours ago"));
+}
+
+/* OFFSET skips matching rows and LIMIT stops the list */
+static void test_page() {
+    GravityFilter filter;
+    HOST_CHECK(view_parse(&filter, "x LIMIT 2 OFFSET 1") == ESP_OK);
+    uint32_t matched = 0;
+    bool done = false;
+    int shown = 0;
+    int row = 0;
+    for (; row < 10 && !done; ++row) {
+        shown += gravity_filter_page(&filter, &matched, &done);
+    }
+    HOST_CHECK(shown == 2 && row == 3);
+
+    HOST_CHECK(view_parse(&filter, "x OFFSET 20") == ESP_OK);
+    matched = 0;
+    for (row = 0, shown = 0; row < 10; ++row) {
+        shown += gravity_filter_page(&filter, &matched, &done);
+    }
+    HOST_CHECK(shown == 0);
+}
+
+static void test_sta() {
+    /* Matches are STAs n with n % 70 < 10 and n even */
+    HOST_CHECK(view("view STA WHERE rssi>-40 AND associated LIMIT 5 OFFSET 2 COLUMNS id,rssi,ch") == ESP_OK);
+    HOST_CHECK(host_line_count(viewOutput) == 2 + 5);
+    HOST_CHECK(!strncmp(viewOutput, " ID  | RSSI | Ch\n", 17));
+    int ids[VIEW_STAS];
+    HOST_CHECK(view_ids(ids, VIEW_STAS) == 5);
+    int expected[] = { 5, 7, 9, 71, 73 };
+    for (int i = 0; i < 5; ++i) {
+        HOST_CHECK(ids[i] == expected[i]);
+    }
+    const char *row = strchr(strchr(viewOutput, '\n') + 1, '\n') + 1;
+    int id, rssi, channel;
+    HOST_CHECK(sscanf(row, " %d | %d | %d", &id, &rssi, &channel) == 3);
+    HOST_CHECK(id == 5 && rssi == -34 && channel == 5);
+
+    /* Default columns */
+    HOST_CHECK(view("view STA WHERE ch=6 LIMIT 3") == ESP_OK);
+    HOST_CHECK(view_ids(ids, VIEW_STAS) == 3);
+    HOST_CHECK(ids[0] == 6 && ids[1] == 19 && ids[2] == 32);
+
+    HOST_CHECK(view("view STA WHERE vendor~apple COLUMNS id,vendor LIMIT 3") == ESP_OK);
+    HOST_CHECK(view_ids(ids, VIEW_STAS) == 3);
+    HOST_CHECK(ids[0] == 1 && ids[1] == 5 && ids[2] == 9);
+    HOST_CHECK(strstr(viewOutput, "Apple") != NULL);
+
+    HOST_CHECK(view("view STA WHERE !associated COLUMNS id,ap LIMIT 2") == ESP_OK);
+    HOST_CHECK(view_ids(ids, VIEW_STAS) == 2);
+    HOST_CHECK(ids[0] == 2 && ids[1] == 4);
+    HOST_CHECK(strstr(viewOutput, "Unknown") != NULL);
+
+    /* STAs of AP 3 */
+    HOST_CHECK(view("view STA WHERE ap=3 COLUMNS id") == ESP_OK);
+    HOST_CHECK(view_ids(ids, VIEW_STAS) == VIEW_STAS / VIEW_APS);
+    for (int i = 0; i < VIEW_STAS / VIEW_APS; ++i) {
+        HOST_CHECK(ids[i] == 3 + i * VIEW_APS);
+    }
+
+    /* Filters that don't apply to STAs are rejected before anything is listed */
+    HOST_CHECK(view("view STA WHERE name~x") == ESP_ERR_INVALID_ARG);
+    HOST_CHECK(view("view STA COLUMNS id,wps") == ESP_ERR_INVALID_ARG);
+    HOST_CHECK(view("view STA LIMIT x") == ESP_ERR_INVALID_ARG);
+    HOST_CHECK(viewOutput[0] == '\0');
+
+    /* A filter that matches nothing prints only the header */
+    HOST_CHECK(view("view STA WHERE rssi>0") == ESP_OK);
+    HOST_CHECK(host_line_count(viewOutput) == 2);
+}
+
+/* Expired rows are skipped without counting towards OFFSET or LIMIT */
+static void test_age() {
+    clock_t old = clock() - 120 * CLOCKS_PER_SEC;
+    for (int n = 0; n < 100; ++n) {
+        gravity_stas[n].lastSeen = old;
+    }
+    int ids[VIEW_STAS];
+    HOST_CHECK(view("view STA WHERE age>=60 COLUMNS id,age") == ESP_OK);
+    HOST_CHECK(view_ids(ids, VIEW_STAS) == 100);
+    HOST_CHECK(strstr(viewOutput, "2 minutes ago") != NULL);
+
+    scanResultExpiry = 1;
+    HOST_CHECK(view("view STA LIMIT 2 OFFSET 1 COLUMNS id") == ESP_OK);
+    HOST_CHECK(view_ids(ids, VIEW_STAS) == 2);
+    HOST_CHECK(ids[0] == 102 && ids[1] == 103);
+    scanResultExpiry = 0;
+    for (int n = 0; n < 100; ++n) {
+        gravity_stas[n].lastSeen = clock();
+    }
+}
+
+static void test_ap() {
+    HOST_CHECK(view("view AP WHERE ssid~guest COLUMNS id,ssid") == ESP_OK);
+    HOST_CHECK(view_id_set() == ((1 << 2) | (1 << 3) | (1 << 6)));
+    HOST_CHECK(view("view AP WHERE ssid~guest AND associated COLUMNS id") == ESP_OK);
+    HOST_CHECK(view_id_set() == (1 << 3));
+    HOST_CHECK(view("view AP WHERE name=OFFICE COLUMNS id") == ESP_OK);
+    HOST_CHECK(view_id_set() == (1 << 4));
+    HOST_CHECK(view("view AP WHERE ch=5 COLUMNS id,ssid,cli") == ESP_OK);
+    HOST_CHECK(view_id_set() == (1 << 5));
+    HOST_CHECK(strstr(viewOutput, "<hidden>") != NULL);
+    HOST_CHECK(view("view AP WHERE rssi>=-55 AND !associated") == ESP_OK);
+    HOST_CHECK(view_id_set() == ((1 << 2) | (1 << 4)));
+    HOST_CHECK(view("view AP WHERE ap=1") == ESP_ERR_INVALID_ARG);
+}
+
+static void test_bt() {
+    const char *names[] = { "JBL Flip 5", "jbl charge", "Pixel", NULL };
+    int8_t rssis[] = { -50, -80, -40, -60 };
+    for (int i = 0; i < 4; ++i) {
+        esp_bd_addr_t bda = { 0xC0, 0x22, 0, 0, 0, i };
+        uint8_t nameLen = (names[i] == NULL) ? 0 : strlen(names[i]);
+        HOST_CHECK(bt_dev_add_components(bda, (char *)names[i], nameLen, NULL, 0, 0, rssis[i],
+                                         GRAVITY_BT_SCAN_BLE) == ESP_OK);
+    }
+    HOST_CHECK(view("view BT WHERE name~jbl AND rssi>=-70 COLUMNS id,name,rssi") == ESP_OK);
+    HOST_CHECK(view_id_set() == (1 << 1));
+    HOST_CHECK(strstr(viewOutput, "JBL Flip 5") != NULL);
+    HOST_CHECK(view("view BT WHERE !selected LIMIT 2 OFFSET 1 COLUMNS id") == ESP_OK);
+    HOST_CHECK(view_id_set() == ((1 << 2) | (1 << 3)));
+    HOST_CHECK(view("view BT WHERE ch=1") == ESP_ERR_INVALID_ARG);
+    HOST_CHECK(gravity_clear_bt() == ESP_OK);
+}
+
+/* Output size and time for the whole STA table against a filtered page */
+static void test_cost() {
+    clock_t start = clock();
+    HOST_CHECK(view("view STA") == ESP_OK);
+    double fullMs = host_elapsed_ms(start);
+    size_t fullBytes = strlen(viewOutput);
+    HOST_CHECK(host_line_count(viewOutput) == 2 + VIEW_STAS);
+
+    start = clock();
+    HOST_CHECK(view("view STA WHERE rssi>-40 AND associated LIMIT 5 COLUMNS id,rssi") == ESP_OK);
+    double pageMs = host_elapsed_ms(start);
+    size_t pageBytes = strlen(viewOutput);
+    printf("%d STAs: full list %zu bytes in %.2f ms, filtered page %zu bytes in %.2f ms\n", VIEW_STAS, fullBytes,
+           fullMs, pageBytes, pageMs);
+}
+
+int main() {
+    attack_status = calloc(ATTACKS_COUNT, sizeof(bool));
+    HOST_CHECK(attack_status != NULL);
+    view_populate();
+
+    test_parse();
+    test_page();
+    test_sta();
+    test_age();
+    test_ap();
+    test_bt();
+    test_cost();
+    puts("view_filter: ok");
+    return 0;
+}
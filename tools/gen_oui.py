@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+"""Generate Gravity's OUI vendor table from an IEEE MA-L registry CSV.
+
+Usage: gen_oui.py <oui.csv> <oui_table.h>
+
+The input uses the format published by the IEEE at
+https://standards-oui.ieee.org/oui/oui.csv:
+    Registry,Assignment,Organization Name,Organization Address
+
+The output is a C header containing:
+  * OUIs sorted and split into blocks of OUI_BLOCK_SIZE entries. The first
+    OUI of each block is stored in full so the block can be found with a
+    binary search; the remaining OUIs are stored as LEB128-encoded deltas
+    from their predecessor.
+  * A vendor index for each OUI, referring to a deduplicated table of
+    shortened vendor names. The index is 16 bits, so the input may name at
+    most 65,536 distinct vendors.
+"""
+
+import csv
+import re
+import sys
+
+OUI_BLOCK_SIZE = 16
+VENDOR_NAME_MAX = 20
+# oui_vendor[] is uint16_t
+VENDOR_COUNT_MAX = 0x10000
+
+# Corporate suffixes that add nothing on a narrow display
+SUFFIXES = re.compile(r'[\s,.]+(inc|incorporated|ltd|limited|llc|corp|corporation|co|company|'
+                      r'gmbh|ag|bv|b\.v|sa|s\.a|srl|spa|plc|pty|oy|ab|as|kg|sas|pte|'
+                      r'technology|technologies|electronics)\.?$', re.IGNORECASE)
+
+
+def shorten(name):
+    original = ' '.join(name.split())
+    name = original
+    previous = None
+    while previous != name:
+        previous = name
+        name = SUFFIXES.sub('', name).rstrip(' ,.')
+    name = name or original
+    if len(name) > VENDOR_NAME_MAX:
+        # Prefer cutting at a word boundary
+        cut = name.rfind(' ', 0, VENDOR_NAME_MAX + 1)
+        name = name[:cut] if cut > 0 else name[:VENDOR_NAME_MAX]
+    return name.rstrip(' ,.')
+
+
+def read_registry(path):
+    entries = {}
+    with open(path, newline='', encoding='utf-8') as csvFile:
+        for row in csv.reader(csvFile):
+            if len(row) < 3 or row[0].strip() != 'MA-L':
+                continue
+            try:
+                oui = int(row[1].strip(), 16)
+            except ValueError:
+                continue
+            if oui > 0xFFFFFF:
+                continue
+            entries[oui] = shorten(row[2])
+    return sorted(entries.items())
+
+
+def leb128(value):
+    out = []
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return out
+
+
+def c_string(value):
+    return '"' + value.replace('\\', '\\\\').replace('"', '\\"') + '\\0"'
+
+
+def wrap(items, perLine):
+    lines = []
+    for i in range(0, len(items), perLine):
+        lines.append('    ' + ', '.join(items[i:i + perLine]))
+    return ',\n'.join(lines) if lines else '    0'
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+    entries = read_registry(sys.argv[1])
+
+    vendors = []
+    vendorIndex = {}
+    for _, name in entries:
+        if name not in vendorIndex:
+            vendorIndex[name] = len(vendors)
+            vendors.append(name)
+    if len(vendors) > VENDOR_COUNT_MAX:
+        sys.exit('gen_oui.py: %s names %d distinct vendors, but the 16-bit vendor index allows at most %d' %
+                 (sys.argv[1], len(vendors), VENDOR_COUNT_MAX))
+
+    blockFirst = []
+    blockOffset = []
+    deltas = []
+    for i, (oui, _) in enumerate(entries):
+        if i % OUI_BLOCK_SIZE == 0:
+            blockFirst.append(oui)
+            blockOffset.append(len(deltas))
+        else:
+            deltas.extend(leb128(oui - entries[i - 1][0]))
+
+    nameOffsets = []
+    offset = 0
+    for name in vendors:
+        nameOffsets.append(offset)
+        offset += len(name.encode('utf-8')) + 1
+
+    with open(sys.argv[2], 'w', encoding='utf-8') as out:
+        out.write('/* Generated by tools/gen_oui.py from %s - do not edit */\n' % sys.argv[1].split('/')[-1])
+        out.write('#ifndef GRAVITY_OUI_TABLE_H\n#define GRAVITY_OUI_TABLE_H\n\n')
+        out.write('#define OUI_ENTRY_COUNT %d\n' % len(entries))
+        out.write('#define OUI_BLOCK_SIZE %d\n' % OUI_BLOCK_SIZE)
+        out.write('#define OUI_BLOCK_COUNT %d\n' % len(blockFirst))
+        out.write('#define OUI_VENDOR_COUNT %d\n\n' % len(vendors))
+        out.write('static const uint32_t oui_block_first[] = {\n%s\n};\n\n' %
+                  wrap(['0x%06X' % v for v in blockFirst], 8))
+        out.write('static const uint32_t oui_block_offset[] = {\n%s\n};\n\n' %
+                  wrap([str(v) for v in blockOffset], 12))
+        out.write('static const uint8_t oui_deltas[] = {\n%s\n};\n\n' %
+                  wrap(['0x%02X' % v for v in deltas], 12))
+        out.write('static const uint16_t oui_vendor[] = {\n%s\n};\n\n' %
+                  wrap([str(vendorIndex[name]) for _, name in entries], 12))
+        out.write('static const uint32_t oui_vendor_name_offset[] = {\n%s\n};\n\n' %
+                  wrap([str(v) for v in nameOffsets], 12))
+        out.write('static const char oui_vendor_names[] =\n')
+        if vendors:
+            out.write('\n'.join('    ' + c_string(name) for name in vendors) + ';\n\n')
+        else:
+            out.write('    "";\n\n')
+        out.write('#endif\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,151 @@
+#!/usr/bin/env python3
+"""Generate Gravity's Bluetooth assigned-numbers tables from the SIG YAML files.
+
+Usage: gen_sig.py <service_class.yaml> <company_identifiers.yaml>
+                  <appearance_values.yaml> <sig_table.h>
+
+The inputs use the format published by the Bluetooth SIG at
+https://bitbucket.org/bluetooth-SIG/public/src/main/assigned_numbers/
+    uuids/service_class.yaml         - uuids: [{uuid, name, id}]
+    company_identifiers/company_identifiers.yaml
+                                     - company_identifiers: [{value, name}]
+    core/appearance_values.yaml      - appearance_values: [{category, name,
+                                         subcategory: [{value, name}]}]
+A missing input produces an empty table rather than an error.
+
+The output is a C header containing, for each table, the 16-bit keys sorted
+for binary search, and a 32-bit offset for each key into a single pool of
+deduplicated, NUL-terminated names. The complete company list alone needs
+well over 64KB of names. Everything is const, so it stays in flash.
+"""
+
+import os
+import re
+import sys
+
+NAME_MAX = 40
+
+ITEM = re.compile(r'^(\s*)(-\s+)?([A-Za-z_]+):\s*(.*?)\s*$')
+
+
+def unquote(value):
+    if len(value) >= 2 and value[0] == value[-1] == "'":
+        return value[1:-1].replace("''", "'")
+    if len(value) >= 2 and value[0] == value[-1] == '"':
+        return value[1:-1].replace('\\"', '"').replace('\\\\', '\\')
+    return value
+
+
+def read_items(path):
+    """Flatten a SIG YAML list, including any nested lists, into a dict per
+    list item, in file order.
+    The SIG files use a small, regular subset of YAML; this avoids needing
+    a YAML library at build time."""
+    items = []
+    if not os.path.exists(path):
+        return items
+    with open(path, encoding='utf-8') as yamlFile:
+        for line in yamlFile:
+            if line.lstrip().startswith('#'):
+                continue
+            match = ITEM.match(line.rstrip('\n'))
+            if match is None:
+                continue
+            _, dash, key, value = match.groups()
+            if dash:
+                items.append({})
+            if items and value:
+                items[-1][key] = unquote(value)
+    return items
+
+
+def shorten(name):
+    name = ' '.join(name.split())
+    if len(name) > NAME_MAX:
+        cut = name.rfind(' ', 0, NAME_MAX + 1)
+        name = (name[:cut] if cut > 0 else name[:NAME_MAX]).rstrip(' ,')
+    return name
+
+
+def read_services(path):
+    entries = {}
+    for item in read_items(path):
+        if 'uuid' in item and 'name' in item:
+            entries[int(item['uuid'], 16) & 0xFFFF] = shorten(item['name'])
+    return sorted(entries.items())
+
+
+def read_companies(path):
+    entries = {}
+    for item in read_items(path):
+        if 'value' in item and 'name' in item:
+            entries[int(item['value'], 16) & 0xFFFF] = shorten(item['name'])
+    return sorted(entries.items())
+
+
+def read_appearances(path):
+    """Appearance is a 10-bit category followed by a 6-bit subcategory.
+    Categories are stored with a subcategory of 0 (generic)"""
+    entries = {}
+    category = None
+    for item in read_items(path):
+        if 'category' in item and 'name' in item:
+            category = int(item['category'], 16)
+            entries[(category << 6) & 0xFFFF] = shorten(item['name'])
+        elif 'value' in item and 'name' in item and category is not None:
+            entries[((category << 6) | (int(item['value'], 16) & 0x3F)) & 0xFFFF] = shorten(item['name'])
+    return sorted(entries.items())
+
+
+def c_string(value):
+    return '"' + value.replace('\\', '\\\\').replace('"', '\\"') + '\\0"'
+
+
+def wrap(items, perLine):
+    lines = []
+    for i in range(0, len(items), perLine):
+        lines.append('    ' + ', '.join(items[i:i + perLine]))
+    return ',\n'.join(lines) if lines else '    0'
+
+
+def main():
+    if len(sys.argv) != 5:
+        sys.exit(__doc__)
+    tables = [
+        ('SERVICE', 'service', read_services(sys.argv[1])),
+        ('COMPANY', 'company', read_companies(sys.argv[2])),
+        ('APPEARANCE', 'appearance', read_appearances(sys.argv[3])),
+    ]
+
+    names = []
+    nameOffset = {}
+    offset = 0
+    for _, _, entries in tables:
+        for _, name in entries:
+            if name not in nameOffset:
+                nameOffset[name] = offset
+                names.append(name)
+                offset += len(name.encode('utf-8')) + 1
+
+    sources = ', '.join(os.path.basename(path) for path in sys.argv[1:4] if os.path.exists(path)) or 'no input'
+    with open(sys.argv[4], 'w', encoding='utf-8') as out:
+        out.write('/* Generated by tools/gen_sig.py from %s - do not edit */\n' % sources)
+        out.write('#ifndef GRAVITY_SIG_TABLE_H\n#define GRAVITY_SIG_TABLE_H\n\n')
+        for macro, _, entries in tables:
+            out.write('#define SIG_%s_COUNT %d\n' % (macro, len(entries)))
+        out.write('\n')
+        for _, prefix, entries in tables:
+            out.write('static const uint16_t sig_%s_keys[] = {\n%s\n};\n\n' %
+                      (prefix, wrap(['0x%04X' % key for key, _ in entries], 10)))
+            out.write('static const uint32_t sig_%s_names[] = {\n%s\n};\n\n' %
+                      (prefix, wrap([str(nameOffset[name]) for _, name in entries], 12)))
+        out.write('static const char sig_name_pool[] =\n')
+        if names:
+            out.write('\n'.join('    ' + c_string(name) for name in names) + ';\n\n')
+        else:
+            out.write('    "";\n\n')
+        out.write('#endif\n')
+
+
+if __name__ == '__main__':
+    main()